@@ -9,6 +9,7 @@
 #define INCLUDE_git_git_h__
 
 #include "git2/attr.h"
+#include "git2/blame.h"
 #include "git2/blob.h"
 #include "git2/branch.h"
 #include "git2/buffer.h"
@@ -17,6 +18,7 @@
 #include "git2/commit.h"
 #include "git2/common.h"
 #include "git2/config.h"
+#include "git2/describe.h"
 #include "git2/diff.h"
 #include "git2/errors.h"
 #include "git2/filter.h"
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_git_blame_h__
+#define INCLUDE_git_blame_h__
+
+#include "common.h"
+#include "types.h"
+#include "oid.h"
+
+/**
+ * @file git2/blame.h
+ * @brief Git blame routines
+ * @defgroup git_blame Git blame routines
+ * @ingroup Git
+ * @{
+ */
+GIT_BEGIN_DECL
+
+/**
+ * Flags for the `flags` value of `git_blame_options`.
+ */
+typedef enum {
+	/** Normal blame, the default */
+	GIT_BLAME_NORMAL = 0,
+	/** Only follow the first parent of merge commits */
+	GIT_BLAME_FIRST_PARENT = (1 << 0),
+} git_blame_flag_t;
+
+/**
+ * Blame options structure
+ *
+ * Use zeros to indicate default settings.  It's easiest to use the
+ * `GIT_BLAME_OPTIONS_INIT` macro:
+ *
+ *     git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+ *
+ * - `flags` is a combination of the `git_blame_flag_t` values above.
+ * - `newest_commit` is the id of the newest commit to consider.  The
+ *   default is HEAD.
+ * - `oldest_commit` is the id of the oldest commit to consider.  Lines
+ *   which are older are blamed on it, and marked as boundary lines.  The
+ *   default is to walk down to the root commits.
+ * - `min_line` is the first line in the file to blame (1-based).  The
+ *   default is 1.
+ * - `max_line` is the last line in the file to blame.  The default is
+ *   the last line of the file.
+ */
+typedef struct git_blame_options {
+	unsigned int version;
+
+	uint32_t flags;
+	git_oid newest_commit;
+	git_oid oldest_commit;
+	size_t min_line;
+	size_t max_line;
+} git_blame_options;
+
+#define GIT_BLAME_OPTIONS_VERSION 1
+#define GIT_BLAME_OPTIONS_INIT {GIT_BLAME_OPTIONS_VERSION}
+
+/**
+ * Structure that represents a blame hunk.
+ *
+ * - `lines_in_hunk` is the number of lines in this hunk
+ * - `final_commit_id` is the id of the commit where this line was last
+ *   changed.
+ * - `final_start_line_number` is the 1-based line number where this hunk
+ *   begins, in the final version of the file
+ * - `final_signature` is the author of `final_commit_id`.
+ * - `orig_commit_id` is the id of the commit where this hunk was found.
+ *   Without copy detection, this is the same as `final_commit_id`.
+ * - `orig_path` is the path to the file where this hunk originated, as of
+ *   the commit specified by `orig_commit_id`; it differs from the blamed
+ *   path when the file has been renamed.
+ * - `orig_start_line_number` is the 1-based line number where this hunk
+ *   begins in the file named by `orig_path` in `orig_commit_id`.
+ * - `orig_signature` is the author of `orig_commit_id`.
+ * - `boundary` is 1 iff the hunk has been tracked to a boundary commit
+ *   (a root commit, or `oldest_commit` from the options).
+ */
+typedef struct git_blame_hunk {
+	size_t lines_in_hunk;
+
+	git_oid final_commit_id;
+	size_t final_start_line_number;
+	git_signature *final_signature;
+
+	git_oid orig_commit_id;
+	const char *orig_path;
+	size_t orig_start_line_number;
+	git_signature *orig_signature;
+
+	char boundary;
+} git_blame_hunk;
+
+/** Opaque structure to hold blame results */
+typedef struct git_blame git_blame;
+
+/**
+ * Callback for `git_blame_file_foreach`.
+ *
+ * The hunk, and everything it points to, is only valid for the duration
+ * of the callback.  Return a non-zero value to stop the blame.
+ */
+typedef int (*git_blame_hunk_cb)(const git_blame_hunk *hunk, void *payload);
+
+/**
+ * Blame a file, reporting hunks as soon as they are found
+ *
+ * Hunks are not reported in line order, but in the order in which the
+ * history walk finds the commit responsible for them, so the newest
+ * changes come first.  Adjacent lines from the same commit may be
+ * reported as several hunks.
+ *
+ * Only the content of the commits which still have lines to account for
+ * is kept in memory, and each commit is diffed once against each of its
+ * parents no matter how many hunks of the file it owns.
+ *
+ * @param repo repository whose history is to be walked
+ * @param path path to file to consider
+ * @param options options for the blame operation.  If NULL, this is
+ *                treated as though GIT_BLAME_OPTIONS_INIT were passed.
+ * @param hunk_cb function called for each blamed hunk
+ * @param payload user-specified pointer passed to the callback
+ * @return 0 on success, GIT_EUSER if the callback aborted the blame, or
+ *         another error code
+ */
+GIT_EXTERN(int) git_blame_file_foreach(
+	git_repository *repo,
+	const char *path,
+	const git_blame_options *options,
+	git_blame_hunk_cb hunk_cb,
+	void *payload);
+
+/**
+ * Get the blame for a single file.
+ *
+ * @param out pointer that will receive the blame object
+ * @param repo repository whose history is to be walked
+ * @param path path to file to consider
+ * @param options options for the blame operation.  If NULL, this is
+ *                treated as though GIT_BLAME_OPTIONS_INIT were passed.
+ * @return 0 on success, or an error code.
+ */
+GIT_EXTERN(int) git_blame_file(
+	git_blame **out,
+	git_repository *repo,
+	const char *path,
+	const git_blame_options *options);
+
+/**
+ * Gets the number of hunks that exist in the blame structure.
+ */
+GIT_EXTERN(size_t) git_blame_get_hunk_count(git_blame *blame);
+
+/**
+ * Gets the blame hunk at the given index.
+ *
+ * Hunks are sorted by line number in the final file.
+ *
+ * @param blame the blame structure to query
+ * @param index index of the hunk to retrieve
+ * @return the hunk at the given index, or NULL on error
+ */
+GIT_EXTERN(const git_blame_hunk *) git_blame_get_hunk_byindex(
+	git_blame *blame,
+	size_t index);
+
+/**
+ * Gets the hunk that relates to the given line number in the newest commit.
+ *
+ * @param blame the blame structure to query
+ * @param lineno the (1-based) line number to find a hunk for
+ * @return the hunk that contains the given line, or NULL on error
+ */
+GIT_EXTERN(const git_blame_hunk *) git_blame_get_hunk_byline(
+	git_blame *blame,
+	size_t lineno);
+
+/**
+ * Free memory allocated by git_blame_file.
+ *
+ * @param blame the blame structure to free
+ */
+GIT_EXTERN(void) git_blame_free(git_blame *blame);
+
+/** @} */
+GIT_END_DECL
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_git_describe_h__
+#define INCLUDE_git_describe_h__
+
+#include "common.h"
+#include "types.h"
+#include "buffer.h"
+
+/**
+ * @file git2/describe.h
+ * @brief Git describing routines
+ * @defgroup git_describe Git describing routines
+ * @ingroup Git
+ * @{
+ */
+GIT_BEGIN_DECL
+
+/**
+ * Reference lookup strategy
+ *
+ * These behave like the --tags and --all options to git-describe,
+ * namely they say to look for any reference in either refs/tags/ or
+ * refs/ respectively.
+ */
+typedef enum {
+	GIT_DESCRIBE_DEFAULT,
+	GIT_DESCRIBE_TAGS,
+	GIT_DESCRIBE_ALL,
+} git_describe_strategy_t;
+
+/**
+ * Describe options structure
+ *
+ * Zero out for defaults.  It's easiest to use `GIT_DESCRIBE_OPTIONS_INIT`:
+ *
+ *     git_describe_options opts = GIT_DESCRIBE_OPTIONS_INIT;
+ *
+ * - `max_candidates_tags` is the number of candidate tags to consider
+ *   (like git-describe's --candidates).  The walk stops as soon as that
+ *   many tags have been found.  Defaults to 10, and is capped at 30.
+ * - `describe_strategy` is one of the `git_describe_strategy_t` values.
+ * - `pattern` is an fnmatch pattern the tag names must match, if any.
+ * - `only_follow_first_parent` only considers the first parent of merges
+ *   when walking the history.
+ * - `show_commit_oid_as_fallback` describes the commit by its
+ *   abbreviated id when no reference can describe it, instead of failing.
+ */
+typedef struct git_describe_options {
+	unsigned int version;
+
+	unsigned int max_candidates_tags;
+	unsigned int describe_strategy;
+	const char *pattern;
+	int only_follow_first_parent;
+	int show_commit_oid_as_fallback;
+} git_describe_options;
+
+#define GIT_DESCRIBE_DEFAULT_MAX_CANDIDATES_TAGS 10
+#define GIT_DESCRIBE_DEFAULT_ABBREVIATED_SIZE 7
+
+#define GIT_DESCRIBE_OPTIONS_VERSION 1
+#define GIT_DESCRIBE_OPTIONS_INIT { \
+	GIT_DESCRIBE_OPTIONS_VERSION, \
+	GIT_DESCRIBE_DEFAULT_MAX_CANDIDATES_TAGS, \
+}
+
+/**
+ * Describe format options structure
+ *
+ * - `abbreviated_size` is the minimum size of the abbreviated commit
+ *   id; it is lengthened until it is unique.  Defaults to 7.  Zero only
+ *   prints the name of the closest reference.
+ * - `always_use_long_format` uses the "<name>-<depth>-g<id>" format even
+ *   when the commit is exactly at a reference.
+ * - `dirty_suffix` is appended when describing a dirty working directory.
+ */
+typedef struct {
+	unsigned int version;
+
+	unsigned int abbreviated_size;
+	int always_use_long_format;
+	const char *dirty_suffix;
+} git_describe_format_options;
+
+#define GIT_DESCRIBE_FORMAT_OPTIONS_VERSION 1
+#define GIT_DESCRIBE_FORMAT_OPTIONS_INIT { \
+	GIT_DESCRIBE_FORMAT_OPTIONS_VERSION, \
+	GIT_DESCRIBE_DEFAULT_ABBREVIATED_SIZE, \
+}
+
+/** Opaque structure to hold the result of a describe operation */
+typedef struct git_describe_result git_describe_result;
+
+/**
+ * Describe a commit
+ *
+ * Find the most recent reference that is reachable from the commit
+ * and describe the commit relative to it.  The references are indexed by
+ * the commit they point to in a single pass, and the history is then
+ * walked newest first until `max_candidates_tags` of them have been met.
+ *
+ * @param result pointer to store the result.  You must free this once
+ *               you're done with it.
+ * @param committish a committish to describe
+ * @param opts the lookup options, or NULL for the defaults
+ * @return 0 on success, GIT_ENOTFOUND if nothing can describe the
+ *         commit, or an error code
+ */
+GIT_EXTERN(int) git_describe_commit(
+	git_describe_result **result,
+	git_object *committish,
+	git_describe_options *opts);
+
+/**
+ * Describe the working directory
+ *
+ * Describe HEAD like `git_describe_commit` does, and note whether the
+ * index or the working directory have changes to tracked files, so that
+ * formatting the result appends the `dirty_suffix`.
+ *
+ * @param out pointer to store the result.  You must free this once
+ *            you're done with it.
+ * @param repo the repository whose working directory to describe
+ * @param opts the lookup options, or NULL for the defaults
+ * @return 0 on success, or an error code
+ */
+GIT_EXTERN(int) git_describe_workdir(
+	git_describe_result **out,
+	git_repository *repo,
+	git_describe_options *opts);
+
+/**
+ * Print the describe result to a buffer
+ *
+ * @param out the buffer to store the result
+ * @param result the result from `git_describe_commit()` or
+ *               `git_describe_workdir()`
+ * @param opts the formatting options, or NULL for the defaults
+ * @return 0 on success, or an error code
+ */
+GIT_EXTERN(int) git_describe_format(
+	git_buf *out,
+	const git_describe_result *result,
+	const git_describe_format_options *opts);
+
+/**
+ * Free the describe result.
+ */
+GIT_EXTERN(void) git_describe_result_free(git_describe_result *result);
+
+/** @} */
+GIT_END_DECL
+
+#endif
@@ -316,6 +316,13 @@ typedef int (*git_diff_notify_cb)(
  * - `notify_payload` is the payload data to pass to the `notify_cb` function
  * - `ignore_submodules` overrides the submodule ignore setting for all
  *   submodules in the diff.
+ * - `threads` is the number of threads to load and diff files on, for the
+ *   functions below that say they can.  `git_diff_foreach` and
+ *   `git_diff_print_patch` only use more than one when it is set above 1;
+ *   `git_diff_get_stats` and `git_diff_find_similar` treat the default of
+ *   0 as picking a number to suit the CPUs and the size of the diff.  1
+ *   keeps it all on the calling thread.  It only makes a difference when
+ *   libgit2 is thread-safe.
  */
 typedef struct {
 	unsigned int version;      /**< version for the struct */
@@ -329,6 +336,7 @@ typedef struct {
 	git_diff_notify_cb notify_cb;
 	void *notify_payload;
 	git_submodule_ignore_t ignore_submodules; /** << submodule ignore rule */
+	unsigned int threads;      /**< defaults to 0 */
 } git_diff_options;
 
 #define GIT_DIFF_OPTIONS_VERSION 1
@@ -418,6 +426,12 @@ typedef int (*git_diff_data_cb)(
  */
 typedef struct git_diff_patch git_diff_patch;
 
+/**
+ * The counts of files changed and lines inserted and deleted in a diff,
+ * as `git diff --stat` shows them.
+ */
+typedef struct git_diff_stats git_diff_stats;
+
 /**
  * Flags to control the behavior of diff rename/copy detection.
  */
@@ -493,6 +507,12 @@ typedef struct {
  * hashes of ranges of data in the file.  The default metric is a pretty
  * good similarity approximation that should work fairly well for both text
  * and binary data, and is pretty fast with fixed memory overhead.
+ *
+ * With the internal metric, the signatures of the files and the
+ * similarity of the pairs worth measuring are worked out on `threads`
+ * threads when libgit2 is built thread-safe.  The renames and copies
+ * found do not depend on the number of threads.  A custom metric is
+ * only ever called on the calling thread.
  */
 typedef struct {
 	unsigned int version;
@@ -516,6 +536,12 @@ typedef struct {
 
 	/** Pluggable similarity metric; pass NULL to use internal metric */
 	git_diff_similarity_metric *metric;
+
+	/** Threads to build signatures and measure similarity on, with the
+	 *  internal metric (default 0, which picks a number to suit the CPUs
+	 *  and the size of the diff; 1 keeps it all on the calling thread)
+	 */
+	unsigned int threads;
 } git_diff_find_options;
 
 #define GIT_DIFF_FIND_OPTIONS_VERSION 1
@@ -694,6 +720,13 @@ GIT_EXTERN(int) git_diff_find_similar(
  * Returning a non-zero value from any of the callbacks will terminate
  * the iteration and cause this return `GIT_EUSER`.
  *
+ * When there are hunk or line callbacks and the `threads` value of the
+ * diff options is more than 1, the files are diffed ahead on that many
+ * threads, except for diffs against the working directory.  Files diffed
+ * ahead are held in memory until their callbacks are made.  The callbacks
+ * are still all made on the calling thread, one file after another in
+ * the order of the deltas.
+ *
  * @param diff A git_diff_list generated by one of the above functions.
  * @param file_cb Callback function to make per file in the diff.
  * @param hunk_cb Optional callback to make per hunk of text diff.  This
@@ -761,7 +794,10 @@ GIT_EXTERN(char) git_diff_status_char(git_delta_t status);
 /**
  * Iterate over a diff generating text output like "git diff".
  *
- * This is a super easy way to generate a patch from a diff.
+ * This is a super easy way to generate a patch from a diff.  Like
+ * `git_diff_foreach`, it diffs the files on other threads only when the
+ * `threads` value of the diff options is more than 1, and prints them in
+ * order on the calling thread.
  *
  * Returning a non-zero value from the callbacks will terminate the
  * iteration and cause this return `GIT_EUSER`.
@@ -811,6 +847,80 @@ GIT_EXTERN(size_t) git_diff_num_deltas_of_type(
  */
 GIT_EXTERN(int) git_diff_is_sorted_icase(const git_diff_list *diff);
 
+/**
+ * Count the files changed and the lines inserted and deleted in a diff.
+ *
+ * This gives the same counts as a `git_diff_patch` of each delta with
+ * `git_diff_patch_line_stats()` would, without generating any patch
+ * text: no hunks or lines are kept, and the content of each file is only
+ * held while it is diffed.  Binary files are counted as changed, with no
+ * lines inserted or deleted.
+ *
+ * The files are loaded and diffed on as many threads as the `threads`
+ * value of the diff options asks for, except for diffs against the
+ * working directory, whose files are loaded through filters on the
+ * calling thread.
+ *
+ * @param out Output pointer to the stats; free with `git_diff_stats_free`
+ * @param diff A git_diff_list generated by one of the above functions
+ * @return 0 on success, <0 on error
+ */
+GIT_EXTERN(int) git_diff_get_stats(
+	git_diff_stats **out,
+	git_diff_list *diff);
+
+/**
+ * Get the number of files changed in a diff.
+ *
+ * @param stats Stats from `git_diff_get_stats`
+ * @return Number of files changed
+ */
+GIT_EXTERN(size_t) git_diff_stats_files_changed(
+	const git_diff_stats *stats);
+
+/**
+ * Get the total number of lines inserted in a diff.
+ *
+ * @param stats Stats from `git_diff_get_stats`
+ * @return Number of lines inserted
+ */
+GIT_EXTERN(size_t) git_diff_stats_insertions(
+	const git_diff_stats *stats);
+
+/**
+ * Get the total number of lines deleted in a diff.
+ *
+ * @param stats Stats from `git_diff_get_stats`
+ * @return Number of lines deleted
+ */
+GIT_EXTERN(size_t) git_diff_stats_deletions(
+	const git_diff_stats *stats);
+
+/**
+ * Get the number of lines inserted and deleted in one delta of a diff.
+ *
+ * Deltas which are skipped (unmodified ones, unless the diff includes
+ * them) and binary files have no lines inserted or deleted.
+ *
+ * @param insertions Count of lines inserted, can be NULL
+ * @param deletions Count of lines deleted, can be NULL
+ * @param stats Stats from `git_diff_get_stats`
+ * @param idx Index of the delta in the diff list
+ * @return 0 on success, GIT_ENOTFOUND if idx is out of range
+ */
+GIT_EXTERN(int) git_diff_stats_delta(
+	size_t *insertions,
+	size_t *deletions,
+	const git_diff_stats *stats,
+	size_t idx);
+
+/**
+ * Free diff stats.
+ *
+ * @param stats Stats from `git_diff_get_stats`, may be NULL
+ */
+GIT_EXTERN(void) git_diff_stats_free(git_diff_stats *stats);
+
 /**
  * Return the diff delta and patch for an entry in the diff list.
  *
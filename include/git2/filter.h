@@ -127,6 +127,59 @@ GIT_EXTERN(int) git_filter_list_apply_to_blob(
 	git_filter_list *filters,
 	git_blob *blob);
 
+/**
+ * Apply a filter list to a data buffer, writing the result to a stream.
+ *
+ * The data is handed to the filters a chunk at a time, so filters which
+ * can stream pass it on to `target` as they go, without the whole of it
+ * being held in memory.  `target` is closed once all of it is written,
+ * but not freed.
+ *
+ * @param filters A loaded git_filter_list (or NULL)
+ * @param data Buffer containing the data to filter
+ * @param target Stream to write the filtered data to
+ * @return 0 on success, an error code otherwise
+ */
+GIT_EXTERN(int) git_filter_list_stream_data(
+	git_filter_list *filters,
+	git_buf *data,
+	git_writestream *target);
+
+/**
+ * Apply a filter list to the contents of a file on disk, writing the
+ * result to a stream.
+ *
+ * The file is read a chunk at a time; see `git_filter_list_stream_data`.
+ *
+ * @param filters A loaded git_filter_list (or NULL)
+ * @param repo The repository whose working directory `path` is relative
+ *             to (or NULL for a path relative to the current directory)
+ * @param path Path of the file to filter
+ * @param target Stream to write the filtered data to
+ * @return 0 on success, an error code otherwise
+ */
+GIT_EXTERN(int) git_filter_list_stream_file(
+	git_filter_list *filters,
+	git_repository *repo,
+	const char *path,
+	git_writestream *target);
+
+/**
+ * Apply a filter list to the contents of a blob, writing the result to a
+ * stream.
+ *
+ * See `git_filter_list_stream_data`.
+ *
+ * @param filters A loaded git_filter_list (or NULL)
+ * @param blob The blob to filter
+ * @param target Stream to write the filtered data to
+ * @return 0 on success, an error code otherwise
+ */
+GIT_EXTERN(int) git_filter_list_stream_blob(
+	git_filter_list *filters,
+	git_blob *blob,
+	git_writestream *target);
+
 /**
  * Free a git_filter_list
  *
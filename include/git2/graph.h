@@ -36,6 +36,32 @@ GIT_BEGIN_DECL
  */
 GIT_EXTERN(int) git_graph_ahead_behind(size_t *ahead, size_t *behind, git_repository *repo, const git_oid *local, const git_oid *upstream);
 
+/**
+ * Count the unique commits between many commits and a single upstream
+ *
+ * This gives the same results as calling `git_graph_ahead_behind` for
+ * each of the `local_array` commits against `upstream`, but walks the
+ * history once for all of them, so it costs about as much as a single
+ * walk over the commits they do not all have in common.
+ *
+ * @param ahead array of `length` elements; `ahead[i]` is set to the
+ *              number of unique commits in `upstream` against `local_array[i]`
+ * @param behind array of `length` elements; `behind[i]` is set to the
+ *               number of unique commits in `local_array[i]`
+ * @param repo the repository where the commits exist
+ * @param local_array the commits for the locals
+ * @param length the number of commits in `local_array`
+ * @param upstream the commit for upstream
+ * @return 0 on success, or an error code
+ */
+GIT_EXTERN(int) git_graph_ahead_behind_many(
+	size_t *ahead,
+	size_t *behind,
+	git_repository *repo,
+	const git_oid local_array[],
+	size_t length,
+	const git_oid *upstream);
+
 /** @} */
 GIT_END_DECL
 #endif
@@ -117,6 +117,7 @@ typedef struct git_index_entry {
 
 #define GIT_IDXENTRY_UNPACKED          (1 << 8)
 #define GIT_IDXENTRY_NEW_SKIP_WORKTREE (1 << 9)
+#define GIT_IDXENTRY_FSMONITOR_VALID   (1 << 10) /* unchanged since last checked */
 
 /** Capabilities of system that affect index actions. */
 typedef enum {
@@ -221,6 +222,74 @@ GIT_EXTERN(unsigned int) git_index_caps(const git_index *index);
  */
 GIT_EXTERN(int) git_index_set_caps(git_index *index, unsigned int caps);
 
+/**
+ * Get the on-disk format version of the index.
+ *
+ * This is the version the index was read with, or the one set with
+ * `git_index_set_version`; new indexes use version 2.
+ *
+ * @param index An existing index object
+ * @return the index version: 2, 3 or 4
+ */
+GIT_EXTERN(unsigned int) git_index_version(const git_index *index);
+
+/**
+ * Set the on-disk format version to write the index with.
+ *
+ * Versions 2 and 3 only differ in that version 3 can store extended
+ * entry flags; the index is written in version 3 when it needs them,
+ * and in version 2 otherwise.  Version 4 compresses each path against
+ * the one of the previous entry, which makes the file a lot smaller
+ * (and quicker to read and write) in repositories with deep trees.
+ *
+ * @param index An existing index object
+ * @param version The version to write: 2, 3 or 4
+ * @return 0 on success, -1 on failure
+ */
+GIT_EXTERN(int) git_index_set_version(git_index *index, unsigned int version);
+
+/**
+ * Set whether the index is written as a split index.
+ *
+ * A split index is kept in two files: a shared index next to it, named
+ * `sharedindex.<sha1>`, holds most of the entries, and the index file
+ * itself only holds what changed since the shared index was written.
+ * Writing a large index after a few changes then costs about as much as
+ * the changes.  When over a fifth of the shared entries have changed, a
+ * new shared index is written.  Other index files may still link to the
+ * previous one, so shared indexes are only removed once they are two
+ * weeks old, or as `splitIndex.sharedIndexExpire` says for the index of
+ * a repository.
+ *
+ * This is the format git writes with `core.splitIndex`, which sets this
+ * for the index of a repository.  An index that was read from a split
+ * index stays split.
+ *
+ * @param index An existing index object, backed by a file
+ * @param split 1 to write a split index, 0 to write a single file
+ * @return 0 on success, -1 on failure
+ */
+GIT_EXTERN(int) git_index_set_split(git_index *index, int split);
+
+/**
+ * Set whether the index keeps an untracked cache.
+ *
+ * The untracked cache remembers which entries of each directory of the
+ * working directory are not in the index.  Until a directory changes,
+ * status and diff against the working directory take its entries from
+ * the index and the cache rather than reading the directory again.
+ *
+ * The cache is filled in as the working directory is read, and saved
+ * in the index file when the index is written.  This is set for the
+ * index of a repository with `core.untrackedCache`; an index that was
+ * read with a cache keeps one.
+ *
+ * @param index An existing index object
+ * @param enabled 1 to keep an untracked cache, 0 to drop it
+ * @return 0 on success, -1 on failure
+ */
+GIT_EXTERN(int) git_index_set_untracked_cache(git_index *index, int enabled);
+
 /**
  * Update the contents of an existing index object in memory
  * by reading from the hard disk.
@@ -270,6 +339,11 @@ GIT_EXTERN(int) git_index_read_tree(git_index *index, const git_tree *tree);
  * but only returns the OID of the root tree. This is the OID
  * that can be used e.g. to create a commit.
  *
+ * The OIDs of the trees are kept in the index's tree cache, which is
+ * saved with it, so that the subtrees which haven't changed since they
+ * were last written (or read with `git_index_read_tree`) are reused
+ * without being hashed again.
+ *
  * The index instance cannot be bare, and needs to be associated
  * to an existing repository.
  *
@@ -672,6 +746,96 @@ GIT_EXTERN(void) git_index_conflict_iterator_free(
 
 /**@}*/
 
+/** @name Batch Index Entry Functions
+ *
+ * These functions collect many changes to an index, and make them all
+ * at once.  Adding or removing entries one by one keeps the index
+ * sorted as it goes, which gets slow when there are thousands of them;
+ * a batch sorts its changes once and merges them into the index in a
+ * single pass.
+ */
+/**@{*/
+
+/**
+ * Start a batch of changes to an index
+ *
+ * Nothing is changed in the index until `git_index_batch_apply` is
+ * called.  The batch must be freed before the index is.
+ *
+ * @param out Pointer to store the new batch
+ * @param index an existing index object
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_index_batch_new(git_index_batch **out, git_index *index);
+
+/**
+ * Add or update an index entry from an in-memory struct, as
+ * `git_index_add` does, when the batch is applied
+ *
+ * @param batch the batch of changes
+ * @param source_entry new entry object
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_index_batch_add(
+	git_index_batch *batch, const git_index_entry *source_entry);
+
+/**
+ * Add or update an index entry from a file on disk, as
+ * `git_index_add_bypath` does, when the batch is applied
+ *
+ * The file is read, and its blob written, right away.
+ *
+ * @param batch the batch of changes
+ * @param path filename to add
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_index_batch_add_bypath(git_index_batch *batch, const char *path);
+
+/**
+ * Remove an entry from the index when the batch is applied
+ *
+ * Unlike `git_index_remove`, removing an entry which is not in the
+ * index is not an error.
+ *
+ * @param batch the batch of changes
+ * @param path path to remove
+ * @param stage stage to remove
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_index_batch_remove(
+	git_index_batch *batch, const char *path, int stage);
+
+/**
+ * Remove an index entry corresponding to a file on disk, as
+ * `git_index_remove_bypath` does, when the batch is applied
+ *
+ * @param batch the batch of changes
+ * @param path filename to remove
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_index_batch_remove_bypath(
+	git_index_batch *batch, const char *path);
+
+/**
+ * Make the changes of a batch to its index
+ *
+ * When the same entry (path and stage) is changed more than once, the
+ * last change wins.  The batch is left empty, and can be used again.
+ *
+ * @param batch the batch of changes
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_index_batch_apply(git_index_batch *batch);
+
+/**
+ * Free a batch, dropping the changes that were not applied
+ *
+ * @param batch the batch of changes
+ */
+GIT_EXTERN(void) git_index_batch_free(git_index_batch *batch);
+
+/**@}*/
+
 /** @} */
 GIT_END_DECL
 #endif
@@ -139,6 +139,23 @@ GIT_EXTERN(int) git_revwalk_push_head(git_revwalk *walk);
  */
 GIT_EXTERN(int) git_revwalk_hide(git_revwalk *walk, const git_oid *commit_id);
 
+/**
+ * Mark many commits (and their ancestors) uninteresting for the output.
+ *
+ * This behaves like calling `git_revwalk_hide` for each of the ids, but
+ * is much cheaper when there are many of them, e.g. one for every
+ * reference of a repository: the commits are checked without being
+ * loaded as objects, repeated ids are only hidden once, and the history
+ * they share is only marked once when the walk starts.
+ *
+ * @param walk the walker being used for the traversal.
+ * @param ids the oids of the commits that will be ignored during the traversal
+ * @param count the number of oids in `ids`
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_revwalk_hide_many(
+	git_revwalk *walk, const git_oid *ids, size_t count);
+
 /**
  * Hide matching references.
  *
@@ -238,6 +255,52 @@ GIT_EXTERN(int) git_revwalk_push_range(git_revwalk *walk, const char *range);
  */
 GIT_EXTERN(void) git_revwalk_simplify_first_parent(git_revwalk *walk);
 
+/**
+ * Limit the walk to the commits that modify a path
+ *
+ * A commit is only returned if its tree differs at `path` from the
+ * tree of at least one of its parents (just the first parent when
+ * simplifying by first-parent), as with `git rev-list --full-history`;
+ * a root commit is returned if `path` exists in it.  When several
+ * paths are added, modifying any one of them is enough.
+ *
+ * `path` is the name of a file or a directory relative to the root of
+ * the repository; no pattern matching is done.
+ *
+ * If the repository has a commit-graph with changed-path Bloom filters
+ * (as written by `git commit-graph write --changed-paths`), commits
+ * which the filters rule out are skipped without reading their trees.
+ *
+ * Like the sorting mode, the limit applies to every later walk done
+ * with this walker.
+ *
+ * @param walk the walker being used for the traversal
+ * @param path the path to limit the walk to
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_revwalk_add_path(git_revwalk *walk, const char *path);
+
+/**
+ * Set the number of threads to prefetch commits with
+ *
+ * Without a commit-graph, the walk has to read every commit it meets
+ * from the object database, and waits on its inflation each time.
+ * With prefetch threads, the parents of the commits that enter the walk
+ * are read and parsed on those threads ahead of the walk, the parents of
+ * the newest commits first, so that most commits are ready by the time
+ * the walk gets to them.  The results of the walk are not affected.
+ *
+ * By default, no threads are used.  Setting 0 disables prefetching
+ * again.  This takes effect from the next walk, and libgit2 must have
+ * been built with thread support (`THREADSAFE`).
+ *
+ * @param walk the walker being used for the traversal
+ * @param n number of threads to prefetch commits with
+ * @return number of threads that will be used
+ */
+GIT_EXTERN(unsigned int) git_revwalk_set_prefetch_threads(
+	git_revwalk *walk, unsigned int n);
+
 
 /**
  * Free a revision walker previously allocated.
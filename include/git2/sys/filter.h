@@ -127,6 +127,7 @@ GIT_EXTERN(git_filter_mode_t) git_filter_source_mode(const git_filter_source *sr
  * - shutdown   - filter removed/unregistered from system
  * - check      - considering filter for file
  * - apply      - apply filter to file contents
+ * - stream     - apply filter to file contents as they come
  * - cleanup    - done with file
  */
 
@@ -199,6 +200,33 @@ typedef int (*git_filter_apply_fn)(
 	const git_buf *from,
 	const git_filter_source *src);
 
+/**
+ * Callback to set up a stream that filters data as it comes
+ *
+ * Specified as `filter.stream`, this is an optional callback which
+ * filters can give to process data a chunk at a time instead of all at
+ * once.  It should set `out` to a new stream that filters whatever is
+ * written to it and writes the result on to `next`, and closes `next`
+ * when it is closed itself.  The stream is freed by libgit2, through its
+ * own `free` callback, once the data has gone through; `next` is not
+ * freed by it.
+ *
+ * When a filter has a `stream` callback, it is used in place of `apply`,
+ * whether the data comes from a buffer, a file or a blob.  Filters
+ * without one have all of the data collected for their `apply` call.
+ * It is only looked at for filters of version 2 and later, as those of
+ * version 1 do not have it.
+ *
+ * Like `apply`, it can return GIT_PASSTHROUGH to leave the data as it is,
+ * without setting up a stream.  The `payload` is the same as for `apply`.
+ */
+typedef int (*git_filter_stream_fn)(
+	git_writestream    **out,
+	git_filter          *self,
+	void               **payload,
+	const git_filter_source *src,
+	git_writestream     *next);
+
 /**
  * Callback to clean up after filtering has been applied
  *
@@ -226,8 +254,9 @@ typedef void (*git_filter_cleanup_fn)(
  * a value (i.e. "name=value"), the attribute must match that value for
  * the filter to be applied.
  *
- * The `initialize`, `shutdown`, `check`, `apply`, and `cleanup` callbacks
- * are all documented above with the respective function pointer typedefs.
+ * The `initialize`, `shutdown`, `check`, `apply`, `cleanup` and `stream`
+ * callbacks are all documented above with the respective function pointer
+ * typedefs.
  */
 struct git_filter {
 	unsigned int           version;
@@ -239,9 +268,10 @@ struct git_filter {
 	git_filter_check_fn    check;
 	git_filter_apply_fn    apply;
 	git_filter_cleanup_fn  cleanup;
+	git_filter_stream_fn   stream;
 };
 
-#define GIT_FILTER_VERSION 1
+#define GIT_FILTER_VERSION 2
 
 /**
  * Register a filter under a given name with a given priority.
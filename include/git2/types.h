@@ -134,6 +134,9 @@ typedef struct git_index git_index;
 /** An interator for conflicts in the index. */
 typedef struct git_index_conflict_iterator git_index_conflict_iterator;
 
+/** A set of changes to make to an index all at once. */
+typedef struct git_index_batch git_index_batch;
+
 /** Memory representation of a set of config files */
 typedef struct git_config git_config;
 
@@ -229,6 +232,22 @@ typedef struct git_transfer_progress {
  */
 typedef int (*git_transfer_progress_callback)(const git_transfer_progress *stats, void *payload);
 
+/**
+ * A stream that data is written to a chunk at a time, such as the
+ * output of a filter or a file being checked out.
+ *
+ * `write` is called for each chunk, then `close` once at the end of the
+ * data, and `free` when the stream is done with (after `close` unless
+ * an error cut the writing short).
+ */
+typedef struct git_writestream git_writestream;
+
+struct git_writestream {
+	int (*write)(git_writestream *stream, const char *buffer, size_t len);
+	int (*close)(git_writestream *stream);
+	void (*free)(git_writestream *stream);
+};
+
 /**
  * Opaque structure representing a submodule.
  */
@@ -0,0 +1,919 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "blame.h"
+#include "array.h"
+#include "buffer.h"
+#include "pqueue.h"
+#include "refs.h"
+#include "strmap.h"
+
+#include "git2/blob.h"
+#include "git2/commit.h"
+#include "git2/diff.h"
+#include "git2/signature.h"
+#include "git2/tree.h"
+
+GIT__USE_STRMAP;
+
+/*
+ * Blame works like core git's: every line of the final file starts out
+ * suspected of having been introduced by the newest commit.  Suspects
+ * ("origins") are visited newest first; each one is diffed once against
+ * each of its parents and every line it shares with a parent is passed
+ * down to that parent, as a whole range at a time.  Whatever is left
+ * once all the parents have been looked at was introduced by the origin
+ * and is reported straight away.
+ *
+ * An origin only holds its blob while it is being processed, and is
+ * dropped once it has passed on or reported all of its lines, so the
+ * memory needed depends on how many suspects are queued at a time
+ * rather than on the length of the history.
+ */
+
+/* The blob found at `path` in `commit`. */
+typedef struct {
+	char *key; /* "<commit id>:<path>" */
+	const char *path;
+	git_commit *commit;
+	git_oid blob_id;
+	git_blob *blob;
+
+	/* blame entries this origin is currently suspected of */
+	git_vector entries;
+
+	unsigned int queued:1;
+} blame_origin;
+
+/*
+ * A range of lines of the final file, and where they are found in the
+ * blob of the origin that is currently suspected of them.  Line numbers
+ * are 0-based.
+ */
+typedef struct {
+	size_t lno;
+	size_t num_lines;
+	size_t s_lno;
+} blame_entry;
+
+/* Lines that a suspect shares with one of its parents. */
+typedef struct {
+	size_t s_start;
+	size_t p_start;
+	size_t len;
+} blame_region;
+
+typedef git_array_t(blame_region) blame_region_array;
+
+typedef struct {
+	git_repository *repo;
+	git_blame_options opts;
+	git_strmap *origins;
+	git_pqueue queue;
+
+	git_blame_hunk_cb hunk_cb;
+	void *payload;
+} blame_walk;
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const blame_entry *ea = a, *eb = b;
+
+	if (ea->s_lno < eb->s_lno)
+		return -1;
+	return (ea->s_lno > eb->s_lno);
+}
+
+static int origin_time_cmp(void *a, void *b)
+{
+	blame_origin *oa = a, *ob = b;
+
+	return (git_commit_time(oa->commit) < git_commit_time(ob->commit));
+}
+
+static void origin_free(blame_origin *origin)
+{
+	size_t i;
+	blame_entry *entry;
+
+	if (!origin)
+		return;
+
+	git_vector_foreach(&origin->entries, i, entry)
+		git__free(entry);
+	git_vector_free(&origin->entries);
+
+	git_blob_free(origin->blob);
+	git_commit_free(origin->commit);
+	git__free(origin->key);
+	git__free(origin);
+}
+
+/*
+ * Find or create the origin for `path` in `commit`.  Takes ownership
+ * of `commit`.
+ */
+static int origin_get(
+	blame_origin **out,
+	blame_walk *walk,
+	git_commit *commit,
+	const char *path,
+	const git_oid *blob_id)
+{
+	blame_origin *origin;
+	git_buf key = GIT_BUF_INIT;
+	char oid_str[GIT_OID_HEXSZ + 1];
+	khiter_t pos;
+	int error;
+
+	git_oid_tostr(oid_str, sizeof(oid_str), git_commit_id(commit));
+
+	if (git_buf_printf(&key, "%s:%s", oid_str, path) < 0) {
+		git_commit_free(commit);
+		return -1;
+	}
+
+	pos = git_strmap_lookup_index(walk->origins, key.ptr);
+	if (git_strmap_valid_index(walk->origins, pos)) {
+		git_buf_free(&key);
+		git_commit_free(commit);
+
+		*out = git_strmap_value_at(walk->origins, pos);
+		return 0;
+	}
+
+	origin = git__calloc(1, sizeof(blame_origin));
+	if (!origin || git_vector_init(&origin->entries, 4, entry_cmp) < 0) {
+		git__free(origin);
+		git_buf_free(&key);
+		git_commit_free(commit);
+		return -1;
+	}
+
+	origin->key = git_buf_detach(&key);
+	origin->path = origin->key + GIT_OID_HEXSZ + 1;
+	origin->commit = commit;
+	git_oid_cpy(&origin->blob_id, blob_id);
+
+	git_strmap_insert(walk->origins, origin->key, origin, error);
+	if (error < 0) {
+		origin_free(origin);
+		return -1;
+	}
+
+	*out = origin;
+	return 0;
+}
+
+/*
+ * Forget an origin that is not suspected of anything any more.  Should
+ * another commit lead to it again, it is simply looked up anew.
+ */
+static void origin_drop(blame_walk *walk, blame_origin *origin)
+{
+	git_strmap_delete(walk->origins, origin->key);
+	origin_free(origin);
+}
+
+static int origin_load_blob(blame_walk *walk, blame_origin *origin)
+{
+	if (origin->blob)
+		return 0;
+
+	return git_blob_lookup(&origin->blob, walk->repo, &origin->blob_id);
+}
+
+static void origin_release_blob(blame_origin *origin)
+{
+	git_blob_free(origin->blob);
+	origin->blob = NULL;
+}
+
+static int entry_add(
+	git_vector *entries, size_t lno, size_t num_lines, size_t s_lno)
+{
+	blame_entry *entry = git__malloc(sizeof(blame_entry));
+	GITERR_CHECK_ALLOC(entry);
+
+	entry->lno = lno;
+	entry->num_lines = num_lines;
+	entry->s_lno = s_lno;
+
+	if (git_vector_insert(entries, entry) < 0) {
+		git__free(entry);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int origin_queue(blame_walk *walk, blame_origin *origin)
+{
+	if (origin->queued || !origin->entries.length)
+		return 0;
+
+	if (git_pqueue_insert(&walk->queue, origin) < 0)
+		return -1;
+
+	origin->queued = 1;
+	return 0;
+}
+
+static int find_blob(git_oid *out, git_commit *commit, const char *path)
+{
+	git_tree *tree;
+	git_tree_entry *entry = NULL;
+	int error;
+
+	if ((error = git_commit_tree(&tree, commit)) < 0)
+		return error;
+
+	if ((error = git_tree_entry_bypath(&entry, tree, path)) == 0) {
+		if (git_tree_entry_type(entry) == GIT_OBJ_BLOB)
+			git_oid_cpy(out, git_tree_entry_id(entry));
+		else
+			error = GIT_ENOTFOUND;
+	}
+
+	git_tree_entry_free(entry);
+	git_tree_free(tree);
+	return error;
+}
+
+/*
+ * Look for the file the origin's path was renamed from in `parent`.
+ * Returns GIT_ENOTFOUND if it was created by the origin's commit.
+ */
+static int find_rename(
+	git_buf *path_out,
+	git_oid *blob_out,
+	blame_walk *walk,
+	blame_origin *origin,
+	git_commit *parent)
+{
+	git_tree *old_tree = NULL, *new_tree = NULL;
+	git_diff_list *diff = NULL;
+	git_diff_find_options findopts = GIT_DIFF_FIND_OPTIONS_INIT;
+	const git_diff_delta *delta;
+	size_t i, count;
+	int error;
+
+	findopts.flags = GIT_DIFF_FIND_RENAMES;
+
+	if ((error = git_commit_tree(&old_tree, parent)) < 0 ||
+		(error = git_commit_tree(&new_tree, origin->commit)) < 0 ||
+		(error = git_diff_tree_to_tree(
+			&diff, walk->repo, old_tree, new_tree, NULL)) < 0 ||
+		(error = git_diff_find_similar(diff, &findopts)) < 0)
+		goto done;
+
+	error = GIT_ENOTFOUND;
+
+	count = git_diff_num_deltas(diff);
+	for (i = 0; i < count; ++i) {
+		if (git_diff_get_patch(NULL, &delta, diff, i) < 0)
+			continue;
+
+		if (delta->status != GIT_DELTA_RENAMED ||
+			strcmp(delta->new_file.path, origin->path) != 0)
+			continue;
+
+		git_oid_cpy(blob_out, &delta->old_file.oid);
+		error = git_buf_sets(path_out, delta->old_file.path);
+		break;
+	}
+
+done:
+	git_diff_list_free(diff);
+	git_tree_free(new_tree);
+	git_tree_free(old_tree);
+	return error;
+}
+
+/*
+ * Find the origin of `origin`'s file in its `n`th parent, following
+ * renames.  Returns GIT_ENOTFOUND if the parent does not have it.
+ */
+static int find_parent_origin(
+	blame_origin **out,
+	blame_walk *walk,
+	blame_origin *origin,
+	unsigned int n)
+{
+	git_commit *parent;
+	git_buf path = GIT_BUF_INIT;
+	git_oid blob_id;
+	int error;
+
+	if ((error = git_commit_parent(&parent, origin->commit, n)) < 0)
+		return error;
+
+	if ((error = find_blob(&blob_id, parent, origin->path)) == 0)
+		return origin_get(out, walk, parent, origin->path, &blob_id);
+
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = find_rename(&path, &blob_id, walk, origin, parent);
+	}
+
+	if (!error)
+		error = origin_get(out, walk, parent, path.ptr, &blob_id);
+	else
+		git_commit_free(parent);
+
+	git_buf_free(&path);
+	return error;
+}
+
+typedef struct {
+	size_t s_pos;
+	size_t p_pos;
+	blame_region_array regions;
+} blame_diff_state;
+
+static int collect_region(
+	const git_diff_delta *delta,
+	const git_diff_range *range,
+	const char *header,
+	size_t header_len,
+	void *payload)
+{
+	blame_diff_state *state = payload;
+	blame_region *region;
+	size_t s_start, p_start;
+
+	GIT_UNUSED(delta);
+	GIT_UNUSED(header);
+	GIT_UNUSED(header_len);
+
+	/* an empty side of a hunk gives the line *before* the change */
+	s_start = range->new_lines ? range->new_start - 1 : range->new_start;
+	p_start = range->old_lines ? range->old_start - 1 : range->old_start;
+
+	if (s_start > state->s_pos) {
+		region = git_array_alloc(state->regions);
+		GITERR_CHECK_ALLOC(region);
+
+		region->s_start = state->s_pos;
+		region->p_start = state->p_pos;
+		region->len = s_start - state->s_pos;
+	}
+
+	state->s_pos = s_start + range->new_lines;
+	state->p_pos = p_start + range->old_lines;
+	return 0;
+}
+
+/*
+ * Compute the line ranges that `origin`'s blob shares with `parent`'s,
+ * ordered by their position in `origin`.
+ */
+static int shared_regions(
+	blame_region_array *out,
+	blame_walk *walk,
+	blame_origin *parent,
+	blame_origin *origin)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	blame_diff_state state;
+	blame_region *region;
+	int error;
+
+	opts.context_lines = 0;
+	opts.flags = GIT_DIFF_FORCE_TEXT;
+
+	memset(&state, 0, sizeof(state));
+
+	if ((error = origin_load_blob(walk, parent)) < 0 ||
+		(error = origin_load_blob(walk, origin)) < 0)
+		return error;
+
+	if ((error = git_diff_blobs(parent->blob, NULL, origin->blob, NULL,
+			&opts, NULL, collect_region, NULL, &state)) < 0) {
+		git_array_clear(state.regions);
+		return error;
+	}
+
+	/* everything after the last hunk is shared */
+	region = git_array_alloc(state.regions);
+	GITERR_CHECK_ALLOC(region);
+
+	region->s_start = state.s_pos;
+	region->p_start = state.p_pos;
+	region->len = SIZE_MAX - state.s_pos;
+
+	*out = state.regions;
+	return 0;
+}
+
+/*
+ * Pass the lines of every entry of `origin` that fall in one of the
+ * shared `regions` to `parent`.  Both the entries and the regions are
+ * sorted by their position in `origin`, so this is a single merge.
+ */
+static int pass_shared_lines(
+	blame_walk *walk,
+	blame_origin *origin,
+	blame_origin *parent,
+	const blame_region_array *regions)
+{
+	git_vector pending;
+	blame_entry *entry;
+	blame_region *region;
+	size_t i, r = 0, pos, end, len;
+	int error = 0;
+
+	if (git_vector_init(&pending, 0, entry_cmp) < 0)
+		return -1;
+
+	git_vector_swap(&pending, &origin->entries);
+	git_vector_sort(&pending);
+
+	git_vector_foreach(&pending, i, entry) {
+		pos = entry->s_lno;
+		end = entry->s_lno + entry->num_lines;
+
+		while (!error && pos < end) {
+			region = git_array_get(*regions, r);
+
+			if (!region || region->s_start >= end) {
+				error = entry_add(&origin->entries,
+					entry->lno + (pos - entry->s_lno), end - pos, pos);
+				break;
+			}
+
+			if (region->s_start + region->len <= pos) {
+				r++;
+				continue;
+			}
+
+			if (region->s_start > pos) {
+				len = region->s_start - pos;
+				error = entry_add(&origin->entries,
+					entry->lno + (pos - entry->s_lno), len, pos);
+			} else {
+				len = min(end, region->s_start + region->len) - pos;
+				error = entry_add(&parent->entries,
+					entry->lno + (pos - entry->s_lno), len,
+					region->p_start + (pos - region->s_start));
+			}
+
+			pos += len;
+		}
+
+		if (error < 0)
+			break;
+	}
+
+	git_vector_foreach(&pending, i, entry)
+		git__free(entry);
+	git_vector_free(&pending);
+
+	return error ? error : origin_queue(walk, parent);
+}
+
+/* Pass all the entries of `origin` to `parent`, which has the same blob. */
+static int pass_all_lines(
+	blame_walk *walk, blame_origin *origin, blame_origin *parent)
+{
+	size_t i;
+	blame_entry *entry;
+
+	git_vector_foreach(&origin->entries, i, entry) {
+		if (git_vector_insert(&parent->entries, entry) < 0)
+			return -1;
+
+		origin->entries.contents[i] = NULL;
+	}
+
+	git_vector_clear(&origin->entries);
+	return origin_queue(walk, parent);
+}
+
+static int emit_hunk(
+	blame_walk *walk,
+	blame_origin *origin,
+	size_t lno,
+	size_t num_lines,
+	size_t s_lno,
+	int boundary)
+{
+	git_blame_hunk hunk;
+	git_signature *author = (git_signature *)git_commit_author(origin->commit);
+
+	memset(&hunk, 0, sizeof(hunk));
+
+	hunk.lines_in_hunk = num_lines;
+	git_oid_cpy(&hunk.final_commit_id, git_commit_id(origin->commit));
+	hunk.final_start_line_number = lno + 1;
+	hunk.final_signature = author;
+	git_oid_cpy(&hunk.orig_commit_id, git_commit_id(origin->commit));
+	hunk.orig_path = origin->path;
+	hunk.orig_start_line_number = s_lno + 1;
+	hunk.orig_signature = author;
+	hunk.boundary = (char)boundary;
+
+	if (walk->hunk_cb(&hunk, walk->payload)) {
+		giterr_clear();
+		return GIT_EUSER;
+	}
+
+	return 0;
+}
+
+/*
+ * Report the entries `origin` is still suspected of, merging the ones
+ * that are contiguous in both the origin and the final file.
+ */
+static int emit_entries(blame_walk *walk, blame_origin *origin, int boundary)
+{
+	blame_entry *entry, *start = NULL;
+	size_t i, num_lines = 0;
+	int error = 0;
+
+	git_vector_sort(&origin->entries);
+
+	git_vector_foreach(&origin->entries, i, entry) {
+		if (start &&
+			entry->s_lno == start->s_lno + num_lines &&
+			entry->lno == start->lno + num_lines) {
+			num_lines += entry->num_lines;
+			continue;
+		}
+
+		if (start && (error = emit_hunk(walk, origin,
+				start->lno, num_lines, start->s_lno, boundary)) < 0)
+			break;
+
+		start = entry;
+		num_lines = entry->num_lines;
+	}
+
+	if (!error && start)
+		error = emit_hunk(walk, origin,
+			start->lno, num_lines, start->s_lno, boundary);
+
+	git_vector_foreach(&origin->entries, i, entry)
+		git__free(entry);
+	git_vector_clear(&origin->entries);
+
+	return error;
+}
+
+static int process_origin(blame_walk *walk, blame_origin *origin)
+{
+	git_vector parents = GIT_VECTOR_INIT;
+	blame_origin *parent;
+	blame_region_array regions;
+	unsigned int i, parent_count;
+	int error = 0, boundary = 0;
+
+	parent_count = git_commit_parentcount(origin->commit);
+
+	if (parent_count > 1 && (walk->opts.flags & GIT_BLAME_FIRST_PARENT) != 0)
+		parent_count = 1;
+
+	if (!parent_count ||
+		git_oid_equal(git_commit_id(origin->commit), &walk->opts.oldest_commit)) {
+		boundary = 1;
+		goto emit;
+	}
+
+	for (i = 0; i < parent_count; i++) {
+		if ((error = find_parent_origin(&parent, walk, origin, i)) < 0) {
+			if (error != GIT_ENOTFOUND)
+				goto done;
+
+			giterr_clear();
+			error = 0;
+			continue;
+		}
+
+		/* a parent with the very same blob is to blame for everything */
+		if (git_oid_equal(&parent->blob_id, &origin->blob_id)) {
+			error = pass_all_lines(walk, origin, parent);
+			goto done;
+		}
+
+		/* a merge may well list the same parent twice */
+		if (git_vector_search(NULL, &parents, parent) == 0)
+			continue;
+
+		if ((error = git_vector_insert(&parents, parent)) < 0)
+			goto done;
+	}
+
+	git_vector_foreach(&parents, i, parent) {
+		if (!origin->entries.length)
+			break;
+
+		if ((error = shared_regions(&regions, walk, parent, origin)) < 0)
+			goto done;
+
+		error = pass_shared_lines(walk, origin, parent, &regions);
+		git_array_clear(regions);
+
+		if (error < 0)
+			goto done;
+	}
+
+emit:
+	error = emit_entries(walk, origin, boundary);
+
+done:
+	git_vector_foreach(&parents, i, parent) {
+		if (!parent->queued)
+			origin_drop(walk, parent);
+	}
+	git_vector_free(&parents);
+
+	origin_release_blob(origin);
+	return error;
+}
+
+static int count_lines(size_t *out, const git_blob *blob)
+{
+	const char *data = git_blob_rawcontent(blob);
+	size_t i, len = (size_t)git_blob_rawsize(blob), lines = 0;
+
+	for (i = 0; i < len; i++) {
+		if (data[i] == '\n')
+			lines++;
+	}
+
+	if (len && data[len - 1] != '\n')
+		lines++;
+
+	*out = lines;
+	return 0;
+}
+
+static int blame_walk_init(
+	blame_walk *walk,
+	git_repository *repo,
+	const git_blame_options *options,
+	git_blame_hunk_cb hunk_cb,
+	void *payload)
+{
+	memset(walk, 0, sizeof(*walk));
+
+	walk->repo = repo;
+	walk->hunk_cb = hunk_cb;
+	walk->payload = payload;
+
+	if (options)
+		memcpy(&walk->opts, options, sizeof(git_blame_options));
+	else
+		GIT_INIT_STRUCTURE(&walk->opts, GIT_BLAME_OPTIONS_VERSION);
+
+	if (git_oid_iszero(&walk->opts.newest_commit) &&
+		git_reference_name_to_id(&walk->opts.newest_commit, repo, GIT_HEAD_FILE) < 0)
+		return -1;
+
+	walk->origins = git_strmap_alloc();
+	GITERR_CHECK_ALLOC(walk->origins);
+
+	return git_pqueue_init(&walk->queue, 8, origin_time_cmp);
+}
+
+static void blame_walk_free(blame_walk *walk)
+{
+	blame_origin *origin;
+
+	if (walk->origins) {
+		git_strmap_foreach_value(walk->origins, origin, {
+			origin_free(origin);
+		});
+		git_strmap_free(walk->origins);
+	}
+
+	git_pqueue_free(&walk->queue);
+}
+
+int git_blame_file_foreach(
+	git_repository *repo,
+	const char *path,
+	const git_blame_options *options,
+	git_blame_hunk_cb hunk_cb,
+	void *payload)
+{
+	blame_walk walk;
+	blame_origin *origin;
+	git_commit *commit;
+	git_oid blob_id;
+	size_t num_lines, min_line, max_line;
+	int error;
+
+	assert(repo && path && hunk_cb);
+
+	GITERR_CHECK_VERSION(options, GIT_BLAME_OPTIONS_VERSION, "git_blame_options");
+
+	if ((error = blame_walk_init(&walk, repo, options, hunk_cb, payload)) < 0)
+		goto done;
+
+	if ((error = git_commit_lookup(&commit, repo, &walk.opts.newest_commit)) < 0)
+		goto done;
+
+	if ((error = find_blob(&blob_id, commit, path)) < 0) {
+		git_commit_free(commit);
+		goto done;
+	}
+
+	if ((error = origin_get(&origin, &walk, commit, path, &blob_id)) < 0 ||
+		(error = origin_load_blob(&walk, origin)) < 0 ||
+		(error = count_lines(&num_lines, origin->blob)) < 0)
+		goto done;
+
+	min_line = walk.opts.min_line ? walk.opts.min_line : 1;
+	max_line = walk.opts.max_line ? walk.opts.max_line : num_lines;
+
+	if (!num_lines && !walk.opts.min_line && !walk.opts.max_line)
+		goto done;
+
+	if (min_line > max_line || max_line > num_lines) {
+		giterr_set(GITERR_INVALID,
+			"Invalid line range %"PRIuZ"-%"PRIuZ" for '%s' (%"PRIuZ" lines)",
+			min_line, max_line, path, num_lines);
+		error = -1;
+		goto done;
+	}
+
+	if ((error = entry_add(&origin->entries,
+			min_line - 1, max_line - min_line + 1, min_line - 1)) < 0 ||
+		(error = origin_queue(&walk, origin)) < 0)
+		goto done;
+
+	while ((origin = git_pqueue_pop(&walk.queue)) != NULL) {
+		origin->queued = 0;
+
+		error = process_origin(&walk, origin);
+
+		/* everything it was suspected of has been passed on or reported */
+		origin_drop(&walk, origin);
+
+		if (error < 0)
+			break;
+	}
+
+done:
+	blame_walk_free(&walk);
+	return error;
+}
+
+static void hunk_free(git_blame_hunk *hunk)
+{
+	if (!hunk)
+		return;
+
+	git_signature_free(hunk->final_signature);
+	git_signature_free(hunk->orig_signature);
+	git__free((char *)hunk->orig_path);
+	git__free(hunk);
+}
+
+static int hunk_cmp(const void *a, const void *b)
+{
+	const git_blame_hunk *ha = a, *hb = b;
+
+	if (ha->final_start_line_number < hb->final_start_line_number)
+		return -1;
+	return (ha->final_start_line_number > hb->final_start_line_number);
+}
+
+static int collect_hunk(const git_blame_hunk *hunk, void *payload)
+{
+	git_blame *blame = payload;
+	git_blame_hunk *copy = git__malloc(sizeof(git_blame_hunk));
+	GITERR_CHECK_ALLOC(copy);
+
+	memcpy(copy, hunk, sizeof(git_blame_hunk));
+	copy->final_signature = git_signature_dup(hunk->final_signature);
+	copy->orig_signature = git_signature_dup(hunk->orig_signature);
+	copy->orig_path = git__strdup(hunk->orig_path);
+
+	if (!copy->final_signature || !copy->orig_signature ||
+		!copy->orig_path || git_vector_insert(&blame->hunks, copy) < 0) {
+		hunk_free(copy);
+		return -1;
+	}
+
+	return 0;
+}
+
+GIT_INLINE(int) hunks_contiguous(
+	const git_blame_hunk *a, const git_blame_hunk *b)
+{
+	return git_oid_equal(&a->final_commit_id, &b->final_commit_id) &&
+		a->boundary == b->boundary &&
+		strcmp(a->orig_path, b->orig_path) == 0 &&
+		a->final_start_line_number + a->lines_in_hunk ==
+			b->final_start_line_number &&
+		a->orig_start_line_number + a->lines_in_hunk ==
+			b->orig_start_line_number;
+}
+
+static int hunk_is_removed(const git_vector *v, size_t idx)
+{
+	return (git_vector_get(v, idx) == NULL);
+}
+
+int git_blame_file(
+	git_blame **out,
+	git_repository *repo,
+	const char *path,
+	const git_blame_options *options)
+{
+	git_blame *blame;
+	git_blame_hunk *hunk, *prev = NULL;
+	size_t i;
+	int error;
+
+	assert(out && repo && path);
+
+	*out = NULL;
+
+	blame = git__calloc(1, sizeof(git_blame));
+	GITERR_CHECK_ALLOC(blame);
+
+	if ((error = git_vector_init(&blame->hunks, 8, hunk_cmp)) < 0 ||
+		(error = git_blame_file_foreach(
+			repo, path, options, collect_hunk, blame)) < 0) {
+		/* only our own callback can fail, and it has set the error */
+		if (error == GIT_EUSER)
+			error = -1;
+		git_blame_free(blame);
+		return error;
+	}
+
+	git_vector_sort(&blame->hunks);
+
+	git_vector_foreach(&blame->hunks, i, hunk) {
+		if (prev && hunks_contiguous(prev, hunk)) {
+			prev->lines_in_hunk += hunk->lines_in_hunk;
+			hunk_free(hunk);
+			blame->hunks.contents[i] = NULL;
+		} else {
+			prev = hunk;
+		}
+	}
+
+	git_vector_remove_matching(&blame->hunks, hunk_is_removed);
+
+	*out = blame;
+	return 0;
+}
+
+size_t git_blame_get_hunk_count(git_blame *blame)
+{
+	assert(blame);
+	return blame->hunks.length;
+}
+
+const git_blame_hunk *git_blame_get_hunk_byindex(git_blame *blame, size_t index)
+{
+	assert(blame);
+	return git_vector_get(&blame->hunks, index);
+}
+
+const git_blame_hunk *git_blame_get_hunk_byline(git_blame *blame, size_t lineno)
+{
+	size_t lo = 0, hi;
+	git_blame_hunk *hunk;
+
+	assert(blame);
+
+	hi = blame->hunks.length;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		hunk = git_vector_get(&blame->hunks, mid);
+
+		if (lineno < hunk->final_start_line_number)
+			hi = mid;
+		else if (lineno >= hunk->final_start_line_number + hunk->lines_in_hunk)
+			lo = mid + 1;
+		else
+			return hunk;
+	}
+
+	return NULL;
+}
+
+void git_blame_free(git_blame *blame)
+{
+	size_t i;
+	git_blame_hunk *hunk;
+
+	if (!blame)
+		return;
+
+	git_vector_foreach(&blame->hunks, i, hunk)
+		hunk_free(hunk);
+	git_vector_free(&blame->hunks);
+
+	git__free(blame);
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_blame_h__
+#define INCLUDE_blame_h__
+
+#include "common.h"
+#include "vector.h"
+
+#include "git2/blame.h"
+
+struct git_blame {
+	git_vector hunks;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "bloom.h"
+
+#define BLOOM_SEED0 0x293ae76f
+#define BLOOM_SEED1 0x7e646e2c
+
+GIT_INLINE(uint32_t) rotate_left(uint32_t value, int count)
+{
+	return (value << count) | (value >> (32 - count));
+}
+
+/*
+ * Version 1 filters were computed by a git that read the path through
+ * a (signed) `char *`, so bytes >= 0x80 must be sign-extended to match.
+ */
+GIT_INLINE(uint32_t) bloom_byte(const char *data, size_t i, uint32_t hash_version)
+{
+	if (hash_version == 1)
+		return (uint32_t)(int32_t)(signed char)data[i];
+
+	return (uint32_t)(unsigned char)data[i];
+}
+
+uint32_t git_bloom_murmur3_seeded(
+	uint32_t seed, const char *data, size_t len, uint32_t hash_version)
+{
+	const uint32_t c1 = 0xcc9e2d51;
+	const uint32_t c2 = 0x1b873593;
+	const uint32_t m = 5;
+	const uint32_t n = 0xe6546b64;
+	size_t i, blocks = len / 4;
+	uint32_t k, k1 = 0;
+
+	for (i = 0; i < blocks; i++) {
+		k = bloom_byte(data, 4*i, hash_version) |
+			(bloom_byte(data, 4*i + 1, hash_version) << 8) |
+			(bloom_byte(data, 4*i + 2, hash_version) << 16) |
+			(bloom_byte(data, 4*i + 3, hash_version) << 24);
+
+		k *= c1;
+		k = rotate_left(k, 15);
+		k *= c2;
+
+		seed ^= k;
+		seed = rotate_left(seed, 13) * m + n;
+	}
+
+	i = blocks * 4;
+
+	switch (len & 3) {
+	case 3:
+		k1 ^= bloom_byte(data, i + 2, hash_version) << 16;
+		/* fall through */
+	case 2:
+		k1 ^= bloom_byte(data, i + 1, hash_version) << 8;
+		/* fall through */
+	case 1:
+		k1 ^= bloom_byte(data, i, hash_version);
+		k1 *= c1;
+		k1 = rotate_left(k1, 15);
+		k1 *= c2;
+		seed ^= k1;
+		break;
+	}
+
+	seed ^= (uint32_t)len;
+	seed ^= (seed >> 16);
+	seed *= 0x85ebca6b;
+	seed ^= (seed >> 13);
+	seed *= 0xc2b2ae35;
+	seed ^= (seed >> 16);
+
+	return seed;
+}
+
+void git_bloom_key_init(
+	git_bloom_key *key,
+	const char *path,
+	size_t len,
+	const git_bloom_settings *settings)
+{
+	uint32_t i, hash0, hash1;
+
+	hash0 = git_bloom_murmur3_seeded(
+		BLOOM_SEED0, path, len, settings->hash_version);
+	hash1 = git_bloom_murmur3_seeded(
+		BLOOM_SEED1, path, len, settings->hash_version);
+
+	for (i = 0; i < settings->num_hashes && i < GIT_BLOOM_MAX_HASHES; i++)
+		key->hashes[i] = hash0 + i * hash1;
+}
+
+int git_bloom_filter_contains(
+	const git_bloom_filter *filter,
+	const git_bloom_key *key,
+	const git_bloom_settings *settings)
+{
+	uint64_t mod = (uint64_t)filter->len * 8;
+	uint32_t i;
+
+	if (!mod)
+		return -1;
+
+	for (i = 0; i < settings->num_hashes && i < GIT_BLOOM_MAX_HASHES; i++) {
+		uint64_t pos = key->hashes[i] % mod;
+
+		if (!(filter->data[pos / 8] & (1 << (pos & 7))))
+			return 0;
+	}
+
+	return 1;
+}
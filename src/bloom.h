@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_bloom_h__
+#define INCLUDE_bloom_h__
+
+#include "common.h"
+
+/*
+ * Changed-path Bloom filters, as stored in a commit-graph by
+ * `git commit-graph write --changed-paths`.
+ *
+ * Each commit's filter records every path that differs between the
+ * commit and its first parent, along with all of the leading
+ * directories of those paths.
+ */
+
+#define GIT_BLOOM_MAX_HASHES 32
+
+typedef struct {
+	/* 1 hashes bytes as signed chars (like git <= 2.39), 2 as unsigned */
+	uint32_t hash_version;
+	uint32_t num_hashes;
+	uint32_t bits_per_entry;
+} git_bloom_settings;
+
+typedef struct {
+	const unsigned char *data;
+	size_t len;
+} git_bloom_filter;
+
+typedef struct {
+	uint32_t hashes[GIT_BLOOM_MAX_HASHES];
+} git_bloom_key;
+
+/* The seeded 32-bit MurmurHash3 used for the filter keys. */
+extern uint32_t git_bloom_murmur3_seeded(
+	uint32_t seed, const char *data, size_t len, uint32_t hash_version);
+
+extern void git_bloom_key_init(
+	git_bloom_key *key,
+	const char *path,
+	size_t len,
+	const git_bloom_settings *settings);
+
+/*
+ * Returns 0 if the key is definitely not in the filter, 1 if it may
+ * be, and -1 when the filter carries no information.
+ */
+extern int git_bloom_filter_contains(
+	const git_bloom_filter *filter,
+	const git_bloom_key *key,
+	const git_bloom_settings *settings);
+
+#endif
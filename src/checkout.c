@@ -26,6 +26,7 @@
 #include "diff.h"
 #include "pathspec.h"
 #include "buf_text.h"
+#include "filebuf.h"
 
 /* See docs/checkout-internals.md for more information */
 
@@ -54,6 +55,7 @@ typedef struct {
 	size_t workdir_len;
 	unsigned int strategy;
 	int can_symlink;
+	mode_t umask;
 	bool reload_submodules;
 	size_t total_steps;
 	size_t completed_steps;
@@ -676,30 +678,90 @@ fail:
 	return error;
 }
 
-static int buffer_to_file(
-	struct stat *st,
-	git_buf *buf,
-	const char *path,
-	mode_t dir_mode,
-	int file_open_flags,
-	mode_t file_mode)
+/* writes the filtered content of a blob out to a temporary file, which
+ * only replaces the file once all of it was written */
+struct checkout_stream {
+	git_writestream base;
+	git_filebuf file;
+};
+
+static int checkout_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	struct checkout_stream *stream = (struct checkout_stream *)s;
+	return git_filebuf_write(&stream->file, buffer, len);
+}
+
+static int checkout_stream_close(git_writestream *s)
+{
+	GIT_UNUSED(s);
+	return 0;
+}
+
+static void checkout_stream_free(git_writestream *s)
+{
+	GIT_UNUSED(s);
+}
+
+static int blob_content_stream_to_file(
+	git_filter_list *fl, git_blob *blob, const char *path, mode_t file_mode)
 {
+	struct checkout_stream writer;
+	git_buf tmp = GIT_BUF_INIT;
 	int error;
 
-	if ((error = git_futils_mkpath2file(path, dir_mode)) < 0)
+	memset(&writer, 0, sizeof(writer));
+	writer.base.write = checkout_stream_write;
+	writer.base.close = checkout_stream_close;
+	writer.base.free = checkout_stream_free;
+
+	/* the temporary file is named after the directory rather than the
+	 * file, whose name may leave no room for a suffix */
+	if ((error = git_path_dirname_r(&tmp, path)) < 0 ||
+		(error = git_buf_puts(&tmp, "/.")) < 0 ||
+		(error = git_filebuf_open(
+			&writer.file, tmp.ptr, GIT_FILEBUF_TEMPORARY)) < 0) {
+		git_buf_free(&tmp);
 		return error;
+	}
+
+	git_buf_free(&tmp);
 
-	if ((error = git_futils_writebuffer(
-			buf, path, file_open_flags, file_mode)) < 0)
+	/* the filters write the content out a chunk at a time */
+	if ((error = git_filter_list_stream_blob(fl, blob, &writer.base)) < 0) {
+		git_filebuf_cleanup(&writer.file);
 		return error;
+	}
 
-	if (st != NULL && (error = p_stat(path, st)) < 0)
-		giterr_set(GITERR_OS, "Error statting '%s'", path);
+	return git_filebuf_commit_at(&writer.file, path, file_mode);
+}
 
-	else if (GIT_PERMS_IS_EXEC(file_mode) &&
-			(error = p_chmod(path, file_mode)) < 0)
-		giterr_set(GITERR_OS, "Failed to set permissions on '%s'", path);
+/* with other flags than the default ones, the file may not be replaced
+ * (say, to append to it); its content is filtered in full beforehand */
+static int blob_content_write_to_file(
+	git_filter_list *fl, git_blob *blob,
+	const char *path, int flags, mode_t file_mode)
+{
+	git_buf out = GIT_BUF_INIT;
+	int fd, error;
+
+	if ((error = git_filter_list_apply_to_blob(&out, fl, blob)) < 0)
+		return error;
+
+	if ((fd = p_open(path, flags, file_mode)) < 0) {
+		giterr_set(GITERR_OS, "Could not open '%s' for writing", path);
+		error = fd;
+	} else {
+		if ((error = p_write(fd, out.ptr, out.size)) < 0)
+			giterr_set(GITERR_OS, "Could not write to '%s'", path);
 
+		if (p_close(fd) < 0 && !error) {
+			giterr_set(GITERR_OS, "Error while closing '%s'", path);
+			error = -1;
+		}
+	}
+
+	git_buf_free(&out);
 	return error;
 }
 
@@ -708,31 +770,48 @@ static int blob_content_to_file(
 	git_blob *blob,
 	const char *path,
 	mode_t entry_filemode,
-	git_checkout_opts *opts)
+	git_checkout_opts *opts,
+	mode_t mask)
 {
-	int error = 0;
+	int error = 0, flags;
 	mode_t file_mode = opts->file_mode ? opts->file_mode : entry_filemode;
-	git_buf out = GIT_BUF_INIT;
 	git_filter_list *fl = NULL;
 
-	if (!opts->disable_filters)
-		error = git_filter_list_load(
-			&fl, git_blob_owner(blob), blob, path, GIT_FILTER_TO_WORKTREE);
+	if (!opts->disable_filters &&
+		(error = git_filter_list_load(
+			&fl, git_blob_owner(blob), blob, path, GIT_FILTER_TO_WORKTREE)) < 0)
+		return error;
 
-	if (!error)
-		error = git_filter_list_apply_to_blob(&out, fl, blob);
+	if ((error = git_futils_mkpath2file(path, opts->dir_mode)) < 0)
+		goto done;
 
-	git_filter_list_free(fl);
+	if ((flags = opts->file_open_flags) <= 0)
+		flags = O_CREAT | O_TRUNC | O_WRONLY;
 
-	if (!error) {
-		error = buffer_to_file(
-			st, &out, path, opts->dir_mode, opts->file_open_flags, file_mode);
+	/* a filter that fails part way through leaves the file as it was */
+	if (flags == (O_CREAT | O_TRUNC | O_WRONLY))
+		/* the temporary file gets its mode set outright, so the umask
+		 * is applied here, as opening the file would have */
+		error = blob_content_stream_to_file(fl, blob, path,
+			GIT_PERMS_IS_EXEC(file_mode) ? file_mode : file_mode & ~mask);
+	else
+		error = blob_content_write_to_file(fl, blob, path, flags, file_mode);
 
-		st->st_mode = entry_filemode;
+	if (error < 0)
+		goto done;
 
-		git_buf_free(&out);
-	}
+	if (st != NULL && (error = p_stat(path, st)) < 0)
+		giterr_set(GITERR_OS, "Error statting '%s'", path);
+
+	else if (GIT_PERMS_IS_EXEC(file_mode) &&
+			(error = p_chmod(path, file_mode)) < 0)
+		giterr_set(GITERR_OS, "Failed to set permissions on '%s'", path);
 
+	if (!error)
+		st->st_mode = entry_filemode;
+
+done:
+	git_filter_list_free(fl);
 	return error;
 }
 
@@ -913,7 +992,8 @@ static int checkout_blob(
 			&st, blob, git_buf_cstr(&data->path), data->opts.dir_mode, data->can_symlink);
 	else
 		error = blob_content_to_file(
-			&st, blob, git_buf_cstr(&data->path), file->mode, &data->opts);
+			&st, blob, git_buf_cstr(&data->path), file->mode,
+			&data->opts, data->umask);
 
 	git_blob_free(blob);
 
@@ -1138,6 +1218,10 @@ static int checkout_data_init(
 
 	data->repo = repo;
 
+	/* files are written out with the mode asked for, less the umask */
+	data->umask = p_umask(0);
+	p_umask(data->umask);
+
 	GITERR_CHECK_VERSION(
 		proposed, GIT_CHECKOUT_OPTS_VERSION, "git_checkout_opts");
 
@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "commit_graph.h"
+#include "fileops.h"
+#include "buffer.h"
+#include "path.h"
+
+#define COMMIT_GRAPH_SIGNATURE 0x43475048 /* "CGPH" */
+#define COMMIT_GRAPH_VERSION 1
+#define COMMIT_GRAPH_OBJECT_ID_VERSION 1 /* SHA-1 */
+
+#define COMMIT_GRAPH_CHUNK_OID_FANOUT 0x4f494446 /* "OIDF" */
+#define COMMIT_GRAPH_CHUNK_OID_LOOKUP 0x4f49444c /* "OIDL" */
+#define COMMIT_GRAPH_CHUNK_COMMIT_DATA 0x43444154 /* "CDAT" */
+#define COMMIT_GRAPH_CHUNK_EXTRA_EDGE_LIST 0x45444745 /* "EDGE" */
+#define COMMIT_GRAPH_CHUNK_BLOOM_INDEX 0x42494458 /* "BIDX" */
+#define COMMIT_GRAPH_CHUNK_BLOOM_DATA 0x42444154 /* "BDAT" */
+
+#define COMMIT_GRAPH_PARENT_NONE 0x70000000
+#define COMMIT_GRAPH_EXTRA_EDGES_NEEDED 0x80000000
+#define COMMIT_GRAPH_LAST_EDGE 0x80000000
+
+#define COMMIT_GRAPH_DATA_WIDTH (GIT_OID_RAWSZ + 16)
+
+struct git_commit_graph_header {
+	uint32_t signature;
+	uint8_t version;
+	uint8_t object_id_version;
+	uint8_t chunks;
+	uint8_t base_graph_files;
+};
+
+struct git_commit_graph_chunk {
+	uint32_t id;
+	size_t offset;
+	size_t length;
+};
+
+static int commit_graph_error(const char *message)
+{
+	giterr_set(GITERR_ODB, "Invalid commit-graph file - %s", message);
+	return -1;
+}
+
+GIT_INLINE(uint32_t) read_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+GIT_INLINE(uint64_t) read_be64(const unsigned char *p)
+{
+	return ((uint64_t)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+static int parse_oid_fanout(
+	git_commit_graph_file *file,
+	const unsigned char *data,
+	struct git_commit_graph_chunk *chunk)
+{
+	uint32_t i, nr;
+
+	if (chunk->length != 256 * sizeof(uint32_t))
+		return commit_graph_error("OID Fanout chunk has wrong length");
+
+	file->oid_fanout = (const uint32_t *)(data + chunk->offset);
+
+	for (i = 0, nr = 0; i < 256; ++i) {
+		uint32_t n = ntohl(file->oid_fanout[i]);
+		if (n < nr)
+			return commit_graph_error("index is non-monotonic");
+		nr = n;
+	}
+
+	file->num_commits = nr;
+	return 0;
+}
+
+static int parse_oid_lookup(
+	git_commit_graph_file *file,
+	const unsigned char *data,
+	struct git_commit_graph_chunk *chunk)
+{
+	uint32_t i;
+	const git_oid *prev = NULL, *oid;
+
+	if (chunk->length != (size_t)file->num_commits * GIT_OID_RAWSZ)
+		return commit_graph_error("OID Lookup chunk has wrong length");
+
+	file->oid_lookup = oid = (const git_oid *)(data + chunk->offset);
+
+	for (i = 0; i < file->num_commits; ++i, ++oid) {
+		if (prev && git_oid_cmp(prev, oid) >= 0)
+			return commit_graph_error("OID Lookup index is non-monotonic");
+		prev = oid;
+	}
+
+	return 0;
+}
+
+/*
+ * Bloom filters are optional: if they cannot be used, we simply go
+ * without them rather than refusing the whole graph.
+ */
+static void parse_bloom_filters(
+	git_commit_graph_file *file,
+	const unsigned char *data,
+	struct git_commit_graph_chunk *index,
+	struct git_commit_graph_chunk *filters)
+{
+	git_bloom_settings settings;
+	uint32_t i, prev = 0;
+
+	if (!index || !filters ||
+		index->length != (size_t)file->num_commits * sizeof(uint32_t) ||
+		filters->length < 12)
+		return;
+
+	settings.hash_version = read_be32(data + filters->offset);
+	settings.num_hashes = read_be32(data + filters->offset + 4);
+	settings.bits_per_entry = read_be32(data + filters->offset + 8);
+
+	if ((settings.hash_version != 1 && settings.hash_version != 2) ||
+		!settings.num_hashes || settings.num_hashes > GIT_BLOOM_MAX_HASHES)
+		return;
+
+	file->bloom_index = (const uint32_t *)(data + index->offset);
+
+	for (i = 0; i < file->num_commits; ++i) {
+		uint32_t end = ntohl(file->bloom_index[i]);
+
+		if (end < prev || end > filters->length - 12) {
+			file->bloom_index = NULL;
+			return;
+		}
+
+		prev = end;
+	}
+
+	file->bloom_data = data + filters->offset + 12;
+	file->bloom_data_len = filters->length - 12;
+	file->bloom_settings = settings;
+}
+
+static int parse_commit_graph(git_commit_graph_file *file)
+{
+	const unsigned char *data = file->graph_map.data;
+	size_t size = file->graph_map.len, trailer_offset, i;
+	struct git_commit_graph_header *hdr;
+	struct git_commit_graph_chunk chunks[16], *chunk;
+	struct git_commit_graph_chunk *oid_fanout = NULL, *oid_lookup = NULL;
+	struct git_commit_graph_chunk *commit_data = NULL, *extra_edges = NULL;
+	struct git_commit_graph_chunk *bloom_index = NULL, *bloom_data = NULL;
+	const unsigned char *chunk_hdr;
+	int error;
+
+	/* Header + terminating chunk entry + trailing checksum */
+	if (size < sizeof(*hdr) + 12 + GIT_OID_RAWSZ)
+		return commit_graph_error("file is too short");
+
+	hdr = (struct git_commit_graph_header *)data;
+
+	if (hdr->signature != htonl(COMMIT_GRAPH_SIGNATURE) ||
+		hdr->version != COMMIT_GRAPH_VERSION ||
+		hdr->object_id_version != COMMIT_GRAPH_OBJECT_ID_VERSION)
+		return commit_graph_error("unsupported commit-graph version");
+
+	if (hdr->base_graph_files != 0)
+		return commit_graph_error("split commit-graphs are not supported");
+
+	if (hdr->chunks == 0 || hdr->chunks > ARRAY_SIZE(chunks))
+		return commit_graph_error("wrong number of chunks");
+
+	trailer_offset = size - GIT_OID_RAWSZ;
+	if (sizeof(*hdr) + (hdr->chunks + 1) * 12 > trailer_offset)
+		return commit_graph_error("chunk table is truncated");
+
+	chunk_hdr = data + sizeof(*hdr);
+
+	for (i = 0; i < hdr->chunks; ++i, chunk_hdr += 12) {
+		uint64_t offset = read_be64(chunk_hdr + 4);
+		uint64_t next = read_be64(chunk_hdr + 12 + 4);
+
+		if (offset < sizeof(*hdr) + (hdr->chunks + 1) * 12 ||
+			next < offset || next > trailer_offset)
+			return commit_graph_error("chunk has invalid offset");
+
+		chunk = &chunks[i];
+		chunk->id = read_be32(chunk_hdr);
+		chunk->offset = (size_t)offset;
+		chunk->length = (size_t)(next - offset);
+
+		switch (chunk->id) {
+		case COMMIT_GRAPH_CHUNK_OID_FANOUT:
+			oid_fanout = chunk;
+			break;
+		case COMMIT_GRAPH_CHUNK_OID_LOOKUP:
+			oid_lookup = chunk;
+			break;
+		case COMMIT_GRAPH_CHUNK_COMMIT_DATA:
+			commit_data = chunk;
+			break;
+		case COMMIT_GRAPH_CHUNK_EXTRA_EDGE_LIST:
+			extra_edges = chunk;
+			break;
+		case COMMIT_GRAPH_CHUNK_BLOOM_INDEX:
+			bloom_index = chunk;
+			break;
+		case COMMIT_GRAPH_CHUNK_BLOOM_DATA:
+			bloom_data = chunk;
+			break;
+		default:
+			/* unknown chunks are optional; skip them */
+			break;
+		}
+	}
+
+	if (!oid_fanout || !oid_lookup || !commit_data)
+		return commit_graph_error("missing a required chunk");
+
+	if ((error = parse_oid_fanout(file, data, oid_fanout)) < 0 ||
+		(error = parse_oid_lookup(file, data, oid_lookup)) < 0)
+		return error;
+
+	if (commit_data->length !=
+		(size_t)file->num_commits * COMMIT_GRAPH_DATA_WIDTH)
+		return commit_graph_error("Commit Data chunk has wrong length");
+
+	file->commit_data = data + commit_data->offset;
+
+	if (extra_edges) {
+		if (extra_edges->length % sizeof(uint32_t) != 0)
+			return commit_graph_error("Extra Edge List chunk has wrong length");
+
+		file->extra_edge_list = (const uint32_t *)(data + extra_edges->offset);
+		file->num_extra_edge_list = extra_edges->length / sizeof(uint32_t);
+	}
+
+	parse_bloom_filters(file, data, bloom_index, bloom_data);
+	return 0;
+}
+
+int git_commit_graph_open(git_commit_graph_file **out, const char *path)
+{
+	git_commit_graph_file *file;
+	int error;
+
+	assert(out && path);
+
+	*out = NULL;
+
+	file = git__calloc(1, sizeof(git_commit_graph_file));
+	GITERR_CHECK_ALLOC(file);
+
+	if ((error = git_futils_mmap_ro_file(&file->graph_map, path)) < 0) {
+		git__free(file);
+		return error;
+	}
+
+	if ((error = parse_commit_graph(file)) < 0) {
+		git_commit_graph_free(file);
+		return error;
+	}
+
+	*out = file;
+	return 0;
+}
+
+int git_commit_graph_open_for_objects_dir(
+	git_commit_graph_file **out, const char *objects_dir)
+{
+	git_buf path = GIT_BUF_INIT;
+	int error;
+
+	*out = NULL;
+
+	if (git_buf_joinpath(&path, objects_dir, "info/" GIT_COMMIT_GRAPH_FILE) < 0)
+		return -1;
+
+	if (git_path_isfile(path.ptr) &&
+		(error = git_commit_graph_open(out, path.ptr)) < 0) {
+		if (error == GIT_ENOTFOUND || error == -1)
+			giterr_clear();
+		else {
+			git_buf_free(&path);
+			return error;
+		}
+	}
+
+	git_buf_free(&path);
+	return 0;
+}
+
+void git_commit_graph_free(git_commit_graph_file *file)
+{
+	if (!file)
+		return;
+
+	git_futils_mmap_free(&file->graph_map);
+	git__free(file);
+}
+
+int git_commit_graph_entry_at(
+	git_commit_graph_entry *out,
+	const git_commit_graph_file *file,
+	uint32_t position)
+{
+	const unsigned char *commit_data;
+	uint32_t parent1, parent2, generation;
+
+	assert(out && file);
+
+	if (position >= file->num_commits)
+		return commit_graph_error("commit position out of range");
+
+	commit_data = file->commit_data + position * COMMIT_GRAPH_DATA_WIDTH;
+
+	out->position = position;
+	git_oid_cpy(&out->sha1, &file->oid_lookup[position]);
+	git_oid_fromraw(&out->tree_oid, commit_data);
+
+	parent1 = read_be32(commit_data + GIT_OID_RAWSZ);
+	parent2 = read_be32(commit_data + GIT_OID_RAWSZ + 4);
+
+	/* Upper 30 bits are the generation, lower 34 the commit time. */
+	generation = read_be32(commit_data + GIT_OID_RAWSZ + 8);
+	out->generation = generation >> 2;
+	out->commit_time = (git_time_t)(
+		((uint64_t)(generation & 0x3) << 32) |
+		read_be32(commit_data + GIT_OID_RAWSZ + 12));
+
+	out->parent_positions[0] = parent1;
+	out->parent_positions[1] = parent2;
+	out->extra_parents_index = 0;
+
+	if (parent1 == COMMIT_GRAPH_PARENT_NONE)
+		out->parent_count = 0;
+	else if (parent2 == COMMIT_GRAPH_PARENT_NONE)
+		out->parent_count = 1;
+	else if (!(parent2 & COMMIT_GRAPH_EXTRA_EDGES_NEEDED))
+		out->parent_count = 2;
+	else {
+		size_t i = parent2 & ~COMMIT_GRAPH_EXTRA_EDGES_NEEDED;
+
+		out->extra_parents_index = i;
+		out->parent_count = 1;
+
+		for (; i < file->num_extra_edge_list; ++i) {
+			out->parent_count++;
+			if (ntohl(file->extra_edge_list[i]) & COMMIT_GRAPH_LAST_EDGE)
+				break;
+		}
+
+		if (i == file->num_extra_edge_list)
+			return commit_graph_error("Extra Edge List is truncated");
+	}
+
+	return 0;
+}
+
+int git_commit_graph_entry_find(
+	git_commit_graph_entry *out,
+	const git_commit_graph_file *file,
+	const git_oid *oid)
+{
+	uint32_t lo, hi, mi;
+	int cmp;
+
+	assert(out && file && oid);
+
+	hi = ntohl(file->oid_fanout[oid->id[0]]);
+	lo = oid->id[0] ? ntohl(file->oid_fanout[oid->id[0] - 1]) : 0;
+
+	while (lo < hi) {
+		mi = lo + (hi - lo) / 2;
+		cmp = git_oid_cmp(oid, &file->oid_lookup[mi]);
+
+		if (!cmp)
+			return git_commit_graph_entry_at(out, file, mi);
+
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+int git_commit_graph_entry_parent_position(
+	uint32_t *out,
+	const git_commit_graph_file *file,
+	const git_commit_graph_entry *entry,
+	size_t n)
+{
+	uint32_t position;
+
+	assert(out && file && entry);
+
+	if (n >= entry->parent_count)
+		return commit_graph_error("parent index out of range");
+
+	if (n == 0 || (n == 1 && entry->parent_count == 2))
+		position = entry->parent_positions[n];
+	else
+		position = ntohl(file->extra_edge_list[
+			entry->extra_parents_index + n - 1]) & ~COMMIT_GRAPH_LAST_EDGE;
+
+	if (position >= file->num_commits)
+		return commit_graph_error("parent position out of range");
+
+	*out = position;
+	return 0;
+}
+
+int git_commit_graph_bloom_filter(
+	git_bloom_filter *out,
+	const git_commit_graph_file *file,
+	uint32_t position)
+{
+	uint32_t start, end;
+
+	assert(out && file);
+
+	if (!file->bloom_index || position >= file->num_commits)
+		return GIT_ENOTFOUND;
+
+	start = position ? ntohl(file->bloom_index[position - 1]) : 0;
+	end = ntohl(file->bloom_index[position]);
+
+	out->data = file->bloom_data + start;
+	out->len = end - start;
+	return 0;
+}
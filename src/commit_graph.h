@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_commit_graph_h__
+#define INCLUDE_commit_graph_h__
+
+#include "common.h"
+#include "map.h"
+#include "bloom.h"
+
+#include "git2/oid.h"
+
+#define GIT_COMMIT_GRAPH_FILE "commit-graph"
+
+/*
+ * Generation numbers are the length of the longest path from a commit
+ * to a root commit (roots have generation 1).  A commit that is not in
+ * the commit-graph has an unknown generation, which we treat as larger
+ * than any known one: the graph is closed under reachability, so such a
+ * commit can never be the ancestor of a commit that is in the graph.
+ */
+#define GIT_COMMIT_GENERATION_INFINITY 0xFFFFFFFF
+#define GIT_COMMIT_GENERATION_MAX 0x3FFFFFFF
+
+/*
+ * A read-only view of an `objects/info/commit-graph` file, as written
+ * by `git commit-graph write`.  Only the single-file (non-split) format
+ * with SHA-1 object ids is supported.
+ */
+typedef struct git_commit_graph_file {
+	git_map graph_map;
+
+	uint32_t num_commits;
+
+	/* The OID Fanout table. */
+	const uint32_t *oid_fanout;
+
+	/* The OID Lookup table. */
+	const git_oid *oid_lookup;
+
+	/* The Commit Data table. */
+	const unsigned char *commit_data;
+
+	/* The Extra Edge List table. */
+	const uint32_t *extra_edge_list;
+	size_t num_extra_edge_list;
+
+	/* The Bloom Filter Index and Data tables, if any. */
+	const uint32_t *bloom_index;
+	const unsigned char *bloom_data;
+	size_t bloom_data_len;
+	git_bloom_settings bloom_settings;
+} git_commit_graph_file;
+
+/* A single commit, as described by the commit-graph. */
+typedef struct git_commit_graph_entry {
+	/* Position of the commit in the graph's OID lookup table. */
+	uint32_t position;
+
+	/* The topological level of the commit. */
+	uint32_t generation;
+
+	/* The committer time, in seconds since the epoch. */
+	git_time_t commit_time;
+
+	/* Number of parents, and their positions in the graph. */
+	size_t parent_count;
+	uint32_t parent_positions[2];
+
+	/* Index into the Extra Edge List for octopus merges. */
+	size_t extra_parents_index;
+
+	git_oid tree_oid;
+	git_oid sha1;
+} git_commit_graph_entry;
+
+/*
+ * Open and validate the commit-graph at `path`.  Returns GIT_ENOTFOUND
+ * when there is no such file.
+ */
+extern int git_commit_graph_open(
+	git_commit_graph_file **out, const char *path);
+
+/*
+ * Open the commit-graph of the repository whose objects directory is
+ * `objects_dir`; `*out` is set to NULL if it has none or it cannot be
+ * used, since the graph is only ever an optimization.
+ */
+extern int git_commit_graph_open_for_objects_dir(
+	git_commit_graph_file **out, const char *objects_dir);
+
+extern void git_commit_graph_free(git_commit_graph_file *file);
+
+/* Find the entry for `oid`, or return GIT_ENOTFOUND. */
+extern int git_commit_graph_entry_find(
+	git_commit_graph_entry *out,
+	const git_commit_graph_file *file,
+	const git_oid *oid);
+
+/* Read the entry at `position` in the OID lookup table. */
+extern int git_commit_graph_entry_at(
+	git_commit_graph_entry *out,
+	const git_commit_graph_file *file,
+	uint32_t position);
+
+/* Get the graph position of the `n`th parent of `entry`. */
+extern int git_commit_graph_entry_parent_position(
+	uint32_t *out,
+	const git_commit_graph_file *file,
+	const git_commit_graph_entry *entry,
+	size_t n);
+
+/*
+ * Get the changed-path Bloom filter of the commit at `position`.
+ * Returns GIT_ENOTFOUND if the graph has no filters.
+ */
+extern int git_commit_graph_bloom_filter(
+	git_bloom_filter *out,
+	const git_commit_graph_file *file,
+	uint32_t position);
+
+GIT_INLINE(const git_oid *) git_commit_graph_oid_at(
+	const git_commit_graph_file *file, uint32_t position)
+{
+	return &file->oid_lookup[position];
+}
+
+#endif
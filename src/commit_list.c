@@ -8,8 +8,8 @@
 #include "commit_list.h"
 #include "common.h"
 #include "revwalk.h"
-#include "pool.h"
 #include "odb.h"
+#include "commit_graph.h"
 
 int git_commit_list_time_cmp(void *a, void *b)
 {
@@ -19,6 +19,17 @@ int git_commit_list_time_cmp(void *a, void *b)
 	return (commit_a->time < commit_b->time);
 }
 
+int git_commit_list_generation_cmp(void *a, void *b)
+{
+	git_commit_list_node *commit_a = (git_commit_list_node *)a;
+	git_commit_list_node *commit_b = (git_commit_list_node *)b;
+
+	if (commit_a->generation != commit_b->generation)
+		return (commit_a->generation < commit_b->generation);
+
+	return (commit_a->time < commit_b->time);
+}
+
 git_commit_list *git_commit_list_insert(git_commit_list_node *item, git_commit_list **list_p)
 {
 	git_commit_list *new_list = git__malloc(sizeof(git_commit_list));
@@ -45,32 +56,221 @@ git_commit_list *git_commit_list_insert_by_date(git_commit_list_node *item, git_
 	return git_commit_list_insert(item, pp);
 }
 
-git_commit_list_node *git_commit_list_alloc_node(git_revwalk *walk)
+int git_commit_table_init(git_commit_table *table)
 {
-	return (git_commit_list_node *)git_pool_malloc(&walk->commit_pool, COMMIT_ALLOC);
+	memset(table, 0, sizeof(*table));
+
+	table->bucket_mask = 1023;
+	table->buckets = git__calloc(table->bucket_mask + 1, sizeof(uint32_t));
+	GITERR_CHECK_ALLOC(table->buckets);
+
+	return 0;
 }
 
-static int commit_error(git_commit_list_node *commit, const char *msg)
+void git_commit_table_free(git_commit_table *table)
 {
-	char commit_oid[GIT_OID_HEXSZ + 1];
-	git_oid_fmt(commit_oid, &commit->oid);
-	commit_oid[GIT_OID_HEXSZ] = '\0';
+	size_t i;
 
-	giterr_set(GITERR_ODB, "Failed to parse commit %s - %s", commit_oid, msg);
+	for (i = 0; i < table->chunks; ++i) {
+		git__free(table->nodes[i]);
+		git__free(table->oids[i]);
+	}
 
-	return -1;
+	git__free(table->nodes);
+	git__free(table->oids);
+	git__free(table->buckets);
+	git_array_clear(table->parent_indices);
+
+	memset(table, 0, sizeof(*table));
+}
+
+GIT_INLINE(uint32_t) commit_table_hash(const git_oid *oid)
+{
+	uint32_t h;
+	memcpy(&h, oid->id, sizeof(h));
+	return h;
+}
+
+/* Buckets hold `index + 1`, so that zero marks an empty one. */
+static uint32_t *commit_table_bucket(
+	const git_commit_table *table, const git_oid *oid)
+{
+	uint32_t pos = commit_table_hash(oid) & table->bucket_mask;
+	uint32_t *bucket;
+
+	while (*(bucket = &table->buckets[pos]) != 0) {
+		git_commit_list_node *node =
+			git_commit_table_node(table, *bucket - 1);
+
+		if (git_oid_equal(git_commit_table_oid(table, node), oid))
+			break;
+
+		pos = (pos + 1) & table->bucket_mask;
+	}
+
+	return bucket;
 }
 
-static git_commit_list_node **alloc_parents(
-	git_revwalk *walk, git_commit_list_node *commit, size_t n_parents)
+static int commit_table_grow_buckets(git_commit_table *table)
 {
-	if (n_parents <= PARENTS_PER_COMMIT)
-		return (git_commit_list_node **)((char *)commit + sizeof(git_commit_list_node));
+	uint32_t *old_buckets = table->buckets, old_mask = table->bucket_mask;
+	uint32_t i;
+
+	if (old_mask >= UINT32_MAX / 2) {
+		giterr_set(GITERR_NOMEMORY, "Too many commits in the walk");
+		return -1;
+	}
+
+	table->bucket_mask = (old_mask << 1) | 1;
+	table->buckets = git__calloc(table->bucket_mask + 1, sizeof(uint32_t));
+	if (!table->buckets) {
+		table->buckets = old_buckets;
+		table->bucket_mask = old_mask;
+		return -1;
+	}
+
+	for (i = 0; i <= old_mask; ++i) {
+		git_commit_list_node *node;
+
+		if (!old_buckets[i])
+			continue;
+
+		node = git_commit_table_node(table, old_buckets[i] - 1);
+		*commit_table_bucket(table, git_commit_table_oid(table, node)) =
+			old_buckets[i];
+	}
+
+	git__free(old_buckets);
+	return 0;
+}
+
+static int commit_table_grow_chunks(git_commit_table *table)
+{
+	if (table->chunks == table->chunks_alloc) {
+		size_t new_alloc = table->chunks_alloc ? table->chunks_alloc * 2 : 8;
+		void *nodes, *oids;
+
+		nodes = git__realloc(table->nodes, new_alloc * sizeof(*table->nodes));
+		GITERR_CHECK_ALLOC(nodes);
+		table->nodes = nodes;
+
+		oids = git__realloc(table->oids, new_alloc * sizeof(*table->oids));
+		GITERR_CHECK_ALLOC(oids);
+		table->oids = oids;
+
+		table->chunks_alloc = new_alloc;
+	}
+
+	table->nodes[table->chunks] = git__malloc(
+		GIT_COMMIT_TABLE_CHUNK_SIZE * sizeof(git_commit_list_node));
+	GITERR_CHECK_ALLOC(table->nodes[table->chunks]);
+
+	table->oids[table->chunks] = git__malloc(
+		GIT_COMMIT_TABLE_CHUNK_SIZE * sizeof(git_oid));
+	if (!table->oids[table->chunks]) {
+		git__free(table->nodes[table->chunks]);
+		return -1;
+	}
+
+	table->chunks++;
+	return 0;
+}
+
+git_commit_list_node *git_commit_table_find(
+	const git_commit_table *table, const git_oid *oid)
+{
+	uint32_t *bucket = commit_table_bucket(table, oid);
+	return *bucket ? git_commit_table_node(table, *bucket - 1) : NULL;
+}
+
+git_commit_list_node *git_commit_table_lookup(
+	git_commit_table *table, const git_oid *oid)
+{
+	git_commit_list_node *commit;
+	uint32_t *bucket = commit_table_bucket(table, oid);
+
+	if (*bucket)
+		return git_commit_table_node(table, *bucket - 1);
+
+	if (table->length == UINT32_MAX - 1) {
+		giterr_set(GITERR_NOMEMORY, "Too many commits in the walk");
+		return NULL;
+	}
+
+	/* keep the load factor of the hash at most one half */
+	if ((table->length + 1) > (table->bucket_mask + 1) / 2) {
+		if (commit_table_grow_buckets(table) < 0)
+			return NULL;
+		bucket = commit_table_bucket(table, oid);
+	}
+
+	if ((table->length >> GIT_COMMIT_TABLE_CHUNK_BITS) == table->chunks &&
+		commit_table_grow_chunks(table) < 0)
+		return NULL;
+
+	commit = git_commit_table_node(table, table->length);
+	memset(commit, 0, sizeof(*commit));
+	commit->index = table->length++;
+
+	git_oid_cpy(&table->oids[commit->index >> GIT_COMMIT_TABLE_CHUNK_BITS]
+		[commit->index & GIT_COMMIT_TABLE_CHUNK_MASK], oid);
+
+	*bucket = commit->index + 1;
+	return commit;
+}
+
+int git_commit_table_add_parent(
+	git_commit_table *table,
+	git_commit_list_node *commit,
+	git_commit_list_node *parent)
+{
+	uint32_t *slot;
+
+	if (commit->out_degree == USHRT_MAX) {
+		giterr_set(GITERR_INVALID, "Commit has too many parents");
+		return -1;
+	}
+
+	if (!commit->out_degree)
+		commit->parents = git_array_size(table->parent_indices);
+
+	assert(commit->parents + commit->out_degree ==
+		git_array_size(table->parent_indices));
 
-	return (git_commit_list_node **)git_pool_malloc(
-		&walk->commit_pool, (uint32_t)(n_parents * sizeof(git_commit_list_node *)));
+	slot = git_array_alloc(table->parent_indices);
+	GITERR_CHECK_ALLOC(slot);
+
+	*slot = parent->index;
+	commit->out_degree++;
+	return 0;
 }
 
+size_t git_commit_table_memsize(const git_commit_table *table)
+{
+	return table->chunks * GIT_COMMIT_TABLE_CHUNK_SIZE *
+			(sizeof(git_commit_list_node) + sizeof(git_oid)) +
+		table->chunks_alloc * (sizeof(*table->nodes) + sizeof(*table->oids)) +
+		(table->bucket_mask + 1) * sizeof(uint32_t) +
+		table->parent_indices.asize * sizeof(uint32_t);
+}
+
+typedef struct {
+	const uint8_t *parents;
+	unsigned short parent_count;
+	uint32_t time;
+} commit_quick_info;
+
+static int commit_error(
+	git_revwalk *walk, git_commit_list_node *commit, const char *msg)
+{
+	char commit_oid[GIT_OID_HEXSZ + 1];
+	git_oid_fmt(commit_oid, git_revwalk__commit_oid(walk, commit));
+	commit_oid[GIT_OID_HEXSZ] = '\0';
+
+	giterr_set(GITERR_ODB, "Failed to parse commit %s - %s", commit_oid, msg);
+
+	return -1;
+}
 
 void git_commit_list_free(git_commit_list **list_p)
 {
@@ -100,52 +300,39 @@ git_commit_list_node *git_commit_list_pop(git_commit_list **stack)
 	return item;
 }
 
-static int commit_quick_parse(
-	git_revwalk *walk,
-	git_commit_list_node *commit,
-	const uint8_t *buffer,
-	size_t buffer_len)
+/*
+ * Find the parents and the time of a raw commit.  This only looks at
+ * the buffer, so prefetch workers can do it off the walking thread.
+ */
+static const char *commit_quick_scan(
+	commit_quick_info *out, const uint8_t *buffer, size_t buffer_len)
 {
 	const size_t parent_len = strlen("parent ") + GIT_OID_HEXSZ + 1;
 	const uint8_t *buffer_end = buffer + buffer_len;
-	const uint8_t *parents_start, *committer_start;
-	int i, parents = 0;
+	const uint8_t *committer_start;
+	size_t parents = 0;
 	int commit_time;
 
 	buffer += strlen("tree ") + GIT_OID_HEXSZ + 1;
 
-	parents_start = buffer;
+	out->parents = buffer;
 	while (buffer + parent_len < buffer_end && memcmp(buffer, "parent ", strlen("parent ")) == 0) {
 		parents++;
 		buffer += parent_len;
 	}
 
-	commit->parents = alloc_parents(walk, commit, parents);
-	GITERR_CHECK_ALLOC(commit->parents);
-
-	buffer = parents_start;
-	for (i = 0; i < parents; ++i) {
-		git_oid oid;
-
-		if (git_oid_fromstr(&oid, (const char *)buffer + strlen("parent ")) < 0)
-			return -1;
-
-		commit->parents[i] = git_revwalk__commit_lookup(walk, &oid);
-		if (commit->parents[i] == NULL)
-			return -1;
-
-		buffer += parent_len;
-	}
+	if (parents > USHRT_MAX)
+		return "too many parents";
 
-	commit->out_degree = (unsigned short)parents;
+	out->parent_count = (unsigned short)parents;
 
 	if ((committer_start = buffer = memchr(buffer, '\n', buffer_end - buffer)) == NULL)
-		return commit_error(commit, "object is corrupted");
+		return "object is corrupted";
 
 	buffer++;
 
 	if ((buffer = memchr(buffer, '\n', buffer_end - buffer)) == NULL)
-		return commit_error(commit, "object is corrupted");
+		return "object is corrupted";
 
 	/* Skip trailing spaces */
 	while (buffer > committer_start && git__isspace(*buffer))
@@ -167,34 +354,538 @@ static int commit_quick_parse(
 	}
 
 	if ((buffer == committer_start) || (git__strtol32(&commit_time, (char *)(buffer + 1), NULL, 10) < 0))
-		return commit_error(commit, "cannot parse commit time");
+		return "cannot parse commit time";
+
+	out->time = (uint32_t)commit_time;
+	return NULL;
+}
+
+static int commit_quick_apply(
+	git_revwalk *walk,
+	git_commit_list_node *commit,
+	const commit_quick_info *info)
+{
+	const size_t parent_len = strlen("parent ") + GIT_OID_HEXSZ + 1;
+	const uint8_t *buffer = info->parents;
+	unsigned short i;
+
+	commit->out_degree = 0;
+
+	for (i = 0; i < info->parent_count; ++i) {
+		git_commit_list_node *parent;
+		git_oid oid;
+
+		if (git_oid_fromstr(&oid, (const char *)buffer + strlen("parent ")) < 0)
+			return -1;
+
+		if ((parent = git_revwalk__commit_lookup(walk, &oid)) == NULL ||
+			git_commit_table_add_parent(&walk->commits, commit, parent) < 0)
+			return -1;
+
+		buffer += parent_len;
+	}
+
+	/*
+	 * Without a commit-graph we cannot know the generation of a commit
+	 * with parents short of walking all of its history.
+	 */
+	commit->generation = info->parent_count ? GIT_COMMIT_GENERATION_INFINITY : 1;
+
+	commit->time = info->time;
+	commit->parsed = 1;
+	return 0;
+}
+
+static int commit_quick_parse(
+	git_revwalk *walk, git_commit_list_node *commit, git_odb_object *obj)
+{
+	commit_quick_info info;
+	const char *msg;
+
+	if (obj->cached.type != GIT_OBJ_COMMIT) {
+		giterr_set(GITERR_INVALID, "Object is no commit object");
+		return -1;
+	}
+
+	if ((msg = commit_quick_scan(&info,
+			(const uint8_t *)git_odb_object_data(obj),
+			git_odb_object_size(obj))) != NULL)
+		return commit_error(walk, commit, msg);
+
+	return commit_quick_apply(walk, commit, &info);
+}
+
+static int commit_graph_parse(
+	git_revwalk *walk,
+	git_commit_list_node *commit,
+	const git_commit_graph_entry *entry)
+{
+	size_t i;
+	uint32_t position;
+
+	commit->out_degree = 0;
 
-	commit->time = (time_t)commit_time;
+	for (i = 0; i < entry->parent_count; ++i) {
+		git_commit_list_node *parent;
+
+		if (git_commit_graph_entry_parent_position(
+				&position, walk->cgraph, entry, i) < 0)
+			return -1;
+
+		if ((parent = git_revwalk__commit_lookup(walk,
+				git_commit_graph_oid_at(walk->cgraph, position))) == NULL ||
+			git_commit_table_add_parent(&walk->commits, commit, parent) < 0)
+			return -1;
+	}
+
+	commit->time = (uint32_t)entry->commit_time;
+	commit->generation = entry->generation;
 	commit->parsed = 1;
 	return 0;
 }
 
+#ifdef GIT_THREADS
+
+/*
+ * How many commits each prefetch thread may have read (or be reading)
+ * ahead of the walk.
+ */
+#define PREFETCH_WINDOW_PER_THREAD 64
+
+enum {
+	PREFETCH_QUEUED = 0,
+	PREFETCH_READING,
+	PREFETCH_DONE,
+	PREFETCH_FAILED,
+	PREFETCH_CLAIMED,
+};
+
+typedef struct {
+	git_oid oid;
+	uint32_t time;
+	int state;
+	git_odb_object *obj;
+	commit_quick_info info;
+} prefetch_item;
+
+/*
+ * Everything here is protected by `lock`.  An item is in `items` until
+ * the walk takes it, and in `queue` until a worker picks it up; an item
+ * the walk claims while it is still queued is freed by the worker that
+ * pops it.
+ */
+struct git_commit_prefetch {
+	git_odb *odb;
+	git_commit_graph_file *cgraph;
+	git_thread *threads;
+	unsigned int nthreads;
+
+	git_mutex lock;
+	git_cond work_cond;
+	git_cond done_cond;
+	int shutdown;
+
+	/* items waiting for a worker, the parents of the newest commits first */
+	git_pqueue queue;
+	git_oidmap *items;
+
+	/* items queued, being read or read, and not taken by the walk yet */
+	size_t ahead, window;
+	size_t taken_since_sweep;
+};
+
+static int prefetch_item_cmp(void *a, void *b)
+{
+	return (((prefetch_item *)a)->time < ((prefetch_item *)b)->time);
+}
+
+static void prefetch_item_free(prefetch_item *item)
+{
+	git_odb_object_free(item->obj);
+	git__free(item);
+}
+
+/* Queue `oid` to be read, unless it is already known. */
+static int prefetch_queue(
+	git_commit_prefetch *prefetch, const git_oid *oid, uint32_t time)
+{
+	git_commit_graph_entry entry;
+	prefetch_item *item;
+	khiter_t pos;
+	int ret;
+
+	if (kh_get(oid, prefetch->items, oid) != kh_end(prefetch->items))
+		return 0;
+
+	/* the commit-graph already makes these cheap to parse */
+	if (prefetch->cgraph &&
+		git_commit_graph_entry_find(&entry, prefetch->cgraph, oid) == 0)
+		return 0;
+
+	if ((item = git__calloc(1, sizeof(prefetch_item))) == NULL)
+		return -1;
+
+	git_oid_cpy(&item->oid, oid);
+	item->time = time;
+
+	pos = kh_put(oid, prefetch->items, &item->oid, &ret);
+	if (ret < 0) {
+		git__free(item);
+		return -1;
+	}
+
+	kh_value(prefetch->items, pos) = item;
+
+	if (git_pqueue_insert(&prefetch->queue, item) < 0) {
+		kh_del(oid, prefetch->items, pos);
+		git__free(item);
+		return -1;
+	}
+
+	prefetch->ahead++;
+	return 1;
+}
+
+/*
+ * Queue the parents of a commit a worker has just read, so that the
+ * workers can run ahead of the walk down a line of history, as long as
+ * the walk has not fallen too far behind.
+ */
+static void prefetch_follow(git_commit_prefetch *prefetch, prefetch_item *item)
+{
+	const size_t parent_len = strlen("parent ") + GIT_OID_HEXSZ + 1;
+	const uint8_t *buffer = item->info.parents;
+	unsigned short i;
+	git_oid oid;
+
+	for (i = 0; i < item->info.parent_count; ++i, buffer += parent_len) {
+		if (prefetch->ahead >= prefetch->window)
+			break;
+
+		if (git_oid_fromstr(&oid, (const char *)buffer + strlen("parent ")) < 0 ||
+			prefetch_queue(prefetch, &oid, item->info.time) < 0)
+			break;
+	}
+}
+
+static void *prefetch_worker(void *arg)
+{
+	git_commit_prefetch *prefetch = arg;
+	prefetch_item *item;
+	git_odb_object *obj;
+	int state;
+
+	git_mutex_lock(&prefetch->lock);
+
+	while (!prefetch->shutdown) {
+		if ((item = git_pqueue_pop(&prefetch->queue)) == NULL) {
+			git_cond_wait(&prefetch->work_cond, &prefetch->lock);
+			continue;
+		}
+
+		if (item->state == PREFETCH_CLAIMED) {
+			git__free(item);
+			continue;
+		}
+
+		item->state = PREFETCH_READING;
+		git_mutex_unlock(&prefetch->lock);
+
+		/* errors are reported when the walk reads the commit itself */
+		state = PREFETCH_FAILED;
+		if (git_odb_read(&obj, prefetch->odb, &item->oid) == 0) {
+			if (obj->cached.type == GIT_OBJ_COMMIT &&
+				commit_quick_scan(&item->info,
+					(const uint8_t *)git_odb_object_data(obj),
+					git_odb_object_size(obj)) == NULL) {
+				item->obj = obj;
+				state = PREFETCH_DONE;
+			} else
+				git_odb_object_free(obj);
+		}
+
+		git_mutex_lock(&prefetch->lock);
+		item->state = state;
+		git_cond_broadcast(&prefetch->done_cond);
+
+		if (state == PREFETCH_DONE) {
+			prefetch_follow(prefetch, item);
+			git_cond_broadcast(&prefetch->work_cond);
+		}
+	}
+
+	git_mutex_unlock(&prefetch->lock);
+	return NULL;
+}
+
+/*
+ * Workers follow the history without knowing what the walk has already
+ * parsed (say, where two lines of history meet), so some of what they
+ * read is never taken.  Drop that, lest it fill the window.
+ */
+static void prefetch_sweep(git_revwalk *walk, git_commit_prefetch *prefetch)
+{
+	git_commit_list_node *commit;
+	prefetch_item *item;
+	khiter_t pos;
+
+	for (pos = kh_begin(prefetch->items); pos != kh_end(prefetch->items); ++pos) {
+		if (!kh_exist(prefetch->items, pos))
+			continue;
+
+		item = kh_value(prefetch->items, pos);
+		if (item->state != PREFETCH_DONE && item->state != PREFETCH_FAILED)
+			continue;
+
+		commit = git_commit_table_find(&walk->commits, &item->oid);
+		if (commit && commit->parsed) {
+			kh_del(oid, prefetch->items, pos);
+			prefetch_item_free(item);
+			prefetch->ahead--;
+		}
+	}
+
+	prefetch->taken_since_sweep = 0;
+}
+
+void git_commit_prefetch_stop(git_revwalk *walk)
+{
+	git_commit_prefetch *prefetch = walk->prefetch;
+	prefetch_item *item;
+	unsigned int i;
+
+	if (!prefetch)
+		return;
+
+	git_mutex_lock(&prefetch->lock);
+	prefetch->shutdown = 1;
+	git_cond_broadcast(&prefetch->work_cond);
+	git_mutex_unlock(&prefetch->lock);
+
+	for (i = 0; i < prefetch->nthreads; ++i)
+		git_thread_join(prefetch->threads[i], NULL);
+
+	/* queued items are in both; the others only in `items` */
+	while ((item = git_pqueue_pop(&prefetch->queue)) != NULL) {
+		if (item->state == PREFETCH_QUEUED)
+			kh_del(oid, prefetch->items,
+				kh_get(oid, prefetch->items, &item->oid));
+		prefetch_item_free(item);
+	}
+
+	if (prefetch->items) {
+		kh_foreach_value(prefetch->items, item, {
+			prefetch_item_free(item);
+		});
+		git_oidmap_free(prefetch->items);
+	}
+
+	git_pqueue_free(&prefetch->queue);
+	git_cond_free(&prefetch->done_cond);
+	git_cond_free(&prefetch->work_cond);
+	git_mutex_free(&prefetch->lock);
+	git__free(prefetch->threads);
+	git__free(prefetch);
+
+	walk->prefetch = NULL;
+}
+
+int git_commit_prefetch_start(git_revwalk *walk)
+{
+	git_commit_prefetch *prefetch;
+
+	if (walk->prefetch || !walk->prefetch_threads)
+		return 0;
+
+	prefetch = git__calloc(1, sizeof(git_commit_prefetch));
+	GITERR_CHECK_ALLOC(prefetch);
+
+	prefetch->odb = walk->odb;
+	prefetch->cgraph = walk->cgraph;
+	prefetch->window = walk->prefetch_threads * PREFETCH_WINDOW_PER_THREAD;
+
+	if (git_mutex_init(&prefetch->lock) ||
+		git_cond_init(&prefetch->work_cond) ||
+		git_cond_init(&prefetch->done_cond)) {
+		giterr_set(GITERR_THREAD, "Unable to initialize the prefetch lock");
+		git__free(prefetch);
+		return -1;
+	}
+
+	walk->prefetch = prefetch;
+
+	if (git_pqueue_init(&prefetch->queue, prefetch->window, prefetch_item_cmp) < 0 ||
+		(prefetch->items = git_oidmap_alloc()) == NULL ||
+		(prefetch->threads = git__calloc(
+			walk->prefetch_threads, sizeof(git_thread))) == NULL)
+		goto on_error;
+
+	for (; prefetch->nthreads < walk->prefetch_threads; prefetch->nthreads++) {
+		if (git_thread_create(&prefetch->threads[prefetch->nthreads],
+				NULL, prefetch_worker, prefetch) != 0) {
+			giterr_set(GITERR_THREAD, "Unable to create prefetch thread");
+			goto on_error;
+		}
+	}
+
+	return 0;
+
+on_error:
+	git_commit_prefetch_stop(walk);
+	return -1;
+}
+
+int git_commit_list_prefetch_parents(
+	git_revwalk *walk, git_commit_list_node *commit)
+{
+	git_commit_prefetch *prefetch = walk->prefetch;
+	git_commit_list_node *parent;
+	unsigned short i;
+	int error = 0, queued = 0;
+
+	if (!prefetch)
+		return 0;
+
+	git_mutex_lock(&prefetch->lock);
+
+	if (prefetch->ahead >= prefetch->window &&
+		prefetch->taken_since_sweep >= prefetch->window)
+		prefetch_sweep(walk, prefetch);
+
+	for (i = 0; i < commit->out_degree; ++i) {
+		parent = git_revwalk__commit_parent(walk, commit, i);
+
+		if (parent->parsed)
+			continue;
+
+		if ((error = prefetch_queue(prefetch,
+				git_revwalk__commit_oid(walk, parent), commit->time)) < 0)
+			break;
+
+		queued += error;
+		error = 0;
+	}
+
+	if (queued)
+		git_cond_broadcast(&prefetch->work_cond);
+
+	git_mutex_unlock(&prefetch->lock);
+
+	if (error < 0)
+		giterr_set_oom();
+
+	return error;
+}
+
+/*
+ * Take the object a worker read for `commit`, waiting for the worker
+ * if it is reading it right now.  Returns 0 if there is none, in which
+ * case the commit must be read as usual.
+ */
+static int prefetch_take(
+	git_odb_object **obj,
+	commit_quick_info *info,
+	git_commit_prefetch *prefetch,
+	const git_oid *oid)
+{
+	prefetch_item *item;
+	khiter_t pos;
+	int found = 0;
+
+	*obj = NULL;
+
+	git_mutex_lock(&prefetch->lock);
+
+	pos = kh_get(oid, prefetch->items, oid);
+	if (pos == kh_end(prefetch->items)) {
+		git_mutex_unlock(&prefetch->lock);
+		return 0;
+	}
+
+	item = kh_value(prefetch->items, pos);
+
+	while (item->state == PREFETCH_READING)
+		git_cond_wait(&prefetch->done_cond, &prefetch->lock);
+
+	/* the waiting may have changed the map */
+	kh_del(oid, prefetch->items, kh_get(oid, prefetch->items, oid));
+	prefetch->ahead--;
+	prefetch->taken_since_sweep++;
+
+	if (item->state == PREFETCH_QUEUED) {
+		/* the worker that pops it frees it */
+		item->state = PREFETCH_CLAIMED;
+	} else {
+		if (item->state == PREFETCH_DONE) {
+			*obj = item->obj;
+			*info = item->info;
+			item->obj = NULL;
+			found = 1;
+		}
+
+		prefetch_item_free(item);
+	}
+
+	git_mutex_unlock(&prefetch->lock);
+	return found;
+}
+
+#else
+
+void git_commit_prefetch_stop(git_revwalk *walk)
+{
+	GIT_UNUSED(walk);
+}
+
+int git_commit_prefetch_start(git_revwalk *walk)
+{
+	GIT_UNUSED(walk);
+	return 0;
+}
+
+int git_commit_list_prefetch_parents(
+	git_revwalk *walk, git_commit_list_node *commit)
+{
+	GIT_UNUSED(walk);
+	GIT_UNUSED(commit);
+	return 0;
+}
+
+#endif /* GIT_THREADS */
+
 int git_commit_list_parse(git_revwalk *walk, git_commit_list_node *commit)
 {
 	git_odb_object *obj;
+	git_commit_graph_entry entry;
 	int error;
 
 	if (commit->parsed)
 		return 0;
 
-	if ((error = git_odb_read(&obj, walk->odb, &commit->oid)) < 0)
+	if (walk->cgraph &&
+		git_commit_graph_entry_find(&entry, walk->cgraph,
+			git_revwalk__commit_oid(walk, commit)) == 0)
+		return commit_graph_parse(walk, commit, &entry);
+
+#ifdef GIT_THREADS
+	if (walk->prefetch) {
+		commit_quick_info info;
+
+		if (prefetch_take(&obj, &info, walk->prefetch,
+				git_revwalk__commit_oid(walk, commit))) {
+			error = commit_quick_apply(walk, commit, &info);
+			git_odb_object_free(obj);
+			return error;
+		}
+	}
+#endif
+
+	if ((error = git_odb_read(
+			&obj, walk->odb, git_revwalk__commit_oid(walk, commit))) < 0)
 		return error;
 
-	if (obj->cached.type != GIT_OBJ_COMMIT) {
-		giterr_set(GITERR_INVALID, "Object is no commit object");
-		error = -1;
-	} else
-		error = commit_quick_parse(
-			walk, commit,
-			(const uint8_t *)git_odb_object_data(obj),
-			git_odb_object_size(obj));
+	error = commit_quick_parse(walk, commit, obj);
 
 	git_odb_object_free(obj);
 	return error;
 }
-
@@ -8,42 +8,133 @@
 #define INCLUDE_commit_list_h__
 
 #include "git2/oid.h"
+#include "array.h"
 
 #define PARENT1  (1 << 0)
 #define PARENT2  (1 << 1)
 #define RESULT   (1 << 2)
 #define STALE    (1 << 3)
 
-#define PARENTS_PER_COMMIT	2
-#define COMMIT_ALLOC \
-	(sizeof(git_commit_list_node) + PARENTS_PER_COMMIT * sizeof(git_commit_list_node *))
-
+/*
+ * Commit nodes are identified by their 32-bit index in the walk's
+ * `git_commit_table`; their id and their parents live in side tables
+ * there, so that a node itself stays small.
+ */
 typedef struct git_commit_list_node {
-	git_oid oid;
+	uint32_t index;
 	uint32_t time;
+	uint32_t generation;
+
+	/* offset of the first parent's index in the table's parent arena */
+	uint32_t parents;
+
 	unsigned int seen:1,
 			 uninteresting:1,
 			 topo_delay:1,
 			 parsed:1,
+			 topo_explored:1,
+			 topo_indegree:1,
+			 queued_interesting:1,
 			 flags : 4;
 
 	unsigned short in_degree;
 	unsigned short out_degree;
-
-	struct git_commit_list_node **parents;
 } git_commit_list_node;
 
+#define GIT_COMMIT_TABLE_CHUNK_BITS 12
+#define GIT_COMMIT_TABLE_CHUNK_SIZE (1u << GIT_COMMIT_TABLE_CHUNK_BITS)
+#define GIT_COMMIT_TABLE_CHUNK_MASK (GIT_COMMIT_TABLE_CHUNK_SIZE - 1)
+
+/*
+ * All the commit nodes of a walk.  Nodes and their ids are allocated in
+ * fixed-size chunks so that pointers to them remain valid as the table
+ * grows; nodes are found by id through an open-addressing hash of their
+ * indices, and the parents of every node are stored as indices in a
+ * single arena.
+ */
+typedef struct {
+	git_commit_list_node **nodes;
+	git_oid **oids;
+	size_t chunks, chunks_alloc;
+	uint32_t length;
+
+	uint32_t *buckets;
+	uint32_t bucket_mask;
+
+	git_array_t(uint32_t) parent_indices;
+} git_commit_table;
+
+GIT_INLINE(git_commit_list_node *) git_commit_table_node(
+	const git_commit_table *table, uint32_t index)
+{
+	return &table->nodes[index >> GIT_COMMIT_TABLE_CHUNK_BITS]
+		[index & GIT_COMMIT_TABLE_CHUNK_MASK];
+}
+
+GIT_INLINE(const git_oid *) git_commit_table_oid(
+	const git_commit_table *table, const git_commit_list_node *commit)
+{
+	return &table->oids[commit->index >> GIT_COMMIT_TABLE_CHUNK_BITS]
+		[commit->index & GIT_COMMIT_TABLE_CHUNK_MASK];
+}
+
+GIT_INLINE(git_commit_list_node *) git_commit_table_parent(
+	const git_commit_table *table,
+	const git_commit_list_node *commit,
+	unsigned short n)
+{
+	assert(n < commit->out_degree);
+	return git_commit_table_node(
+		table, table->parent_indices.ptr[commit->parents + n]);
+}
+
+int git_commit_table_init(git_commit_table *table);
+void git_commit_table_free(git_commit_table *table);
+
+/* Find the node for `oid`, or NULL if there is none. */
+git_commit_list_node *git_commit_table_find(
+	const git_commit_table *table, const git_oid *oid);
+
+/* Find the node for `oid`, adding an unparsed one if there is none. */
+git_commit_list_node *git_commit_table_lookup(
+	git_commit_table *table, const git_oid *oid);
+
+/*
+ * Append `parent` to the parents of `commit`.  The parents of a commit
+ * must be added one after the other, with no other commit's in between.
+ */
+int git_commit_table_add_parent(
+	git_commit_table *table,
+	git_commit_list_node *commit,
+	git_commit_list_node *parent);
+
+/* Number of bytes allocated by the table. */
+size_t git_commit_table_memsize(const git_commit_table *table);
+
 typedef struct git_commit_list {
 	git_commit_list_node *item;
 	struct git_commit_list *next;
 } git_commit_list;
 
-git_commit_list_node *git_commit_list_alloc_node(git_revwalk *walk);
 int git_commit_list_time_cmp(void *a, void *b);
+int git_commit_list_generation_cmp(void *a, void *b);
 void git_commit_list_free(git_commit_list **list_p);
 git_commit_list *git_commit_list_insert(git_commit_list_node *item, git_commit_list **list_p);
 git_commit_list *git_commit_list_insert_by_date(git_commit_list_node *item, git_commit_list **list_p);
 int git_commit_list_parse(git_revwalk *walk, git_commit_list_node *commit);
+
+/*
+ * Optional prefetching of commits on worker threads (see
+ * `git_revwalk_set_prefetch_threads`).  The parents of the commits that
+ * enter the walk's frontier are read and scanned ahead of the walk, the
+ * newest first, and `git_commit_list_parse` picks them up from there.
+ */
+typedef struct git_commit_prefetch git_commit_prefetch;
+
+int git_commit_prefetch_start(git_revwalk *walk);
+void git_commit_prefetch_stop(git_revwalk *walk);
+int git_commit_list_prefetch_parents(
+	git_revwalk *walk, git_commit_list_node *commit);
 git_commit_list_node *git_commit_list_pop(git_commit_list **stack);
 
 #endif
@@ -0,0 +1,703 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "buffer.h"
+#include "fnmatch.h"
+#include "pool.h"
+#include "refs.h"
+#include "repository.h"
+#include "revwalk.h"
+
+#include "git2/commit.h"
+#include "git2/describe.h"
+#include "git2/object.h"
+#include "git2/odb.h"
+#include "git2/revparse.h"
+#include "git2/diff.h"
+#include "git2/status.h"
+#include "git2/tag.h"
+
+/*
+ * The candidate tags are tracked with one bit each in the flags of the
+ * commits reachable from them; bit 0 is used to mark the commits that
+ * have been queued.
+ */
+#define DESCRIBE_SEEN (1u << 0)
+#define DESCRIBE_MAX_CANDIDATES 30
+
+struct git_describe_result {
+	int dirty;
+	int exact_match;
+	int fallback_to_id;
+	git_oid commit_id;
+	git_repository *repo;
+	char *name;
+	size_t depth;
+};
+
+/* A reference that can describe the commit it points to. */
+typedef struct {
+	git_oid peeled;
+	git_oid sha1;
+	const char *path;
+	int prio; /* annotated tag = 2, tag = 1, anything else = 0 */
+	git_tag *tag;
+} commit_name;
+
+typedef struct {
+	commit_name *name;
+	size_t depth;
+	unsigned int found_order;
+	uint32_t flag_within;
+} possible_tag;
+
+typedef struct {
+	git_commit_list_node *commit;
+	uint32_t flags;
+} describe_node;
+
+typedef struct {
+	git_repository *repo;
+	git_describe_options opts;
+
+	/* peeled commit id -> commit_name */
+	git_oidmap *names;
+	git_pool name_pool;
+	git_pool path_pool;
+
+	git_revwalk *walk;
+	git_oidmap *nodes;
+	git_pool node_pool;
+	git_pqueue queue;
+} describe_state;
+
+static int describe_node_cmp(void *a, void *b)
+{
+	return git_commit_list_time_cmp(
+		((describe_node *)a)->commit, ((describe_node *)b)->commit);
+}
+
+static commit_name *find_name(describe_state *state, const git_oid *oid)
+{
+	khiter_t pos = kh_get(oid, state->names, oid);
+
+	if (pos == kh_end(state->names))
+		return NULL;
+
+	return kh_value(state->names, pos);
+}
+
+static git_time_t tag_time(describe_state *state, commit_name *name)
+{
+	const git_signature *tagger;
+
+	if (!name->tag &&
+		git_tag_lookup(&name->tag, state->repo, &name->sha1) < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	tagger = git_tag_tagger(name->tag);
+	return tagger ? tagger->when.time : 0;
+}
+
+/*
+ * Pick the best name for a commit with several references: annotated
+ * tags over lightweight ones over everything else, then the newest
+ * annotated tag, then the first name in sorted order like git does.
+ */
+static int replace_name(
+	describe_state *state, commit_name *existing, commit_name *candidate)
+{
+	if (existing->prio != candidate->prio)
+		return (existing->prio < candidate->prio);
+
+	if (candidate->prio == 2) {
+		git_time_t existing_time = tag_time(state, existing);
+		git_time_t candidate_time = tag_time(state, candidate);
+
+		if (existing_time != candidate_time)
+			return (existing_time < candidate_time);
+	}
+
+	return (strcmp(candidate->path, existing->path) < 0);
+}
+
+static int add_name(
+	describe_state *state,
+	const git_oid *peeled,
+	const git_oid *sha1,
+	const char *path,
+	int prio)
+{
+	commit_name *name, *existing;
+	khiter_t pos;
+	int error;
+
+	name = git_pool_mallocz(&state->name_pool, 1);
+	GITERR_CHECK_ALLOC(name);
+
+	git_oid_cpy(&name->peeled, peeled);
+	git_oid_cpy(&name->sha1, sha1);
+	name->prio = prio;
+	name->path = git_pool_strdup(&state->path_pool, path);
+	GITERR_CHECK_ALLOC(name->path);
+
+	if ((existing = find_name(state, peeled)) != NULL) {
+		if (!replace_name(state, existing, name)) {
+			git_tag_free(name->tag);
+			return 0;
+		}
+
+		git_tag_free(existing->tag);
+		existing->tag = NULL;
+	}
+
+	pos = kh_put(oid, state->names, &name->peeled, &error);
+	if (error < 0)
+		return -1;
+
+	kh_key(state->names, pos) = &name->peeled;
+	kh_value(state->names, pos) = name;
+	return 0;
+}
+
+/*
+ * Index the references by the commit they point to.  Packed tags carry
+ * their peeled target, so only loose ones need their object read.
+ */
+static int get_name(describe_state *state, git_odb *odb, git_reference *ref)
+{
+	const char *refname = git_reference_name(ref);
+	const git_oid *target, *peel;
+	git_oid peeled;
+	git_otype type;
+	size_t len;
+	int is_tag, is_annotated, error;
+
+	if (git_reference_type(ref) != GIT_REF_OID)
+		return 0;
+
+	is_tag = !git__prefixcmp(refname, GIT_REFS_TAGS_DIR);
+
+	if (!is_tag && state->opts.describe_strategy != GIT_DESCRIBE_ALL)
+		return 0;
+
+	if (state->opts.pattern && (!is_tag || p_fnmatch(state->opts.pattern,
+			refname + strlen(GIT_REFS_TAGS_DIR), 0) != 0))
+		return 0;
+
+	target = git_reference_target(ref);
+	peel = git_reference_target_peel(ref);
+
+	if (peel && !git_oid_iszero(peel)) {
+		is_annotated = 1;
+		git_oid_cpy(&peeled, peel);
+	} else {
+		if ((error = git_odb_read_header(&len, &type, odb, target)) < 0)
+			return error;
+
+		is_annotated = (type == GIT_OBJ_TAG);
+
+		if (is_annotated) {
+			git_tag *tag;
+			git_object *obj;
+
+			if ((error = git_tag_lookup(&tag, state->repo, target)) < 0)
+				return error;
+
+			error = git_tag_peel(&obj, tag);
+			git_tag_free(tag);
+
+			if (error < 0)
+				return error;
+
+			type = git_object_type(obj);
+			git_oid_cpy(&peeled, git_object_id(obj));
+			git_object_free(obj);
+		} else {
+			git_oid_cpy(&peeled, target);
+		}
+
+		/* only commits can be described */
+		if (type != GIT_OBJ_COMMIT)
+			return 0;
+	}
+
+	if (!is_annotated && state->opts.describe_strategy == GIT_DESCRIBE_DEFAULT)
+		return 0;
+
+	return add_name(state, &peeled, target,
+		state->opts.describe_strategy == GIT_DESCRIBE_ALL ?
+			refname + strlen(GIT_REFS_DIR) :
+			refname + strlen(GIT_REFS_TAGS_DIR),
+		is_annotated ? 2 : is_tag);
+}
+
+static int load_names(describe_state *state)
+{
+	git_reference_iterator *iter;
+	git_reference *ref;
+	git_odb *odb;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, state->repo)) < 0 ||
+		(error = git_reference_iterator_new(&iter, state->repo)) < 0)
+		return error;
+
+	while ((error = git_reference_next(&ref, iter)) == 0) {
+		error = get_name(state, odb, ref);
+		git_reference_free(ref);
+
+		if (error < 0)
+			break;
+	}
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+	git_reference_iterator_free(iter);
+	return error;
+}
+
+static describe_node *node_lookup(describe_state *state, const git_oid *oid)
+{
+	git_commit_list_node *commit;
+	describe_node *node;
+	khiter_t pos;
+	int ret;
+
+	pos = kh_get(oid, state->nodes, oid);
+	if (pos != kh_end(state->nodes))
+		return kh_value(state->nodes, pos);
+
+	if ((commit = git_revwalk__commit_lookup(state->walk, oid)) == NULL ||
+		git_commit_list_parse(state->walk, commit) < 0)
+		return NULL;
+
+	if ((node = git_pool_mallocz(&state->node_pool, 1)) == NULL)
+		return NULL;
+
+	node->commit = commit;
+
+	pos = kh_put(oid, state->nodes,
+		git_revwalk__commit_oid(state->walk, commit), &ret);
+	assert(ret != 0);
+	kh_value(state->nodes, pos) = node;
+
+	return node;
+}
+
+/* Queue the parents of `node`, which are reachable from what it is. */
+static int queue_parents(describe_state *state, describe_node *node)
+{
+	describe_node *parent;
+	unsigned short i;
+
+	for (i = 0; i < node->commit->out_degree; i++) {
+		if ((parent = node_lookup(state, git_revwalk__commit_oid(state->walk,
+				git_revwalk__commit_parent(state->walk, node->commit, i)))) == NULL)
+			return -1;
+
+		if (!(parent->flags & DESCRIBE_SEEN) &&
+			git_pqueue_insert(&state->queue, parent) < 0)
+			return -1;
+
+		parent->flags |= node->flags;
+
+		if (state->opts.only_follow_first_parent)
+			break;
+	}
+
+	return 0;
+}
+
+static int compare_pt(const void *a_, const void *b_, void *payload)
+{
+	const possible_tag *a = a_, *b = b_;
+
+	GIT_UNUSED(payload);
+
+	if (a->depth != b->depth)
+		return (a->depth < b->depth) ? -1 : 1;
+	if (a->found_order != b->found_order)
+		return (a->found_order < b->found_order) ? -1 : 1;
+	return 0;
+}
+
+static int all_queued_within(describe_state *state, uint32_t flag)
+{
+	size_t i;
+
+	/* element 0 isn't used - we need to start at 1 */
+	for (i = 1; i < state->queue.size; i++) {
+		describe_node *node = state->queue.d[i];
+		if (!(node->flags & flag))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Keep walking until everything left is reachable from the best tag,
+ * counting the commits it cannot reach.
+ */
+static int finish_depth_computation(describe_state *state, possible_tag *best)
+{
+	describe_node *node;
+
+	while ((node = git_pqueue_pop(&state->queue)) != NULL) {
+		if (node->flags & best->flag_within) {
+			if (all_queued_within(state, best->flag_within))
+				break;
+		} else
+			best->depth++;
+
+		if (queue_parents(state, node) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int describe(
+	git_describe_result *result,
+	describe_state *state,
+	const git_oid *oid)
+{
+	possible_tag all_matches[DESCRIBE_MAX_CANDIDATES];
+	unsigned int match_cnt = 0, annotated_cnt = 0, cur, max_candidates;
+	describe_node *node, *gave_up_on = NULL;
+	commit_name *name;
+	size_t seen_commits = 0;
+
+	max_candidates = state->opts.max_candidates_tags;
+	if (max_candidates > DESCRIBE_MAX_CANDIDATES)
+		max_candidates = DESCRIBE_MAX_CANDIDATES;
+
+	if ((name = find_name(state, oid)) != NULL) {
+		result->exact_match = 1;
+		result->name = git__strdup(name->path);
+		GITERR_CHECK_ALLOC(result->name);
+		return 0;
+	}
+
+	if (!max_candidates)
+		goto not_found;
+
+	if ((node = node_lookup(state, oid)) == NULL)
+		return -1;
+
+	node->flags = DESCRIBE_SEEN;
+	if (git_pqueue_insert(&state->queue, node) < 0)
+		return -1;
+
+	while ((node = git_pqueue_pop(&state->queue)) != NULL) {
+		seen_commits++;
+
+		if ((name = find_name(state,
+				git_revwalk__commit_oid(state->walk, node->commit))) != NULL) {
+			if (match_cnt < max_candidates) {
+				possible_tag *t = &all_matches[match_cnt++];
+				t->name = name;
+				t->depth = seen_commits - 1;
+				t->flag_within = 1u << match_cnt;
+				t->found_order = match_cnt;
+				node->flags |= t->flag_within;
+				if (name->prio == 2)
+					annotated_cnt++;
+			} else {
+				gave_up_on = node;
+				break;
+			}
+		}
+
+		for (cur = 0; cur < match_cnt; cur++) {
+			possible_tag *t = &all_matches[cur];
+			if (!(node->flags & t->flag_within))
+				t->depth++;
+		}
+
+		if (annotated_cnt && !git_pqueue_size(&state->queue))
+			break;
+
+		if (queue_parents(state, node) < 0)
+			return -1;
+	}
+
+	if (!match_cnt)
+		goto not_found;
+
+	git__qsort_r(all_matches, match_cnt, sizeof(possible_tag), compare_pt, NULL);
+
+	if (gave_up_on && git_pqueue_insert(&state->queue, gave_up_on) < 0)
+		return -1;
+
+	if (finish_depth_computation(state, &all_matches[0]) < 0)
+		return -1;
+
+	result->name = git__strdup(all_matches[0].name->path);
+	GITERR_CHECK_ALLOC(result->name);
+	result->depth = all_matches[0].depth;
+	return 0;
+
+not_found:
+	if (state->opts.show_commit_oid_as_fallback) {
+		result->fallback_to_id = 1;
+		return 0;
+	}
+
+	{
+		char oid_str[GIT_OID_HEXSZ + 1];
+		git_oid_tostr(oid_str, sizeof(oid_str), oid);
+		giterr_set(GITERR_DESCRIBE, "No tags can describe '%s'.", oid_str);
+	}
+	return GIT_ENOTFOUND;
+}
+
+static int describe_state_init(
+	describe_state *state,
+	git_repository *repo,
+	const git_describe_options *opts)
+{
+	memset(state, 0, sizeof(*state));
+
+	state->repo = repo;
+
+	if (opts)
+		memcpy(&state->opts, opts, sizeof(git_describe_options));
+	else {
+		git_describe_options defaults = GIT_DESCRIBE_OPTIONS_INIT;
+		memcpy(&state->opts, &defaults, sizeof(git_describe_options));
+	}
+
+	if ((state->names = git_oidmap_alloc()) == NULL ||
+		(state->nodes = git_oidmap_alloc()) == NULL ||
+		git_pool_init(&state->name_pool, sizeof(commit_name), 0) < 0 ||
+		git_pool_init(&state->path_pool, 1, 0) < 0 ||
+		git_pool_init(&state->node_pool, sizeof(describe_node), 0) < 0 ||
+		git_pqueue_init(&state->queue, 16, describe_node_cmp) < 0)
+		return -1;
+
+	return git_revwalk_new(&state->walk, repo);
+}
+
+static void describe_state_free(describe_state *state)
+{
+	commit_name *name;
+
+	if (state->names) {
+		kh_foreach_value(state->names, name, {
+			git_tag_free(name->tag);
+		});
+		git_oidmap_free(state->names);
+	}
+
+	if (state->nodes)
+		git_oidmap_free(state->nodes);
+
+	git_pqueue_free(&state->queue);
+	git_revwalk_free(state->walk);
+	git_pool_clear(&state->node_pool);
+	git_pool_clear(&state->path_pool);
+	git_pool_clear(&state->name_pool);
+}
+
+int git_describe_commit(
+	git_describe_result **result,
+	git_object *committish,
+	git_describe_options *opts)
+{
+	describe_state state;
+	git_describe_result *data;
+	git_object *commit;
+	int error;
+
+	assert(result && committish);
+
+	*result = NULL;
+
+	GITERR_CHECK_VERSION(opts, GIT_DESCRIBE_OPTIONS_VERSION, "git_describe_options");
+
+	data = git__calloc(1, sizeof(git_describe_result));
+	GITERR_CHECK_ALLOC(data);
+
+	data->repo = git_object_owner(committish);
+
+	if ((error = git_object_peel(&commit, committish, GIT_OBJ_COMMIT)) < 0) {
+		git__free(data);
+		return error;
+	}
+
+	git_oid_cpy(&data->commit_id, git_object_id(commit));
+	git_object_free(commit);
+
+	if ((error = describe_state_init(&state, data->repo, opts)) == 0 &&
+		(error = load_names(&state)) == 0)
+		error = describe(data, &state, &data->commit_id);
+
+	describe_state_free(&state);
+
+	if (error < 0) {
+		git_describe_result_free(data);
+		return error;
+	}
+
+	*result = data;
+	return 0;
+}
+
+int git_describe_workdir(
+	git_describe_result **out,
+	git_repository *repo,
+	git_describe_options *opts)
+{
+	git_status_options status_opts = GIT_STATUS_OPTIONS_INIT;
+	git_status_list *status = NULL;
+	git_describe_result *result = NULL;
+	git_object *commit;
+	int error;
+
+	assert(out && repo);
+
+	*out = NULL;
+
+	if ((error = git_revparse_single(&commit, repo, GIT_HEAD_FILE)) < 0)
+		return error;
+
+	error = git_describe_commit(&result, commit, opts);
+	git_object_free(commit);
+
+	if (error < 0)
+		return error;
+
+	/* only changes to tracked files make the working directory dirty */
+	status_opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+	status_opts.flags = GIT_STATUS_OPT_EXCLUDE_SUBMODULES;
+
+	if ((error = git_status_list_new(&status, repo, &status_opts)) < 0) {
+		git_describe_result_free(result);
+		return error;
+	}
+
+	result->dirty = (git_status_list_entrycount(status) > 0);
+	git_status_list_free(status);
+
+	*out = result;
+	return 0;
+}
+
+/*
+ * Find the length of the shortest prefix of `id`, no shorter than
+ * `size`, that no other object in the repository shares.
+ */
+static int find_unique_abbrev_size(
+	size_t *out, git_repository *repo, const git_oid *id, size_t size)
+{
+	git_odb *odb;
+	git_odb_object *obj;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, repo)) < 0)
+		return error;
+
+	for (; size < GIT_OID_HEXSZ; size++) {
+		error = git_odb_read_prefix(&obj, odb, id, size);
+
+		if (error == GIT_EAMBIGUOUS) {
+			giterr_clear();
+			continue;
+		}
+
+		if (error < 0)
+			return error;
+
+		git_odb_object_free(obj);
+		break;
+	}
+
+	*out = size;
+	return 0;
+}
+
+static int show_suffix(
+	git_buf *buf,
+	size_t depth,
+	git_repository *repo,
+	const git_oid *id,
+	size_t abbrev_size)
+{
+	char hex_oid[GIT_OID_HEXSZ];
+	size_t size;
+	int error;
+
+	if ((error = find_unique_abbrev_size(&size, repo, id, abbrev_size)) < 0)
+		return error;
+
+	git_oid_fmt(hex_oid, id);
+
+	git_buf_printf(buf, "-%" PRIuZ "-g", depth);
+	git_buf_put(buf, hex_oid, size);
+
+	return git_buf_oom(buf) ? -1 : 0;
+}
+
+int git_describe_format(
+	git_buf *out,
+	const git_describe_result *result,
+	const git_describe_format_options *given)
+{
+	git_describe_format_options opts = GIT_DESCRIBE_FORMAT_OPTIONS_INIT;
+	int error;
+
+	assert(out && result);
+
+	GITERR_CHECK_VERSION(given, GIT_DESCRIBE_FORMAT_OPTIONS_VERSION, "git_describe_format_options");
+
+	if (given)
+		memcpy(&opts, given, sizeof(opts));
+
+	git_buf_clear(out);
+
+	if (result->fallback_to_id) {
+		char hex_oid[GIT_OID_HEXSZ];
+		size_t size;
+
+		if ((error = find_unique_abbrev_size(&size, result->repo,
+				&result->commit_id, opts.abbreviated_size ?
+				opts.abbreviated_size :
+				GIT_DESCRIBE_DEFAULT_ABBREVIATED_SIZE)) < 0)
+			return error;
+
+		git_oid_fmt(hex_oid, &result->commit_id);
+		git_buf_put(out, hex_oid, size);
+	} else {
+		git_buf_puts(out, result->name);
+
+		if (opts.abbreviated_size &&
+			(!result->exact_match || opts.always_use_long_format) &&
+			(error = show_suffix(out, result->depth, result->repo,
+				&result->commit_id, opts.abbreviated_size)) < 0)
+			return error;
+	}
+
+	if (result->dirty && opts.dirty_suffix)
+		git_buf_puts(out, opts.dirty_suffix);
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+void git_describe_result_free(git_describe_result *result)
+{
+	if (result == NULL)
+		return;
+
+	git__free(result->name);
+	git__free(result);
+}
@@ -14,6 +14,9 @@
 #include "index.h"
 #include "odb.h"
 #include "submodule.h"
+#include "git2/blob.h"
+
+GIT__USE_OIDMAP
 
 #define DIFF_FLAG_IS_SET(DIFF,FLAG) (((DIFF)->opts.flags & (FLAG)) != 0)
 #define DIFF_FLAG_ISNT_SET(DIFF,FLAG) (((DIFF)->opts.flags & (FLAG)) == 0)
@@ -358,7 +361,8 @@ static git_diff_list *diff_list_alloc(
 	diff->new_src = new_iter->type;
 	memcpy(&diff->opts, &dflt, sizeof(diff->opts));
 
-	if (git_vector_init(&diff->deltas, 0, git_diff_delta__cmp) < 0 ||
+	if (git_mutex_init(&diff->blobs_lock) < 0 ||
+		git_vector_init(&diff->deltas, 0, git_diff_delta__cmp) < 0 ||
 		git_pool_init(&diff->pool, 1, 0) < 0) {
 		git_diff_list_free(diff);
 		return NULL;
@@ -504,6 +508,13 @@ static void diff_list_free(git_diff_list *diff)
 	git_pathspec__vfree(&diff->pathspec);
 	git_pool_clear(&diff->pool);
 
+	if (diff->blobs) {
+		git_blob *blob;
+		kh_foreach_value(diff->blobs, blob, git_blob_free(blob));
+		git_oidmap_free(diff->blobs);
+	}
+	git_mutex_free(&diff->blobs_lock);
+
 	git__memzero(diff, sizeof(*diff));
 	git__free(diff);
 }
@@ -521,6 +532,56 @@ void git_diff_list_addref(git_diff_list *diff)
 	GIT_REFCOUNT_INC(diff);
 }
 
+void git_diff__keep_blob(git_diff_list *diff, git_blob *blob)
+{
+	size_t size = (size_t)git_blob_rawsize(blob);
+	git_blob *kept;
+	khiter_t pos;
+	int error;
+
+	if (git_mutex_lock(&diff->blobs_lock) < 0)
+		return;
+
+	/* whatever does not fit is simply read again later */
+	if (diff->blobs_size + size <= GIT_DIFF__KEEP_BLOBS_SIZE &&
+		(diff->blobs != NULL ||
+		 (diff->blobs = git_oidmap_alloc()) != NULL) &&
+		kh_get(oid, diff->blobs, git_blob_id(blob)) == kh_end(diff->blobs) &&
+		!git_object_dup((git_object **)&kept, (git_object *)blob)) {
+
+		pos = kh_put(oid, diff->blobs, git_blob_id(kept), &error);
+
+		if (error < 0)
+			git_blob_free(kept);
+		else {
+			kh_val(diff->blobs, pos) = kept;
+			diff->blobs_size += size;
+		}
+	}
+
+	git_mutex_unlock(&diff->blobs_lock);
+}
+
+git_blob *git_diff__take_blob(git_diff_list *diff, const git_oid *id)
+{
+	git_blob *blob = NULL;
+	khiter_t pos;
+
+	if (git_mutex_lock(&diff->blobs_lock) < 0)
+		return NULL;
+
+	if (diff->blobs != NULL &&
+		(pos = kh_get(oid, diff->blobs, id)) != kh_end(diff->blobs)) {
+		blob = kh_val(diff->blobs, pos);
+		kh_del(oid, diff->blobs, pos);
+		diff->blobs_size -= (size_t)git_blob_rawsize(blob);
+	}
+
+	git_mutex_unlock(&diff->blobs_lock);
+
+	return blob;
+}
+
 int git_diff__oid_for_file(
 	git_repository *repo,
 	const char *path,
@@ -772,6 +833,16 @@ static int maybe_modified(
 			status = GIT_DELTA_UNMODIFIED;
 	}
 
+	/* a file that was looked at and found unchanged need not be looked
+	 * at again, until the file system monitor sees it change */
+	if (status == GIT_DELTA_UNMODIFIED && new_is_workdir &&
+		info->old_iter->type == GIT_ITERATOR_TYPE_INDEX &&
+		(diff->diffcaps & GIT_DIFFCAPS_ASSUME_UNCHANGED) == 0 &&
+		(oitem->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) == 0 &&
+		!S_ISGITLINK(omode))
+		git_index__fsmonitor_mark_valid(
+			git_iterator_get_index(info->old_iter), oitem);
+
 	return diff_delta__from_two(
 		diff, status, oitem, omode, nitem, nmode,
 		git_oid_iszero(&noid) ? NULL : &noid, matched_pathspec);
@@ -1040,6 +1111,7 @@ static int handle_unmatched_old_item(
 		 * Unless RECURSE_UNTRACKED_DIRS is set, skip over them...
 		 */
 		if (S_ISDIR(info->nitem->mode) &&
+			info->new_iter->type == GIT_ITERATOR_TYPE_WORKDIR &&
 			DIFF_FLAG_ISNT_SET(diff, GIT_DIFF_RECURSE_UNTRACKED_DIRS))
 			return git_iterator_advance(&info->nitem, info->new_iter);
 	}
@@ -1062,6 +1134,45 @@ static int handle_matched_item(
 	return error;
 }
 
+GIT_INLINE(bool) item_is_subtree(
+	git_iterator *iter, const git_index_entry *item)
+{
+	return (item != NULL && iter->type == GIT_ITERATOR_TYPE_TREE &&
+		S_ISDIR(item->mode));
+}
+
+/*
+ * Tree iterators which don't expand subtrees on their own hand them over
+ * as items.  A subtree that is the same on both sides can't hold any
+ * differences, so it is skipped without being read; others are stepped
+ * into, to compare what they contain.
+ */
+static int handle_subtree_items(diff_in_progress *info, int cmp)
+{
+	int error = 0;
+	bool old_tree = cmp <= 0 && item_is_subtree(info->old_iter, info->oitem);
+	bool new_tree = cmp >= 0 && item_is_subtree(info->new_iter, info->nitem);
+
+	if (old_tree && new_tree &&
+		git_oid_equal(&info->oitem->oid, &info->nitem->oid)) {
+		if (!(error = git_iterator_advance(&info->oitem, info->old_iter)) ||
+			error == GIT_ITEROVER)
+			error = git_iterator_advance(&info->nitem, info->new_iter);
+
+		return error;
+	}
+
+	if (old_tree)
+		error = git_iterator_advance_into_or_over(
+			&info->oitem, info->old_iter);
+
+	if (new_tree && (!error || error == GIT_ITEROVER))
+		error = git_iterator_advance_into_or_over(
+			&info->nitem, info->new_iter);
+
+	return error;
+}
+
 int git_diff__from_iterators(
 	git_diff_list **diff_ptr,
 	git_repository *repo,
@@ -1107,8 +1218,13 @@ int git_diff__from_iterators(
 		int cmp = info.oitem ?
 			(info.nitem ? diff->entrycomp(info.oitem, info.nitem) : -1) : 1;
 
+		/* step over or into subtrees given as items */
+		if ((cmp <= 0 && item_is_subtree(old_iter, info.oitem)) ||
+			(cmp >= 0 && item_is_subtree(new_iter, info.nitem)))
+			error = handle_subtree_items(&info, cmp);
+
 		/* create DELETED records for old items not matched in new */
-		if (cmp < 0)
+		else if (cmp < 0)
 			error = handle_unmatched_old_item(diff, &info);
 
 		/* create ADDED, TRACKED, or IGNORED records for new items not
@@ -1167,6 +1283,14 @@ int git_diff_tree_to_tree(
 	if (opts && (opts->flags & GIT_DIFF_DELTAS_ARE_ICASE) != 0)
 		iflag = GIT_ITERATOR_IGNORE_CASE;
 
+	/* unless every file is to be listed, subtrees that are the same on
+	 * both sides are skipped, which takes handing them over as items;
+	 * case insensitive iterators can merge several trees into one item,
+	 * so they are not compared that way
+	 */
+	else if (!opts || (opts->flags & GIT_DIFF_INCLUDE_UNMODIFIED) == 0)
+		iflag |= GIT_ITERATOR_DONT_AUTOEXPAND;
+
 	DIFF_FROM_ITERATORS(
 		git_iterator_for_tree(&a, old_tree, iflag, pfx, pfx),
 		git_iterator_for_tree(&b, new_tree, iflag, pfx, pfx)
@@ -1378,3 +1502,141 @@ int git_diff__paired_foreach(
 
 	return 0;
 }
+
+#define DIFF_MAX_THREADS 32
+#define DIFF_ITEMS_PER_CLAIM 16
+#define DIFF_ITEMS_PER_THREAD 256
+
+typedef struct {
+	git_diff__work_cb cb;
+	void *payload;
+	size_t count;
+	git_atomic claims;
+	git_atomic failed;
+} diff_work;
+
+typedef struct {
+	diff_work *work;
+	int error;
+	int error_class;
+	char *error_message;
+} diff_worker;
+
+static int diff_work_run(diff_work *work)
+{
+	size_t item, end;
+	int error = 0;
+
+	while (!error && !git_atomic_get(&work->failed)) {
+		item = (size_t)(git_atomic_inc(&work->claims) - 1) *
+			DIFF_ITEMS_PER_CLAIM;
+		if (item >= work->count)
+			break;
+
+		end = min(item + DIFF_ITEMS_PER_CLAIM, work->count);
+
+		for (; !error && item < end; ++item)
+			error = work->cb(item, work->payload);
+	}
+
+	if (error < 0)
+		git_atomic_set(&work->failed, 1);
+
+	return error;
+}
+
+#ifdef GIT_THREADS
+static void *diff_work_thread(void *arg)
+{
+	diff_worker *worker = arg;
+	const git_error *last;
+
+	/* errors are kept per thread; take this one back to the caller */
+	if ((worker->error = diff_work_run(worker->work)) < 0 &&
+		(last = giterr_last()) != NULL) {
+		worker->error_class = last->klass;
+		worker->error_message = git__strdup(last->message);
+	}
+
+	/* the thread's state is freed on exit, but not the message in it */
+	giterr_clear();
+
+	return NULL;
+}
+#endif
+
+size_t git_diff__threads(unsigned int requested, size_t count)
+{
+	size_t threads = 1;
+
+#ifdef GIT_THREADS
+	if (!(threads = requested))
+		threads = min((size_t)max(git_online_cpus(), 1),
+			count / DIFF_ITEMS_PER_THREAD);
+
+	threads = min(threads,
+		(count + DIFF_ITEMS_PER_CLAIM - 1) / DIFF_ITEMS_PER_CLAIM);
+	threads = min(threads, DIFF_MAX_THREADS);
+	threads = max(threads, 1);
+#else
+	GIT_UNUSED(requested);
+	GIT_UNUSED(count);
+#endif
+
+	return threads;
+}
+
+int git_diff__parallel(
+	size_t threads, size_t count, git_diff__work_cb cb, void *payload)
+{
+	diff_work work;
+	int error;
+#ifdef GIT_THREADS
+	git_thread thread[DIFF_MAX_THREADS];
+	diff_worker worker[DIFF_MAX_THREADS];
+	bool started[DIFF_MAX_THREADS] = { false };
+	size_t i;
+#endif
+
+	memset(&work, 0, sizeof(work));
+	work.cb = cb;
+	work.payload = payload;
+	work.count = count;
+
+#ifdef GIT_THREADS
+	memset(worker, 0, sizeof(worker));
+	threads = min(threads, DIFF_MAX_THREADS);
+
+	for (i = 1; i < threads; ++i) {
+		worker[i].work = &work;
+		started[i] = !git_thread_create(
+			&thread[i], NULL, diff_work_thread, &worker[i]);
+	}
+#else
+	GIT_UNUSED(threads);
+#endif
+
+	/* what a thread could not be started for is done here */
+	error = diff_work_run(&work);
+
+#ifdef GIT_THREADS
+	for (i = 1; i < threads; ++i) {
+		if (!started[i])
+			continue;
+
+		git_thread_join(thread[i], NULL);
+
+		if (!error && worker[i].error < 0) {
+			error = worker[i].error;
+
+			if (worker[i].error_message)
+				giterr_set_str(
+					worker[i].error_class, worker[i].error_message);
+		}
+
+		git__free(worker[i].error_message);
+	}
+#endif
+
+	return error;
+}
@@ -17,6 +17,7 @@
 #include "repository.h"
 #include "pool.h"
 #include "odb.h"
+#include "oidmap.h"
 
 #define DIFF_OLD_PREFIX_DEFAULT "a/"
 #define DIFF_NEW_PREFIX_DEFAULT "b/"
@@ -62,6 +63,9 @@ struct git_diff_list {
 	git_iterator_type_t old_src;
 	git_iterator_type_t new_src;
 	uint32_t diffcaps;
+	git_mutex blobs_lock;
+	git_oidmap *blobs;  /* blobs kept for patches, by oid */
+	size_t blobs_size;
 
 	int (*strcomp)(const char *, const char *);
 	int (*strncomp)(const char *, const char *, size_t);
@@ -105,6 +109,42 @@ extern int git_diff__paired_foreach(
 	int (*cb)(git_diff_delta *i2h, git_diff_delta *w2i, void *payload),
 	void *payload);
 
+/*
+ * Work that can be split up between threads is done in items: `cb` is
+ * called for each of them, on any of the threads, and must give each
+ * item a place of its own for its result, so that what comes out does
+ * not depend on which thread got to which item.  Each thread claims the
+ * next few items whenever it runs out.
+ */
+typedef int (*git_diff__work_cb)(size_t item, void *payload);
+
+/*
+ * How many threads `count` items are worth: `requested` if it is set,
+ * otherwise one per CPU as long as there are enough items to go round.
+ * Without GIT_THREADS, there is only ever the calling thread.
+ */
+extern size_t git_diff__threads(unsigned int requested, size_t count);
+
+/*
+ * Call `cb` for each of `count` items, on the calling thread and up to
+ * `threads - 1` more.  The first error stops the others; it is returned,
+ * with its message, to the calling thread.
+ */
+extern int git_diff__parallel(
+	size_t threads, size_t count, git_diff__work_cb cb, void *payload);
+
+/*
+ * Blobs loaded to find renames are kept on the diff list, up to
+ * GIT_DIFF__KEEP_BLOBS_SIZE bytes of them, so that the patches of the
+ * same files need not read them again.  Taking one back hands its
+ * reference over to the caller.  Both can be called from any thread.
+ */
+#define GIT_DIFF__KEEP_BLOBS_SIZE (64 * 1024 * 1024)
+
+extern void git_diff__keep_blob(git_diff_list *diff, git_blob *blob);
+
+extern git_blob *git_diff__take_blob(git_diff_list *diff, const git_oid *id);
+
 extern int git_diff_find_similar__hashsig_for_file(
 	void **out, const git_diff_file *f, const char *path, void *p);
 
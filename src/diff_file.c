@@ -97,6 +97,7 @@ int git_diff_file_content__init_from_diff(
 
 	memset(fc, 0, sizeof(*fc));
 	fc->repo = diff->repo;
+	fc->diff = diff;
 	fc->file = use_old ? &delta->old_file : &delta->new_file;
 	fc->src  = use_old ? diff->old_src : diff->new_src;
 
@@ -239,17 +240,27 @@ static int diff_file_content_load_blob(git_diff_file_content *fc)
 	if (fc->file->mode == GIT_FILEMODE_COMMIT)
 		return diff_file_content_commit_to_str(fc, false);
 
+	/* finding renames may have read the blob already */
+	if (fc->diff != NULL)
+		fc->blob = git_diff__take_blob(fc->diff, &fc->file->oid);
+
 	/* if we don't know size, try to peek at object header first */
-	if (!fc->file->size) {
+	if (!fc->blob && !fc->file->size) {
 		if ((error = git_diff_file__resolve_zero_size(
 				fc->file, &odb_obj, fc->repo)) < 0)
 			return error;
 	}
 
-	if (diff_file_content_binary_by_size(fc))
+	if (diff_file_content_binary_by_size(fc)) {
+		git_blob_free((git_blob *)fc->blob);
+		fc->blob = NULL;
+		git_odb_object_free(odb_obj);
 		return 0;
+	}
 
-	if (odb_obj != NULL) {
+	if (fc->blob != NULL)
+		/* already have it */;
+	else if (odb_obj != NULL) {
 		error = git_object__from_odb_object(
 			(git_object **)&fc->blob, fc->repo, odb_obj, GIT_OBJ_BLOB);
 		git_odb_object_free(odb_obj);
@@ -15,6 +15,7 @@
 /* expanded information for one side of a delta */
 typedef struct {
 	git_repository *repo;
+	git_diff_list *diff; /* NULL for blobs and buffers */
 	git_diff_file *file;
 	git_diff_driver *driver;
 	uint32_t flags;
@@ -273,6 +273,190 @@ static int diff_required(git_diff_list *diff, const char *action)
 	return -1;
 }
 
+/* issue the hunk and line callbacks for a patch that was diffed ahead */
+static int diff_patch_replay(git_diff_patch *patch, git_diff_output *output)
+{
+	size_t i, j;
+
+	for (i = 0; !output->error && i < git_array_size(patch->hunks); ++i) {
+		diff_patch_hunk *hunk = git_array_get(patch->hunks, i);
+
+		if (output->hunk_cb != NULL &&
+			output->hunk_cb(patch->delta, &hunk->range,
+				hunk->header, hunk->header_len, output->payload))
+			output->error = GIT_EUSER;
+
+		for (j = 0; output->data_cb != NULL && !output->error &&
+				j < hunk->line_count; ++j) {
+			diff_patch_line *line =
+				git_array_get(patch->lines, hunk->line_start + j);
+
+			if (output->data_cb(patch->delta, &hunk->range,
+					line->origin, line->ptr, line->len, output->payload))
+				output->error = GIT_EUSER;
+		}
+	}
+
+	return output->error;
+}
+
+static int diff_patch_invoke(git_diff_patch *patch, git_diff_output *output)
+{
+	int error = diff_patch_file_callback(patch, output);
+
+	if (!error) {
+		if ((patch->flags & GIT_DIFF_PATCH_DIFFED) != 0)
+			error = diff_patch_replay(patch, output);
+		else
+			error = diff_patch_generate(patch, output);
+	}
+
+	return error;
+}
+
+/* how many deltas are diffed ahead of their callbacks at a time, and how
+ * much content those may hold before the rest of them are left to be
+ * diffed in turn as their callbacks are issued
+ */
+#define DIFF_FOREACH_BATCH  256
+#define DIFF_FOREACH_MEMORY (64 * 1024 * 1024)
+
+typedef struct {
+	git_diff_patch patch;
+
+	/* the delta as loading the patch left it (with the files found to
+	 * be binary, say), which the file callback only gets to see after
+	 * it is called, as when the patch is loaded in turn
+	 */
+	git_diff_delta loaded;
+	unsigned int ahead:1;
+} diff_foreach_item;
+
+typedef struct {
+	git_diff_list *diff;
+	diff_foreach_item *items;
+	git_atomic_ssize held;
+	git_atomic full;
+} diff_foreach_batch;
+
+static int diff_foreach_cb(size_t idx, void *payload)
+{
+	diff_foreach_batch *batch = payload;
+	diff_foreach_item *item = &batch->items[idx];
+	git_diff_patch *patch = &item->patch;
+	git_diff_delta delta;
+	git_xdiff_output xo;
+	size_t held;
+	int error;
+
+	if (git_atomic_get(&batch->full))
+		return 0;
+
+	diff_output_to_patch(&xo.output, patch);
+	git_xdiff_init(&xo, &batch->diff->opts);
+
+	memcpy(&delta, patch->delta, sizeof(git_diff_delta));
+	error = diff_patch_generate(patch, &xo.output);
+
+	memcpy(&item->loaded, patch->delta, sizeof(git_diff_delta));
+	memcpy(patch->delta, &delta, sizeof(git_diff_delta));
+
+	if (error < 0)
+		return error;
+
+	item->ahead = 1;
+
+	/* without hunks, nothing needs the content any more; the patch is
+	 * still marked as loaded, so it is not loaded again for them */
+	if ((patch->flags & GIT_DIFF_PATCH_DIFFED) == 0) {
+		git_diff_file_content__unload(&patch->ofile);
+		git_diff_file_content__unload(&patch->nfile);
+		return 0;
+	}
+
+	held = patch->ofile.map.len + patch->nfile.map.len +
+		git_array_size(patch->lines) * sizeof(diff_patch_line);
+
+	if (git_atomic_ssize_add(&batch->held, (ssize_t)held) >
+		DIFF_FOREACH_MEMORY)
+		git_atomic_set(&batch->full, 1);
+
+	return 0;
+}
+
+static int diff_foreach_invoke(
+	diff_foreach_item *item, git_diff_output *output)
+{
+	git_diff_patch *patch = &item->patch;
+	int error;
+
+	if (!item->ahead)
+		return diff_patch_invoke(patch, output);
+
+	if ((error = diff_patch_file_callback(patch, output)) < 0)
+		return error;
+
+	memcpy(patch->delta, &item->loaded, sizeof(git_diff_delta));
+
+	return diff_patch_replay(patch, output);
+}
+
+static int diff_foreach_parallel(
+	git_diff_list *diff, git_xdiff_output *xo, size_t threads)
+{
+	diff_foreach_batch batch;
+	diff_foreach_item *item;
+	size_t num_deltas = diff->deltas.length, start, idx, count, i;
+	int error = 0;
+
+	memset(&batch, 0, sizeof(batch));
+	batch.diff = diff;
+	batch.items = git__calloc(
+		min(num_deltas, DIFF_FOREACH_BATCH), sizeof(diff_foreach_item));
+	GITERR_CHECK_ALLOC(batch.items);
+
+	for (start = 0; !error && start < num_deltas; start += DIFF_FOREACH_BATCH) {
+		count = 0;
+		memset(&batch.held, 0, sizeof(batch.held));
+		git_atomic_set(&batch.full, 0);
+
+		/* finding the drivers of the files looks up attributes, which
+		 * can only be done here
+		 */
+		for (idx = start;
+			!error && idx < num_deltas && idx < start + DIFF_FOREACH_BATCH;
+			++idx) {
+			if (git_diff_delta__should_skip(
+					&diff->opts, git_vector_get(&diff->deltas, idx)))
+				continue;
+
+			batch.items[count].ahead = 0;
+
+			if (!(error = diff_patch_init_from_diff(
+					&batch.items[count].patch, diff, idx)))
+				count++;
+		}
+
+		if (!error)
+			error = git_diff__parallel(
+				threads, count, diff_foreach_cb, &batch);
+
+		/* the callbacks are issued in order once the batch is diffed */
+		for (i = 0; i < count; ++i) {
+			item = &batch.items[i];
+
+			if (!error)
+				error = diff_foreach_invoke(item, &xo->output);
+
+			git_diff_patch_free(&item->patch);
+		}
+	}
+
+	git__free(batch.items);
+
+	return error;
+}
+
 int git_diff_foreach(
 	git_diff_list *diff,
 	git_diff_file_cb file_cb,
@@ -282,7 +466,7 @@ int git_diff_foreach(
 {
 	int error = 0;
 	git_xdiff_output xo;
-	size_t idx;
+	size_t idx, threads = 1;
 	git_diff_patch patch;
 
 	if (diff_required(diff, "git_diff_foreach") < 0)
@@ -292,24 +476,35 @@ int git_diff_foreach(
 		&xo.output, &diff->opts, file_cb, hunk_cb, data_cb, payload);
 	git_xdiff_init(&xo, &diff->opts);
 
-	git_vector_foreach(&diff->deltas, idx, patch.delta) {
+	/* files in the working directory are loaded through filters, which
+	 * look up attributes; that can only be done on the calling thread.
+	 * Diffing ahead holds on to the files, so it is only done when the
+	 * options ask for more than one thread outright.
+	 */
+	if ((hunk_cb != NULL || data_cb != NULL) &&
+		diff->opts.threads > 1 &&
+		diff->old_src != GIT_ITERATOR_TYPE_WORKDIR &&
+		diff->new_src != GIT_ITERATOR_TYPE_WORKDIR)
+		threads = git_diff__threads(diff->opts.threads, diff->deltas.length);
 
-		/* check flags against patch status */
-		if (git_diff_delta__should_skip(&diff->opts, patch.delta))
-			continue;
+	if (threads > 1)
+		error = diff_foreach_parallel(diff, &xo, threads);
+	else {
+		git_vector_foreach(&diff->deltas, idx, patch.delta) {
 
-		if (!(error = diff_patch_init_from_diff(&patch, diff, idx))) {
+			/* check flags against patch status */
+			if (git_diff_delta__should_skip(&diff->opts, patch.delta))
+				continue;
 
-			error = diff_patch_file_callback(&patch, &xo.output);
+			if (!(error = diff_patch_init_from_diff(&patch, diff, idx))) {
+				error = diff_patch_invoke(&patch, &xo.output);
 
-			if (!error)
-				error = diff_patch_generate(&patch, &xo.output);
+				git_diff_patch_free(&patch);
+			}
 
-			git_diff_patch_free(&patch);
+			if (error < 0)
+				break;
 		}
-
-		if (error < 0)
-			break;
 	}
 
 	if (error == GIT_EUSER)
@@ -720,6 +915,172 @@ int git_diff_patch_line_stats(
 	return 0;
 }
 
+/* how many deltas are set up at a time to work out stats */
+#define DIFF_STATS_BATCH 1024
+
+struct git_diff_stats {
+	size_t files_changed;
+	size_t insertions;
+	size_t deletions;
+	size_t num_deltas;
+	size_t lines[GIT_FLEX_ARRAY]; /* insertions and deletions by delta */
+};
+
+typedef struct {
+	git_diff_stats *stats;
+	git_xdiff_output xo;
+	git_diff_patch *patches;
+} diff_stats_batch;
+
+static int diff_stats_cb(size_t item, void *payload)
+{
+	diff_stats_batch *batch = payload;
+	git_diff_patch *patch = &batch->patches[item];
+	size_t *lines = &batch->stats->lines[2 * patch->delta_index];
+	int error;
+
+	if ((error = diff_patch_load(patch, NULL)) < 0)
+		return error;
+
+	if ((patch->flags & GIT_DIFF_PATCH_DIFFABLE) != 0)
+		error = git_xdiff_line_stats(&lines[0], &lines[1], &batch->xo, patch);
+
+	/* only the counts are kept */
+	git_diff_file_content__unload(&patch->ofile);
+	git_diff_file_content__unload(&patch->nfile);
+
+	return error;
+}
+
+int git_diff_get_stats(git_diff_stats **out, git_diff_list *diff)
+{
+	git_diff_stats *stats;
+	diff_stats_batch batch;
+	git_diff_patch *patch;
+	size_t num_deltas, threads, start, idx, count, i;
+	int error = 0;
+
+	assert(out);
+	*out = NULL;
+
+	if (diff_required(diff, "git_diff_get_stats") < 0)
+		return -1;
+
+	num_deltas = diff->deltas.length;
+
+	stats = git__calloc(1,
+		sizeof(git_diff_stats) + 2 * num_deltas * sizeof(size_t));
+	GITERR_CHECK_ALLOC(stats);
+	stats->num_deltas = num_deltas;
+
+	/* files in the working directory are loaded through filters, which
+	 * look up attributes; that can only be done on the calling thread */
+	if (diff->old_src == GIT_ITERATOR_TYPE_WORKDIR ||
+		diff->new_src == GIT_ITERATOR_TYPE_WORKDIR)
+		threads = 1;
+	else
+		threads = git_diff__threads(diff->opts.threads, num_deltas);
+
+	memset(&batch, 0, sizeof(batch));
+	batch.stats = stats;
+	git_xdiff_init(&batch.xo, &diff->opts);
+
+	batch.patches = git__calloc(
+		max(min(num_deltas, DIFF_STATS_BATCH), 1), sizeof(git_diff_patch));
+	if (!batch.patches) {
+		git__free(stats);
+		return -1;
+	}
+
+	for (start = 0; !error && start < num_deltas; start += DIFF_STATS_BATCH) {
+		count = 0;
+
+		/* the patches are set up here, as finding their drivers looks
+		 * up attributes as well */
+		for (idx = start;
+			!error && idx < num_deltas && idx < start + DIFF_STATS_BATCH;
+			++idx) {
+			if (git_diff_delta__should_skip(
+					&diff->opts, git_vector_get(&diff->deltas, idx)))
+				continue;
+
+			if (!(error = diff_patch_init_from_diff(
+					&batch.patches[count], diff, idx)))
+				count++;
+		}
+
+		if (!error)
+			error = git_diff__parallel(
+				threads, count, diff_stats_cb, &batch);
+
+		for (i = 0; i < count; ++i) {
+			patch = &batch.patches[i];
+
+			/* a file may turn out to be unmodified once it is loaded */
+			if (!git_diff_delta__should_skip(&diff->opts, patch->delta)) {
+				stats->files_changed++;
+				stats->insertions += stats->lines[2 * patch->delta_index];
+				stats->deletions += stats->lines[2 * patch->delta_index + 1];
+			}
+
+			git_diff_patch_free(patch);
+		}
+	}
+
+	git__free(batch.patches);
+
+	if (error < 0)
+		git_diff_stats_free(stats);
+	else
+		*out = stats;
+
+	return error;
+}
+
+size_t git_diff_stats_files_changed(const git_diff_stats *stats)
+{
+	assert(stats);
+	return stats->files_changed;
+}
+
+size_t git_diff_stats_insertions(const git_diff_stats *stats)
+{
+	assert(stats);
+	return stats->insertions;
+}
+
+size_t git_diff_stats_deletions(const git_diff_stats *stats)
+{
+	assert(stats);
+	return stats->deletions;
+}
+
+int git_diff_stats_delta(
+	size_t *insertions,
+	size_t *deletions,
+	const git_diff_stats *stats,
+	size_t idx)
+{
+	assert(stats);
+
+	if (idx >= stats->num_deltas) {
+		giterr_set(GITERR_INVALID, "Index out of range for delta in diff");
+		return GIT_ENOTFOUND;
+	}
+
+	if (insertions)
+		*insertions = stats->lines[2 * idx];
+	if (deletions)
+		*deletions = stats->lines[2 * idx + 1];
+
+	return 0;
+}
+
+void git_diff_stats_free(git_diff_stats *stats)
+{
+	git__free(stats);
+}
+
 static int diff_error_outofrange(const char *thing)
 {
 	giterr_set(GITERR_INVALID, "Diff patch %s index out of range", thing);
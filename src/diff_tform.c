@@ -13,6 +13,7 @@
 #include "hashsig.h"
 #include "path.h"
 #include "fileops.h"
+#include "array.h"
 
 static git_diff_delta *diff_delta__dup(
 	const git_diff_delta *d, git_pool *pool)
@@ -408,9 +409,17 @@ GIT_INLINE(git_diff_file *) similarity_get_file(git_diff_list *diff, size_t idx)
 	return (idx & 1) ? &delta->new_file : &delta->old_file;
 }
 
+GIT_INLINE(git_delta_t) similarity_delta_status(
+	git_diff_list *diff, size_t idx)
+{
+	git_diff_delta *delta = git_vector_get(&diff->deltas, idx / 2);
+	return delta->status;
+}
+
 typedef struct {
 	size_t idx;
 	git_iterator_type_t src;
+	git_diff_list *diff;
 	git_repository *repo;
 	git_diff_file *file;
 	git_buf data;
@@ -423,6 +432,7 @@ static int similarity_init(
 {
 	info->idx  = file_idx;
 	info->src  = (file_idx & 1) ? diff->new_src : diff->old_src;
+	info->diff = diff;
 	info->repo = diff->repo;
 	info->file = similarity_get_file(diff, file_idx);
 	info->odb_obj = NULL;
@@ -484,6 +494,16 @@ static int similarity_sig(
 			error = opts->metric->buffer_signature(
 				&cache[info->idx], info->file,
 				git_blob_rawcontent(info->blob), sz, opts->metric->payload);
+
+			/* the patch for the file will want its content too; that
+			 * is not needed for unmodified files which are only there
+			 * as sources for copies
+			 */
+			if (!error &&
+				(similarity_delta_status(info->diff, info->idx) !=
+					GIT_DELTA_UNMODIFIED ||
+				 (info->diff->opts.flags & GIT_DIFF_INCLUDE_UNMODIFIED) != 0))
+				git_diff__keep_blob(info->diff, info->blob);
 		}
 	}
 
@@ -501,8 +521,38 @@ static void similarity_unload(similarity_info *info)
 		git_buf_free(&info->data);
 }
 
+static int similarity_load(
+	git_diff_list *diff,
+	const git_diff_find_options *opts,
+	void **cache,
+	size_t file_idx)
+{
+	similarity_info info;
+	int error;
+
+	if (cache[file_idx])
+		return 0;
+
+	memset(&info, 0, sizeof(info));
+
+	if ((error = similarity_init(&info, diff, file_idx)) == 0)
+		error = similarity_sig(&info, opts, cache);
+
+	similarity_unload(&info);
+	return error;
+}
+
 #define FLAG_SET(opts,flag_name) (((opts)->flags & flag_name) != 0)
 
+GIT_INLINE(bool) similarity_sizes_differ(
+	const git_diff_file *a_file, const git_diff_file *b_file)
+{
+	return (a_file->size > 127 &&
+		b_file->size > 127 &&
+		(a_file->size > (b_file->size << 3) ||
+		 b_file->size > (a_file->size << 3)));
+}
+
 /* - score < 0 means files cannot be compared
  * - score >= 100 means files are exact match
  * - score == 0 means files are completely different
@@ -564,10 +614,7 @@ static int similarity_measure(
 		goto cleanup;
 
 	/* check if file sizes are nowhere near each other */
-	if (a_file->size > 127 &&
-		b_file->size > 127 &&
-		(a_file->size > (b_file->size << 3) ||
-		 b_file->size > (a_file->size << 3)))
+	if (similarity_sizes_differ(a_file, b_file))
 		goto cleanup;
 
 	/* update signature cache if needed */
@@ -594,6 +641,41 @@ cleanup:
 	return error;
 }
 
+/*
+ * The same as `similarity_measure`, for files whose signatures have all
+ * been loaded already (a file may still have none), and when not looking
+ * for exact matches only.  It changes nothing, so it may run on any
+ * number of threads at once.
+ */
+static int similarity_measure_loaded(
+	int *score,
+	git_diff_list *diff,
+	const git_diff_find_options *opts,
+	void **cache,
+	size_t a_idx,
+	size_t b_idx)
+{
+	const git_diff_file *a_file = similarity_get_file(diff, a_idx);
+	const git_diff_file *b_file = similarity_get_file(diff, b_idx);
+
+	*score = -1;
+
+	if (GIT_MODE_TYPE(a_file->mode) != GIT_MODE_TYPE(b_file->mode))
+		return 0;
+
+	if (git_oid__cmp(&a_file->oid, &b_file->oid) == 0) {
+		*score = 100;
+		return 0;
+	}
+
+	if (similarity_sizes_differ(a_file, b_file) ||
+		!cache[a_idx] || !cache[b_idx])
+		return 0;
+
+	return opts->metric->similarity(
+		score, cache[a_idx], cache[b_idx], opts->metric->payload);
+}
+
 static int calc_self_similarity(
 	git_diff_list *diff,
 	const git_diff_find_options *opts,
@@ -758,14 +840,269 @@ typedef struct {
 	uint32_t similarity;
 } diff_find_match;
 
+/*
+ * The sources that each target is measured against, when they can be
+ * narrowed down to those that may be similar enough to matter: the ones
+ * with the same contents, and the ones whose signatures may score the
+ * lowest threshold in use or more.  That takes the internal metric,
+ * whose signatures can be searched that way.
+ */
+typedef struct {
+	uint32_t tgt;
+	uint32_t src;
+	int similarity;
+} diff_find_pair;
+
+typedef struct {
+	git_array_t(diff_find_pair) pairs;
+	size_t *tgt_start; /* where the sources of each target start in pairs */
+} diff_find_candidates;
+
+typedef struct {
+	diff_find_candidates *cands;
+	git_diff_list *diff;
+	const git_diff_find_options *opts;
+	void **sigcache;
+	uint32_t *srcs;
+	uint32_t *tgts;
+	size_t num_srcs;
+} diff_find_candidates_build;
+
+static bool use_find_candidates(const git_diff_find_options *opts)
+{
+	return !FLAG_SET(opts, GIT_DIFF_FIND_EXACT_MATCH_ONLY) &&
+		opts->metric->similarity == git_diff_find_similar__calc_similarity &&
+		opts->metric->free_signature == git_diff_find_similar__hashsig_free;
+}
+
+static int find_candidates_threshold(const git_diff_find_options *opts)
+{
+	int threshold = opts->rename_threshold;
+
+	if (opts->rename_from_rewrite_threshold < threshold)
+		threshold = opts->rename_from_rewrite_threshold;
+
+	if (FLAG_SET(opts, GIT_DIFF_FIND_COPIES) &&
+		opts->copy_threshold < threshold)
+		threshold = opts->copy_threshold;
+
+	return threshold;
+}
+
+static int find_candidates_add(
+	diff_find_candidates *cands, uint32_t tgt, uint32_t src)
+{
+	diff_find_pair *pair = git_array_alloc(cands->pairs);
+	GITERR_CHECK_ALLOC(pair);
+
+	pair->tgt = tgt;
+	pair->src = src;
+	pair->similarity = -1;
+	return 0;
+}
+
+static int find_candidates_similar_cb(
+	size_t tgt_pos, size_t src_pos, void *payload)
+{
+	diff_find_candidates_build *build = payload;
+
+	return find_candidates_add(
+		build->cands, build->tgts[tgt_pos], build->srcs[src_pos]);
+}
+
+GIT_INLINE(const git_oid *) find_candidates_src_oid(
+	git_diff_list *diff, uint32_t idx)
+{
+	return &((git_diff_delta *)git_vector_get(&diff->deltas, idx))->old_file.oid;
+}
+
+static int find_candidates_src_cmp(const void *a, const void *b, void *payload)
+{
+	uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+	int cmp = git_oid__cmp(
+		find_candidates_src_oid(payload, ia),
+		find_candidates_src_oid(payload, ib));
+
+	return cmp ? cmp : (ia < ib) ? -1 : (ia > ib);
+}
+
+static int find_candidates_pair_cmp(const void *a, const void *b, void *payload)
+{
+	const diff_find_pair *pa = a, *pb = b;
+	GIT_UNUSED(payload);
+
+	if (pa->tgt != pb->tgt)
+		return (pa->tgt < pb->tgt) ? -1 : 1;
+	return (pa->src < pb->src) ? -1 : (pa->src > pb->src) ? 1 : 0;
+}
+
+/* Add the sources with the same contents as each target */
+static int find_candidates_by_oid(diff_find_candidates_build *build,
+	size_t num_srcs, size_t num_tgts)
+{
+	git_diff_list *diff = build->diff;
+	git_diff_delta *tgt;
+	size_t i, lo, hi, mid;
+	int error = 0;
+
+	git__qsort_r(build->srcs, num_srcs, sizeof(uint32_t),
+		find_candidates_src_cmp, diff);
+
+	for (i = 0; !error && i < num_tgts; ++i) {
+		tgt = git_vector_get(&diff->deltas, build->tgts[i]);
+
+		for (lo = 0, hi = num_srcs; lo < hi; ) {
+			mid = lo + (hi - lo) / 2;
+			if (git_oid__cmp(find_candidates_src_oid(
+					diff, build->srcs[mid]), &tgt->new_file.oid) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for (; !error && lo < num_srcs && !git_oid__cmp(
+				find_candidates_src_oid(diff, build->srcs[lo]),
+				&tgt->new_file.oid); ++lo)
+			error = find_candidates_add(
+				build->cands, build->tgts[i], build->srcs[lo]);
+	}
+
+	return error;
+}
+
+static int find_candidates_load_cb(size_t item, void *payload)
+{
+	diff_find_candidates_build *build = payload;
+	size_t file_idx = (item < build->num_srcs) ?
+		2 * (size_t)build->srcs[item] :
+		2 * (size_t)build->tgts[item - build->num_srcs] + 1;
+
+	return similarity_load(
+		build->diff, build->opts, build->sigcache, file_idx);
+}
+
+static int find_candidates_measure_cb(size_t item, void *payload)
+{
+	diff_find_candidates_build *build = payload;
+	diff_find_pair *pair = git_array_get(build->cands->pairs, item);
+
+	/* self-similarity is not measured here */
+	if (pair->src == pair->tgt)
+		return 0;
+
+	return similarity_measure_loaded(&pair->similarity,
+		build->diff, build->opts, build->sigcache,
+		2 * (size_t)pair->src, 2 * (size_t)pair->tgt + 1);
+}
+
+static int find_candidates(
+	diff_find_candidates *cands,
+	git_diff_list *diff,
+	const git_diff_find_options *opts,
+	void **sigcache,
+	size_t num_srcs,
+	size_t num_tgts)
+{
+	diff_find_candidates_build build;
+	const git_hashsig **srcsigs = NULL, **tgtsigs = NULL;
+	const git_diff_delta *delta;
+	git_odb *odb;
+	size_t i, s = 0, t = 0, last;
+	int error = 0;
+
+	memset(&build, 0, sizeof(build));
+	build.cands = cands;
+	build.diff = diff;
+	build.opts = opts;
+	build.sigcache = sigcache;
+	build.num_srcs = num_srcs;
+
+	if ((build.srcs = git__calloc(num_srcs, sizeof(uint32_t))) == NULL ||
+		(build.tgts = git__calloc(num_tgts, sizeof(uint32_t))) == NULL ||
+		(srcsigs = git__calloc(num_srcs, sizeof(git_hashsig *))) == NULL ||
+		(tgtsigs = git__calloc(num_tgts, sizeof(git_hashsig *))) == NULL ||
+		(cands->tgt_start = git__calloc(
+			diff->deltas.length + 1, sizeof(size_t))) == NULL) {
+		error = -1;
+		goto cleanup;
+	}
+
+	git_vector_foreach(&diff->deltas, i, delta) {
+		if ((delta->flags & GIT_DIFF_FLAG__IS_RENAME_SOURCE) != 0)
+			build.srcs[s++] = (uint32_t)i;
+
+		if ((delta->flags & GIT_DIFF_FLAG__IS_RENAME_TARGET) != 0)
+			build.tgts[t++] = (uint32_t)i;
+	}
+
+	/* every signature is needed to find the similar ones; the odb is
+	 * opened up front, as the threads loading them cannot do it */
+	if ((error = git_repository_odb__weakptr(&odb, diff->repo)) < 0 ||
+		(error = git_diff__parallel(
+			git_diff__threads(opts->threads, num_srcs + num_tgts),
+			num_srcs + num_tgts, find_candidates_load_cb, &build)) < 0)
+		goto cleanup;
+
+	for (s = 0; s < num_srcs; ++s)
+		srcsigs[s] = sigcache[2 * (size_t)build.srcs[s]];
+	for (t = 0; t < num_tgts; ++t)
+		tgtsigs[t] = sigcache[2 * (size_t)build.tgts[t] + 1];
+
+	if ((error = git_hashsig_find_similar(tgtsigs, num_tgts, srcsigs,
+			num_srcs, find_candidates_threshold(opts),
+			find_candidates_similar_cb, &build)) < 0 ||
+		(error = find_candidates_by_oid(&build, num_srcs, num_tgts)) < 0)
+		goto cleanup;
+
+	/* sources are measured in the order of the deltas, as they would be
+	 * without narrowing them down, once for each target */
+	git__qsort_r(cands->pairs.ptr, cands->pairs.size,
+		sizeof(diff_find_pair), find_candidates_pair_cmp, NULL);
+
+	for (i = 0, last = 0; i < cands->pairs.size; ++i) {
+		diff_find_pair *pair = git_array_get(cands->pairs, i);
+
+		if (last > 0 && !find_candidates_pair_cmp(
+				pair, git_array_get(cands->pairs, last - 1), NULL))
+			continue;
+
+		cands->pairs.ptr[last++] = *pair;
+		cands->tgt_start[pair->tgt + 1]++;
+	}
+	cands->pairs.size = (uint32_t)last;
+
+	for (i = 0; i < diff->deltas.length; ++i)
+		cands->tgt_start[i + 1] += cands->tgt_start[i];
+
+	error = git_diff__parallel(
+		git_diff__threads(opts->threads, cands->pairs.size),
+		cands->pairs.size, find_candidates_measure_cb, &build);
+
+cleanup:
+	git__free(build.srcs);
+	git__free(build.tgts);
+	git__free(srcsigs);
+	git__free(tgtsigs);
+
+	return error;
+}
+
+static void find_candidates_free(diff_find_candidates *cands)
+{
+	git_array_clear(cands->pairs);
+	git__free(cands->tgt_start);
+}
+
 int git_diff_find_similar(
 	git_diff_list *diff,
 	git_diff_find_options *given_opts)
 {
-	size_t s, t;
+	size_t s, t, c, num_cands;
 	int error = 0, similarity;
 	git_diff_delta *src, *tgt;
 	git_diff_find_options opts;
+	diff_find_candidates cands = { GIT_ARRAY_INIT, NULL };
+	bool use_cands = false;
 	size_t num_deltas, num_srcs = 0, num_tgts = 0;
 	size_t tried_srcs = 0, tried_tgts = 0;
 	size_t num_rewrites = 0, num_updates = 0, num_bumped = 0;
@@ -818,6 +1155,14 @@ int git_diff_find_similar(
 		GITERR_CHECK_ALLOC(tgt2src_copy);
 	}
 
+	if (use_find_candidates(&opts)) {
+		if ((error = find_candidates(&cands, diff, &opts, sigcache,
+				num_srcs, num_tgts)) < 0)
+			goto cleanup;
+
+		use_cands = true;
+	}
+
 	/*
 	 * Find best-fit matches for rename / copy candidates
 	 */
@@ -832,7 +1177,13 @@ find_best_matches:
 
 		tried_srcs = 0;
 
-		git_vector_foreach(&diff->deltas, s, src) {
+		num_cands = use_cands ?
+			cands.tgt_start[t + 1] - cands.tgt_start[t] : num_deltas;
+
+		for (c = 0; c < num_cands; ++c) {
+			s = use_cands ? cands.pairs.ptr[cands.tgt_start[t] + c].src : c;
+			src = GIT_VECTOR_GET(&diff->deltas, s);
+
 			/* skip things that are not rename sources */
 			if ((src->flags & GIT_DIFF_FLAG__IS_RENAME_SOURCE) == 0)
 				continue;
@@ -840,6 +1191,8 @@ find_best_matches:
 			/* calculate similarity for this pair and find best match */
 			if (s == t)
 				similarity = -1; /* don't measure self-similarity here */
+			else if (use_cands)
+				similarity = cands.pairs.ptr[cands.tgt_start[t] + c].similarity;
 			else if ((error = similarity_measure(
 				&similarity, diff, &opts, sigcache, 2 * s, 2 * t + 1)) < 0)
 				goto cleanup;
@@ -1046,6 +1399,7 @@ cleanup:
 	git__free(tgt2src);
 	git__free(src2tgt);
 	git__free(tgt2src_copy);
+	find_candidates_free(&cands);
 
 	for (t = 0; t < num_deltas * 2; ++t) {
 		if (sigcache[t] != NULL)
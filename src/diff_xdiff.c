@@ -9,6 +9,7 @@
 #include "diff_driver.h"
 #include "diff_patch.h"
 #include "diff_xdiff.h"
+#include "xdiff/xinclude.h"
 
 static int git_xdiff_scan_int(const char **str, int *value)
 {
@@ -143,6 +144,62 @@ static int git_xdiff(git_diff_output *output, git_diff_patch *patch)
 	return xo->output.error;
 }
 
+typedef struct {
+	size_t adds;
+	size_t dels;
+} git_xdiff_stats;
+
+/* Every change in the script is emitted in full, so it can be counted
+ * straight from there */
+static int git_xdiff_count(
+	xdfenv_t *xe, xdchange_t *xscr, xdemitcb_t *ecb, xdemitconf_t const *xecfg)
+{
+	git_xdiff_stats *stats = ecb->priv;
+
+	GIT_UNUSED(xe);
+	GIT_UNUSED(xecfg);
+
+	for (; xscr != NULL; xscr = xscr->next) {
+		stats->dels += (size_t)xscr->chg1;
+		stats->adds += (size_t)xscr->chg2;
+	}
+
+	return 0;
+}
+
+int git_xdiff_line_stats(
+	size_t *adds,
+	size_t *dels,
+	const git_xdiff_output *xo,
+	git_diff_patch *patch)
+{
+	git_xdiff_stats stats = { 0, 0 };
+	xdemitconf_t config;
+	xdemitcb_t callback;
+	mmfile_t xd_old_data, xd_new_data;
+
+	memcpy(&config, &xo->config, sizeof(config));
+	config.flags &= ~XDL_EMIT_FUNCNAMES;
+	config.find_func = NULL;
+	config.emit_func = (void (*)(void))git_xdiff_count;
+
+	memset(&callback, 0, sizeof(callback));
+	callback.priv = &stats;
+
+	git_diff_patch__old_data(&xd_old_data.ptr, &xd_old_data.size, patch);
+	git_diff_patch__new_data(&xd_new_data.ptr, &xd_new_data.size, patch);
+
+	if (xdl_diff(&xd_old_data, &xd_new_data,
+			&xo->params, &config, &callback) < 0) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	*adds = stats.adds;
+	*dels = stats.dels;
+	return 0;
+}
+
 void git_xdiff_init(git_xdiff_output *xo, const git_diff_options *opts)
 {
 	uint32_t flags = opts ? opts->flags : GIT_DIFF_NORMAL;
@@ -25,4 +25,14 @@ typedef struct {
 
 void git_xdiff_init(git_xdiff_output *xo, const git_diff_options *opts);
 
+/* Count the lines that the diff of `patch` adds and deletes, as `xo`
+ * would diff it, without emitting any of them.  This only reads `xo`,
+ * so one output can be shared between threads.
+ */
+int git_xdiff_line_stats(
+	size_t *adds,
+	size_t *dels,
+	const git_xdiff_output *xo,
+	git_diff_patch *patch);
+
 #endif
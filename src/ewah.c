@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "ewah.h"
+
+/*
+ * A marker word holds the bit that the run is made of in its lowest
+ * bit, the length of the run in the next 32 bits, and the number of
+ * literal words that follow the run in the 31 highest bits.
+ */
+#define RUNNING_BITS 32
+#define LITERAL_BITS 31
+
+#define MAX_RUNNING ((((uint64_t)1) << RUNNING_BITS) - 1)
+#define MAX_LITERAL ((((uint64_t)1) << LITERAL_BITS) - 1)
+
+#define MARKER(bit, run, literal) \
+	((uint64_t)(bit) | ((uint64_t)(run) << 1) | \
+	 ((uint64_t)(literal) << (1 + RUNNING_BITS)))
+
+static uint32_t get_be32(const unsigned char *buf)
+{
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+		((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+static uint64_t get_be64(const unsigned char *buf)
+{
+	return ((uint64_t)get_be32(buf) << 32) | get_be32(buf + 4);
+}
+
+static void put_be32(git_buf *out, uint32_t value)
+{
+	unsigned char buf[4];
+
+	buf[0] = (unsigned char)(value >> 24);
+	buf[1] = (unsigned char)(value >> 16);
+	buf[2] = (unsigned char)(value >> 8);
+	buf[3] = (unsigned char)value;
+
+	git_buf_put(out, (const char *)buf, sizeof(buf));
+}
+
+static void put_be64(git_buf *out, uint64_t value)
+{
+	put_be32(out, (uint32_t)(value >> 32));
+	put_be32(out, (uint32_t)value);
+}
+
+/* The word of `bv` at bit `pos`, which is a multiple of 64 */
+static uint64_t get_word(git_bitvec *bv, size_t bit_size, size_t pos)
+{
+	uint64_t word = bv->length ? bv->u.words[pos / 64] : bv->u.bits;
+
+	if (bit_size - pos < 64)
+		word &= (((uint64_t)1) << (bit_size - pos)) - 1;
+
+	return word;
+}
+
+static void set_word(git_bitvec *bv, size_t bit_size, size_t pos, uint64_t word)
+{
+	if (bit_size - pos < 64)
+		word &= (((uint64_t)1) << (bit_size - pos)) - 1;
+
+	if (bv->length)
+		bv->u.words[pos / 64] |= word;
+	else
+		bv->u.bits |= word;
+}
+
+size_t git_ewah_read(
+	git_bitvec *out, size_t *bit_size, const char *buffer, size_t buffer_size)
+{
+	const unsigned char *buf = (const unsigned char *)buffer;
+	size_t word_count, i;
+	uint64_t pos = 0;
+
+	if (buffer_size < 12)
+		return 0;
+
+	*bit_size = get_be32(buf);
+	word_count = get_be32(buf + 4);
+
+	if ((buffer_size - 12) / 8 < word_count)
+		return 0;
+
+	if (git_bitvec_init(out, *bit_size) < 0)
+		return 0;
+
+	buf += 8;
+
+	for (i = 0; i < word_count; ) {
+		uint64_t marker = get_be64(buf + 8 * i++);
+		uint64_t run = (marker >> 1) & MAX_RUNNING;
+		uint64_t literal = marker >> (1 + RUNNING_BITS);
+
+		if (literal > word_count - i)
+			goto corrupted;
+
+		for (; run > 0 && pos < *bit_size; run--, pos += 64)
+			if (marker & 1)
+				set_word(out, *bit_size, (size_t)pos, ~(uint64_t)0);
+
+		for (; literal > 0; literal--, i++) {
+			if (pos < *bit_size)
+				set_word(out, *bit_size, (size_t)pos, get_be64(buf + 8 * i));
+			pos += 64;
+		}
+	}
+
+	/* the words are followed by the position of the last marker */
+	return 8 + word_count * 8 + 4;
+
+corrupted:
+	git_bitvec_free(out);
+	return 0;
+}
+
+int git_ewah_write(git_buf *out, git_bitvec *bv, size_t bit_size)
+{
+	git_buf words = GIT_BUF_INIT;
+	size_t pos = 0, word_count = 0, last_marker = 0;
+
+	if (bit_size > UINT32_MAX) {
+		giterr_set(GITERR_INVALID, "Bitmap too large");
+		return -1;
+	}
+
+	do {
+		uint64_t run = 0, literal = 0, word = 0, marker;
+		size_t marker_pos = words.size;
+		int run_bit = 0, i;
+
+		/* room for the marker, which is known once its words are */
+		put_be64(&words, 0);
+		last_marker = word_count++;
+
+		if (pos < bit_size)
+			word = get_word(bv, bit_size, pos);
+
+		if (pos < bit_size && (word == 0 || word == ~(uint64_t)0)) {
+			run_bit = (word != 0);
+
+			while (pos < bit_size && run < MAX_RUNNING &&
+				get_word(bv, bit_size, pos) == word) {
+				run++;
+				pos += 64;
+			}
+		}
+
+		while (pos < bit_size && literal < MAX_LITERAL) {
+			word = get_word(bv, bit_size, pos);
+
+			/* leave runs to the next marker */
+			if ((word == 0 || word == ~(uint64_t)0) && literal > 0)
+				break;
+
+			put_be64(&words, word);
+			word_count++;
+			literal++;
+			pos += 64;
+		}
+
+		if (git_buf_oom(&words))
+			break;
+
+		marker = MARKER(run_bit, run, literal);
+		for (i = 7; i >= 0; --i, marker >>= 8)
+			words.ptr[marker_pos + i] = (char)(marker & 0xff);
+	} while (pos < bit_size);
+
+	if (git_buf_oom(&words)) {
+		git_buf_free(&words);
+		return -1;
+	}
+
+	put_be32(out, (uint32_t)bit_size);
+	put_be32(out, (uint32_t)word_count);
+	git_buf_put(out, words.ptr, words.size);
+	put_be32(out, (uint32_t)last_marker);
+
+	git_buf_free(&words);
+
+	return git_buf_oom(out) ? -1 : 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_ewah_h__
+#define INCLUDE_ewah_h__
+
+#include "common.h"
+#include "bitvec.h"
+#include "buffer.h"
+
+/*
+ * EWAH-compressed bitmaps, the way git stores them on disk (e.g. in the
+ * "link" extension of a split index): the bitmap is cut in 64-bit words,
+ * and each marker word tells how many empty or full words come next,
+ * then how many words follow as they are.
+ */
+
+/*
+ * Read a bitmap from `buffer` into `out`, which gets initialized with
+ * room for `bit_size` bits.  Returns the number of bytes read, or 0 if
+ * the bitmap is truncated or corrupted.
+ */
+extern size_t git_ewah_read(
+	git_bitvec *out, size_t *bit_size, const char *buffer, size_t buffer_size);
+
+/* Append the first `bit_size` bits of `bv` to `out`, compressed */
+extern int git_ewah_write(git_buf *out, git_bitvec *bv, size_t bit_size);
+
+#endif
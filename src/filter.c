@@ -229,6 +229,8 @@ int git_filter_register(
 	size_t nattr = 0, nmatch = 0;
 	git_buf attrs = GIT_BUF_INIT;
 
+	GITERR_CHECK_VERSION(filter, GIT_FILTER_VERSION, "git_filter");
+
 	if (filter_registry_initialize() < 0)
 		return -1;
 
@@ -570,92 +572,271 @@ static int filter_list_out_buffer_from_raw(
 	return 0;
 }
 
-int git_filter_list_apply_to_data(
-	git_buf *tgt, git_filter_list *fl, git_buf *src)
+/* writes what comes into a buffer */
+typedef struct {
+	git_writestream parent;
+	git_buf *target;
+} buf_stream;
+
+static int buf_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
 {
-	int error = 0;
-	uint32_t i;
-	git_buf *dbuffer[2], local = GIT_BUF_INIT;
-	unsigned int si = 0;
+	buf_stream *stream = (buf_stream *)s;
+	return git_buf_put(stream->target, buffer, len);
+}
 
-	if (!fl)
-		return filter_list_out_buffer_from_raw(tgt, src->ptr, src->size);
+static int buf_stream_close(git_writestream *s)
+{
+	GIT_UNUSED(s);
+	return 0;
+}
 
-	dbuffer[0] = src;
-	dbuffer[1] = tgt;
+static void buf_stream_free(git_writestream *s)
+{
+	GIT_UNUSED(s);
+}
 
-	/* if `src` buffer is reallocable, then use it, otherwise copy it */
-	if (!git_buf_is_allocated(src)) {
-		if (git_buf_set(&local, src->ptr, src->size) < 0)
-			return -1;
-		dbuffer[0] = &local;
+static void buf_stream_init(buf_stream *writer, git_buf *target)
+{
+	memset(writer, 0, sizeof(buf_stream));
+
+	writer->parent.write = buf_stream_write;
+	writer->parent.close = buf_stream_close;
+	writer->parent.free = buf_stream_free;
+	writer->target = target;
+
+	/* `target` may refer to data it does not own */
+	if (!git_buf_is_allocated(target))
+		git_buf_init(target, 0);
+	else
+		git_buf_clear(target);
+}
+
+/* collects all of the data for a filter which can only `apply` */
+typedef struct {
+	git_writestream parent;
+	git_filter *filter;
+	void **payload;
+	const git_filter_source *source;
+	git_buf input;
+	git_buf output;
+	git_writestream *target;
+} proxy_stream;
+
+static int proxy_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	proxy_stream *proxy = (proxy_stream *)s;
+	return git_buf_put(&proxy->input, buffer, len);
+}
+
+static int proxy_stream_close(git_writestream *s)
+{
+	proxy_stream *proxy = (proxy_stream *)s;
+	git_buf *filtered = &proxy->output;
+	int error;
+
+	error = proxy->filter->apply(
+		proxy->filter, proxy->payload,
+		&proxy->output, &proxy->input, proxy->source);
+
+	/* the filter decided not to process the data, so pass it on as is */
+	if (error == GIT_PASSTHROUGH) {
+		filtered = &proxy->input;
+		error = 0;
 	}
 
-	for (i = 0; i < git_array_size(fl->filters); ++i) {
-		unsigned int di = 1 - si;
-		uint32_t fidx = (fl->source.mode == GIT_FILTER_TO_WORKTREE) ?
-			i : git_array_size(fl->filters) - 1 - i;
-		git_filter_entry *fe = git_array_get(fl->filters, fidx);
+	git_buf_free(filtered == &proxy->input ?
+		&proxy->output : &proxy->input);
+
+	if (!error &&
+		!(error = proxy->target->write(
+			proxy->target, filtered->ptr, filtered->size)))
+		error = proxy->target->close(proxy->target);
+
+	return error;
+}
+
+static void proxy_stream_free(git_writestream *s)
+{
+	proxy_stream *proxy = (proxy_stream *)s;
+
+	git_buf_free(&proxy->input);
+	git_buf_free(&proxy->output);
+	git__free(proxy);
+}
 
-		dbuffer[di]->size = 0;
+static int proxy_stream_init(
+	git_writestream **out,
+	git_filter *filter,
+	void **payload,
+	const git_filter_source *source,
+	git_writestream *target)
+{
+	proxy_stream *proxy = git__calloc(1, sizeof(proxy_stream));
+	GITERR_CHECK_ALLOC(proxy);
+
+	proxy->parent.write = proxy_stream_write;
+	proxy->parent.close = proxy_stream_close;
+	proxy->parent.free = proxy_stream_free;
+	proxy->filter = filter;
+	proxy->payload = payload;
+	proxy->source = source;
+	proxy->target = target;
+
+	*out = (git_writestream *)proxy;
+	return 0;
+}
 
-		/* Apply the filter from dbuffer[src] to the other buffer;
-		 * if the filtering is canceled by the user mid-filter,
-		 * we skip to the next filter without changing the source
-		 * of the double buffering (so that the text goes through
-		 * cleanly).
-		 */
+static void stream_list_free(git_vector *streams)
+{
+	git_writestream *stream;
+	size_t i;
 
-		error = fe->filter->apply(
-			fe->filter, &fe->payload, dbuffer[di], dbuffer[si], &fl->source);
+	git_vector_foreach(streams, i, stream)
+		stream->free(stream);
+	git_vector_free(streams);
+}
+
+/* chain a stream for each filter in front of `target`, in the order the
+ * filters are applied in, and point `out` at the first of them
+ */
+static int stream_list_init(
+	git_writestream **out,
+	git_vector *streams,
+	git_filter_list *filters,
+	git_writestream *target)
+{
+	git_writestream *next = target, *stream;
+	size_t count = git_filter_list_length(filters), i;
+	int error = 0;
+
+	/* the last filter to be applied is set up first */
+	for (i = 0; i < count; ++i) {
+		size_t fidx = (filters->source.mode == GIT_FILTER_TO_WORKTREE) ?
+			count - 1 - i : i;
+		git_filter_entry *fe = git_array_get(filters->filters, fidx);
+
+		if (fe->filter->version >= 2 && fe->filter->stream)
+			error = fe->filter->stream(
+				&stream, fe->filter, &fe->payload, &filters->source, next);
+		else
+			error = proxy_stream_init(
+				&stream, fe->filter, &fe->payload, &filters->source, next);
 
 		if (error == GIT_PASSTHROUGH) {
-			/* PASSTHROUGH means filter decided not to process the buffer */
 			error = 0;
-		} else if (!error) {
-			git_buf_shorten(dbuffer[di], 0); /* force NUL termination */
-			si = di; /* swap buffers */
-		} else {
-			tgt->size = 0;
+			continue;
+		} else if (error < 0)
 			return error;
+
+		if (git_vector_insert(streams, stream) < 0) {
+			stream->free(stream);
+			return -1;
 		}
+
+		next = stream;
 	}
 
-	/* Ensure that the output ends up in dbuffer[1] (i.e. the dest) */
-	if (si != 1)
-		git_buf_swap(dbuffer[0], dbuffer[1]);
+	*out = next;
+	return 0;
+}
 
-	git_buf_free(&local); /* don't leak if we allocated locally */
+/* how much of a file or buffer is handed to the filters at a time */
+#define FILTER_CHUNK_SIZE (64 * 1024)
 
-	return 0;
+int git_filter_list_stream_data(
+	git_filter_list *filters,
+	git_buf *data,
+	git_writestream *target)
+{
+	git_vector streams = GIT_VECTOR_INIT;
+	git_writestream *stream;
+	size_t written = 0, len;
+	int error;
+
+	if ((error = stream_list_init(&stream, &streams, filters, target)) < 0)
+		goto done;
+
+	while (written < data->size) {
+		len = min(data->size - written, FILTER_CHUNK_SIZE);
+
+		if ((error = stream->write(stream, data->ptr + written, len)) < 0)
+			goto done;
+
+		written += len;
+	}
+
+	error = stream->close(stream);
+
+done:
+	stream_list_free(&streams);
+	return error;
 }
 
-int git_filter_list_apply_to_file(
-	git_buf *out,
+int git_filter_list__stream_fd(
 	git_filter_list *filters,
-	git_repository *repo,
-	const char *path)
+	git_file fd,
+	git_writestream *target)
 {
+	git_vector streams = GIT_VECTOR_INIT;
+	git_writestream *stream;
+	char *buffer = NULL;
+	ssize_t read_len = 0;
 	int error;
-	const char *base = repo ? git_repository_workdir(repo) : NULL;
-	git_buf abspath = GIT_BUF_INIT, raw = GIT_BUF_INIT;
 
-	if (!(error = git_path_join_unrooted(&abspath, path, base, NULL)) &&
-		!(error = git_futils_readbuffer(&raw, abspath.ptr)))
-	{
-		error = git_filter_list_apply_to_data(out, filters, &raw);
+	if ((error = stream_list_init(&stream, &streams, filters, target)) < 0)
+		goto done;
+
+	if ((buffer = git__malloc(FILTER_CHUNK_SIZE)) == NULL) {
+		error = -1;
+		goto done;
+	}
 
-		git_buf_free(&raw);
+	while ((read_len = p_read(fd, buffer, FILTER_CHUNK_SIZE)) > 0) {
+		if ((error = stream->write(stream, buffer, (size_t)read_len)) < 0)
+			goto done;
+	}
+
+	if (read_len < 0) {
+		giterr_set(GITERR_OS, "Failed to read file to filter");
+		error = -1;
+	} else
+		error = stream->close(stream);
+
+done:
+	git__free(buffer);
+	stream_list_free(&streams);
+	return error;
+}
+
+int git_filter_list_stream_file(
+	git_filter_list *filters,
+	git_repository *repo,
+	const char *path,
+	git_writestream *target)
+{
+	int error, fd;
+	const char *base = repo ? git_repository_workdir(repo) : NULL;
+	git_buf abspath = GIT_BUF_INIT;
+
+	if (!(error = git_path_join_unrooted(&abspath, path, base, NULL))) {
+		if ((fd = git_futils_open_ro(abspath.ptr)) < 0)
+			error = fd;
+		else {
+			error = git_filter_list__stream_fd(filters, fd, target);
+			p_close(fd);
+		}
 	}
 
 	git_buf_free(&abspath);
 	return error;
 }
 
-int git_filter_list_apply_to_blob(
-	git_buf *out,
+int git_filter_list_stream_blob(
 	git_filter_list *filters,
-	git_blob *blob)
+	git_blob *blob,
+	git_writestream *target)
 {
 	git_buf in = GIT_BUF_INIT;
 	git_off_t rawsize = git_blob_rawsize(blob);
@@ -672,5 +853,83 @@ int git_filter_list_apply_to_blob(
 	if (filters)
 		git_oid_cpy(&filters->source.oid, git_blob_id(blob));
 
-	return git_filter_list_apply_to_data(out, filters, &in);
+	return git_filter_list_stream_data(filters, &in, target);
+}
+
+int git_filter_list_apply_to_data(
+	git_buf *tgt, git_filter_list *fl, git_buf *src)
+{
+	buf_stream writer;
+	int error;
+
+	if (!fl)
+		return filter_list_out_buffer_from_raw(tgt, src->ptr, src->size);
+
+	buf_stream_init(&writer, tgt);
+
+	if ((error = git_filter_list_stream_data(fl, src, &writer.parent)) < 0)
+		tgt->size = 0;
+
+	return error;
+}
+
+int git_filter_list__apply_to_fd(
+	git_buf *out, git_filter_list *filters, git_file fd)
+{
+	buf_stream writer;
+	int error;
+
+	buf_stream_init(&writer, out);
+
+	if ((error = git_filter_list__stream_fd(filters, fd, &writer.parent)) < 0)
+		out->size = 0;
+
+	return error;
+}
+
+int git_filter_list_apply_to_file(
+	git_buf *out,
+	git_filter_list *filters,
+	git_repository *repo,
+	const char *path)
+{
+	buf_stream writer;
+	int error;
+
+	buf_stream_init(&writer, out);
+
+	if ((error = git_filter_list_stream_file(
+			filters, repo, path, &writer.parent)) < 0)
+		out->size = 0;
+
+	return error;
+}
+
+int git_filter_list_apply_to_blob(
+	git_buf *out,
+	git_filter_list *filters,
+	git_blob *blob)
+{
+	buf_stream writer;
+	int error;
+
+	if (!filters) {
+		git_off_t rawsize = git_blob_rawsize(blob);
+
+		if (!git__is_sizet(rawsize)) {
+			giterr_set(GITERR_OS, "Blob is too large to filter");
+			return -1;
+		}
+
+		return filter_list_out_buffer_from_raw(
+			out, git_blob_rawcontent(blob), (size_t)rawsize);
+	}
+
+	buf_stream_init(&writer, out);
+
+	if ((error = git_filter_list_stream_blob(
+			filters, blob, &writer.parent)) < 0)
+		out->size = 0;
+
+	return error;
 }
@@ -9,6 +9,8 @@
 
 #include "common.h"
 #include "git2/filter.h"
+#include "buffer.h"
+#include "posix.h"
 
 typedef enum {
 	GIT_CRLF_GUESS = -1,
@@ -21,6 +23,16 @@ typedef enum {
 
 extern void git_filter_free(git_filter *filter);
 
+/*
+ * Filter the contents of an open file, read a chunk at a time, into a
+ * stream or a buffer
+ */
+extern int git_filter_list__stream_fd(
+	git_filter_list *filters, git_file fd, git_writestream *target);
+
+extern int git_filter_list__apply_to_fd(
+	git_buf *out, git_filter_list *filters, git_file fd);
+
 /*
  * Available filters
  */
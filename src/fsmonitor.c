@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "fsmonitor.h"
+
+#ifdef GIT_USE_INOTIFY
+
+#include <sys/inotify.h>
+
+#include "path.h"
+#include "posix.h"
+#include "strmap.h"
+#include "thread-utils.h"
+
+GIT__USE_STRMAP;
+
+#define WATCH_MASK \
+	(IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+	 IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | \
+	 IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+typedef struct {
+	size_t seq;
+	char path[GIT_FLEX_ARRAY];
+} fsmonitor_change;
+
+struct git_fsmonitor {
+	int fd;
+	git_buf workdir;
+
+	/* the directory of each watch, by watch descriptor */
+	git_vector watches;
+
+	/* the last change of each path, as the number of changes so far */
+	git_strmap *changes;
+	size_t seq;
+
+	/* the changes up to this one may have been lost */
+	size_t lost_seq;
+
+	/* what the tokens of this monitor start with */
+	git_buf token_prefix;
+};
+
+static git_atomic monitor_count;
+
+static int watch_tree(git_fsmonitor *mon, git_buf *path);
+
+static int watch_tree_cb(void *payload, git_buf *path)
+{
+	git_fsmonitor *mon = payload;
+	struct stat st;
+
+	/* the repository itself, and those of submodules, are left alone */
+	if (!git__suffixcmp(path->ptr, "/.git") ||
+		p_lstat(path->ptr, &st) < 0 || !S_ISDIR(st.st_mode))
+		return 0;
+
+	return watch_tree(mon, path);
+}
+
+/* Watch the directory `path` and every directory below it */
+static int watch_tree(git_fsmonitor *mon, git_buf *path)
+{
+	const char *relative = path->ptr + mon->workdir.size;
+	char *dir;
+	int wd;
+
+	if ((wd = inotify_add_watch(mon->fd, path->ptr, WATCH_MASK)) < 0) {
+		/* gone before we got to it; its parent saw it go */
+		if (errno == ENOENT || errno == ENOTDIR)
+			return 0;
+
+		giterr_set(GITERR_OS, "Failed to watch '%s'%s", path->ptr,
+			(errno == ENOSPC) ? " (fs.inotify.max_user_watches is too low)" : "");
+		return -1;
+	}
+
+	while (mon->watches.length <= (size_t)wd) {
+		if (git_vector_insert(&mon->watches, NULL) < 0)
+			return -1;
+	}
+
+	/* a directory watched twice keeps its watch, under its new name */
+	dir = git__strdup(relative);
+	GITERR_CHECK_ALLOC(dir);
+
+	git__free(mon->watches.contents[wd]);
+	mon->watches.contents[wd] = dir;
+
+	return git_path_direach(path, 0, watch_tree_cb, mon);
+}
+
+static int watch_tree_at(git_fsmonitor *mon, const char *relative)
+{
+	git_buf path = GIT_BUF_INIT;
+	int error;
+
+	if ((error = git_buf_joinpath(&path, mon->workdir.ptr, relative)) == 0)
+		error = watch_tree(mon, &path);
+
+	git_buf_free(&path);
+	return error;
+}
+
+/* Stop watching `relative` and what is below it, whose names are gone */
+static void unwatch_tree(git_fsmonitor *mon, const char *relative)
+{
+	size_t len = strlen(relative), wd;
+	char *dir;
+
+	git_vector_foreach(&mon->watches, wd, dir) {
+		if (dir == NULL || strncmp(dir, relative, len) != 0 ||
+			(dir[len] != '\0' && dir[len] != '/'))
+			continue;
+
+		inotify_rm_watch(mon->fd, (int)wd);
+
+		git__free(dir);
+		mon->watches.contents[wd] = NULL;
+	}
+}
+
+static int record_change(git_fsmonitor *mon, const char *path)
+{
+	fsmonitor_change *change;
+	size_t path_len = strlen(path);
+	khiter_t pos;
+	int error;
+
+	pos = git_strmap_lookup_index(mon->changes, path);
+
+	if (git_strmap_valid_index(mon->changes, pos)) {
+		change = git_strmap_value_at(mon->changes, pos);
+		change->seq = ++mon->seq;
+		return 0;
+	}
+
+	change = git__malloc(sizeof(fsmonitor_change) + path_len + 1);
+	GITERR_CHECK_ALLOC(change);
+
+	change->seq = ++mon->seq;
+	memcpy(change->path, path, path_len + 1);
+
+	git_strmap_insert(mon->changes, change->path, change, error);
+
+	if (error < 0) {
+		git__free(change);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Everything may have changed; find the directories we missed */
+static int lose_changes(git_fsmonitor *mon)
+{
+	mon->lost_seq = ++mon->seq;
+	return watch_tree_at(mon, "");
+}
+
+static int process_event(
+	git_fsmonitor *mon, const struct inotify_event *event, git_buf *path)
+{
+	const char *dir;
+	int error;
+
+	if (event->mask & IN_Q_OVERFLOW)
+		return lose_changes(mon);
+
+	if ((size_t)event->wd >= mon->watches.length ||
+		(dir = git_vector_get(&mon->watches, event->wd)) == NULL)
+		return 0;
+
+	/* the kernel dropped the watch, as the directory went away */
+	if (event->mask & IN_IGNORED) {
+		git__free(mon->watches.contents[event->wd]);
+		mon->watches.contents[event->wd] = NULL;
+		return 0;
+	}
+
+	if (event->len == 0 || !event->name[0])
+		error = git_buf_sets(path, dir);
+	else if (*dir)
+		error = git_buf_join(path, '/', dir, event->name);
+	else
+		error = git_buf_sets(path, event->name);
+
+	if (error < 0)
+		return error;
+
+	if (!*dir && !strcmp(path->ptr, ".git"))
+		return 0;
+
+	/* the whole working directory went away, or moved */
+	if (!path->size)
+		return lose_changes(mon);
+
+	if ((error = record_change(mon, path->ptr)) < 0)
+		return error;
+
+	if (!(event->mask & IN_ISDIR))
+		return 0;
+
+	if (event->mask & IN_MOVED_FROM)
+		unwatch_tree(mon, path->ptr);
+	else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+		error = watch_tree_at(mon, path->ptr);
+
+	return error;
+}
+
+/* Record the changes that were reported since we last looked */
+static int read_events(git_fsmonitor *mon)
+{
+	union {
+		struct inotify_event event;
+		char data[4096 + sizeof(struct inotify_event)];
+	} buf;
+	git_buf path = GIT_BUF_INIT;
+	ssize_t len;
+	int error = 0;
+
+	while (!error) {
+		const char *ptr;
+
+		if ((len = read(mon->fd, buf.data, sizeof(buf.data))) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EAGAIN) {
+				giterr_set(GITERR_OS, "Failed to read file system events");
+				error = -1;
+			}
+
+			break;
+		}
+
+		for (ptr = buf.data; !error && ptr < buf.data + len; ) {
+			const struct inotify_event *event =
+				(const struct inotify_event *)ptr;
+
+			error = process_event(mon, event, &path);
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	git_buf_free(&path);
+	return error;
+}
+
+int git_fsmonitor_new(git_fsmonitor **out, const char *workdir)
+{
+	git_fsmonitor *mon;
+
+	*out = NULL;
+
+	mon = git__calloc(1, sizeof(git_fsmonitor));
+	GITERR_CHECK_ALLOC(mon);
+
+	if ((mon->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+		giterr_set(GITERR_OS, "Failed to start monitoring the file system");
+		git__free(mon);
+		return -1;
+	}
+
+	if (git_buf_sets(&mon->workdir, workdir) < 0 ||
+		git_path_to_dir(&mon->workdir) < 0 ||
+		git_vector_init(&mon->watches, 0, NULL) < 0 ||
+		(mon->changes = git_strmap_alloc()) == NULL ||
+		git_buf_printf(&mon->token_prefix, "libgit2:%ld.%ld.%d:",
+			(long)getpid(), (long)time(NULL),
+			git_atomic_inc(&monitor_count)) < 0 ||
+		watch_tree_at(mon, "") < 0) {
+		git_fsmonitor_free(mon);
+		return -1;
+	}
+
+	*out = mon;
+	return 0;
+}
+
+int git_fsmonitor_changes(
+	git_vector *paths, git_buf *token, git_fsmonitor *mon, const char *since)
+{
+	fsmonitor_change *change;
+	int64_t since_seq;
+	const char *end;
+
+	if (read_events(mon) < 0)
+		return -1;
+
+	git_buf_clear(token);
+	if (git_buf_printf(token, "%s%"PRIuZ, mon->token_prefix.ptr, mon->seq) < 0)
+		return -1;
+
+	if (!since || git__prefixcmp(since, mon->token_prefix.ptr) != 0 ||
+		git__strtol64(&since_seq, since + mon->token_prefix.size, &end, 10) < 0 ||
+		*end || since_seq < (int64_t)mon->lost_seq ||
+		since_seq > (int64_t)mon->seq) {
+		giterr_clear();
+		return 1;
+	}
+
+	git_strmap_foreach_value(mon->changes, change, {
+		char *path;
+
+		if (change->seq <= (size_t)since_seq)
+			continue;
+
+		if ((path = git__strdup(change->path)) == NULL ||
+			git_vector_insert(paths, path) < 0) {
+			git__free(path);
+			return -1;
+		}
+	});
+
+	git_vector_sort(paths);
+	return 0;
+}
+
+void git_fsmonitor_free(git_fsmonitor *mon)
+{
+	fsmonitor_change *change;
+	char *dir;
+	size_t i;
+
+	if (mon == NULL)
+		return;
+
+	if (mon->fd >= 0)
+		p_close(mon->fd);
+
+	git_vector_foreach(&mon->watches, i, dir)
+		git__free(dir);
+	git_vector_free(&mon->watches);
+
+	if (mon->changes) {
+		git_strmap_foreach_value(mon->changes, change, {
+			git__free(change);
+		});
+		git_strmap_free(mon->changes);
+	}
+
+	git_buf_free(&mon->workdir);
+	git_buf_free(&mon->token_prefix);
+	git__free(mon);
+}
+
+#else
+
+int git_fsmonitor_new(git_fsmonitor **out, const char *workdir)
+{
+	GIT_UNUSED(workdir);
+
+	*out = NULL;
+	giterr_set(GITERR_INVALID,
+		"File system monitoring is not supported on this platform");
+	return -1;
+}
+
+int git_fsmonitor_changes(
+	git_vector *paths, git_buf *token, git_fsmonitor *mon, const char *since)
+{
+	GIT_UNUSED(paths);
+	GIT_UNUSED(token);
+	GIT_UNUSED(mon);
+	GIT_UNUSED(since);
+
+	return 1;
+}
+
+void git_fsmonitor_free(git_fsmonitor *mon)
+{
+	GIT_UNUSED(mon);
+}
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_fsmonitor_h__
+#define INCLUDE_fsmonitor_h__
+
+#include "common.h"
+#include "vector.h"
+#include "buffer.h"
+
+/*
+ * A file system monitor watches the working directory for as long as it
+ * lives, and tells which paths changed since a token it gave out.  The
+ * token is kept in the index, so that status only has to look again at
+ * the entries whose paths changed since the last time it looked.
+ *
+ * It is built on inotify, and only available on Linux.
+ */
+typedef struct git_fsmonitor git_fsmonitor;
+
+/* Start watching the working directory `workdir` */
+extern int git_fsmonitor_new(git_fsmonitor **out, const char *workdir);
+
+/*
+ * Fill `paths` with the paths (relative to the working directory) that
+ * changed since the monitor gave out `since`, and `token` with a token
+ * for this point in time.  A path stands for itself and whatever is
+ * below it.
+ *
+ * Returns 1, with no paths, when the monitor cannot tell: `since` is
+ * NULL, was not given out by this monitor, or some changes since then
+ * were lost.
+ */
+extern int git_fsmonitor_changes(
+	git_vector *paths, git_buf *token, git_fsmonitor *mon, const char *since);
+
+extern void git_fsmonitor_free(git_fsmonitor *mon);
+
+#endif
@@ -10,16 +10,36 @@
 #include "merge.h"
 #include "git2/graph.h"
 
+/*
+ * Without generation numbers we have to keep marking while anything is
+ * non-STALE.  Once every queued commit has a generation number, commits
+ * are popped in topological order and their flags are final, so we can
+ * stop as soon as everything left in the queue is reachable from both
+ * sides: `ahead_behind` never walks past such a commit.
+ */
 static int interesting(git_pqueue *list, git_commit_list *roots)
 {
 	unsigned int i;
+	int all_finite = 1, all_common = 1, nonstale = 0;
+
 	/* element 0 isn't used - we need to start at 1 */
 	for (i = 1; i < list->size; i++) {
 		git_commit_list_node *commit = list->d[i];
+
+		if (commit->generation == GIT_COMMIT_GENERATION_INFINITY)
+			all_finite = 0;
+		if ((commit->flags & (PARENT1 | PARENT2)) != (PARENT1 | PARENT2))
+			all_common = 0;
 		if ((commit->flags & STALE) == 0)
-			return 1;
+			nonstale = 1;
 	}
 
+	if (all_finite && all_common)
+		return 0;
+
+	if (nonstale)
+		return 1;
+
 	while(roots) {
 		if ((roots->item->flags & STALE) == 0)
 			return 1;
@@ -42,7 +62,7 @@ static int mark_parents(git_revwalk *walk, git_commit_list_node *one,
 		return 0;
 	}
 
-	if (git_pqueue_init(&list, 2, git_commit_list_time_cmp) < 0)
+	if (git_pqueue_init(&list, 2, git_commit_list_generation_cmp) < 0)
 		return -1;
 
 	if (git_commit_list_parse(walk, one) < 0)
@@ -75,7 +95,8 @@ static int mark_parents(git_revwalk *walk, git_commit_list_node *one,
 		}
 
 		for (i = 0; i < commit->out_degree; i++) {
-			git_commit_list_node *p = commit->parents[i];
+			git_commit_list_node *p =
+				git_revwalk__commit_parent(walk, commit, i);
 			if ((p->flags & flags) == flags)
 				continue;
 
@@ -105,7 +126,8 @@ on_error:
 }
 
 
-static int ahead_behind(git_commit_list_node *one, git_commit_list_node *two,
+static int ahead_behind(git_revwalk *walk,
+	git_commit_list_node *one, git_commit_list_node *two,
 	size_t *ahead, size_t *behind)
 {
 	git_commit_list_node *commit;
@@ -131,7 +153,8 @@ static int ahead_behind(git_commit_list_node *one, git_commit_list_node *two,
 			(*ahead)++;
 
 		for (i = 0; i < commit->out_degree; i++) {
-			git_commit_list_node *p = commit->parents[i];
+			git_commit_list_node *p =
+				git_revwalk__commit_parent(walk, commit, i);
 			if (git_pqueue_insert(&pq, p) < 0)
 				return -1;
 		}
@@ -165,7 +188,7 @@ int git_graph_ahead_behind(size_t *ahead, size_t *behind, git_repository *repo,
 
 	if (mark_parents(walk, commit_l, commit_u) < 0)
 		goto on_error;
-	if (ahead_behind(commit_l, commit_u, ahead, behind) < 0)
+	if (ahead_behind(walk, commit_l, commit_u, ahead, behind) < 0)
 		goto on_error;
 
 	git_revwalk_free(walk);
@@ -176,3 +199,237 @@ on_error:
 	git_revwalk_free(walk);
 	return -1;
 }
+
+/*
+ * Batched ahead/behind: one walk from the upstream and all the locals at
+ * once.  Every commit we meet carries a bitset of the tips it can be
+ * reached from (bit 0 for the upstream, bit `i + 1` for `local[i]`),
+ * which is or-ed into its parents.  Commits reachable from every tip
+ * count for nobody, so the walk can stop once only those are left
+ * queued, as long as they all have generation numbers: the queue is then
+ * popped in topological order and nothing left in it can reach a commit
+ * that was already popped.  A commit without one is popped by date, so
+ * with skewed dates it may still pass its tips on to such a commit,
+ * which is then queued again.
+ */
+typedef struct {
+	git_commit_list_node *commit;
+	unsigned int queued:1;
+	uint32_t bits[GIT_FLEX_ARRAY];
+} tips_node;
+
+typedef struct {
+	git_revwalk *walk;
+	git_oidmap *nodes;
+	git_pool pool;
+	git_vector visited;
+	git_pqueue queue;
+
+	size_t words;
+	uint32_t last_mask;
+
+	/* number of queued nodes not reachable from every tip */
+	size_t partial;
+
+	/* number of queued nodes without a generation number */
+	size_t infinite;
+} tips_walk;
+
+static int tips_node_cmp(void *a, void *b)
+{
+	return git_commit_list_generation_cmp(
+		((tips_node *)a)->commit, ((tips_node *)b)->commit);
+}
+
+static int tips_node_full(tips_walk *tw, tips_node *node)
+{
+	size_t i;
+
+	for (i = 0; i < tw->words - 1; i++)
+		if (node->bits[i] != 0xFFFFFFFF)
+			return 0;
+
+	return (node->bits[i] == tw->last_mask);
+}
+
+static tips_node *tips_node_lookup(tips_walk *tw, const git_oid *oid)
+{
+	git_commit_list_node *commit;
+	tips_node *node;
+	khiter_t pos;
+	int ret;
+
+	pos = kh_get(oid, tw->nodes, oid);
+	if (pos != kh_end(tw->nodes))
+		return kh_value(tw->nodes, pos);
+
+	if ((commit = git_revwalk__commit_lookup(tw->walk, oid)) == NULL ||
+		git_commit_list_parse(tw->walk, commit) < 0)
+		return NULL;
+
+	node = git_pool_mallocz(&tw->pool, 1);
+	if (!node || git_vector_insert(&tw->visited, node) < 0)
+		return NULL;
+
+	node->commit = commit;
+
+	pos = kh_put(oid, tw->nodes,
+		git_revwalk__commit_oid(tw->walk, commit), &ret);
+	assert(ret != 0);
+	kh_value(tw->nodes, pos) = node;
+
+	return node;
+}
+
+/* Add the tips of `bits` to `node`, queueing it if that changed it. */
+static int tips_node_mark(tips_walk *tw, tips_node *node, const uint32_t *bits)
+{
+	size_t i;
+	int changed = 0, was_full = node->queued && tips_node_full(tw, node);
+
+	for (i = 0; i < tw->words; i++) {
+		if ((node->bits[i] | bits[i]) != node->bits[i]) {
+			node->bits[i] |= bits[i];
+			changed = 1;
+		}
+	}
+
+	if (!changed)
+		return 0;
+
+	if (node->queued) {
+		if (!was_full && tips_node_full(tw, node))
+			tw->partial--;
+		return 0;
+	}
+
+	if (git_pqueue_insert(&tw->queue, node) < 0)
+		return -1;
+
+	node->queued = 1;
+	if (!tips_node_full(tw, node))
+		tw->partial++;
+	if (node->commit->generation == GIT_COMMIT_GENERATION_INFINITY)
+		tw->infinite++;
+
+	return 0;
+}
+
+static int tips_walk_run(tips_walk *tw)
+{
+	tips_node *node, *parent;
+	unsigned int i;
+
+	while ((tw->partial || tw->infinite) &&
+		(node = git_pqueue_pop(&tw->queue)) != NULL) {
+		node->queued = 0;
+		if (!tips_node_full(tw, node))
+			tw->partial--;
+		if (node->commit->generation == GIT_COMMIT_GENERATION_INFINITY)
+			tw->infinite--;
+
+		for (i = 0; i < node->commit->out_degree; i++) {
+			if ((parent = tips_node_lookup(tw, git_revwalk__commit_oid(tw->walk,
+					git_revwalk__commit_parent(tw->walk, node->commit, i)))) == NULL ||
+				tips_node_mark(tw, parent, node->bits) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * A commit reachable from the upstream but not from `local[i]` is in
+ * `ahead[i]`, and one reachable from `local[i]` but not the upstream is
+ * in `behind[i]`; go over the set (or unset) bits a word at a time.
+ */
+static void tips_walk_count(
+	size_t *ahead, size_t *behind, tips_walk *tw, size_t length)
+{
+	tips_node *node;
+	size_t i, w, bit;
+	uint32_t word;
+
+	memset(ahead, 0, length * sizeof(size_t));
+	memset(behind, 0, length * sizeof(size_t));
+
+	git_vector_foreach(&tw->visited, i, node) {
+		int upstream = (node->bits[0] & 1);
+		size_t *counts = upstream ? ahead : behind;
+
+		for (w = 0; w < tw->words; w++) {
+			word = upstream ? ~node->bits[w] : node->bits[w];
+
+			if (w == 0)
+				word &= ~1u;
+			if (w == tw->words - 1)
+				word &= tw->last_mask;
+
+			for (bit = w * 32; word; word >>= 1, bit++) {
+				if (word & 1)
+					counts[bit - 1]++;
+			}
+		}
+	}
+}
+
+int git_graph_ahead_behind_many(
+	size_t *ahead,
+	size_t *behind,
+	git_repository *repo,
+	const git_oid local_array[],
+	size_t length,
+	const git_oid *upstream)
+{
+	tips_walk tw;
+	tips_node *node;
+	uint32_t *bits = NULL;
+	size_t i, nbits = length + 1;
+	int error = -1;
+
+	assert(ahead && behind && repo && upstream && (local_array || !length));
+
+	memset(&tw, 0, sizeof(tw));
+
+	tw.words = (nbits + 31) / 32;
+	tw.last_mask = (nbits % 32) ? ((1u << (nbits % 32)) - 1) : 0xFFFFFFFF;
+
+	if (git_revwalk_new(&tw.walk, repo) < 0)
+		return -1;
+
+	if ((tw.nodes = git_oidmap_alloc()) == NULL ||
+		(bits = git__calloc(tw.words, sizeof(uint32_t))) == NULL ||
+		git_pool_init(&tw.pool, (uint32_t)(sizeof(tips_node) +
+			tw.words * sizeof(uint32_t)), 0) < 0 ||
+		git_vector_init(&tw.visited, 64, NULL) < 0 ||
+		git_pqueue_init(&tw.queue, nbits, tips_node_cmp) < 0)
+		goto done;
+
+	for (i = 0; i < nbits; i++) {
+		const git_oid *tip = i ? &local_array[i - 1] : upstream;
+
+		memset(bits, 0, tw.words * sizeof(uint32_t));
+		bits[i / 32] = (1u << (i % 32));
+
+		if ((node = tips_node_lookup(&tw, tip)) == NULL ||
+			tips_node_mark(&tw, node, bits) < 0)
+			goto done;
+	}
+
+	if (tips_walk_run(&tw) < 0)
+		goto done;
+
+	tips_walk_count(ahead, behind, &tw, length);
+	error = 0;
+
+done:
+	git__free(bits);
+	git_pqueue_free(&tw.queue);
+	git_vector_free(&tw.visited);
+	git_pool_clear(&tw.pool);
+	if (tw.nodes)
+		git_oidmap_free(tw.nodes);
+	git_revwalk_free(tw.walk);
+	return error;
+}
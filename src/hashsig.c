@@ -7,6 +7,13 @@
 #include "hashsig.h"
 #include "fileops.h"
 #include "util.h"
+#include "array.h"
+
+#define kmalloc git__malloc
+#define kcalloc git__calloc
+#define krealloc git__realloc
+#define kfree git__free
+#include "khash.h"
 
 typedef uint32_t hashsig_t;
 typedef uint64_t hashsig_state;
@@ -345,3 +352,241 @@ int git_hashsig_compare(const git_hashsig *a, const git_hashsig *b)
 		return (hashsig_heap_compare(&a->mins, &b->mins) +
 				hashsig_heap_compare(&a->maxs, &b->maxs)) / 2;
 }
+
+/*
+ * Two signatures are scored by the share of the hashes that they have in
+ * common in their heaps of smallest hashes and of largest hashes, so a
+ * pair that scores `threshold` has at least that share in one of the two.
+ *
+ * Two heaps that have that share in common have to share one of the
+ * first few hashes of each, when both are put in the same order, which
+ * is how similar pairs are found without comparing them all (this is
+ * known as prefix filtering).  The order puts the hashes which are rare
+ * among all signatures first, so that those first few of unrelated files
+ * do not meet by chance.
+ *
+ * A hash which is in a heap more than once is told apart from the other
+ * times it is there, as `hashsig_heap_compare` only matches it as many
+ * times as it is in both heaps.
+ */
+
+#define HASHSIG_TOKEN(V,HEAP,N) \
+	(((uint64_t)(V) << 8) | ((uint64_t)(HEAP) << 7) | (uint64_t)(N))
+
+__KHASH_TYPE(hashsig_freq, uint64_t, uint32_t);
+__KHASH_IMPL(hashsig_freq, static kh_inline, uint64_t, uint32_t, 1,
+	kh_int64_hash_func, kh_int64_hash_equal);
+
+typedef khash_t(hashsig_freq) hashsig_freqs;
+
+typedef struct {
+	uint64_t token;
+	uint32_t freq;
+} hashsig_ranked;
+
+typedef struct {
+	uint64_t token;
+	size_t idx;
+} hashsig_posting;
+
+static size_t hashsig_heap_tokens(
+	uint64_t *out, const hashsig_heap *h, int heap)
+{
+	int i, n = 0;
+
+	for (i = 0; i < h->size; ++i) {
+		/* equal hashes sit next to each other in a sorted heap */
+		n = (i > 0 && h->values[i] == h->values[i - 1]) ? n + 1 : 0;
+		out[i] = HASHSIG_TOKEN(h->values[i], heap, n);
+	}
+
+	return (size_t)h->size;
+}
+
+static int hashsig_count_tokens(hashsig_freqs *freqs, const git_hashsig *sig)
+{
+	uint64_t tokens[HASHSIG_HEAP_SIZE];
+	size_t count, i;
+	khiter_t pos;
+	int heap, rval;
+
+	for (heap = 0; heap < 2; ++heap) {
+		count = hashsig_heap_tokens(
+			tokens, heap ? &sig->maxs : &sig->mins, heap);
+
+		for (i = 0; i < count; ++i) {
+			pos = kh_put(hashsig_freq, freqs, tokens[i], &rval);
+			if (rval < 0) {
+				giterr_set_oom();
+				return -1;
+			}
+			if (rval)
+				kh_val(freqs, pos) = 0;
+			kh_val(freqs, pos)++;
+		}
+	}
+
+	return 0;
+}
+
+static int hashsig_ranked_cmp(const void *a, const void *b, void *payload)
+{
+	const hashsig_ranked *ra = a, *rb = b;
+	GIT_UNUSED(payload);
+
+	if (ra->freq != rb->freq)
+		return (ra->freq < rb->freq) ? -1 : 1;
+	return (ra->token < rb->token) ? -1 : (ra->token > rb->token) ? 1 : 0;
+}
+
+/*
+ * Put in `out` the first hashes of both heaps of `sig`, one of which any
+ * heap that shares `threshold` of its hashes with it has to share too.
+ */
+static size_t hashsig_prefix(
+	uint64_t *out, hashsig_freqs *freqs, const git_hashsig *sig, int threshold)
+{
+	hashsig_ranked ranked[HASHSIG_HEAP_SIZE];
+	uint64_t tokens[HASHSIG_HEAP_SIZE];
+	size_t count, needed, total = 0, i;
+	int heap;
+
+	for (heap = 0; heap < 2; ++heap) {
+		count = hashsig_heap_tokens(
+			tokens, heap ? &sig->maxs : &sig->mins, heap);
+
+		/* a share of `threshold` is at least this many of these hashes */
+		needed = (threshold * count + (2 * HASHSIG_SCALE - threshold) - 1) /
+			(2 * HASHSIG_SCALE - threshold);
+
+		for (i = 0; i < count; ++i) {
+			ranked[i].token = tokens[i];
+			ranked[i].freq = kh_val(freqs, kh_get(hashsig_freq, freqs, tokens[i]));
+		}
+
+		git__qsort_r(ranked, count, sizeof(hashsig_ranked),
+			hashsig_ranked_cmp, NULL);
+
+		for (i = 0; i + needed <= count; ++i)
+			out[total++] = ranked[i].token;
+	}
+
+	return total;
+}
+
+static int hashsig_posting_cmp(const void *a, const void *b, void *payload)
+{
+	const hashsig_posting *pa = a, *pb = b;
+	GIT_UNUSED(payload);
+
+	if (pa->token != pb->token)
+		return (pa->token < pb->token) ? -1 : 1;
+	return (pa->idx < pb->idx) ? -1 : (pa->idx > pb->idx) ? 1 : 0;
+}
+
+int git_hashsig_find_similar(
+	const git_hashsig **a,
+	size_t a_count,
+	const git_hashsig **b,
+	size_t b_count,
+	int threshold,
+	git_hashsig_pair_cb cb,
+	void *payload)
+{
+	hashsig_freqs *freqs;
+	git_array_t(hashsig_posting) postings = GIT_ARRAY_INIT;
+	uint64_t prefix[HASHSIG_HEAP_SIZE * 2];
+	size_t *seen = NULL, count, i, j;
+	int error = 0;
+
+	if (!a_count || !b_count)
+		return 0;
+
+	if (threshold < 1)
+		threshold = 1;
+	if (threshold > HASHSIG_SCALE)
+		threshold = HASHSIG_SCALE;
+
+	freqs = kh_init(hashsig_freq);
+	GITERR_CHECK_ALLOC(freqs);
+
+	for (i = 0; !error && i < a_count; ++i)
+		if (a[i])
+			error = hashsig_count_tokens(freqs, a[i]);
+	for (i = 0; !error && i < b_count; ++i)
+		if (b[i])
+			error = hashsig_count_tokens(freqs, b[i]);
+
+	if (error < 0)
+		goto done;
+
+	/* list the signatures of `b` under the first hashes of each */
+	for (j = 0; j < b_count; ++j) {
+		if (!b[j])
+			continue;
+
+		count = hashsig_prefix(prefix, freqs, b[j], threshold);
+
+		for (i = 0; i < count; ++i) {
+			hashsig_posting *posting = git_array_alloc(postings);
+
+			if (!posting) {
+				error = -1;
+				goto done;
+			}
+
+			posting->token = prefix[i];
+			posting->idx = j;
+		}
+	}
+
+	git__qsort_r(postings.ptr, postings.size, sizeof(hashsig_posting),
+		hashsig_posting_cmp, NULL);
+
+	/* the last signature of `a` that each one of `b` was paired with */
+	if ((seen = git__calloc(b_count, sizeof(size_t))) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	/* and pair those of `a` with those listed under their first hashes */
+	for (i = 0; !error && i < a_count; ++i) {
+		size_t p;
+
+		if (!a[i])
+			continue;
+
+		count = hashsig_prefix(prefix, freqs, a[i], threshold);
+
+		for (p = 0; !error && p < count; ++p) {
+			size_t lo = 0, hi = postings.size, mid;
+
+			while (lo < hi) {
+				mid = lo + (hi - lo) / 2;
+				if (postings.ptr[mid].token < prefix[p])
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+
+			for (; lo < postings.size &&
+				postings.ptr[lo].token == prefix[p]; ++lo) {
+				j = postings.ptr[lo].idx;
+
+				if (seen[j] == i + 1)
+					continue;
+				seen[j] = i + 1;
+
+				if ((error = cb(i, j, payload)) != 0)
+					break;
+			}
+		}
+	}
+
+done:
+	git__free(seen);
+	git_array_clear(postings);
+	kh_destroy(hashsig_freq, freqs);
+
+	return error;
+}
@@ -69,4 +69,26 @@ extern int git_hashsig_compare(
 	const git_hashsig *a,
 	const git_hashsig *b);
 
+typedef int (*git_hashsig_pair_cb)(size_t a_idx, size_t b_idx, void *payload);
+
+/**
+ * Find the pairs of signatures from `a` and `b` that may be similar
+ *
+ * This calls `cb` with the positions in `a` and `b` of every pair of
+ * signatures that `git_hashsig_compare` may score at `threshold` or
+ * more, without comparing all of them; any pair that it leaves out
+ * scores less.  Some of the pairs it gives may score less as well.
+ * NULL signatures are passed over.
+ *
+ * @return 0 on success, <0 on error, or the non-zero return of `cb`
+ */
+extern int git_hashsig_find_similar(
+	const git_hashsig **a,
+	size_t a_count,
+	const git_hashsig **b,
+	size_t b_count,
+	int threshold,
+	git_hashsig_pair_cb cb,
+	void *payload);
+
 #endif
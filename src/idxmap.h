@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_idxmap_h__
+#define INCLUDE_idxmap_h__
+
+#include <ctype.h>
+#include "common.h"
+#include "git2/index.h"
+
+#define kmalloc git__malloc
+#define kcalloc git__calloc
+#define krealloc git__realloc
+#define kfree git__free
+#include "khash.h"
+
+/*
+ * Sets of index entries, looked up by path and stage; one for indexes
+ * which tell paths apart by case, one for those which do not.
+ */
+__KHASH_TYPE(idx, const git_index_entry *, char);
+typedef khash_t(idx) git_idxmap;
+
+__KHASH_TYPE(idxicase, const git_index_entry *, char);
+typedef khash_t(idxicase) git_idxmap_icase;
+
+GIT_INLINE(khint_t) git_idxmap_hash(const git_index_entry *entry)
+{
+	return kh_str_hash_func(entry->path) + GIT_IDXENTRY_STAGE(entry);
+}
+
+GIT_INLINE(int) git_idxmap_equal(
+	const git_index_entry *a, const git_index_entry *b)
+{
+	return GIT_IDXENTRY_STAGE(a) == GIT_IDXENTRY_STAGE(b) &&
+		strcmp(a->path, b->path) == 0;
+}
+
+GIT_INLINE(khint_t) git_idxmap_icase_hash(const git_index_entry *entry)
+{
+	const char *s = entry->path;
+	khint_t h = 0;
+
+	for (; *s; ++s)
+		h = (h << 5) - h + (khint_t)tolower((unsigned char)*s);
+
+	return h + GIT_IDXENTRY_STAGE(entry);
+}
+
+GIT_INLINE(int) git_idxmap_icase_equal(
+	const git_index_entry *a, const git_index_entry *b)
+{
+	return GIT_IDXENTRY_STAGE(a) == GIT_IDXENTRY_STAGE(b) &&
+		strcasecmp(a->path, b->path) == 0;
+}
+
+#define GIT__USE_IDXMAP \
+	__KHASH_IMPL(idx, static kh_inline, const git_index_entry *, char, 0, git_idxmap_hash, git_idxmap_equal)
+
+#define GIT__USE_IDXMAP_ICASE \
+	__KHASH_IMPL(idxicase, static kh_inline, const git_index_entry *, char, 0, git_idxmap_icase_hash, git_idxmap_icase_equal)
+
+#define git_idxmap_alloc() kh_init(idx)
+#define git_idxmap_free(h) kh_destroy(idx, h), h = NULL
+
+#define git_idxmap_icase_alloc() kh_init(idxicase)
+#define git_idxmap_icase_free(h) kh_destroy(idxicase, h), h = NULL
+
+#endif
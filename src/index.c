@@ -17,6 +17,8 @@
 #include "pathspec.h"
 #include "ignore.h"
 #include "blob.h"
+#include "varint.h"
+#include "ewah.h"
 
 #include "git2/odb.h"
 #include "git2/oid.h"
@@ -24,22 +26,40 @@
 #include "git2/config.h"
 #include "git2/sys/index.h"
 
+GIT__USE_IDXMAP;
+GIT__USE_IDXMAP_ICASE;
+
 #define entry_size(type,len) ((offsetof(type, path) + (len) + 8) & ~7)
 #define short_entry_size(len) entry_size(struct entry_short, len)
 #define long_entry_size(len) entry_size(struct entry_long, len)
 
 #define minimal_entry_size (offsetof(struct entry_short, path))
 
+/* in version 4 paths are not padded, and the length is not known upfront */
+#define compressed_entry_size(type,varint_len,len) \
+	(offsetof(type, path) + (varint_len) + (len) + 1)
+
 static const size_t INDEX_FOOTER_SIZE = GIT_OID_RAWSZ;
 static const size_t INDEX_HEADER_SIZE = 12;
 
 static const unsigned int INDEX_VERSION_NUMBER = 2;
 static const unsigned int INDEX_VERSION_NUMBER_EXT = 3;
+static const unsigned int INDEX_VERSION_NUMBER_COMP = 4;
 
 static const unsigned int INDEX_HEADER_SIG = 0x44495243;
 static const char INDEX_EXT_TREECACHE_SIG[] = {'T', 'R', 'E', 'E'};
 static const char INDEX_EXT_UNMERGED_SIG[] = {'R', 'E', 'U', 'C'};
 static const char INDEX_EXT_CONFLICT_NAME_SIG[] = {'N', 'A', 'M', 'E'};
+static const char INDEX_EXT_LINK_SIG[] = {'l', 'i', 'n', 'k'};
+static const char INDEX_EXT_UNTRACKED_SIG[] = {'U', 'N', 'T', 'R'};
+static const char INDEX_EXT_FSMONITOR_SIG[] = {'F', 'S', 'M', 'N'};
+
+/* write a new shared index when more than this share of it has changed */
+#define INDEX_SPLIT_MAX_PERCENT_CHANGE 20
+
+/* how long a shared index that is not ours anymore is kept by default,
+ * for the other index files that may still link to it */
+#define INDEX_SHARED_EXPIRE (14 * 24 * 60 * 60)
 
 #define INDEX_OWNER(idx) ((git_repository *)(GIT_REFCOUNT_OWNER(idx)))
 
@@ -93,15 +113,88 @@ struct entry_srch_key {
 	int stage;
 };
 
+/*
+ * The entries of an index are allocated with room for what the index
+ * keeps track of about them, past the public `git_index_entry`.
+ */
+struct entry_internal {
+	git_index_entry entry;
+
+	/* position in the shared index plus one, or 0 if not from there;
+	 * an entry that changed since keeps its position, and replaces the
+	 * one in the shared index when the split index is written */
+	size_t shared_pos;
+	unsigned int shared_replaced:1;
+
+	/* set for the entries read from disk, which live in the entry pool
+	 * of the index, followed by their path */
+	unsigned int in_pool:1;
+	char path[GIT_FLEX_ARRAY];
+};
+
+#define ENTRY_SHARED_POS(E) (((struct entry_internal *)(E))->shared_pos)
+#define ENTRY_SHARED_REPLACED(E) \
+	(((struct entry_internal *)(E))->shared_replaced)
+
+/* whether the shared index holds an entry exactly as it is */
+#define ENTRY_IS_SHARED(E) \
+	(ENTRY_SHARED_POS(E) > 0 && !ENTRY_SHARED_REPLACED(E))
+
+/* the room that an entry read from disk takes in the entry pool */
+#define pool_entry_size(len) \
+	((offsetof(struct entry_internal, path) + (len) + 8) & ~7)
+
+/*
+ * The entries of a large index are read by several threads at once,
+ * each taking as many entries in a row; fewer than this many are not
+ * worth a thread.
+ */
+#define INDEX_ENTRIES_PER_THREAD 16384
+#define INDEX_MAX_THREADS 8
+
+/*
+ * The "link" extension of a split index: the shared index that holds
+ * most of its entries, and which of those are gone or replaced by the
+ * first entries of the split index itself.
+ */
+struct index_link {
+	bool present;
+	git_oid shared_id;
+
+	git_bitvec deleted;
+	size_t deleted_size;
+	git_bitvec replaced;
+	size_t replaced_size;
+
+	/* the entries that the "FSMN" extension does not vouch for, which
+	 * are numbered like those of the merged index */
+	git_bitvec fsmonitor_dirty;
+	size_t fsmonitor_dirty_size;
+};
+
+/* What goes into an index file */
+enum index_write_mode {
+	INDEX_WRITE_FULL,
+	/* every entry, without the extensions */
+	INDEX_WRITE_SHARED,
+	/* the entries that are not in the shared index, and a link to it */
+	INDEX_WRITE_SPLIT,
+};
+
 /* local declarations */
-static size_t read_extension(git_index *index, const char *buffer, size_t buffer_size);
-static size_t read_entry(git_index_entry *dest, const void *buffer, size_t buffer_size);
+static size_t read_extension(
+	git_index *index, struct index_link *link,
+	const char *buffer, size_t buffer_size);
 static int read_header(struct index_header *dest, const void *buffer);
 
 static int parse_index(git_index *index, const char *buffer, size_t buffer_size);
+static int shared_index_path(git_buf *out, git_index *index, const git_oid *id);
 static bool is_index_extended(git_index *index);
-static int write_index(git_index *index, git_filebuf *file);
+static int write_index(
+	git_oid *checksum, git_index *index,
+	git_filebuf *file, enum index_write_mode mode);
 
+static git_index_entry *index_entry_alloc(void);
 static void index_entry_free(git_index_entry *entry);
 static void index_entry_reuc_free(git_index_reuc_entry *reuc);
 
@@ -270,12 +363,124 @@ static void index_entry_reuc_free(git_index_reuc_entry *reuc)
 
 static void index_entry_free(git_index_entry *entry)
 {
-	if (!entry)
+	/* those of the entry pool go with it */
+	if (!entry || ((struct entry_internal *)entry)->in_pool)
 		return;
 	git__free(entry->path);
 	git__free(entry);
 }
 
+static void index_map_free(git_index *index)
+{
+	git_idxmap_free(index->entries_map);
+	git_idxmap_icase_free(index->entries_map_icase);
+}
+
+/* Add `entry` to the path map, or drop the map if it cannot be */
+static void index_map_insert(git_index *index, const git_index_entry *entry)
+{
+	int ret;
+
+	if (index->entries_map)
+		kh_put(idx, index->entries_map, entry, &ret);
+	else if (index->entries_map_icase)
+		kh_put(idxicase, index->entries_map_icase, entry, &ret);
+	else
+		return;
+
+	/* lookups can always go back to searching the sorted entries */
+	if (ret <= 0) {
+		index_map_free(index);
+		index->no_entries_map = (ret == 0);
+		giterr_clear();
+	}
+}
+
+static void index_map_remove(git_index *index, const git_index_entry *entry)
+{
+	khiter_t pos;
+
+	if (index->entries_map) {
+		pos = kh_get(idx, index->entries_map, entry);
+		if (pos != kh_end(index->entries_map))
+			kh_del(idx, index->entries_map, pos);
+	} else if (index->entries_map_icase) {
+		pos = kh_get(idxicase, index->entries_map_icase, entry);
+		if (pos != kh_end(index->entries_map_icase))
+			kh_del(idxicase, index->entries_map_icase, pos);
+	}
+}
+
+/* Whether there is a path map to look entries up in, once built */
+static bool index_map_ready(git_index *index)
+{
+	git_index_entry *entry;
+	khint_t buckets;
+	size_t i;
+
+	if (index->entries_map || index->entries_map_icase)
+		return true;
+
+	if (index->no_entries_map)
+		return false;
+
+	/* room for every entry without growing */
+	buckets = (khint_t)(index->entries.length + index->entries.length / 3 + 1);
+
+	if (index->ignore_case) {
+		if ((index->entries_map_icase = git_idxmap_icase_alloc()) == NULL ||
+			kh_resize(idxicase, index->entries_map_icase, buckets) < 0)
+			index_map_free(index);
+	} else {
+		if ((index->entries_map = git_idxmap_alloc()) == NULL ||
+			kh_resize(idx, index->entries_map, buckets) < 0)
+			index_map_free(index);
+	}
+
+	git_vector_foreach(&index->entries, i, entry)
+		index_map_insert(index, entry);
+
+	giterr_clear();
+	return (index->entries_map || index->entries_map_icase);
+}
+
+static git_index_entry *index_map_get(
+	git_index *index, const char *path, int stage)
+{
+	git_index_entry key;
+	khiter_t pos;
+
+	key.path = (char *)path;
+	key.flags = (stage << GIT_IDXENTRY_STAGESHIFT) & GIT_IDXENTRY_STAGEMASK;
+
+	if (index->entries_map) {
+		pos = kh_get(idx, index->entries_map, &key);
+		if (pos != kh_end(index->entries_map))
+			return (git_index_entry *)kh_key(index->entries_map, pos);
+	} else if (index->entries_map_icase) {
+		pos = kh_get(idxicase, index->entries_map_icase, &key);
+		if (pos != kh_end(index->entries_map_icase))
+			return (git_index_entry *)kh_key(index->entries_map_icase, pos);
+	}
+
+	return NULL;
+}
+
+/* The entry at `path` and `stage`, by its path if the map can be used */
+static git_index_entry *index_find_entry(
+	git_index *index, const char *path, int stage)
+{
+	size_t pos;
+
+	if (stage != GIT_INDEX_STAGE_ANY && index_map_ready(index))
+		return index_map_get(index, path, stage);
+
+	if (git_index__find(&pos, index, path, stage) < 0)
+		return NULL;
+
+	return git_vector_get(&index->entries, pos);
+}
+
 static unsigned int index_create_mode(unsigned int mode)
 {
 	if (S_ISLNK(mode))
@@ -305,6 +510,10 @@ void git_index__set_ignore_case(git_index *index, bool ignore_case)
 {
 	index->ignore_case = ignore_case;
 
+	/* the paths of the entries hash differently now */
+	index_map_free(index);
+	index->no_entries_map = 0;
+
 	index->entries_cmp_path = ignore_case ? index_icmp_path : index_cmp_path;
 	index->entries_search = ignore_case ? index_isrch : index_srch;
 	index->entries_search_path = ignore_case ? index_isrch_path : index_srch_path;
@@ -338,13 +547,16 @@ int git_index_open(git_index **index_out, const char *index_path)
 
 	if (git_vector_init(&index->entries, 32, index_cmp) < 0 ||
 		git_vector_init(&index->names, 32, conflict_name_cmp) < 0 ||
-		git_vector_init(&index->reuc, 32, reuc_cmp) < 0)
+		git_vector_init(&index->reuc, 32, reuc_cmp) < 0 ||
+		git_pool_init(&index->entry_pool, 8, 0) < 0)
 		return -1;
 
 	index->entries_cmp_path = index_cmp_path;
 	index->entries_search = index_srch;
 	index->entries_search_path = index_srch_path;
 	index->reuc_search = reuc_srch;
+	index->version = INDEX_VERSION_NUMBER;
+	index->shared_expire = INDEX_SHARED_EXPIRE;
 
 	*index_out = index;
 	GIT_REFCOUNT_INC(index);
@@ -392,7 +604,17 @@ void git_index_clear(git_index *index)
 {
 	assert(index);
 
-	index_entries_free(&index->entries);
+	if (index->entries_pooled)
+		git_vector_clear(&index->entries);
+	else
+		index_entries_free(&index->entries);
+
+	git_pool_clear(&index->entry_pool);
+	index->entries_pooled = 0;
+
+	index_map_free(index);
+	index->no_entries_map = 0;
+
 	git_index_reuc_clear(index);
 	git_index_name_clear(index);
 
@@ -400,6 +622,12 @@ void git_index_clear(git_index *index)
 
 	git_tree_cache_free(index->tree);
 	index->tree = NULL;
+
+	git_untracked_cache_free(index->untracked);
+	index->untracked = NULL;
+
+	git__free(index->fsmonitor_token);
+	index->fsmonitor_token = NULL;
 }
 
 static int create_index_error(int error, const char *msg)
@@ -451,6 +679,136 @@ unsigned int git_index_caps(const git_index *index)
 			(index->no_symlinks ? GIT_INDEXCAP_NO_SYMLINKS : 0));
 }
 
+unsigned int git_index_version(const git_index *index)
+{
+	assert(index);
+	return index->version;
+}
+
+int git_index_set_version(git_index *index, unsigned int version)
+{
+	assert(index);
+
+	if (version < INDEX_VERSION_NUMBER ||
+		version > INDEX_VERSION_NUMBER_COMP) {
+		giterr_set(GITERR_INDEX, "Invalid version number %u", version);
+		return -1;
+	}
+
+	index->version = version;
+	return 0;
+}
+
+int git_index_set_split(git_index *index, int split)
+{
+	assert(index);
+
+	if (split && !index->index_file_path)
+		return create_index_error(-1,
+			"Could not split the index: The index is in-memory only");
+
+	index->split = (split != 0);
+	return 0;
+}
+
+int git_index_set_untracked_cache(git_index *index, int enabled)
+{
+	assert(index);
+
+	index->keep_untracked = (enabled != 0);
+
+	if (!enabled) {
+		git_untracked_cache_free(index->untracked);
+		index->untracked = NULL;
+	}
+
+	return 0;
+}
+
+int git_index__untracked_cache(
+	git_untracked_cache **out, git_index *index, const char *workdir)
+{
+	*out = NULL;
+
+	if (!index->keep_untracked)
+		return 0;
+
+	/* a cache made somewhere else tells nothing about here */
+	if (index->untracked &&
+		!git_untracked_cache_is_for(index->untracked, workdir)) {
+		git_untracked_cache_free(index->untracked);
+		index->untracked = NULL;
+	}
+
+	if (!index->untracked &&
+		git_untracked_cache_new(&index->untracked, workdir) < 0)
+		return -1;
+
+	*out = index->untracked;
+	return 0;
+}
+
+/* Forget that the entries at or below `path` are unchanged */
+static void fsmonitor_invalidate(git_index *index, const char *path)
+{
+	int (*strncomp)(const char *a, const char *b, size_t sz) =
+		index->ignore_case ? git__strncasecmp : git__strncmp;
+	size_t pos = git_index__prefix_position(index, path), len = strlen(path);
+	git_index_entry *entry;
+
+	/* "a/b" sorts after "a-b", so only a different prefix ends it */
+	while ((entry = git_vector_get(&index->entries, pos++)) != NULL &&
+		!strncomp(entry->path, path, len)) {
+		if (entry->path[len] == '\0' || entry->path[len] == '/')
+			entry->flags_extended &= ~GIT_IDXENTRY_FSMONITOR_VALID;
+	}
+}
+
+int git_index__fsmonitor_refresh(git_index *index, git_fsmonitor *mon)
+{
+	git_vector paths = GIT_VECTOR_INIT;
+	git_buf token = GIT_BUF_INIT;
+	git_index_entry *entry;
+	char *path;
+	size_t i;
+	int error = 1;
+
+	if (!mon && !index->fsmonitor_token)
+		return 0;
+
+	if (mon && (error = git_fsmonitor_changes(
+			&paths, &token, mon, index->fsmonitor_token)) < 0)
+		goto done;
+
+	if (error > 0) {
+		/* nothing can be said to be unchanged */
+		git_vector_foreach(&index->entries, i, entry)
+			entry->flags_extended &= ~GIT_IDXENTRY_FSMONITOR_VALID;
+	} else {
+		git_vector_foreach(&paths, i, path)
+			fsmonitor_invalidate(index, path);
+	}
+
+	git__free(index->fsmonitor_token);
+	index->fsmonitor_token = mon ? git_buf_detach(&token) : NULL;
+	error = 0;
+
+done:
+	git_vector_foreach(&paths, i, path)
+		git__free(path);
+	git_vector_free(&paths);
+	git_buf_free(&token);
+	return error;
+}
+
+void git_index__fsmonitor_mark_valid(
+	git_index *index, const git_index_entry *entry)
+{
+	if (index->fsmonitor_token != NULL)
+		((git_index_entry *)entry)->flags_extended |=
+			GIT_IDXENTRY_FSMONITOR_VALID;
+}
+
 int git_index_read(git_index *index)
 {
 	int error = 0, updated;
@@ -486,9 +844,151 @@ int git_index_read(git_index *index)
 	return error;
 }
 
+static void forget_shared_index(git_index *index)
+{
+	size_t i;
+	git_index_entry *entry;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		ENTRY_SHARED_POS(entry) = 0;
+		ENTRY_SHARED_REPLACED(entry) = 0;
+	}
+
+	memset(&index->shared_id, 0x0, sizeof(git_oid));
+	index->shared_count = 0;
+}
+
+/* A new shared index is written once enough has changed since the last */
+static bool shared_index_outdated(git_index *index)
+{
+	size_t i, kept = 0, changes;
+	git_index_entry *entry;
+
+	if (git_oid_iszero(&index->shared_id))
+		return true;
+
+	/* as for git, a replaced entry still counts as kept */
+	git_vector_foreach(&index->entries, i, entry) {
+		if (ENTRY_SHARED_POS(entry) > 0)
+			kept++;
+	}
+
+	changes = (index->entries.length - kept) + (index->shared_count - kept);
+	return changes * 100 > index->shared_count * INDEX_SPLIT_MAX_PERCENT_CHANGE;
+}
+
+static int write_shared_index(git_index *index)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_oid checksum;
+	int error;
+
+	forget_shared_index(index);
+
+	if ((error = git_path_dirname_r(&path, index->index_file_path)) < 0 ||
+		(error = git_buf_puts(&path, "/sharedindex")) < 0 ||
+		(error = git_filebuf_open(
+			&file, path.ptr, GIT_FILEBUF_HASH_CONTENTS)) < 0)
+		goto done;
+
+	/* it is named after its checksum, which we only know once written */
+	git_buf_clear(&path);
+
+	if ((error = write_index(&checksum, index, &file, INDEX_WRITE_SHARED)) < 0 ||
+		(error = shared_index_path(&path, index, &checksum)) < 0) {
+		git_filebuf_cleanup(&file);
+		goto done;
+	}
+
+	if ((error = git_filebuf_commit_at(&file, path.ptr, GIT_INDEX_FILE_MODE)) < 0)
+		goto done;
+
+	git_oid_cpy(&index->shared_id, &checksum);
+	index->shared_count = index->entries.length;
+
+done:
+	if (error < 0)
+		forget_shared_index(index);
+
+	git_buf_free(&path);
+	return error;
+}
+
+int git_index__set_shared_expire(git_index *index, const char *expire)
+{
+	git_time_t when;
+
+	if (git__date_parse(&when, expire) < 0) {
+		giterr_set(GITERR_INDEX,
+			"Invalid expiry date for shared indexes '%s'", expire);
+		return -1;
+	}
+
+	/* "never" is the start of the epoch */
+	if (when <= 0)
+		index->shared_expire = -1;
+	else
+		index->shared_expire = max(0, (git_time_t)time(NULL) - when);
+
+	return 0;
+}
+
+typedef struct {
+	const char *keep;
+	git_time_t before;
+} expire_shared_data;
+
+static int expire_shared_cb(void *payload, git_buf *path)
+{
+	expire_shared_data *data = payload;
+	const char *name = path->ptr + git_path_basename_offset(path);
+	struct stat st;
+
+	if (git__prefixcmp(name, "sharedindex.") != 0 ||
+		!strcmp(name, data->keep))
+		return 0;
+
+	/* which is only best effort */
+	if (!p_stat(path->ptr, &st) && (git_time_t)st.st_mtime <= data->before)
+		p_unlink(path->ptr);
+
+	return 0;
+}
+
+/*
+ * Remove the shared indexes next to ours which have not been written to
+ * in a while: other index files than ours (like the temporary ones that
+ * git writes) may still link to the recent ones.
+ */
+static void expire_shared_indexes(git_index *index)
+{
+	git_buf dir = GIT_BUF_INIT;
+	char keep[GIT_OID_HEXSZ + 13];
+	expire_shared_data data;
+
+	if (index->shared_expire < 0 ||
+		git_path_dirname_r(&dir, index->index_file_path) < 0)
+		goto done;
+
+	/* the one we link to now is never expired */
+	memcpy(keep, "sharedindex.", 12);
+	git_oid_tostr(keep + 12, GIT_OID_HEXSZ + 1, &index->shared_id);
+
+	data.keep = keep;
+	data.before = (git_time_t)time(NULL) - index->shared_expire;
+
+	if (git_path_direach(&dir, 0, expire_shared_cb, &data) < 0)
+		giterr_clear();
+
+done:
+	git_buf_free(&dir);
+}
+
 int git_index_write(git_index *index)
 {
 	git_filebuf file = GIT_FILEBUF_INIT;
+	git_oid old_shared_id;
 	int error;
 
 	if (!index->index_file_path)
@@ -506,7 +1006,18 @@ int git_index_write(git_index *index)
 		return error;
 	}
 
-	if ((error = write_index(index, &file)) < 0) {
+	git_oid_cpy(&old_shared_id, &index->shared_id);
+
+	if (!index->split)
+		forget_shared_index(index);
+	else if (shared_index_outdated(index) &&
+		(error = write_shared_index(index)) < 0) {
+		git_filebuf_cleanup(&file);
+		return error;
+	}
+
+	if ((error = write_index(NULL, index, &file,
+			index->split ? INDEX_WRITE_SPLIT : INDEX_WRITE_FULL)) < 0) {
 		git_filebuf_cleanup(&file);
 		return error;
 	}
@@ -514,6 +1025,11 @@ int git_index_write(git_index *index)
 	if ((error = git_filebuf_commit(&file, GIT_INDEX_FILE_MODE)) < 0)
 		return error;
 
+	/* ours does not refer to the previous shared index anymore */
+	if (!git_oid_iszero(&old_shared_id) &&
+		git_oid_cmp(&old_shared_id, &index->shared_id) != 0)
+		expire_shared_indexes(index);
+
 	error = git_futils_filestamp_check(&index->stamp, index->index_file_path);
 	if (error < 0)
 		return error;
@@ -566,18 +1082,14 @@ const git_index_entry *git_index_get_byindex(
 const git_index_entry *git_index_get_bypath(
 	git_index *index, const char *path, int stage)
 {
-	size_t pos;
+	git_index_entry *entry;
 
 	assert(index);
 
-	git_vector_sort(&index->entries);
-
-	if (git_index__find(&pos, index, path, stage) < 0) {
+	if ((entry = index_find_entry(index, path, stage)) == NULL)
 		giterr_set(GITERR_INDEX, "Index does not contain %s", path);
-		return NULL;
-	}
 
-	return git_index_get_byindex(index, pos);
+	return entry;
 }
 
 void git_index_entry__init_from_stat(
@@ -631,7 +1143,7 @@ static int index_entry_init(
 	if (error < 0)
 		return error;
 
-	entry = git__calloc(1, sizeof(git_index_entry));
+	entry = index_entry_alloc();
 	GITERR_CHECK_ALLOC(entry);
 
 	git_index_entry__init_from_stat(entry, &st, !index->distrust_filemode);
@@ -676,11 +1188,16 @@ static int index_entry_reuc_init(git_index_reuc_entry **reuc_out,
 	return 0;
 }
 
+static git_index_entry *index_entry_alloc(void)
+{
+	return git__calloc(1, sizeof(struct entry_internal));
+}
+
 static git_index_entry *index_entry_dup(const git_index_entry *source_entry)
 {
 	git_index_entry *entry;
 
-	entry = git__malloc(sizeof(git_index_entry));
+	entry = index_entry_alloc();
 	if (!entry)
 		return NULL;
 
@@ -694,12 +1211,10 @@ static git_index_entry *index_entry_dup(const git_index_entry *source_entry)
 	return entry;
 }
 
-static int index_insert(git_index *index, git_index_entry *entry, int replace)
+/* Get `entry` ready to go into `index`; returns the length of its path */
+static size_t index_entry_prepare(git_index *index, git_index_entry *entry)
 {
-	size_t path_length, position;
-	git_index_entry **existing = NULL;
-
-	assert(index && entry && entry->path != NULL);
+	size_t path_length;
 
 	/* make sure that the path length flag is correct */
 	path_length = strlen(entry->path);
@@ -711,26 +1226,58 @@ static int index_insert(git_index *index, git_index_entry *entry, int replace)
 	else
 		entry->flags |= GIT_IDXENTRY_NAMEMASK;
 
+	/* nobody has looked at the working directory for this one yet */
+	entry->flags_extended &= ~GIT_IDXENTRY_FSMONITOR_VALID;
+
+	/* from here on, clearing the index has to look at each entry */
+	index->entries_pooled = 0;
+
+	return path_length;
+}
+
+/*
+ * Insert `*entry_ptr` into the index.  An entry which it replaces is
+ * updated in place instead, and `*entry_ptr` is set to it.
+ */
+static int index_insert(git_index *index, git_index_entry **entry_ptr, int replace)
+{
+	git_index_entry *entry = *entry_ptr, *existing;
+	char *path;
+
+	assert(index && entry && entry->path != NULL);
+
+	index_entry_prepare(index, entry);
+
 	/* look if an entry with this path already exists */
-	if (!git_index__find(
-			&position, index, entry->path, GIT_IDXENTRY_STAGE(entry))) {
-		existing = (git_index_entry **)&index->entries.contents[position];
+	existing = index_find_entry(index, entry->path, GIT_IDXENTRY_STAGE(entry));
 
-		/* update filemode to existing values if stat is not trusted */
-		entry->mode = index_merge_mode(index, *existing, entry->mode);
-	}
+	/* update filemode to existing values if stat is not trusted */
+	if (existing)
+		entry->mode = index_merge_mode(index, existing, entry->mode);
 
 	/* if replacing is not requested or no existing entry exists, just
 	 * insert entry at the end; the index is no longer sorted
 	 */
-	if (!replace || !existing)
-		return git_vector_insert(&index->entries, entry);
+	if (!replace || !existing) {
+		if (git_vector_insert(&index->entries, entry) < 0)
+			return -1;
 
-	/* exists, replace it (preserving name from existing entry) */
-	git__free(entry->path);
-	entry->path = (*existing)->path;
-	git__free(*existing);
-	*existing = entry;
+		index_map_insert(index, entry);
+		return 0;
+	}
+
+	/* exists, replace it (preserving name from existing entry, which
+	 * only differs from ours in case, if at all) */
+	path = existing->path;
+	memcpy(existing, entry, sizeof(git_index_entry));
+	existing->path = path;
+
+	/* it now replaces the one in the shared index, if that has it */
+	if (ENTRY_SHARED_POS(existing) > 0)
+		ENTRY_SHARED_REPLACED(existing) = 1;
+
+	index_entry_free(entry);
+	*entry_ptr = existing;
 
 	return 0;
 }
@@ -768,20 +1315,22 @@ int git_index_add_bypath(git_index *index, const char *path)
 
 	assert(index && path);
 
-	if ((ret = index_entry_init(&entry, index, path)) < 0 ||
-		(ret = index_insert(index, entry, 1)) < 0)
-		goto on_error;
+	if ((ret = index_entry_init(&entry, index, path)) < 0)
+		return ret;
 
-	/* Adding implies conflict was resolved, move conflict entries to REUC */
-	if ((ret = index_conflict_to_reuc(index, path)) < 0 && ret != GIT_ENOTFOUND)
-		goto on_error;
+	if ((ret = index_insert(index, &entry, 1)) < 0) {
+		index_entry_free(entry);
+		return ret;
+	}
 
 	git_tree_cache_invalidate_path(index->tree, entry->path);
-	return 0;
+	git_untracked_cache_invalidate_path(index->untracked, entry->path);
 
-on_error:
-	index_entry_free(entry);
-	return ret;
+	/* Adding implies conflict was resolved, move conflict entries to REUC */
+	if ((ret = index_conflict_to_reuc(index, path)) < 0 && ret != GIT_ENOTFOUND)
+		return ret;
+
+	return 0;
 }
 
 int git_index_remove_bypath(git_index *index, const char *path)
@@ -808,12 +1357,13 @@ int git_index_add(git_index *index, const git_index_entry *source_entry)
 	if (entry == NULL)
 		return -1;
 
-	if ((ret = index_insert(index, entry, 1)) < 0) {
+	if ((ret = index_insert(index, &entry, 1)) < 0) {
 		index_entry_free(entry);
 		return ret;
 	}
 
 	git_tree_cache_invalidate_path(index->tree, entry->path);
+	git_untracked_cache_invalidate_path(index->untracked, entry->path);
 	return 0;
 }
 
@@ -832,13 +1382,17 @@ int git_index_remove(git_index *index, const char *path, int stage)
 	}
 
 	entry = git_vector_get(&index->entries, position);
-	if (entry != NULL)
+	if (entry != NULL) {
 		git_tree_cache_invalidate_path(index->tree, entry->path);
+		git_untracked_cache_invalidate_path(index->untracked, entry->path);
+	}
 
 	error = git_vector_remove(&index->entries, position);
 
-	if (!error)
+	if (!error) {
+		index_map_remove(index, entry);
 		index_entry_free(entry);
+	}
 
 	return error;
 }
@@ -868,9 +1422,11 @@ int git_index_remove_directory(git_index *index, const char *dir, int stage)
 		}
 
 		git_tree_cache_invalidate_path(index->tree, entry->path);
+		git_untracked_cache_invalidate_path(index->untracked, entry->path);
 
 		if ((error = git_vector_remove(&index->entries, pos)) < 0)
 			break;
+		index_map_remove(index, entry);
 		index_entry_free(entry);
 
 		/* removed entry at 'pos' so we don't need to increment it */
@@ -881,6 +1437,281 @@ int git_index_remove_directory(git_index *index, const char *dir, int stage)
 	return error;
 }
 
+/*
+ * A change that a batch makes to the index: an entry to add, or the path
+ * and stage of one to remove.  Once applied, an added entry belongs to
+ * the index.
+ */
+typedef struct {
+	git_index_entry *entry;
+	size_t seq;
+	unsigned int remove:1;
+	unsigned int resolve:1; /* the conflict on the path goes to REUC */
+	unsigned int applied:1;
+} index_batch_op;
+
+struct git_index_batch {
+	git_index *index;
+	git_pool pool;
+	git_vector ops;
+};
+
+/* Changes to the same entry are kept in the order they were made in */
+static int batch_op_cmp(const void *a, const void *b)
+{
+	const index_batch_op *op_a = a, *op_b = b;
+	int diff = index_cmp(op_a->entry, op_b->entry);
+
+	if (diff == 0)
+		diff = (op_a->seq > op_b->seq) - (op_a->seq < op_b->seq);
+
+	return diff;
+}
+
+static int batch_op_icmp(const void *a, const void *b)
+{
+	const index_batch_op *op_a = a, *op_b = b;
+	int diff = index_icmp(op_a->entry, op_b->entry);
+
+	if (diff == 0)
+		diff = (op_a->seq > op_b->seq) - (op_a->seq < op_b->seq);
+
+	return diff;
+}
+
+int git_index_batch_new(git_index_batch **out, git_index *index)
+{
+	git_index_batch *batch;
+
+	assert(out && index);
+
+	batch = git__calloc(1, sizeof(git_index_batch));
+	GITERR_CHECK_ALLOC(batch);
+
+	if (git_pool_init(&batch->pool, sizeof(index_batch_op), 0) < 0 ||
+		git_vector_init(&batch->ops, 0, batch_op_cmp) < 0) {
+		git_index_batch_free(batch);
+		return -1;
+	}
+
+	batch->index = index;
+
+	*out = batch;
+	return 0;
+}
+
+static int batch_push(
+	git_index_batch *batch, git_index_entry *entry, bool remove, bool resolve)
+{
+	index_batch_op *op;
+
+	if ((op = git_pool_mallocz(&batch->pool, 1)) == NULL ||
+		git_vector_insert(&batch->ops, op) < 0) {
+		index_entry_free(entry);
+		return -1;
+	}
+
+	op->entry = entry;
+	op->seq = batch->ops.length;
+	op->remove = remove;
+	op->resolve = resolve;
+
+	return 0;
+}
+
+int git_index_batch_add(git_index_batch *batch, const git_index_entry *source_entry)
+{
+	git_index_entry *entry;
+
+	assert(batch && source_entry && source_entry->path);
+
+	if ((entry = index_entry_dup(source_entry)) == NULL)
+		return -1;
+
+	return batch_push(batch, entry, false, false);
+}
+
+int git_index_batch_add_bypath(git_index_batch *batch, const char *path)
+{
+	git_index_entry *entry;
+	int error;
+
+	assert(batch && path);
+
+	if ((error = index_entry_init(&entry, batch->index, path)) < 0)
+		return error;
+
+	return batch_push(batch, entry, false, true);
+}
+
+static int batch_push_removal(
+	git_index_batch *batch, const char *path, int stage, bool resolve)
+{
+	git_index_entry *entry;
+
+	entry = index_entry_alloc();
+	GITERR_CHECK_ALLOC(entry);
+
+	entry->flags = (stage << GIT_IDXENTRY_STAGESHIFT) & GIT_IDXENTRY_STAGEMASK;
+
+	if ((entry->path = git__strdup(path)) == NULL) {
+		git__free(entry);
+		return -1;
+	}
+
+	return batch_push(batch, entry, true, resolve);
+}
+
+int git_index_batch_remove(git_index_batch *batch, const char *path, int stage)
+{
+	assert(batch && path);
+	return batch_push_removal(batch, path, stage, false);
+}
+
+int git_index_batch_remove_bypath(git_index_batch *batch, const char *path)
+{
+	assert(batch && path);
+	return batch_push_removal(batch, path, 0, true);
+}
+
+static void batch_clear(git_index_batch *batch)
+{
+	index_batch_op *op;
+	size_t i;
+
+	git_vector_foreach(&batch->ops, i, op) {
+		if (!op->applied)
+			index_entry_free(op->entry);
+	}
+
+	git_vector_clear(&batch->ops);
+	git_pool_clear(&batch->pool);
+}
+
+/* Apply the last change of the run of changes to one entry at `op` */
+static void batch_apply_op(
+	git_index *index, git_vector *merged,
+	index_batch_op *op, git_index_entry *existing)
+{
+	if (op->remove) {
+		if (existing == NULL)
+			return;
+
+		git_tree_cache_invalidate_path(index->tree, existing->path);
+		git_untracked_cache_invalidate_path(index->untracked, existing->path);
+
+		index_entry_free(existing);
+		return;
+	}
+
+	/* as `index_insert` would do, with a single entry */
+	op->entry->mode = index_merge_mode(index, existing, op->entry->mode);
+
+	if (existing) {
+		size_t path_length = index_entry_prepare(index, op->entry);
+
+		memcpy(op->entry->path, existing->path, path_length);
+
+		/* it now replaces the one in the shared index, if that has it */
+		if (ENTRY_SHARED_POS(existing) > 0) {
+			ENTRY_SHARED_POS(op->entry) = ENTRY_SHARED_POS(existing);
+			ENTRY_SHARED_REPLACED(op->entry) = 1;
+		}
+
+		index_entry_free(existing);
+	} else
+		index_entry_prepare(index, op->entry);
+
+	git_tree_cache_invalidate_path(index->tree, op->entry->path);
+	git_untracked_cache_invalidate_path(index->untracked, op->entry->path);
+
+	git_vector_insert(merged, op->entry);
+	op->applied = 1;
+}
+
+int git_index_batch_apply(git_index_batch *batch)
+{
+	git_index *index;
+	git_vector merged = GIT_VECTOR_INIT;
+	git_index_entry **entries;
+	index_batch_op *op, *next;
+	size_t i = 0, j, count;
+	int error = 0;
+
+	assert(batch);
+
+	index = batch->index;
+
+	/* both sides sorted the same way, and merged in a single pass */
+	git_vector_set_cmp(&batch->ops,
+		index->ignore_case ? batch_op_icmp : batch_op_cmp);
+	git_vector_sort(&batch->ops);
+	git_vector_sort(&index->entries);
+
+	if (git_vector_init(&merged,
+			index->entries.length + batch->ops.length, index->entries._cmp) < 0)
+		return -1;
+
+	entries = (git_index_entry **)index->entries.contents;
+	count = index->entries.length;
+
+	/* nothing can fail from here on */
+	git_vector_foreach(&batch->ops, j, op) {
+		git_index_entry *existing = NULL;
+		int cmp = 1;
+
+		/* only the last change to an entry counts */
+		next = git_vector_get(&batch->ops, j + 1);
+		if (next && index->entries._cmp(op->entry, next->entry) == 0)
+			continue;
+
+		while (i < count &&
+			(cmp = index->entries._cmp(entries[i], op->entry)) < 0)
+			git_vector_insert(&merged, entries[i++]);
+
+		if (i < count && cmp == 0)
+			existing = entries[i++];
+
+		batch_apply_op(index, &merged, op, existing);
+	}
+
+	while (i < count)
+		git_vector_insert(&merged, entries[i++]);
+
+	git_vector_swap(&merged, &index->entries);
+	index->entries.sorted = 1;
+
+	/* the map is built again when it is next needed */
+	index_map_free(index);
+
+	/* added or removed files resolve their conflicts */
+	git_vector_foreach(&batch->ops, j, op) {
+		if (op->resolve &&
+			(error = index_conflict_to_reuc(index, op->entry->path)) < 0) {
+			if (error != GIT_ENOTFOUND)
+				break;
+
+			giterr_clear();
+			error = 0;
+		}
+	}
+
+	git_vector_free(&merged);
+	batch_clear(batch);
+
+	return error;
+}
+
+void git_index_batch_free(git_index_batch *batch)
+{
+	if (batch == NULL)
+		return;
+
+	batch_clear(batch);
+	git_vector_free(&batch->ops);
+	git__free(batch);
+}
+
 int git_index__find(
 	size_t *at_pos, git_index *index, const char *path, int stage)
 {
@@ -963,17 +1794,19 @@ int git_index_conflict_add(git_index *index,
 		entries[i]->flags = (entries[i]->flags & ~GIT_IDXENTRY_STAGEMASK) |
 			((i+1) << GIT_IDXENTRY_STAGESHIFT);
 
-		if ((ret = index_insert(index, entries[i], 1)) < 0)
+		if ((ret = index_insert(index, &entries[i], 1)) < 0)
 			goto on_error;
+
+		git_tree_cache_invalidate_path(index->tree, entries[i]->path);
+		git_untracked_cache_invalidate_path(index->untracked, entries[i]->path);
 	}
 
 	return 0;
 
 on_error:
-	for (i = 0; i < 3; i++) {
-		if (entries[i] != NULL)
-			index_entry_free(entries[i]);
-	}
+	/* those before belong to the index now */
+	for (; i < 3; i++)
+		index_entry_free(entries[i]);
 
 	return ret;
 }
@@ -1042,6 +1875,19 @@ int git_index_conflict_get(
 	*our_out = NULL;
 	*their_out = NULL;
 
+	if (index_map_ready(index)) {
+		*ancestor_out = index_map_get(index, path, 1);
+		*our_out = index_map_get(index, path, 2);
+		*their_out = index_map_get(index, path, 3);
+
+		if (!*ancestor_out && !*our_out && !*their_out) {
+			giterr_set(GITERR_INDEX, "Index does not contain a conflict for %s", path);
+			return GIT_ENOTFOUND;
+		}
+
+		return 0;
+	}
+
 	if (git_index_find(&pos, index, path) < 0)
 		return GIT_ENOTFOUND;
 
@@ -1078,9 +1924,13 @@ int git_index_conflict_remove(git_index *index, const char *path)
 			continue;
 		}
 
+		git_tree_cache_invalidate_path(index->tree, conflict_entry->path);
+		git_untracked_cache_invalidate_path(index->untracked, conflict_entry->path);
+
 		if ((error = git_vector_remove(&index->entries, pos)) < 0)
 			return error;
 
+		index_map_remove(index, conflict_entry);
 		index_entry_free(conflict_entry);
 		posmax--;
 	}
@@ -1102,8 +1952,22 @@ static int index_conflicts_match(const git_vector *v, size_t idx)
 
 void git_index_conflict_cleanup(git_index *index)
 {
+	size_t i;
+	git_index_entry *entry;
+
 	assert(index);
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (GIT_IDXENTRY_STAGE(entry) > 0) {
+			git_tree_cache_invalidate_path(index->tree, entry->path);
+			git_untracked_cache_invalidate_path(index->untracked, entry->path);
+		}
+	}
+
 	git_vector_remove_matching(&index->entries, index_conflicts_match);
+
+	/* the map is built again when it is next needed */
+	index_map_free(index);
 }
 
 int git_index_has_conflicts(const git_index *index)
@@ -1486,146 +2350,466 @@ static int read_conflict_names(git_index *index, const char *buffer, size_t size
 	return 0;
 }
 
-static size_t read_entry(git_index_entry *dest, const void *buffer, size_t buffer_size)
+/*
+ * Check that the entry at `buffer` is all there, and find how much room
+ * it takes and how long its path is; `last_length` is the length of the
+ * path of the entry before it.
+ */
+static size_t read_entry_size(
+	size_t *path_length, unsigned int version,
+	const char *buffer, size_t buffer_size, size_t last_length)
 {
-	size_t path_length, entry_size;
-	uint16_t flags_raw;
 	const char *path_ptr;
-	const struct entry_short *source = buffer;
+	size_t entry_size, remaining;
+	uint16_t flags;
 
 	if (INDEX_FOOTER_SIZE + minimal_entry_size > buffer_size)
 		return 0;
 
-	memset(dest, 0x0, sizeof(git_index_entry));
-
-	dest->ctime.seconds = (git_time_t)ntohl(source->ctime.seconds);
-	dest->ctime.nanoseconds = ntohl(source->ctime.nanoseconds);
-	dest->mtime.seconds = (git_time_t)ntohl(source->mtime.seconds);
-	dest->mtime.nanoseconds = ntohl(source->mtime.nanoseconds);
-	dest->dev = ntohl(source->dev);
-	dest->ino = ntohl(source->ino);
-	dest->mode = ntohl(source->mode);
-	dest->uid = ntohl(source->uid);
-	dest->gid = ntohl(source->gid);
-	dest->file_size = ntohl(source->file_size);
-	git_oid_cpy(&dest->oid, &source->oid);
-	dest->flags = ntohs(source->flags);
-
-	if (dest->flags & GIT_IDXENTRY_EXTENDED) {
-		const struct entry_long *source_l = (const struct entry_long *)source;
-		path_ptr = source_l->path;
-
-		flags_raw = ntohs(source_l->flags_extended);
-		memcpy(&dest->flags_extended, &flags_raw, 2);
-	} else
-		path_ptr = source->path;
+	/* entries are not aligned in version 4 */
+	memcpy(&flags, buffer + offsetof(struct entry_short, flags), sizeof(flags));
+	flags = ntohs(flags);
 
-	path_length = dest->flags & GIT_IDXENTRY_NAMEMASK;
+	if (flags & GIT_IDXENTRY_EXTENDED)
+		path_ptr = buffer + offsetof(struct entry_long, path);
+	else
+		path_ptr = buffer + offsetof(struct entry_short, path);
+
+	if (INDEX_FOOTER_SIZE + (path_ptr - buffer) > buffer_size)
+		return 0;
+
+	remaining = buffer_size - INDEX_FOOTER_SIZE - (path_ptr - buffer);
+
+	if (version >= INDEX_VERSION_NUMBER_COMP) {
+		/*
+		 * The path is stored as the number of bytes to remove from
+		 * the end of the previous entry's path, and what to append
+		 * to it in their place.
+		 */
+		size_t varint_len, suffix_len;
+		uintmax_t strip;
+		const char *suffix_end;
+
+		strip = git_decode_varint(
+			&varint_len, (const unsigned char *)path_ptr, remaining);
+
+		if (varint_len == 0 || strip > last_length)
+			return 0;
+
+		suffix_end = memchr(path_ptr + varint_len, '\0', remaining - varint_len);
+		if (suffix_end == NULL)
+			return 0;
+
+		suffix_len = suffix_end - (path_ptr + varint_len);
+		*path_length = last_length - (size_t)strip + suffix_len;
+
+		if (flags & GIT_IDXENTRY_EXTENDED)
+			return compressed_entry_size(struct entry_long, varint_len, suffix_len);
+		else
+			return compressed_entry_size(struct entry_short, varint_len, suffix_len);
+	}
+
+	*path_length = flags & GIT_IDXENTRY_NAMEMASK;
 
 	/* if this is a very long string, we must find its
 	 * real length without overflowing */
-	if (path_length == 0xFFF) {
+	if (*path_length == 0xFFF) {
 		const char *path_end;
 
-		path_end = memchr(path_ptr, '\0', buffer_size);
+		path_end = memchr(path_ptr, '\0', remaining);
 		if (path_end == NULL)
 			return 0;
 
-		path_length = path_end - path_ptr;
+		*path_length = path_end - path_ptr;
 	}
 
-	if (dest->flags & GIT_IDXENTRY_EXTENDED)
-		entry_size = long_entry_size(path_length);
+	if (flags & GIT_IDXENTRY_EXTENDED)
+		entry_size = long_entry_size(*path_length);
 	else
-		entry_size = short_entry_size(path_length);
+		entry_size = short_entry_size(*path_length);
 
 	if (INDEX_FOOTER_SIZE + entry_size > buffer_size)
 		return 0;
 
-	dest->path = git__strdup(path_ptr);
-	assert(dest->path);
-
 	return entry_size;
 }
 
-static int read_header(struct index_header *dest, const void *buffer)
+/*
+ * Read the entry at `buffer`, which `read_entry_size` found to be all
+ * there, into `dest` and the path that follows it in the entry pool.
+ */
+static size_t read_entry(
+	struct entry_internal *dest, size_t *path_length,
+	unsigned int version, const char *buffer, const char *last)
 {
-	const struct index_header *source = buffer;
-
-	dest->signature = ntohl(source->signature);
-	if (dest->signature != INDEX_HEADER_SIG)
-		return index_error_invalid("incorrect header signature");
+	struct entry_long source;
+	const char *path_ptr;
 
-	dest->version = ntohl(source->version);
-	if (dest->version != INDEX_VERSION_NUMBER_EXT &&
-		dest->version != INDEX_VERSION_NUMBER)
-		return index_error_invalid("incorrect header version");
+	/*
+	 * Entries are not aligned in version 4, so the fields are copied
+	 * out of the buffer rather than read in place.
+	 */
+	memcpy(&source, buffer, offsetof(struct entry_short, path));
+
+	memset(dest, 0x0, sizeof(struct entry_internal));
+	dest->in_pool = 1;
+
+	dest->entry.ctime.seconds = (git_time_t)ntohl(source.ctime.seconds);
+	dest->entry.ctime.nanoseconds = ntohl(source.ctime.nanoseconds);
+	dest->entry.mtime.seconds = (git_time_t)ntohl(source.mtime.seconds);
+	dest->entry.mtime.nanoseconds = ntohl(source.mtime.nanoseconds);
+	dest->entry.dev = ntohl(source.dev);
+	dest->entry.ino = ntohl(source.ino);
+	dest->entry.mode = ntohl(source.mode);
+	dest->entry.uid = ntohl(source.uid);
+	dest->entry.gid = ntohl(source.gid);
+	dest->entry.file_size = ntohl(source.file_size);
+	git_oid_cpy(&dest->entry.oid, &source.oid);
+	dest->entry.flags = ntohs(source.flags);
+	dest->entry.path = dest->path;
+
+	if (dest->entry.flags & GIT_IDXENTRY_EXTENDED) {
+		memcpy(&source.flags_extended,
+			buffer + offsetof(struct entry_long, flags_extended),
+			sizeof(source.flags_extended));
+
+		dest->entry.flags_extended = ntohs(source.flags_extended);
+		path_ptr = buffer + offsetof(struct entry_long, path);
+	} else
+		path_ptr = buffer + offsetof(struct entry_short, path);
 
-	dest->entry_count = ntohl(source->entry_count);
-	return 0;
-}
+	if (version >= INDEX_VERSION_NUMBER_COMP) {
+		size_t varint_len, prefix_len, suffix_len;
+		uintmax_t strip;
 
-static size_t read_extension(git_index *index, const char *buffer, size_t buffer_size)
-{
-	const struct index_extension *source;
-	struct index_extension dest;
-	size_t total_size;
+		/* it was checked already, and cannot be any longer */
+		strip = git_decode_varint(&varint_len,
+			(const unsigned char *)path_ptr, (sizeof(uintmax_t) * 8 + 6) / 7);
 
-	source = (const struct index_extension *)(buffer);
+		prefix_len = (last ? strlen(last) : 0) - (size_t)strip;
+		suffix_len = strlen(path_ptr + varint_len);
 
-	memcpy(dest.signature, source->signature, 4);
-	dest.extension_size = ntohl(source->extension_size);
+		if (prefix_len)
+			memcpy(dest->path, last, prefix_len);
+		memcpy(dest->path + prefix_len, path_ptr + varint_len, suffix_len + 1);
+		*path_length = prefix_len + suffix_len;
 
-	total_size = dest.extension_size + sizeof(struct index_extension);
+		if (dest->entry.flags & GIT_IDXENTRY_EXTENDED)
+			return compressed_entry_size(struct entry_long, varint_len, suffix_len);
+		else
+			return compressed_entry_size(struct entry_short, varint_len, suffix_len);
+	}
 
-	if (dest.extension_size > total_size ||
-		buffer_size < total_size ||
-		buffer_size - total_size < INDEX_FOOTER_SIZE)
-		return 0;
+	*path_length = dest->entry.flags & GIT_IDXENTRY_NAMEMASK;
+	if (*path_length == 0xFFF)
+		*path_length = strlen(path_ptr);
 
-	/* optional extension */
-	if (dest.signature[0] >= 'A' && dest.signature[0] <= 'Z') {
-		/* tree cache */
-		if (memcmp(dest.signature, INDEX_EXT_TREECACHE_SIG, 4) == 0) {
-			if (git_tree_cache_read(&index->tree, buffer + 8, dest.extension_size) < 0)
-				return 0;
-		} else if (memcmp(dest.signature, INDEX_EXT_UNMERGED_SIG, 4) == 0) {
-			if (read_reuc(index, buffer + 8, dest.extension_size) < 0)
-				return 0;
-		} else if (memcmp(dest.signature, INDEX_EXT_CONFLICT_NAME_SIG, 4) == 0) {
-			if (read_conflict_names(index, buffer + 8, dest.extension_size) < 0)
-				return 0;
-		}
-		/* else, unsupported extension. We cannot parse this, but we can skip
-		 * it by returning `total_size */
-	} else {
-		/* we cannot handle non-ignorable extensions;
-		 * in fact they aren't even defined in the standard */
-		return 0;
-	}
+	memcpy(dest->path, path_ptr, *path_length);
+	dest->path[*path_length] = '\0';
 
-	return total_size;
+	if (dest->entry.flags & GIT_IDXENTRY_EXTENDED)
+		return long_entry_size(*path_length);
+	else
+		return short_entry_size(*path_length);
 }
 
-static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
+/* A run of entries in a row, read by one thread */
+typedef struct {
+	unsigned int version;
+	const char *buffer;
+	size_t count;
+	size_t pool_offset;
+	char *pool;
+	git_index_entry **entries;
+} entry_block;
+
+static void read_entry_block(entry_block *block)
 {
-	unsigned int i;
-	struct index_header header = { 0 };
-	git_oid checksum_calculated, checksum_expected;
+	const char *buffer = block->buffer, *last = NULL;
+	char *pool = block->pool;
+	size_t i, path_length;
 
-#define seek_forward(_increase) { \
-	if (_increase >= buffer_size) \
-		return index_error_invalid("ran out of data while parsing"); \
-	buffer += _increase; \
-	buffer_size -= _increase;\
-}
+	for (i = 0; i < block->count; ++i) {
+		struct entry_internal *entry = (struct entry_internal *)pool;
 
-	if (buffer_size < INDEX_HEADER_SIZE + INDEX_FOOTER_SIZE)
-		return index_error_invalid("insufficient buffer space");
+		buffer += read_entry(entry, &path_length, block->version, buffer, last);
+		block->entries[i] = &entry->entry;
 
-	/* Precalculate the SHA1 of the files's contents -- we'll match it to
-	 * the provided SHA1 in the footer */
-	git_hash_buf(&checksum_calculated, buffer, buffer_size - INDEX_FOOTER_SIZE);
+		last = entry->path;
+		pool += pool_entry_size(path_length);
+	}
+}
+
+#ifdef GIT_THREADS
+static void *read_entry_block_thread(void *payload)
+{
+	read_entry_block(payload);
+	return NULL;
+}
+#endif
+
+/*
+ * Read the `count` entries at the start of `buffer`: once to see that
+ * they are all there and how much room they take, then again to fill in
+ * a single allocation from the entry pool.  Paths which are compressed
+ * depend on the one before them, so only those which are not are split
+ * up between threads.  Returns the size of the entries on disk.
+ */
+static size_t read_entries(
+	git_index *index, unsigned int version, size_t count,
+	const char *buffer, size_t buffer_size)
+{
+	entry_block blocks[INDEX_MAX_THREADS];
+	size_t nblocks = 1, block_size, i, entry_size, path_length = 0;
+	size_t read = 0, pool_size = 0;
+	char *pool;
+
+	memset(blocks, 0x0, sizeof(blocks));
+
+#ifdef GIT_THREADS
+	if (version < INDEX_VERSION_NUMBER_COMP) {
+		nblocks = min(count / INDEX_ENTRIES_PER_THREAD, INDEX_MAX_THREADS);
+		nblocks = min(nblocks, (size_t)max(git_online_cpus(), 1));
+		nblocks = max(nblocks, 1);
+	}
+#endif
+
+	block_size = (count + nblocks - 1) / nblocks;
+
+	for (i = 0; i < count; ++i) {
+		entry_block *block = &blocks[i / block_size];
+
+		if (block->count++ == 0) {
+			block->version = version;
+			block->buffer = buffer + read;
+			block->pool_offset = pool_size;
+			block->entries = (git_index_entry **)index->entries.contents + i;
+		}
+
+		entry_size = read_entry_size(&path_length,
+			version, buffer + read, buffer_size - read, path_length);
+
+		/* 0 bytes read means an object corruption */
+		if (entry_size == 0 || entry_size >= buffer_size - read) {
+			index_error_invalid("invalid entry");
+			return 0;
+		}
+
+		read += entry_size;
+		pool_size += pool_entry_size(path_length);
+	}
+
+	if (!count)
+		return read;
+
+	if (pool_size / index->entry_pool.item_size > UINT32_MAX) {
+		giterr_set(GITERR_INDEX, "Index is too large to be read");
+		return 0;
+	}
+
+	pool = git_pool_malloc(&index->entry_pool,
+		(uint32_t)(pool_size / index->entry_pool.item_size));
+	if (!pool)
+		return 0;
+
+	for (i = 0; i < nblocks; ++i)
+		blocks[i].pool = pool + blocks[i].pool_offset;
+
+#ifdef GIT_THREADS
+	{
+		git_thread threads[INDEX_MAX_THREADS];
+		bool started[INDEX_MAX_THREADS] = { false };
+
+		for (i = 1; i < nblocks; ++i)
+			started[i] = !git_thread_create(
+				&threads[i], NULL, read_entry_block_thread, &blocks[i]);
+
+		read_entry_block(&blocks[0]);
+
+		/* what a thread could not be started for is read here */
+		for (i = 1; i < nblocks; ++i) {
+			if (started[i])
+				git_thread_join(threads[i], NULL);
+			else
+				read_entry_block(&blocks[i]);
+		}
+	}
+#else
+	read_entry_block(&blocks[0]);
+#endif
+
+	return read;
+}
+
+static int read_header(struct index_header *dest, const void *buffer)
+{
+	const struct index_header *source = buffer;
+
+	dest->signature = ntohl(source->signature);
+	if (dest->signature != INDEX_HEADER_SIG)
+		return index_error_invalid("incorrect header signature");
+
+	dest->version = ntohl(source->version);
+	if (dest->version != INDEX_VERSION_NUMBER_COMP &&
+		dest->version != INDEX_VERSION_NUMBER_EXT &&
+		dest->version != INDEX_VERSION_NUMBER)
+		return index_error_invalid("incorrect header version");
+
+	dest->entry_count = ntohl(source->entry_count);
+	return 0;
+}
+
+static int read_link(struct index_link *link, const char *buffer, size_t size)
+{
+	size_t len;
+
+	if (size < GIT_OID_RAWSZ)
+		return -1;
+
+	git_oid_fromraw(&link->shared_id, (const unsigned char *)buffer);
+	buffer += GIT_OID_RAWSZ;
+	size -= GIT_OID_RAWSZ;
+
+	link->present = true;
+
+	/* nothing of the shared index was deleted or replaced */
+	if (size == 0)
+		return 0;
+
+	if ((len = git_ewah_read(
+			&link->deleted, &link->deleted_size, buffer, size)) == 0)
+		return -1;
+
+	buffer += len;
+	size -= len;
+
+	if ((len = git_ewah_read(
+			&link->replaced, &link->replaced_size, buffer, size)) == 0)
+		return -1;
+
+	return (len == size) ? 0 : -1;
+}
+
+static int read_fsmonitor(
+	git_index *index, struct index_link *link,
+	const char *buffer, size_t size)
+{
+	const char *token_end;
+	uint32_t version, dirty_size;
+
+	if (size < 4)
+		return -1;
+
+	memcpy(&version, buffer, 4);
+
+	/* version 1 holds a time for the hook of git, not a token */
+	if (ntohl(version) != 2)
+		return 0;
+
+	buffer += 4;
+	size -= 4;
+
+	if ((token_end = memchr(buffer, '\0', size)) == NULL ||
+		(size_t)(buffer + size - token_end) < 1 + 4)
+		return -1;
+
+	git__free(index->fsmonitor_token);
+	index->fsmonitor_token = git__strdup(buffer);
+	GITERR_CHECK_ALLOC(index->fsmonitor_token);
+
+	size -= token_end + 1 - buffer;
+	buffer = token_end + 1;
+
+	memcpy(&dirty_size, buffer, 4);
+	dirty_size = ntohl(dirty_size);
+
+	buffer += 4;
+	size -= 4;
+
+	if (dirty_size != size ||
+		git_ewah_read(&link->fsmonitor_dirty,
+			&link->fsmonitor_dirty_size, buffer, size) != size)
+		return -1;
+
+	return 0;
+}
+
+static size_t read_extension(
+	git_index *index, struct index_link *link,
+	const char *buffer, size_t buffer_size)
+{
+	struct index_extension dest;
+	size_t total_size;
+
+	/* after version 4 entries, extensions are not aligned either */
+	memcpy(&dest, buffer, sizeof(struct index_extension));
+	dest.extension_size = ntohl(dest.extension_size);
+
+	total_size = dest.extension_size + sizeof(struct index_extension);
+
+	if (dest.extension_size > total_size ||
+		buffer_size < total_size ||
+		buffer_size - total_size < INDEX_FOOTER_SIZE)
+		return 0;
+
+	/* optional extension */
+	if (dest.signature[0] >= 'A' && dest.signature[0] <= 'Z') {
+		/* tree cache */
+		if (memcmp(dest.signature, INDEX_EXT_TREECACHE_SIG, 4) == 0) {
+			if (git_tree_cache_read(&index->tree, buffer + 8, dest.extension_size) < 0)
+				return 0;
+		} else if (memcmp(dest.signature, INDEX_EXT_UNMERGED_SIG, 4) == 0) {
+			if (read_reuc(index, buffer + 8, dest.extension_size) < 0)
+				return 0;
+		} else if (memcmp(dest.signature, INDEX_EXT_CONFLICT_NAME_SIG, 4) == 0) {
+			if (read_conflict_names(index, buffer + 8, dest.extension_size) < 0)
+				return 0;
+		} else if (memcmp(dest.signature, INDEX_EXT_UNTRACKED_SIG, 4) == 0) {
+			/* git's own listings are left out, but we keep a cache */
+			if (git_untracked_cache_read(
+					&index->untracked, buffer + 8, dest.extension_size) < 0)
+				return 0;
+			index->keep_untracked = 1;
+		} else if (memcmp(dest.signature, INDEX_EXT_FSMONITOR_SIG, 4) == 0) {
+			if (read_fsmonitor(index, link, buffer + 8, dest.extension_size) < 0)
+				return 0;
+		}
+		/* else, unsupported extension. We cannot parse this, but we can skip
+		 * it by returning `total_size */
+	} else if (memcmp(dest.signature, INDEX_EXT_LINK_SIG, 4) == 0) {
+		if (link->present ||
+			read_link(link, buffer + 8, dest.extension_size) < 0)
+			return 0;
+	} else {
+		/* we cannot handle non-ignorable extensions;
+		 * in fact they aren't even defined in the standard */
+		return 0;
+	}
+
+	return total_size;
+}
+
+static int parse_index_file(
+	git_index *index, struct index_link *link,
+	const char *buffer, size_t buffer_size)
+{
+	size_t entries_size;
+	struct index_header header = { 0 };
+	git_oid checksum_calculated, checksum_expected;
+
+#define seek_forward(_increase) { \
+	if (_increase >= buffer_size) \
+		return index_error_invalid("ran out of data while parsing"); \
+	buffer += _increase; \
+	buffer_size -= _increase;\
+}
+
+	if (buffer_size < INDEX_HEADER_SIZE + INDEX_FOOTER_SIZE)
+		return index_error_invalid("insufficient buffer space");
+
+	/* Precalculate the SHA1 of the files's contents -- we'll match it to
+	 * the provided SHA1 in the footer */
+	git_hash_buf(&checksum_calculated, buffer, buffer_size - INDEX_FOOTER_SIZE);
 
 	/* Parse header */
 	if (read_header(&header, buffer) < 0)
@@ -1633,36 +2817,32 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 
 	seek_forward(INDEX_HEADER_SIZE);
 
-	git_vector_clear(&index->entries);
+	index->version = header.version;
 
-	/* Parse all the entries */
-	for (i = 0; i < header.entry_count && buffer_size > INDEX_FOOTER_SIZE; ++i) {
-		size_t entry_size;
-		git_index_entry *entry;
+	if (header.entry_count > buffer_size / minimal_entry_size)
+		return index_error_invalid("header entries changed while parsing");
 
-		entry = git__malloc(sizeof(git_index_entry));
-		GITERR_CHECK_ALLOC(entry);
+	/* Parse all the entries */
+	git_vector_clear(&index->entries);
 
-		entry_size = read_entry(entry, buffer, buffer_size);
+	if (git_vector_resize_to(&index->entries, header.entry_count) < 0)
+		return -1;
 
-		/* 0 bytes read means an object corruption */
-		if (entry_size == 0)
-			return index_error_invalid("invalid entry");
+	entries_size = read_entries(
+		index, header.version, header.entry_count, buffer, buffer_size);
 
-		if (git_vector_insert(&index->entries, entry) < 0)
-			return -1;
-
-		seek_forward(entry_size);
+	if (header.entry_count > 0 && entries_size == 0) {
+		git_vector_clear(&index->entries);
+		return -1;
 	}
 
-	if (i != header.entry_count)
-		return index_error_invalid("header entries changed while parsing");
+	seek_forward(entries_size);
 
 	/* There's still space for some extensions! */
 	while (buffer_size > INDEX_FOOTER_SIZE) {
 		size_t extension_size;
 
-		extension_size = read_extension(index, buffer, buffer_size);
+		extension_size = read_extension(index, link, buffer, buffer_size);
 
 		/* see if we have read any bytes from the extension */
 		if (extension_size == 0)
@@ -1682,13 +2862,196 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 
 #undef seek_forward
 
-	/* Entries are stored case-sensitively on disk. */
-	index->entries.sorted = !index->ignore_case;
-	git_vector_sort(&index->entries);
+	return 0;
+}
+
+static int shared_index_path(git_buf *out, git_index *index, const git_oid *id)
+{
+	char hex[GIT_OID_HEXSZ + 1];
+
+	if (git_path_dirname_r(out, index->index_file_path) < 0)
+		return -1;
+
+	return git_buf_printf(out, "/sharedindex.%s",
+		git_oid_tostr(hex, sizeof(hex), id));
+}
+
+/*
+ * Merge the entries of the shared index into the ones just read from a
+ * split index: those that are kept remember where they are in the shared
+ * index, so that the next write can leave them out.
+ */
+static int read_shared_index(git_index *index, struct index_link *link)
+{
+	git_buf path = GIT_BUF_INIT, buffer = GIT_BUF_INIT;
+	git_index *shared = NULL;
+	git_vector merged = GIT_VECTOR_INIT;
+	git_index_entry **own, **base;
+	size_t i, own_count, base_count, replaced = 0;
+	int error;
+
+	if ((error = shared_index_path(&path, index, &link->shared_id)) < 0)
+		goto done;
+
+	if (!git_path_exists(path.ptr)) {
+		giterr_set(GITERR_INDEX,
+			"The shared index '%s' does not exist", path.ptr);
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_index_new(&shared)) < 0 ||
+		(error = git_futils_readbuffer(&buffer, path.ptr)) < 0)
+		goto done;
+
+	shared->index_file_path = git_buf_detach(&path);
+
+	/* its entries are read into the entry pool of the index, to live
+	 * as long as the ones read from the split index itself */
+	git_pool_swap(&shared->entry_pool, &index->entry_pool);
+	error = parse_index(shared, buffer.ptr, buffer.size);
+	git_pool_swap(&shared->entry_pool, &index->entry_pool);
+
+	if (error < 0)
+		goto done;
+
+	own = (git_index_entry **)index->entries.contents;
+	own_count = index->entries.length;
+	base = (git_index_entry **)shared->entries.contents;
+	base_count = shared->entries.length;
+
+	if (shared->shared_count > 0 ||
+		link->deleted_size > base_count || link->replaced_size > base_count) {
+		error = index_error_invalid("corrupted link extension");
+		goto done;
+	}
+
+	/* the replacements come first, without a name of their own; the
+	 * entries added by the split index come after them */
+	for (i = 0; i < link->replaced_size; ++i)
+		if (git_bitvec_get(&link->replaced, i))
+			replaced++;
+
+	for (i = 0; i < own_count && replaced <= own_count; ++i)
+		if ((*own[i]->path == '\0') != (i < replaced))
+			break;
+
+	if (replaced > own_count || i < own_count) {
+		error = index_error_invalid("corrupted link extension");
+		goto done;
+	}
+
+	if ((error = git_vector_init(&merged,
+			base_count + own_count, index->entries._cmp)) < 0)
+		goto done;
+
+	/* nothing can fail from here on */
+	for (i = 0, replaced = 0; i < base_count; ++i) {
+		git_index_entry *entry = base[i];
+
+		if (i < link->replaced_size && git_bitvec_get(&link->replaced, i)) {
+			git_index_entry *replacement = own[replaced++];
+			size_t path_length = strlen(entry->path);
+
+			/* both are in the entry pool of the index */
+			replacement->path = entry->path;
+
+			replacement->flags &= ~GIT_IDXENTRY_NAMEMASK;
+			replacement->flags |= (path_length < GIT_IDXENTRY_NAMEMASK) ?
+				path_length : GIT_IDXENTRY_NAMEMASK;
+
+			/* and it keeps replacing the same entry when written */
+			ENTRY_SHARED_REPLACED(replacement) = 1;
+			entry = replacement;
+		}
+
+		ENTRY_SHARED_POS(entry) = i + 1;
+
+		if (i < link->deleted_size && git_bitvec_get(&link->deleted, i))
+			index_entry_free(entry);
+		else
+			git_vector_insert(&merged, entry);
+	}
+
+	for (i = replaced; i < own_count; ++i)
+		git_vector_insert(&merged, own[i]);
+
+	git_vector_clear(&shared->entries);
+	git_vector_swap(&merged, &index->entries);
+
+	git_oid_cpy(&index->shared_id, &link->shared_id);
+	index->shared_count = base_count;
+	index->split = 1;
+
+done:
+	git_vector_free(&merged);
+	git_index_free(shared);
+	git_buf_free(&buffer);
+	git_buf_free(&path);
+	return error;
+}
+
+/* The entries of `index` in the order that they are written in */
+static int disk_order_entries(git_vector *out, git_index *index)
+{
+	if (git_vector_dup(out, &index->entries, index_cmp) < 0)
+		return -1;
+
+	git_vector_sort(out);
+	return 0;
+}
+
+/* Mark the entries that the "FSMN" extension vouches for */
+static int read_fsmonitor_valid(git_index *index, struct index_link *link)
+{
+	git_vector entries;
+	git_index_entry *entry;
+	size_t i;
+
+	if (disk_order_entries(&entries, index) < 0)
+		return -1;
+
+	git_vector_foreach(&entries, i, entry) {
+		if (i >= link->fsmonitor_dirty_size ||
+			!git_bitvec_get(&link->fsmonitor_dirty, i))
+			entry->flags_extended |= GIT_IDXENTRY_FSMONITOR_VALID;
+	}
 
+	git_vector_free(&entries);
 	return 0;
 }
 
+static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
+{
+	struct index_link link;
+	int error;
+
+	memset(&link, 0x0, sizeof(link));
+
+	memset(&index->shared_id, 0x0, sizeof(git_oid));
+	index->shared_count = 0;
+
+	if ((error = parse_index_file(index, &link, buffer, buffer_size)) == 0 &&
+		link.present)
+		error = read_shared_index(index, &link);
+
+	/* Entries are stored case-sensitively on disk. */
+	if (!error) {
+		index->entries.sorted = !index->ignore_case && !link.present;
+		git_vector_sort(&index->entries);
+		index->entries_pooled = 1;
+	}
+
+	if (!error && index->fsmonitor_token)
+		error = read_fsmonitor_valid(index, &link);
+
+	git_bitvec_free(&link.deleted);
+	git_bitvec_free(&link.replaced);
+	git_bitvec_free(&link.fsmonitor_dirty);
+
+	return error;
+}
+
 static bool is_index_extended(git_index *index)
 {
 	size_t i, extended;
@@ -1707,26 +3070,50 @@ static bool is_index_extended(git_index *index)
 	return (extended > 0);
 }
 
-static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
+static int write_disk_entry(
+	git_filebuf *file, git_index_entry *entry,
+	unsigned int version, const char *last)
 {
-	void *mem = NULL;
-	struct entry_short *ondisk;
-	size_t path_len, disk_size;
+	char *mem = NULL;
+	struct entry_long ondisk;
+	size_t path_len, disk_size, header_size;
+	unsigned char varint[16];
+	int varint_len = 0;
+	const char *suffix;
 	char *path;
 
 	path_len = strlen(entry->path);
+	suffix = entry->path;
 
-	if (entry->flags & GIT_IDXENTRY_EXTENDED)
-		disk_size = long_entry_size(path_len);
-	else
-		disk_size = short_entry_size(path_len);
+	if (version >= INDEX_VERSION_NUMBER_COMP) {
+		size_t same_len = 0, last_len = last ? strlen(last) : 0;
 
-	if (git_filebuf_reserve(file, &mem, disk_size) < 0)
-		return -1;
+		while (same_len < last_len && same_len < path_len &&
+			last[same_len] == entry->path[same_len])
+			same_len++;
+
+		varint_len = git_encode_varint(
+			varint, sizeof(varint), last_len - same_len);
 
-	ondisk = (struct entry_short *)mem;
+		suffix += same_len;
+		path_len -= same_len;
+
+		if (entry->flags & GIT_IDXENTRY_EXTENDED)
+			disk_size = compressed_entry_size(struct entry_long, varint_len, path_len);
+		else
+			disk_size = compressed_entry_size(struct entry_short, varint_len, path_len);
+	} else {
+		if (entry->flags & GIT_IDXENTRY_EXTENDED)
+			disk_size = long_entry_size(path_len);
+		else
+			disk_size = short_entry_size(path_len);
+	}
+
+	if (git_filebuf_reserve(file, (void **)&mem, disk_size) < 0)
+		return -1;
 
-	memset(ondisk, 0x0, disk_size);
+	memset(mem, 0x0, disk_size);
+	memset(&ondisk, 0x0, sizeof(ondisk));
 
 	/**
 	 * Yes, we have to truncate.
@@ -1738,42 +3125,98 @@ static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
 	 *
 	 * In 2038 I will be either too dead or too rich to care about this
 	 */
-	ondisk->ctime.seconds = htonl((uint32_t)entry->ctime.seconds);
-	ondisk->mtime.seconds = htonl((uint32_t)entry->mtime.seconds);
-	ondisk->ctime.nanoseconds = htonl(entry->ctime.nanoseconds);
-	ondisk->mtime.nanoseconds = htonl(entry->mtime.nanoseconds);
-	ondisk->dev = htonl(entry->dev);
-	ondisk->ino = htonl(entry->ino);
-	ondisk->mode = htonl(entry->mode);
-	ondisk->uid = htonl(entry->uid);
-	ondisk->gid = htonl(entry->gid);
-	ondisk->file_size = htonl((uint32_t)entry->file_size);
+	ondisk.ctime.seconds = htonl((uint32_t)entry->ctime.seconds);
+	ondisk.mtime.seconds = htonl((uint32_t)entry->mtime.seconds);
+	ondisk.ctime.nanoseconds = htonl(entry->ctime.nanoseconds);
+	ondisk.mtime.nanoseconds = htonl(entry->mtime.nanoseconds);
+	ondisk.dev = htonl(entry->dev);
+	ondisk.ino = htonl(entry->ino);
+	ondisk.mode = htonl(entry->mode);
+	ondisk.uid = htonl(entry->uid);
+	ondisk.gid = htonl(entry->gid);
+	ondisk.file_size = htonl((uint32_t)entry->file_size);
 
-	git_oid_cpy(&ondisk->oid, &entry->oid);
+	git_oid_cpy(&ondisk.oid, &entry->oid);
 
-	ondisk->flags = htons(entry->flags);
+	ondisk.flags = htons(entry->flags);
 
 	if (entry->flags & GIT_IDXENTRY_EXTENDED) {
-		struct entry_long *ondisk_ext;
-		ondisk_ext = (struct entry_long *)ondisk;
-		ondisk_ext->flags_extended = htons(entry->flags_extended);
-		path = ondisk_ext->path;
+		ondisk.flags_extended =
+			htons(entry->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS);
+		header_size = offsetof(struct entry_long, path);
 	}
 	else
-		path = ondisk->path;
+		header_size = offsetof(struct entry_short, path);
 
-	memcpy(path, entry->path, path_len);
+	/* entries are not aligned in version 4, so `mem` may not be either */
+	memcpy(mem, &ondisk, header_size);
+	path = mem + header_size;
+
+	memcpy(path, varint, varint_len);
+	memcpy(path + varint_len, suffix, path_len);
 
 	return 0;
 }
 
-static int write_entries(git_index *index, git_filebuf *file)
+static int shared_pos_cmp(const void *a, const void *b)
 {
-	int error = 0;
+	size_t pos_a = ENTRY_SHARED_POS(a), pos_b = ENTRY_SHARED_POS(b);
+	return (pos_a < pos_b) ? -1 : (pos_a > pos_b);
+}
+
+/*
+ * A split index starts with the entries that replace ones of the shared
+ * index, in the order of those and without a name, as they take theirs.
+ */
+static int write_replacements(
+	git_index *index, git_filebuf *file, const char **last)
+{
+	git_vector replaced = GIT_VECTOR_INIT;
+	git_index_entry *entry, stripped;
 	size_t i;
+	int error;
+
+	if ((error = git_vector_init(&replaced, 0, shared_pos_cmp)) < 0)
+		return error;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (ENTRY_SHARED_REPLACED(entry) &&
+			(error = git_vector_insert(&replaced, entry)) < 0)
+			goto done;
+	}
+
+	git_vector_sort(&replaced);
+
+	git_vector_foreach(&replaced, i, entry) {
+		memcpy(&stripped, entry, sizeof(git_index_entry));
+		stripped.path = "";
+		stripped.flags &= ~GIT_IDXENTRY_NAMEMASK;
+
+		if ((error = write_disk_entry(
+				file, &stripped, index->version, *last)) < 0)
+			goto done;
+
+		*last = "";
+	}
+
+done:
+	git_vector_free(&replaced);
+	return error;
+}
+
+static int write_entries(
+	git_index *index, git_filebuf *file, enum index_write_mode mode)
+{
+	int error = 0;
+	size_t i, written = 0;
 	git_vector case_sorted;
 	git_index_entry *entry;
 	git_vector *out = &index->entries;
+	const char *last = NULL;
+
+	if (mode == INDEX_WRITE_SPLIT &&
+		(error = write_replacements(index, file, &last)) < 0)
+		return error;
 
 	/* If index->entries is sorted case-insensitively, then we need
 	 * to re-sort it case-sensitively before writing */
@@ -1783,10 +3226,22 @@ static int write_entries(git_index *index, git_filebuf *file)
 		out = &case_sorted;
 	}
 
-	git_vector_foreach(out, i, entry)
-		if ((error = write_disk_entry(file, entry)) < 0)
+	git_vector_foreach(out, i, entry) {
+		/* the shared index already has it, or it replaces one there */
+		if (mode == INDEX_WRITE_SPLIT && ENTRY_SHARED_POS(entry) > 0)
+			continue;
+
+		if ((error = write_disk_entry(file, entry, index->version, last)) < 0)
 			break;
 
+		if (mode == INDEX_WRITE_SHARED) {
+			ENTRY_SHARED_POS(entry) = ++written;
+			ENTRY_SHARED_REPLACED(entry) = 0;
+		}
+
+		last = entry->path;
+	}
+
 	if (index->ignore_case)
 		git_vector_free(&case_sorted);
 
@@ -1808,6 +3263,148 @@ static int write_extension(git_filebuf *file, struct index_extension *header, gi
 	return error;
 }
 
+static int write_link_extension(git_index *index, git_filebuf *file)
+{
+	git_buf link_buf = GIT_BUF_INIT;
+	git_bitvec deleted, replaced;
+	struct index_extension extension;
+	git_index_entry *entry;
+	size_t i;
+	int error;
+
+	if ((error = git_bitvec_init(&deleted, index->shared_count)) < 0)
+		return error;
+
+	if ((error = git_bitvec_init(&replaced, index->shared_count)) < 0) {
+		git_bitvec_free(&deleted);
+		return error;
+	}
+
+	for (i = 0; i < index->shared_count; ++i)
+		git_bitvec_set(&deleted, i, true);
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (ENTRY_SHARED_POS(entry) == 0)
+			continue;
+
+		git_bitvec_set(&deleted, ENTRY_SHARED_POS(entry) - 1, false);
+
+		if (ENTRY_SHARED_REPLACED(entry))
+			git_bitvec_set(&replaced, ENTRY_SHARED_POS(entry) - 1, true);
+	}
+
+	/* git expects both bitmaps, even when they are empty */
+	if ((error = git_buf_put(&link_buf,
+			(const char *)index->shared_id.id, GIT_OID_RAWSZ)) < 0 ||
+		(error = git_ewah_write(&link_buf, &deleted, index->shared_count)) < 0 ||
+		(error = git_ewah_write(&link_buf, &replaced, index->shared_count)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_LINK_SIG, 4);
+	extension.extension_size = (uint32_t)link_buf.size;
+
+	error = write_extension(file, &extension, &link_buf);
+
+done:
+	git_bitvec_free(&deleted);
+	git_bitvec_free(&replaced);
+	git_buf_free(&link_buf);
+	return error;
+}
+
+static int write_tree_extension(git_index *index, git_filebuf *file)
+{
+	git_buf tree_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	int error;
+
+	if ((error = git_tree_cache_write(&tree_buf, index->tree)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_TREECACHE_SIG, 4);
+	extension.extension_size = (uint32_t)tree_buf.size;
+
+	error = write_extension(file, &extension, &tree_buf);
+
+done:
+	git_buf_free(&tree_buf);
+	return error;
+}
+
+static int write_untracked_extension(git_index *index, git_filebuf *file)
+{
+	git_buf untracked_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	int error;
+
+	if ((error = git_untracked_cache_write(&untracked_buf, index->untracked)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_UNTRACKED_SIG, 4);
+	extension.extension_size = (uint32_t)untracked_buf.size;
+
+	error = write_extension(file, &extension, &untracked_buf);
+
+done:
+	git_buf_free(&untracked_buf);
+	return error;
+}
+
+static int write_fsmonitor_extension(git_index *index, git_filebuf *file)
+{
+	git_buf fsmonitor_buf = GIT_BUF_INIT;
+	git_vector entries = GIT_VECTOR_INIT;
+	git_bitvec dirty;
+	struct index_extension extension;
+	git_index_entry *entry;
+	uint32_t version = htonl(2), dirty_size;
+	size_t i, bitmap_start;
+	int error;
+
+	memset(&dirty, 0x0, sizeof(dirty));
+
+	if ((error = disk_order_entries(&entries, index)) < 0 ||
+		(error = git_bitvec_init(&dirty, entries.length)) < 0)
+		goto done;
+
+	git_vector_foreach(&entries, i, entry) {
+		if (!(entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID))
+			git_bitvec_set(&dirty, i, true);
+	}
+
+	git_buf_put(&fsmonitor_buf, (const char *)&version, 4);
+	git_buf_put(&fsmonitor_buf,
+		index->fsmonitor_token, strlen(index->fsmonitor_token) + 1);
+
+	/* the size of the bitmap goes before it, once it is known */
+	bitmap_start = fsmonitor_buf.size + 4;
+	git_buf_put(&fsmonitor_buf, "\0\0\0\0", 4);
+
+	if (git_ewah_write(&fsmonitor_buf, &dirty, entries.length) < 0 ||
+		git_buf_oom(&fsmonitor_buf)) {
+		error = -1;
+		goto done;
+	}
+
+	dirty_size = htonl((uint32_t)(fsmonitor_buf.size - bitmap_start));
+	memcpy(fsmonitor_buf.ptr + bitmap_start - 4, &dirty_size, 4);
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_FSMONITOR_SIG, 4);
+	extension.extension_size = (uint32_t)fsmonitor_buf.size;
+
+	error = write_extension(file, &extension, &fsmonitor_buf);
+
+done:
+	git_bitvec_free(&dirty);
+	git_vector_free(&entries);
+	git_buf_free(&fsmonitor_buf);
+	return error;
+}
+
 static int create_name_extension_data(git_buf *name_buf, git_index_name_entry *conflict_name)
 {
 	int error = 0;
@@ -1911,39 +3508,79 @@ done:
 	return error;
 }
 
-static int write_index(git_index *index, git_filebuf *file)
+static int write_index(
+	git_oid *checksum, git_index *index,
+	git_filebuf *file, enum index_write_mode mode)
 {
 	git_oid hash_final;
 	struct index_header header;
 	bool is_extended;
+	unsigned int version;
+	size_t i, entry_count = index->entries.length;
+	git_index_entry *entry;
 
 	assert(index && file);
 
 	is_extended = is_index_extended(index);
 
+	/* version 4 can hold extended flags; 2 and 3 only differ by them */
+	if (index->version >= INDEX_VERSION_NUMBER_COMP)
+		version = INDEX_VERSION_NUMBER_COMP;
+	else
+		version = is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER;
+
+	if (mode == INDEX_WRITE_SPLIT) {
+		git_vector_foreach(&index->entries, i, entry) {
+			if (ENTRY_IS_SHARED(entry))
+				entry_count--;
+		}
+	}
+
 	header.signature = htonl(INDEX_HEADER_SIG);
-	header.version = htonl(is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER);
-	header.entry_count = htonl((uint32_t)index->entries.length);
+	header.version = htonl(version);
+	header.entry_count = htonl((uint32_t)entry_count);
 
 	if (git_filebuf_write(file, &header, sizeof(struct index_header)) < 0)
 		return -1;
 
-	if (write_entries(index, file) < 0)
+	if (write_entries(index, file, mode) < 0)
 		return -1;
 
-	/* TODO: write tree cache extension */
-
-	/* write the rename conflict extension */
-	if (index->names.length > 0 && write_name_extension(index, file) < 0)
+	/* write the link to the shared index of a split index */
+	if (mode == INDEX_WRITE_SPLIT && write_link_extension(index, file) < 0)
 		return -1;
 
-	/* write the reuc extension */
-	if (index->reuc.length > 0 && write_reuc_extension(index, file) < 0)
-		return -1;
+	/* the extensions go with the split index, not the shared one */
+	if (mode != INDEX_WRITE_SHARED) {
+		/* write the tree cache extension */
+		if (index->tree != NULL && write_tree_extension(index, file) < 0)
+			return -1;
+
+		/* write the rename conflict extension */
+		if (index->names.length > 0 && write_name_extension(index, file) < 0)
+			return -1;
+
+		/* write the reuc extension */
+		if (index->reuc.length > 0 && write_reuc_extension(index, file) < 0)
+			return -1;
+
+		/* write the untracked cache extension */
+		if (index->untracked != NULL &&
+			write_untracked_extension(index, file) < 0)
+			return -1;
+
+		/* write the token of the file system monitor */
+		if (index->fsmonitor_token != NULL &&
+			write_fsmonitor_extension(index, file) < 0)
+			return -1;
+	}
 
 	/* get out the hash for all the contents we've appended to the file */
 	git_filebuf_hash(&hash_final, file);
 
+	if (checksum)
+		git_oid_cpy(checksum, &hash_final);
+
 	/* write it at the end of the file */
 	return git_filebuf_write(file, hash_final.id, GIT_OID_RAWSZ);
 }
@@ -1953,82 +3590,177 @@ int git_index_entry_stage(const git_index_entry *entry)
 	return GIT_IDXENTRY_STAGE(entry);
 }
 
+/* the pages in which `git_index_read_tree` lays out its entries */
+#define READ_TREE_POOL_PAGE_ITEMS (65536 / 8)
+
 typedef struct read_tree_data {
-	git_vector *old_entries;
+	git_index *index;
 	git_vector *new_entries;
-	git_vector_cmp entries_search;
+	git_pool *pool;
+
+	/* the entries come out of the tree in the order of a case sensitive
+	 * index, so the old ones are merged with them as they go by */
+	bool merge;
+	size_t old_pos;
 } read_tree_data;
 
-static int read_tree_cb(
-	const char *root, const git_tree_entry *tentry, void *payload)
+/* The old stage 0 entry for `path`, whose stat data may be kept */
+static const git_index_entry *read_tree_old_entry(
+	read_tree_data *data, const char *path)
 {
-	read_tree_data *data = payload;
-	git_index_entry *entry = NULL, *old_entry;
-	git_buf path = GIT_BUF_INIT;
+	git_vector *old_entries = &data->index->entries;
+	const git_index_entry *old_entry;
+	int cmp;
 
-	if (git_tree_entry__is_tree(tentry))
-		return 0;
+	if (!data->merge)
+		return index_find_entry(data->index, path, 0);
 
-	if (git_buf_joinpath(&path, root, tentry->filename) < 0)
-		return -1;
+	while (data->old_pos < old_entries->length) {
+		old_entry = git_vector_get(old_entries, data->old_pos);
+
+		if ((cmp = strcmp(old_entry->path, path)) > 0)
+			break;
+		if (cmp == 0 && GIT_IDXENTRY_STAGE(old_entry) == 0)
+			return old_entry;
 
-	entry = git__calloc(1, sizeof(git_index_entry));
+		data->old_pos++;
+	}
+
+	return NULL;
+}
+
+static int read_tree_entry(
+	read_tree_data *data, const git_buf *dir, const git_tree_entry *tentry)
+{
+	struct entry_internal *entry;
+	git_index_entry *old_entry, *shared_entry;
+	size_t path_len = dir->size + tentry->filename_len;
+
+	entry = git_pool_malloc(data->pool,
+		(uint32_t)(pool_entry_size(path_len) / data->pool->item_size));
 	GITERR_CHECK_ALLOC(entry);
 
-	entry->mode = tentry->attr;
-	entry->oid = tentry->oid;
-
-	/* look for corresponding old entry and copy data to new entry */
-	if (data->old_entries) {
-		size_t pos;
-		struct entry_srch_key skey;
-
-		skey.path = path.ptr;
-		skey.stage = 0;
-
-		if (!git_vector_bsearch2(
-				&pos, data->old_entries, data->entries_search, &skey) &&
-			(old_entry = git_vector_get(data->old_entries, pos)) != NULL &&
-			entry->mode == old_entry->mode &&
-			git_oid_equal(&entry->oid, &old_entry->oid))
-		{
-			memcpy(entry, old_entry, sizeof(*entry));
-			entry->flags_extended = 0;
-		}
+	memset(entry, 0x0, sizeof(struct entry_internal));
+	entry->in_pool = 1;
+
+	memcpy(entry->path, dir->ptr, dir->size);
+	memcpy(entry->path + dir->size, tentry->filename, tentry->filename_len);
+	entry->path[path_len] = '\0';
+
+	/* copy the data of a corresponding old entry to the new one */
+	old_entry = (git_index_entry *)read_tree_old_entry(data, entry->path);
+	shared_entry = old_entry;
+
+	if (old_entry && old_entry->mode == tentry->attr &&
+		git_oid_equal(&old_entry->oid, &tentry->oid)) {
+		memcpy(&entry->entry, old_entry, sizeof(git_index_entry));
+		entry->entry.flags_extended = 0;
+	} else {
+		entry->entry.mode = tentry->attr;
+		git_oid_cpy(&entry->entry.oid, &tentry->oid);
+		old_entry = NULL;
 	}
 
-	if (path.size < GIT_IDXENTRY_NAMEMASK)
-		entry->flags = path.size & GIT_IDXENTRY_NAMEMASK;
+	entry->entry.path = entry->path;
+
+	if (path_len < GIT_IDXENTRY_NAMEMASK)
+		entry->entry.flags = path_len & GIT_IDXENTRY_NAMEMASK;
 	else
-		entry->flags = GIT_IDXENTRY_NAMEMASK;
+		entry->entry.flags = GIT_IDXENTRY_NAMEMASK;
+
+	/* an entry which is exactly as it was stays in the shared index,
+	 * and one that changed replaces it there */
+	if (old_entry && entry->entry.flags == old_entry->flags &&
+		!(old_entry->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS)) {
+		entry->shared_pos = ENTRY_SHARED_POS(old_entry);
+		entry->shared_replaced = ENTRY_SHARED_REPLACED(old_entry);
+	} else if (shared_entry && ENTRY_SHARED_POS(shared_entry) > 0) {
+		entry->shared_pos = ENTRY_SHARED_POS(shared_entry);
+		entry->shared_replaced = 1;
+	}
 
-	entry->path = git_buf_detach(&path);
-	git_buf_free(&path);
+	return git_vector_insert(data->new_entries, entry);
+}
 
-	if (git_vector_insert(data->new_entries, entry) < 0) {
-		index_entry_free(entry);
-		return -1;
+/*
+ * Walk the tree like `git_tree_walk` does, and fill in a tree cache on
+ * the way: the tree was just read, so every subtree of it is valid.
+ */
+static int read_tree_recursive(
+	read_tree_data *data,
+	const git_tree *tree,
+	git_buf *path,
+	git_tree_cache *cache)
+{
+	size_t i, path_len = path->size, start = data->new_entries->length;
+	int error = 0;
+
+	for (i = 0; i < git_tree_entrycount(tree); ++i) {
+		const git_tree_entry *tentry = git_tree_entry_byindex(tree, i);
+		git_tree *subtree;
+		git_tree_cache *sub_cache;
+
+		if (!git_tree_entry__is_tree(tentry)) {
+			if ((error = read_tree_entry(data, path, tentry)) < 0)
+				break;
+			continue;
+		}
+
+		if ((error = git_tree_lookup(
+				&subtree, git_tree_owner(tree), &tentry->oid)) < 0)
+			break;
+
+		if ((error = git_tree_cache_child(&sub_cache, cache,
+				tentry->filename, tentry->filename_len)) == 0 &&
+			(error = git_buf_puts(path, tentry->filename)) == 0 &&
+			(error = git_buf_putc(path, '/')) == 0)
+			error = read_tree_recursive(data, subtree, path, sub_cache);
+
+		git_buf_truncate(path, path_len);
+		git_tree_free(subtree);
+
+		if (error < 0)
+			break;
 	}
 
-	return 0;
+	if (!error) {
+		git_oid_cpy(&cache->oid, git_tree_id(tree));
+		cache->entries = data->new_entries->length - start;
+	}
+
+	return error;
 }
 
 int git_index_read_tree(git_index *index, const git_tree *tree)
 {
 	int error = 0;
 	git_vector entries = GIT_VECTOR_INIT;
+	git_tree_cache *cache = NULL;
+	git_buf path = GIT_BUF_INIT;
+	git_pool pool;
 	read_tree_data data;
 
-	git_vector_set_cmp(&entries, index->entries._cmp); /* match sort */
+	/* room for as many entries as there were, in the same sort order */
+	if (git_pool_init(&pool, 8, READ_TREE_POOL_PAGE_ITEMS) < 0 ||
+		git_vector_init(&entries,
+			index->entries.length, index->entries._cmp) < 0)
+		return -1;
+
+	git_vector_sort(&index->entries);
 
-	data.old_entries = &index->entries;
+	data.index = index;
 	data.new_entries = &entries;
-	data.entries_search = index->entries_search;
+	data.pool = &pool;
+	data.merge = !index->ignore_case;
+	data.old_pos = 0;
 
-	git_vector_sort(&index->entries);
+	if ((error = git_tree_cache_new(&cache)) == 0)
+		error = read_tree_recursive(&data, tree, &path, cache);
 
-	error = git_tree_walk(tree, GIT_TREEWALK_POST, read_tree_cb, &data);
+	git_buf_free(&path);
 
+	/* only an index that ignores case sorts differently than the tree */
+	entries.sorted = data.merge;
 	git_vector_sort(&entries);
 
 	git_index_clear(index);
@@ -2036,6 +3768,19 @@ int git_index_read_tree(git_index *index, const git_tree *tree)
 	git_vector_swap(&entries, &index->entries);
 	git_vector_free(&entries);
 
+	/* the new entries all live in the entry pool now */
+	git_pool_swap(&pool, &index->entry_pool);
+	git_pool_clear(&pool);
+	index->entries_pooled = 1;
+
+	/* a partly read tree leaves the cache invalid; don't keep it */
+	if (error < 0) {
+		git_tree_cache_free(cache);
+		cache = NULL;
+	}
+
+	index->tree = cache;
+
 	return error;
 }
 
@@ -2058,7 +3803,6 @@ int git_index_add_all(
 	git_index_entry *entry;
 	git_pathspec ps;
 	const char *match;
-	size_t existing;
 	bool no_fnmatch = (flags & GIT_INDEX_ADD_DISABLE_PATHSPEC_MATCH) != 0;
 	int ignorecase;
 	git_oid blobid;
@@ -2101,7 +3845,7 @@ int git_index_add_all(
 		/* skip ignored items that are not already in the index */
 		if ((flags & GIT_INDEX_ADD_FORCE) == 0 &&
 			git_iterator_current_is_ignored(wditer) &&
-			git_index__find(&existing, index, wd->path, 0) < 0)
+			index_find_entry(index, wd->path, 0) == NULL)
 			continue;
 
 		/* issue notification callback if requested */
@@ -2131,12 +3875,13 @@ int git_index_add_all(
 		entry->oid = blobid;
 
 		/* add working directory item to index */
-		if ((error = index_insert(index, entry, 1)) < 0) {
+		if ((error = index_insert(index, &entry, 1)) < 0) {
 			index_entry_free(entry);
 			break;
 		}
 
 		git_tree_cache_invalidate_path(index->tree, wd->path);
+		git_untracked_cache_invalidate_path(index->untracked, wd->path);
 
 		/* add implies conflict resolved, move conflict entries to REUC */
 		if ((error = index_conflict_to_reuc(index, wd->path)) < 0) {
@@ -10,7 +10,11 @@
 #include "fileops.h"
 #include "filebuf.h"
 #include "vector.h"
+#include "pool.h"
+#include "idxmap.h"
 #include "tree-cache.h"
+#include "untracked_cache.h"
+#include "fsmonitor.h"
 #include "git2/odb.h"
 #include "git2/index.h"
 
@@ -25,14 +29,51 @@ struct git_index {
 	git_futils_filestamp stamp;
 	git_vector entries;
 
+	/* the entries read from disk, with their paths; they are freed all
+	 * at once, and without looking at them when `entries_pooled` says
+	 * that no entry was added since */
+	git_pool entry_pool;
+	unsigned int entries_pooled:1;
+
+	/* the entries by path and stage, built for the first lookup that
+	 * can use them and kept up to date from then on; the one to use
+	 * depends on `ignore_case`.  Entries which share a path and stage
+	 * (as only a broken index has) set `no_entries_map`. */
+	git_idxmap *entries_map;
+	git_idxmap_icase *entries_map_icase;
+	unsigned int no_entries_map:1;
+
 	unsigned int on_disk:1;
 
+	/* the on-disk format to write; see `git_index_set_version` */
+	unsigned int version;
+
 	unsigned int ignore_case:1;
 	unsigned int distrust_filemode:1;
 	unsigned int no_symlinks:1;
 
 	git_tree_cache *tree;
 
+	/* a split index is written as its changes since the shared index
+	 * it refers to; see `git_index_set_split` */
+	unsigned int split:1;
+	git_oid shared_id;
+	size_t shared_count;
+
+	/* for how many seconds the shared indexes we stop linking to are
+	 * kept, or -1 for good; see `git_index__set_shared_expire` */
+	git_time_t shared_expire;
+
+	/* the listings of the working directory that status can reuse,
+	 * kept when `keep_untracked` is set; see
+	 * `git_index_set_untracked_cache` */
+	unsigned int keep_untracked:1;
+	git_untracked_cache *untracked;
+
+	/* the token of the file system monitor as of which the entries
+	 * marked GIT_IDXENTRY_FSMONITOR_VALID are known to be unchanged */
+	char *fsmonitor_token;
+
 	git_vector names;
 	git_vector reuc;
 
@@ -60,4 +101,24 @@ extern int git_index__find(
 
 extern void git_index__set_ignore_case(git_index *index, bool ignore_case);
 
+/*
+ * Keep the shared indexes that a split index stops linking to until they
+ * are older than `expire`, a date like "2.weeks.ago" or "never"
+ */
+extern int git_index__set_shared_expire(git_index *index, const char *expire);
+
+/* The untracked cache of the index for `workdir`, or NULL if it keeps none */
+extern int git_index__untracked_cache(
+	git_untracked_cache **out, git_index *index, const char *workdir);
+
+/*
+ * Forget that the entries that `mon` saw change since the last refresh
+ * are unchanged, or that any entry is when `mon` cannot tell (or is NULL)
+ */
+extern int git_index__fsmonitor_refresh(git_index *index, git_fsmonitor *mon);
+
+/* Remember that `entry` was found unchanged in the working directory */
+extern void git_index__fsmonitor_mark_valid(
+	git_index *index, const git_index_entry *entry);
+
 #endif
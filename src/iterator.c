@@ -294,7 +294,6 @@ static bool tree_iterator__move_to_next(
 
 static int tree_iterator__set_next(tree_iterator *ti, tree_iterator_frame *tf)
 {
-	int error = 0;
 	const git_tree_entry *te, *last = NULL;
 
 	tf->next = tf->current;
@@ -304,22 +303,11 @@ static int tree_iterator__set_next(tree_iterator *ti, tree_iterator_frame *tf)
 
 		if (last && tree_iterator__te_cmp(last, te, ti->strncomp))
 			break;
-
-		/* try to load trees for items in [current,next) range */
-		if (!error && git_tree_entry__is_tree(te))
-			error = git_tree_lookup(
-				&tf->entries[tf->next]->tree, ti->base.repo, &te->oid);
 	}
 
 	if (tf->next > tf->current + 1)
 		ti->path_ambiguities++;
 
-	/* if a tree lookup failed, advance over this span and return failure */
-	if (error < 0) {
-		tree_iterator__move_to_next(ti, tf);
-		return error;
-	}
-
 	if (last && !tree_iterator__current_filename(ti, last))
 		return -1; /* must have been allocation failure */
 
@@ -328,21 +316,53 @@ static int tree_iterator__set_next(tree_iterator *ti, tree_iterator_frame *tf)
 
 GIT_INLINE(bool) tree_iterator__at_tree(tree_iterator *ti)
 {
-	return (ti->head->current < ti->head->n_entries &&
-			ti->head->entries[ti->head->current]->tree != NULL);
+	tree_iterator_entry *entry;
+
+	if (ti->head->current >= ti->head->n_entries)
+		return false;
+
+	/* only the root has no tree entry, just a tree */
+	entry = ti->head->entries[ti->head->current];
+	return entry->te ? git_tree_entry__is_tree(entry->te) : true;
+}
+
+/*
+ * Load the trees of the items in the [current,next) range, which are
+ * only read when they are about to be stepped into, and count their
+ * entries.
+ */
+static int tree_iterator__load_trees(tree_iterator *ti, size_t *n_entries)
+{
+	tree_iterator_frame *head = ti->head;
+	size_t i;
+	int error;
+
+	*n_entries = 0;
+
+	for (i = head->current; i < head->next; ++i) {
+		tree_iterator_entry *entry = head->entries[i];
+
+		if (!entry->tree && (error = git_tree_lookup(
+				&entry->tree, ti->base.repo, &entry->te->oid)) < 0)
+			return error;
+
+		*n_entries += git_tree_entrycount(entry->tree);
+	}
+
+	return 0;
 }
 
 static int tree_iterator__push_frame(tree_iterator *ti)
 {
 	int error = 0;
 	tree_iterator_frame *head = ti->head, *tf = NULL;
-	size_t i, n_entries = 0;
+	size_t i, n_entries;
 
-	if (head->current >= head->n_entries || !head->entries[head->current]->tree)
+	if (!tree_iterator__at_tree(ti))
 		return GIT_ITEROVER;
 
-	for (i = head->current; i < head->next; ++i)
-		n_entries += git_tree_entrycount(head->entries[i]->tree);
+	if ((error = tree_iterator__load_trees(ti, &n_entries)) < 0)
+		return error;
 
 	tf = git__calloc(sizeof(tree_iterator_frame) +
 		n_entries * sizeof(tree_iterator_entry *), 1);
@@ -496,8 +516,18 @@ static int tree_iterator__advance_into(
 
 	iterator__clear_entry(entry);
 
-	if (tree_iterator__at_tree(ti))
-		error = tree_iterator__push_frame(ti);
+	if (tree_iterator__at_tree(ti)) {
+		size_t n_entries;
+
+		/* like an empty directory, an empty tree is not stepped into */
+		if (!iterator__do_autoexpand(ti) &&
+			!(error = tree_iterator__load_trees(ti, &n_entries)) &&
+			!n_entries)
+			return GIT_ENOTFOUND;
+
+		if (!error)
+			error = tree_iterator__push_frame(ti);
+	}
 
 	if (!error && entry)
 		error = tree_iterator__current(entry, self);
@@ -896,6 +926,7 @@ struct fs_iterator {
 	uint32_t dirload_flags;
 	int depth;
 
+	int (*dirload_cb)(fs_iterator *self, git_vector *entries);
 	int (*enter_dir_cb)(fs_iterator *self);
 	int (*leave_dir_cb)(fs_iterator *self);
 	int (*update_entry_cb)(fs_iterator *self);
@@ -986,9 +1017,12 @@ static int fs_iterator__expand_dir(fs_iterator *fi)
 	ff = fs_iterator__alloc_frame(fi);
 	GITERR_CHECK_ALLOC(ff);
 
-	error = git_path_dirload_with_stat(
-		fi->path.ptr, fi->root_len, fi->dirload_flags,
-		fi->base.start, fi->base.end, &ff->entries);
+	if (fi->dirload_cb)
+		error = fi->dirload_cb(fi, &ff->entries);
+	else
+		error = git_path_dirload_with_stat(
+			fi->path.ptr, fi->root_len, fi->dirload_flags,
+			fi->base.start, fi->base.end, &ff->entries);
 
 	if (error < 0) {
 		fs_iterator__free_frame(ff);
@@ -1250,6 +1284,7 @@ typedef struct {
 	fs_iterator fi;
 	git_ignores ignores;
 	int is_ignored;
+	git_index *index; /* when it keeps an untracked cache */
 } workdir_iterator;
 
 GIT_INLINE(bool) workdir_path_is_dotgit(const git_buf *path)
@@ -1271,6 +1306,29 @@ GIT_INLINE(bool) workdir_path_is_dotgit(const git_buf *path)
 	return (len == 4 || path->ptr[len - 5] == '/');
 }
 
+static int workdir_iterator__dirload(fs_iterator *fi, git_vector *entries)
+{
+	workdir_iterator *wi = (workdir_iterator *)fi;
+	git_path_with_stat *ps = NULL;
+	struct stat st;
+
+	/* the stat data of a subdirectory was read with its parent */
+	if (fi->stack)
+		ps = git_vector_get(&fi->stack->entries, fi->stack->index);
+
+	if (ps)
+		memcpy(&st, &ps->st, sizeof(st));
+
+	if (!wi->index->untracked || (!ps && p_lstat(fi->path.ptr, &st) < 0))
+		return git_path_dirload_with_stat(
+			fi->path.ptr, fi->root_len, fi->dirload_flags,
+			fi->base.start, fi->base.end, entries);
+
+	return git_untracked_cache_dirload(
+		wi->index->untracked, wi->index, fi->path.ptr, fi->root_len, &st,
+		fi->dirload_flags, fi->base.start, fi->base.end, entries);
+}
+
 static int workdir_iterator__enter_dir(fs_iterator *fi)
 {
 	/* only push new ignores if this is not top level directory */
@@ -1325,6 +1383,32 @@ static void workdir_iterator__free(git_iterator *self)
 	workdir_iterator *wi = (workdir_iterator *)self;
 	fs_iterator__free(self);
 	git_ignore__free(&wi->ignores);
+	git_index_free(wi->index);
+}
+
+static int workdir_iterator__init_index(
+	workdir_iterator *wi, const char *workdir)
+{
+	git_index *index;
+	git_untracked_cache *untracked;
+	git_fsmonitor *mon;
+
+	/* without a monitor, the index just cannot trust its entries */
+	if (git_repository__fsmonitor(&mon, wi->fi.base.repo) < 0)
+		giterr_clear();
+
+	if (git_repository_index__weakptr(&index, wi->fi.base.repo) < 0 ||
+		git_index__fsmonitor_refresh(index, mon) < 0 ||
+		git_index__untracked_cache(&untracked, index, workdir) < 0)
+		return -1;
+
+	if (untracked) {
+		GIT_REFCOUNT_INC(index);
+		wi->index = index;
+		wi->fi.dirload_cb = workdir_iterator__dirload;
+	}
+
+	return 0;
 }
 
 int git_iterator_for_workdir_ext(
@@ -1336,6 +1420,7 @@ int git_iterator_for_workdir_ext(
 	const char *end)
 {
 	int error, precompose = 0;
+	bool use_index_caches = !repo_workdir;
 	workdir_iterator *wi;
 
 	if (!repo_workdir) {
@@ -1368,6 +1453,11 @@ int git_iterator_for_workdir_ext(
 	else if (precompose)
 		wi->fi.base.flags |= GIT_ITERATOR_PRECOMPOSE_UNICODE;
 
+	/* the caches of the index only know about its own workdir */
+	if (use_index_caches &&
+		workdir_iterator__init_index(wi, repo_workdir) < 0)
+		giterr_clear();
+
 	return fs_iterator__initialize(out, &wi->fi, repo_workdir);
 }
 
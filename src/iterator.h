@@ -157,7 +157,8 @@ GIT_INLINE(int) git_iterator_advance(
  *
  * For filesystem and working directory iterators, a tree (i.e. directory)
  * can be empty.  In that case, this function returns GIT_ENOTFOUND and
- * does not advance.  That can't happen for tree and index iterators.
+ * does not advance.  Tree iterators do the same for an empty tree object,
+ * which git itself never writes.  That can't happen for index iterators.
  */
 GIT_INLINE(int) git_iterator_advance_into(
 	const git_index_entry **entry, git_iterator *iter)
@@ -169,7 +170,7 @@ GIT_INLINE(int) git_iterator_advance_into(
  * Advance into a tree or skip over it if it is empty.
  *
  * Because `git_iterator_advance_into` may return GIT_ENOTFOUND if the
- * directory is empty (only with filesystem and working directory
+ * directory is empty (only with filesystem, working directory and tree
  * iterators) and a common response is to just call `git_iterator_advance`
  * when that happens, this bundles the two into a single simple call.
  */
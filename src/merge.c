@@ -101,7 +101,7 @@ int git_merge_base_many(git_oid *out, git_repository *repo, size_t length, const
 		goto cleanup;
 	}
 
-	git_oid_cpy(out, &result->item->oid);
+	git_oid_cpy(out, git_revwalk__commit_oid(walk, result->item));
 
 	error = 0;
 
@@ -146,7 +146,7 @@ int git_merge_base(git_oid *out, git_repository *repo, const git_oid *one, const
 		return GIT_ENOTFOUND;
 	}
 
-	git_oid_cpy(out, &result->item->oid);
+	git_oid_cpy(out, git_revwalk__commit_oid(walk, result->item));
 	git_commit_list_free(&result);
 	git_revwalk_free(walk);
 
@@ -157,17 +157,46 @@ on_error:
 	return -1;
 }
 
-static int interesting(git_pqueue *list)
+/*
+ * Decide whether walking any further can still change the merge bases.
+ *
+ * Without generation numbers we keep going as long as there is a
+ * non-STALE commit queued.  Once every queued commit has a generation
+ * number, the queue is popped in topological order, so a commit can no
+ * longer be reached from anything that was already popped: a new merge
+ * base then needs a queued commit from each side, and an existing one
+ * can only be made STALE by a STALE commit of higher generation.
+ */
+static int interesting(git_pqueue *list, uint32_t min_result_gen)
 {
 	unsigned int i;
+	int nonstale = 0, all_finite = 1, stale_matters = 0, flags = 0;
+
 	/* element 0 isn't used - we need to start at 1 */
 	for (i = 1; i < list->size; i++) {
 		git_commit_list_node *commit = list->d[i];
-		if ((commit->flags & STALE) == 0)
-			return 1;
+
+		if (commit->generation == GIT_COMMIT_GENERATION_INFINITY)
+			all_finite = 0;
+
+		if (commit->flags & STALE) {
+			if (commit->generation == GIT_COMMIT_GENERATION_INFINITY ||
+				commit->generation > min_result_gen)
+				stale_matters = 1;
+			continue;
+		}
+
+		nonstale = 1;
+		flags |= commit->flags & (PARENT1 | PARENT2);
 	}
 
-	return 0;
+	if (!nonstale)
+		return 0;
+
+	if (!all_finite)
+		return 1;
+
+	return flags == (PARENT1 | PARENT2) || stale_matters;
 }
 
 int git_merge__bases_many(git_commit_list **out, git_revwalk *walk, git_commit_list_node *one, git_vector *twos)
@@ -177,6 +206,7 @@ int git_merge__bases_many(git_commit_list **out, git_revwalk *walk, git_commit_l
 	git_commit_list_node *two;
 	git_commit_list *result = NULL, *tmp = NULL;
 	git_pqueue list;
+	uint32_t min_result_gen = GIT_COMMIT_GENERATION_INFINITY;
 
 	/* if the commit is repeated, we have a our merge base already */
 	git_vector_foreach(twos, i, two) {
@@ -184,7 +214,7 @@ int git_merge__bases_many(git_commit_list **out, git_revwalk *walk, git_commit_l
 			return git_commit_list_insert(one, out) ? 0 : -1;
 	}
 
-	if (git_pqueue_init(&list, twos->length * 2, git_commit_list_time_cmp) < 0)
+	if (git_pqueue_init(&list, twos->length * 2, git_commit_list_generation_cmp) < 0)
 		return -1;
 
 	if (git_commit_list_parse(walk, one) < 0)
@@ -202,7 +232,7 @@ int git_merge__bases_many(git_commit_list **out, git_revwalk *walk, git_commit_l
 	}
 
 	/* as long as there are non-STALE commits */
-	while (interesting(&list)) {
+	while (interesting(&list, min_result_gen)) {
 		git_commit_list_node *commit;
 		int flags;
 
@@ -214,13 +244,16 @@ int git_merge__bases_many(git_commit_list **out, git_revwalk *walk, git_commit_l
 				commit->flags |= RESULT;
 				if (git_commit_list_insert(commit, &result) == NULL)
 					return -1;
+				if (commit->generation < min_result_gen)
+					min_result_gen = commit->generation;
 			}
 			/* we mark the parents of a merge stale */
 			flags |= STALE;
 		}
 
 		for (i = 0; i < commit->out_degree; i++) {
-			git_commit_list_node *p = commit->parents[i];
+			git_commit_list_node *p =
+				git_revwalk__commit_parent(walk, commit, i);
 			if ((p->flags & flags) == flags)
 				continue;
 
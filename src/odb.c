@@ -181,27 +181,23 @@ int git_odb__hashfd_filtered(
 	git_oid *out, git_file fd, size_t size, git_otype type, git_filter_list *fl)
 {
 	int error;
-	git_buf raw = GIT_BUF_INIT;
+	git_buf post = GIT_BUF_INIT;
 
 	if (!fl)
 		return git_odb__hashfd(out, fd, size, type);
 
-	/* size of data is used in header, so we have to read the whole file
-	 * into memory to apply filters before beginning to calculate the hash
+	/* size of data is used in header, so the filtered data has to be in
+	 * memory before beginning to calculate the hash; the file itself is
+	 * streamed through the filters, into room for about as much as it
+	 * holds
 	 */
+	if (git_buf_grow(&post, size) < 0)
+		return -1;
 
-	if (!(error = git_futils_readbuffer_fd(&raw, fd, size))) {
-		git_buf post = GIT_BUF_INIT;
-
-		error = git_filter_list_apply_to_data(&post, fl, &raw);
-
-		git_buf_free(&raw);
-
-		if (!error)
-			error = git_odb_hash(out, post.ptr, post.size, type);
+	if (!(error = git_filter_list__apply_to_fd(&post, fl, fd)))
+		error = git_odb_hash(out, post.ptr, post.size, type);
 
-		git_buf_free(&post);
-	}
+	git_buf_free(&post);
 
 	return error;
 }
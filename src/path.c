@@ -968,23 +968,11 @@ int git_path_dirload_with_stat(
 	int error;
 	unsigned int i;
 	git_path_with_stat *ps;
-	git_buf full = GIT_BUF_INIT;
-	int (*strncomp)(const char *a, const char *b, size_t sz);
-	size_t start_len = start_stat ? strlen(start_stat) : 0;
-	size_t end_len = end_stat ? strlen(end_stat) : 0, cmp_len;
-
-	if (git_buf_set(&full, path, prefix_len) < 0)
-		return -1;
 
 	error = git_path_dirload(
 		path, prefix_len, sizeof(git_path_with_stat) + 1, flags, contents);
-	if (error < 0) {
-		git_buf_free(&full);
+	if (error < 0)
 		return error;
-	}
-
-	strncomp = (flags & GIT_PATH_DIR_IGNORE_CASE) != 0 ?
-		git__strncasecmp : git__strncmp;
 
 	/* stat struct at start of git_path_with_stat, so shift path text */
 	git_vector_foreach(contents, i, ps) {
@@ -993,6 +981,32 @@ int git_path_dirload_with_stat(
 		ps->path_len = path_len;
 	}
 
+	return git_path_with_stat_entries(
+		path, prefix_len, flags, start_stat, end_stat, contents);
+}
+
+int git_path_with_stat_entries(
+	const char *path,
+	size_t prefix_len,
+	unsigned int flags,
+	const char *start_stat,
+	const char *end_stat,
+	git_vector *contents)
+{
+	int error = 0;
+	unsigned int i;
+	git_path_with_stat *ps;
+	git_buf full = GIT_BUF_INIT;
+	int (*strncomp)(const char *a, const char *b, size_t sz);
+	size_t start_len = start_stat ? strlen(start_stat) : 0;
+	size_t end_len = end_stat ? strlen(end_stat) : 0, cmp_len;
+
+	if (git_buf_set(&full, path, prefix_len) < 0)
+		return -1;
+
+	strncomp = (flags & GIT_PATH_DIR_IGNORE_CASE) != 0 ?
+		git__strncasecmp : git__strncmp;
+
 	git_vector_foreach(contents, i, ps) {
 		/* skip if before start_stat or after end_stat */
 		cmp_len = min(start_len, ps->path_len);
@@ -1010,6 +1024,7 @@ int git_path_dirload_with_stat(
 				giterr_clear();
 				error = 0;
 				git_vector_remove(contents, i--);
+				git__free(ps);
 				continue;
 			}
 
@@ -358,6 +358,23 @@ extern int git_path_dirload_with_stat(
 	const char *end_stat,
 	git_vector *contents);
 
+/**
+ * Stat the entries of a directory and sort them.
+ *
+ * This is `git_path_dirload_with_stat` for a caller that already knows
+ * the names in the directory: `contents` holds a `git_path_with_stat`
+ * for each of them, with room for a trailing '/', and paths relative to
+ * `prefix_len` like `git_path_dirload` gives.  Entries which no longer
+ * exist are removed.
+ */
+extern int git_path_with_stat_entries(
+	const char *path,
+	size_t prefix_len,
+	uint32_t flags,
+	const char *start_stat,
+	const char *end_stat,
+	git_vector *contents);
+
 /* translate errno to libgit2 error code and set error message */
 extern int git_path_set_error(
 	int errno_value, const char *path, const char *action);
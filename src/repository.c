@@ -113,6 +113,8 @@ void git_repository_free(git_repository *repo)
 	git_diff_driver_registry_free(repo->diff_drivers);
 	repo->diff_drivers = NULL;
 
+	git_fsmonitor_free(repo->fsmonitor);
+
 	git__free(repo->path_repository);
 	git__free(repo->workdir);
 	git__free(repo->namespace);
@@ -728,6 +730,84 @@ void git_repository_set_refdb(git_repository *repo, git_refdb *refdb)
 	set_refdb(repo, refdb);
 }
 
+static int load_index_config(git_index *index, git_repository *repo)
+{
+	git_config *config;
+	const char *value;
+	int split, untracked, error;
+
+	if ((error = git_repository_config__weakptr(&config, repo)) < 0)
+		return error;
+
+	/* when unset, a split index stays split and others stay whole */
+	if ((error = git_config_get_bool(&split, config, "core.splitindex")) < 0) {
+		if (error != GIT_ENOTFOUND)
+			return error;
+
+		giterr_clear();
+	} else if ((error = git_index_set_split(index, split)) < 0)
+		return error;
+
+	if ((error = git_config_get_string(
+			&value, config, "splitindex.sharedindexexpire")) < 0) {
+		if (error != GIT_ENOTFOUND)
+			return error;
+
+		giterr_clear();
+	} else if ((error = git_index__set_shared_expire(index, value)) < 0)
+		return error;
+
+	/* likewise, an untracked cache is kept if there was one; git also
+	 * spells that out as "keep" */
+	if ((error = git_config_get_string(
+			&value, config, "core.untrackedcache")) < 0) {
+		if (error != GIT_ENOTFOUND)
+			return error;
+
+		giterr_clear();
+		return 0;
+	}
+
+	if (!strcasecmp(value, "keep"))
+		return 0;
+
+	if ((error = git_config_parse_bool(&untracked, value)) < 0)
+		return error;
+
+	return git_index_set_untracked_cache(index, untracked);
+}
+
+int git_repository__fsmonitor(git_fsmonitor **out, git_repository *repo)
+{
+	git_fsmonitor *mon;
+	int enabled;
+
+	*out = NULL;
+
+	/* a hook for git (rather than a boolean) says nothing to us */
+	if (git_repository__cvar(&enabled, repo, GIT_CVAR_FSMONITOR) < 0) {
+		giterr_clear();
+		enabled = 0;
+	}
+
+	if (!enabled || repo->is_bare)
+		return 0;
+
+	/* watching the whole tree again would fail again, and cost much */
+	if (repo->fsmonitor == NULL && !repo->fsmonitor_failed) {
+		if (git_fsmonitor_new(&mon, repo->workdir) < 0) {
+			repo->fsmonitor_failed = 1;
+			return -1;
+		}
+
+		mon = git__compare_and_swap(&repo->fsmonitor, NULL, mon);
+		git_fsmonitor_free(mon);
+	}
+
+	*out = repo->fsmonitor;
+	return 0;
+}
+
 int git_repository_index__weakptr(git_index **out, git_repository *repo)
 {
 	int error = 0;
@@ -751,6 +831,9 @@ int git_repository_index__weakptr(git_index **out, git_repository *repo)
 			}
 
 			error = git_index_set_caps(repo->_index, GIT_INDEXCAP_FROM_OWNER);
+
+			if (!error)
+				error = load_index_config(repo->_index, repo);
 		}
 
 		git_buf_free(&index_path);
@@ -1701,6 +1784,11 @@ int git_repository_set_workdir(
 		repo->is_bare = 0;
 
 		git__free(old_workdir);
+
+		/* it watches the old working directory */
+		git_fsmonitor_free(repo->fsmonitor);
+		repo->fsmonitor = NULL;
+		repo->fsmonitor_failed = 0;
 	}
 
 	return error;
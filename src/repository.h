@@ -21,6 +21,7 @@
 #include "attrcache.h"
 #include "strmap.h"
 #include "diff_driver.h"
+#include "fsmonitor.h"
 
 #define DOT_GIT ".git"
 #define GIT_DIR DOT_GIT "/"
@@ -38,6 +39,7 @@ typedef enum {
 	GIT_CVAR_TRUSTCTIME,    /* core.trustctime */
 	GIT_CVAR_ABBREV,        /* core.abbrev */
 	GIT_CVAR_PRECOMPOSE,    /* core.precomposeunicode */
+	GIT_CVAR_FSMONITOR,     /* core.fsmonitor */
 	GIT_CVAR_CACHE_MAX
 } git_cvar_cached;
 
@@ -89,6 +91,8 @@ typedef enum {
 	GIT_ABBREV_DEFAULT = 7,
 	/* core.precomposeunicode */
 	GIT_PRECOMPOSE_DEFAULT = GIT_CVAR_FALSE,
+	/* core.fsmonitor */
+	GIT_FSMONITOR_DEFAULT = GIT_CVAR_FALSE,
 
 } git_cvar_value;
 
@@ -110,12 +114,14 @@ struct git_repository {
 	git_attr_cache attrcache;
 	git_strmap *submodules;
 	git_diff_driver_registry *diff_drivers;
+	git_fsmonitor *fsmonitor;
 
 	char *path_repository;
 	char *workdir;
 	char *namespace;
 
 	unsigned is_bare:1;
+	unsigned fsmonitor_failed:1;
 	unsigned int lru_counter;
 
 	git_cvar_value cvar_cache[GIT_CVAR_CACHE_MAX];
@@ -138,6 +144,12 @@ int git_repository_head_tree(git_tree **tree, git_repository *repo);
 int git_repository_config__weakptr(git_config **out, git_repository *repo);
 int git_repository_odb__weakptr(git_odb **out, git_repository *repo);
 int git_repository_refdb__weakptr(git_refdb **out, git_repository *repo);
+
+/*
+ * The file system monitor of the working directory, started on first use
+ * when core.fsmonitor is set; NULL if it is not, or cannot be started.
+ */
+int git_repository__fsmonitor(git_fsmonitor **out, git_repository *repo);
 int git_repository_index__weakptr(git_index **out, git_repository *repo);
 
 /*
@@ -13,75 +13,83 @@
 #include "revwalk.h"
 #include "git2/revparse.h"
 #include "merge.h"
+#include "bloom.h"
+#include "tree.h"
 
 git_commit_list_node *git_revwalk__commit_lookup(
 	git_revwalk *walk, const git_oid *oid)
 {
-	git_commit_list_node *commit;
-	khiter_t pos;
-	int ret;
-
-	/* lookup and reserve space if not already present */
-	pos = kh_get(oid, walk->commits, oid);
-	if (pos != kh_end(walk->commits))
-		return kh_value(walk->commits, pos);
-
-	commit = git_commit_list_alloc_node(walk);
-	if (commit == NULL)
-		return NULL;
-
-	git_oid_cpy(&commit->oid, oid);
+	return git_commit_table_lookup(&walk->commits, oid);
+}
 
-	pos = kh_put(oid, walk->commits, &commit->oid, &ret);
-	assert(ret != 0);
-	kh_value(walk->commits, pos) = commit;
+static void hide_commit(git_revwalk *walk, git_commit_list_node *commit)
+{
+	commit->uninteresting = 1;
 
-	return commit;
+	if (commit->queued_interesting) {
+		commit->queued_interesting = 0;
+		walk->queued_interesting--;
+	}
 }
 
-static int mark_uninteresting(git_commit_list_node *commit)
+/*
+ * Mark the given commits and their known ancestors uninteresting, in a
+ * single flood over all of them, so that history they share is only
+ * visited once.
+ */
+static int mark_uninteresting_many(
+	git_revwalk *walk, git_commit_list_node **commits, size_t count)
 {
+	size_t n;
 	unsigned short i;
 	git_array_t(git_commit_list_node *) pending = GIT_ARRAY_INIT;
-	git_commit_list_node **tmp;
+	git_commit_list_node *commit, **node;
 
-	assert(commit);
+	for (n = 0; n < count; ++n) {
+		node = git_array_alloc(pending);
+		GITERR_CHECK_ALLOC(node);
 
-	git_array_alloc(pending);
-	GITERR_CHECK_ARRAY(pending);
+		*node = commits[n];
+		hide_commit(walk, commits[n]);
+	}
 
-	do {
-		commit->uninteresting = 1;
+	while ((node = git_array_pop(pending)) != NULL) {
+		commit = *node;
 
 		/* This means we've reached a merge base, so there's no need to walk any more */
-		if ((commit->flags & (RESULT | STALE)) == RESULT) {
-			tmp = git_array_pop(pending);
-			commit = tmp ? *tmp : NULL;
+		if ((commit->flags & (RESULT | STALE)) == RESULT)
 			continue;
-		}
 
-		for (i = 0; i < commit->out_degree; ++i)
-			if (!commit->parents[i]->uninteresting) {
-				git_commit_list_node **node = git_array_alloc(pending);
-				GITERR_CHECK_ALLOC(node);
-				*node = commit->parents[i];
-			}
+		for (i = 0; i < commit->out_degree; ++i) {
+			git_commit_list_node *parent =
+				git_revwalk__commit_parent(walk, commit, i);
 
-		tmp = git_array_pop(pending);
-		commit = tmp ? *tmp : NULL;
+			if (parent->uninteresting)
+				continue;
 
-	} while (git_array_size(pending) > 0);
+			node = git_array_alloc(pending);
+			GITERR_CHECK_ALLOC(node);
 
-	git_array_clear(pending);
+			*node = parent;
+			hide_commit(walk, parent);
+		}
+	}
 
+	git_array_clear(pending);
 	return 0;
 }
 
+static int mark_uninteresting(git_revwalk *walk, git_commit_list_node *commit)
+{
+	assert(commit);
+	return mark_uninteresting_many(walk, &commit, 1);
+}
+
 static int process_commit(git_revwalk *walk, git_commit_list_node *commit, int hide)
 {
 	int error;
 
-	if (hide && mark_uninteresting(commit) < 0)
+	if (hide && mark_uninteresting(walk, commit) < 0)
 		return -1;
 
 	if (commit->seen)
@@ -89,9 +97,15 @@ static int process_commit(git_revwalk *walk, git_commit_list_node *commit, int h
 
 	commit->seen = 1;
 
-	if ((error = git_commit_list_parse(walk, commit)) < 0)
+	if ((error = git_commit_list_parse(walk, commit)) < 0 ||
+		(error = git_commit_list_prefetch_parents(walk, commit)) < 0)
 		return error;
 
+	if (!commit->uninteresting) {
+		commit->queued_interesting = 1;
+		walk->queued_interesting++;
+	}
+
 	return walk->enqueue(walk, commit);
 }
 
@@ -105,7 +119,8 @@ static int process_commit_parents(git_revwalk *walk, git_commit_list_node *commi
 		max = 1;
 
 	for (i = 0; i < max && !error; ++i)
-		error = process_commit(walk, commit->parents[i], commit->uninteresting);
+		error = process_commit(walk,
+			git_revwalk__commit_parent(walk, commit, i), commit->uninteresting);
 
 	return error;
 }
@@ -155,6 +170,33 @@ int git_revwalk_hide(git_revwalk *walk, const git_oid *oid)
 	return push_commit(walk, oid, 1);
 }
 
+int git_revwalk_hide_many(git_revwalk *walk, const git_oid *ids, size_t count)
+{
+	size_t i;
+	git_commit_list_node *commit;
+
+	assert(walk && (ids || !count));
+
+	for (i = 0; i < count; ++i) {
+		if ((commit = git_revwalk__commit_lookup(walk, &ids[i])) == NULL)
+			return -1;
+
+		/* already hidden, by this call or an earlier one */
+		if (commit->uninteresting)
+			continue;
+
+		/* this checks that we have a commit without loading an object */
+		if (git_commit_list_parse(walk, commit) < 0)
+			return -1;
+
+		commit->uninteresting = 1;
+		if (git_vector_insert(&walk->twos, commit) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 static int push_ref(git_revwalk *walk, const char *refname, int hide)
 {
 	git_oid oid;
@@ -168,20 +210,29 @@ static int push_ref(git_revwalk *walk, const char *refname, int hide)
 struct push_cb_data {
 	git_revwalk *walk;
 	int hide;
+	git_array_t(git_oid) hidden;
 };
 
 static int push_glob_cb(const char *refname, void *data_)
 {
 	struct push_cb_data *data = (struct push_cb_data *)data_;
+	git_oid *oid;
+
+	if (!data->hide)
+		return push_ref(data->walk, refname, 0);
+
+	/* hidden references are all hidden together once they are known */
+	oid = git_array_alloc(data->hidden);
+	GITERR_CHECK_ALLOC(oid);
 
-	return push_ref(data->walk, refname, data->hide);
+	return git_reference_name_to_id(oid, data->walk->repo, refname);
 }
 
 static int push_glob(git_revwalk *walk, const char *glob, int hide)
 {
 	int error = 0;
 	git_buf buf = GIT_BUF_INIT;
-	struct push_cb_data data;
+	struct push_cb_data data = { 0 };
 	size_t wildcard;
 
 	assert(walk && glob);
@@ -206,6 +257,11 @@ static int push_glob(git_revwalk *walk, const char *glob, int hide)
 		error = git_reference_foreach_glob(
 			walk->repo, git_buf_cstr(&buf), push_glob_cb, &data);
 
+	if (!error && hide)
+		error = git_revwalk_hide_many(
+			walk, data.hidden.ptr, data.hidden.size);
+
+	git_array_clear(data.hidden);
 	git_buf_free(&buf);
 	return error;
 }
@@ -286,7 +342,14 @@ static int revwalk_next_timesort(git_commit_list_node **object_out, git_revwalk
 	int error;
 	git_commit_list_node *next;
 
-	while ((next = git_pqueue_pop(&walk->iterator_time)) != NULL) {
+	/* once only hidden commits are left, only hidden commits can follow */
+	while (walk->queued_interesting > 0 &&
+		(next = git_pqueue_pop(&walk->iterator_time)) != NULL) {
+		if (next->queued_interesting) {
+			next->queued_interesting = 0;
+			walk->queued_interesting--;
+		}
+
 		if ((error = process_commit_parents(walk, next)) < 0)
 			return error;
 
@@ -305,7 +368,13 @@ static int revwalk_next_unsorted(git_commit_list_node **object_out, git_revwalk
 	int error;
 	git_commit_list_node *next;
 
-	while ((next = git_commit_list_pop(&walk->iterator_rand)) != NULL) {
+	while (walk->queued_interesting > 0 &&
+		(next = git_commit_list_pop(&walk->iterator_rand)) != NULL) {
+		if (next->queued_interesting) {
+			next->queued_interesting = 0;
+			walk->queued_interesting--;
+		}
+
 		if ((error = process_commit_parents(walk, next)) < 0)
 			return error;
 
@@ -342,7 +411,8 @@ static int revwalk_next_toposort(git_commit_list_node **object_out, git_revwalk
 			max = 1;
 
 		for (i = 0; i < max; ++i) {
-			git_commit_list_node *parent = next->parents[i];
+			git_commit_list_node *parent =
+				git_revwalk__commit_parent(walk, next, i);
 
 			if (--parent->in_degree == 0 && parent->topo_delay) {
 				parent->topo_delay = 0;
@@ -363,12 +433,257 @@ static int revwalk_next_reverse(git_commit_list_node **object_out, git_revwalk *
 }
 
 
+/*
+ * Incremental topological sorting.
+ *
+ * When commits carry generation numbers from a commit-graph we do not
+ * need to count the in-degree of every reachable commit before returning
+ * the first one.  Three queues, ordered by generation, drive the walk:
+ *
+ * - the explore queue propagates the "uninteresting" mark;
+ * - the indegree queue counts, for every commit down to the current
+ *   `min_generation`, how many children it has in the walk;
+ * - commits whose in-degree drops to zero are ready to be returned
+ *   (`iterator_topo`, or `iterator_time` when also sorting by time).
+ *
+ * Since a parent always has a lower generation than its children, once
+ * the indegree walk has gone past a commit's generation, its in-degree
+ * is final, and likewise for the uninteresting mark.
+ */
+
+static int topo_queue_insert(git_revwalk *walk, git_commit_list_node *commit)
+{
+	if (walk->sorting & GIT_SORT_TIME)
+		return git_pqueue_insert(&walk->iterator_time, commit);
+
+	return git_commit_list_insert(commit, &walk->iterator_topo) ? 0 : -1;
+}
+
+static int explore_walk_step(git_revwalk *walk)
+{
+	git_commit_list_node *commit, *parent;
+	unsigned short i;
+	int error;
+
+	if ((commit = git_pqueue_pop(&walk->explore_queue)) == NULL)
+		return 0;
+
+	for (i = 0; i < commit->out_degree; ++i) {
+		parent = git_revwalk__commit_parent(walk, commit, i);
+
+		if (commit->uninteresting && !parent->uninteresting) {
+			/* only possible when commit times are skewed */
+			if (parent->topo_explored &&
+				(error = mark_uninteresting(walk, parent)) < 0)
+				return error;
+
+			parent->uninteresting = 1;
+		}
+
+		if (parent->topo_explored)
+			continue;
+
+		if ((error = git_commit_list_parse(walk, parent)) < 0)
+			return error;
+
+		parent->topo_explored = 1;
+		if (git_pqueue_insert(&walk->explore_queue, parent) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int explore_to_depth(git_revwalk *walk, uint32_t generation)
+{
+	git_commit_list_node *commit;
+	int error;
+
+	while ((commit = git_pqueue_peek(&walk->explore_queue)) != NULL &&
+		commit->generation >= generation) {
+		if ((error = explore_walk_step(walk)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+static int indegree_walk_step(git_revwalk *walk)
+{
+	git_commit_list_node *commit, *parent;
+	unsigned short i, max;
+	int error;
+
+	if ((commit = git_pqueue_pop(&walk->indegree_queue)) == NULL)
+		return 0;
+
+	if ((error = explore_to_depth(walk, commit->generation)) < 0)
+		return error;
+
+	max = commit->out_degree;
+	if (walk->first_parent && commit->out_degree)
+		max = 1;
+
+	for (i = 0; i < max; ++i) {
+		parent = git_revwalk__commit_parent(walk, commit, i);
+		parent->in_degree++;
+
+		if (parent->topo_indegree)
+			continue;
+
+		if ((error = git_commit_list_parse(walk, parent)) < 0)
+			return error;
+
+		parent->topo_indegree = 1;
+		if (git_pqueue_insert(&walk->indegree_queue, parent) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int compute_indegrees_to_depth(git_revwalk *walk, uint32_t generation)
+{
+	git_commit_list_node *commit;
+	int error;
+
+	while ((commit = git_pqueue_peek(&walk->indegree_queue)) != NULL &&
+		commit->generation >= generation) {
+		if ((error = indegree_walk_step(walk)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+static int expand_topo_walk(git_revwalk *walk, git_commit_list_node *commit)
+{
+	git_commit_list_node *parent;
+	unsigned short i, max;
+	int error;
+
+	max = commit->out_degree;
+	if (walk->first_parent && commit->out_degree)
+		max = 1;
+
+	for (i = 0; i < max; ++i) {
+		parent = git_revwalk__commit_parent(walk, commit, i);
+
+		if (parent->uninteresting)
+			continue;
+
+		if (parent->generation < walk->min_generation) {
+			walk->min_generation = parent->generation;
+			if ((error = compute_indegrees_to_depth(
+					walk, walk->min_generation)) < 0)
+				return error;
+		}
+
+		if (--parent->in_degree == 0 && !parent->topo_delay) {
+			parent->topo_delay = 1;
+			if (topo_queue_insert(walk, parent) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int revwalk_next_topo_incremental(
+	git_commit_list_node **object_out, git_revwalk *walk)
+{
+	git_commit_list_node *next;
+	int error;
+
+	for (;;) {
+		if (walk->sorting & GIT_SORT_TIME)
+			next = git_pqueue_pop(&walk->iterator_time);
+		else
+			next = git_commit_list_pop(&walk->iterator_topo);
+
+		if (next == NULL) {
+			giterr_clear();
+			return GIT_ITEROVER;
+		}
+
+		if ((error = expand_topo_walk(walk, next)) < 0)
+			return error;
+
+		if (!next->uninteresting) {
+			*object_out = next;
+			return 0;
+		}
+	}
+}
+
+static int init_topo_start(git_revwalk *walk, git_commit_list_node *commit)
+{
+	int error;
+
+	if ((error = git_commit_list_parse(walk, commit)) < 0)
+		return error;
+
+	if (!commit->topo_explored) {
+		commit->topo_explored = 1;
+		if (git_pqueue_insert(&walk->explore_queue, commit) < 0)
+			return -1;
+	}
+
+	if (!commit->topo_indegree) {
+		commit->topo_indegree = 1;
+		if (git_pqueue_insert(&walk->indegree_queue, commit) < 0)
+			return -1;
+	}
+
+	if (commit->generation < walk->min_generation)
+		walk->min_generation = commit->generation;
+
+	return 0;
+}
+
+static int init_topo_walk(git_revwalk *walk)
+{
+	unsigned int i;
+	git_commit_list_node *two;
+	int error;
+
+	walk->min_generation = GIT_COMMIT_GENERATION_INFINITY;
+
+	if ((error = init_topo_start(walk, walk->one)) < 0)
+		return error;
+
+	git_vector_foreach(&walk->twos, i, two) {
+		if ((error = init_topo_start(walk, two)) < 0)
+			return error;
+	}
+
+	if ((error = compute_indegrees_to_depth(walk, walk->min_generation)) < 0)
+		return error;
+
+	for (i = 0; i <= walk->twos.length; ++i) {
+		git_commit_list_node *commit =
+			i ? git_vector_get(&walk->twos, i - 1) : walk->one;
+
+		if (commit->uninteresting || commit->in_degree || commit->topo_delay)
+			continue;
+
+		commit->topo_delay = 1;
+		if (topo_queue_insert(walk, commit) < 0)
+			return -1;
+	}
+
+	walk->get_next = &revwalk_next_topo_incremental;
+	return 0;
+}
+
+
 static int prepare_walk(git_revwalk *walk)
 {
 	int error;
 	unsigned int i;
 	git_commit_list_node *next, *two;
 	git_commit_list *bases = NULL;
+	git_array_t(git_commit_list_node *) hidden = GIT_ARRAY_INIT;
 
 	/*
 	 * If walk->one is NULL, there were no positive references,
@@ -379,16 +694,65 @@ static int prepare_walk(git_revwalk *walk)
 		return GIT_ITEROVER;
 	}
 
-	/* first figure out what the merge bases are */
-	if (git_merge__bases_many(&bases, walk, walk->one, &walk->twos) < 0)
-		return -1;
+	if ((error = git_commit_prefetch_start(walk)) < 0)
+		return error;
+
+	/*
+	 * With generation numbers available, a topological walk can
+	 * produce its first commits without visiting the whole history.
+	 */
+	if ((walk->sorting & GIT_SORT_TOPOLOGICAL) &&
+		!(walk->sorting & GIT_SORT_REVERSE) && walk->cgraph) {
+		if ((error = init_topo_walk(walk)) < 0)
+			return error;
 
-	git_commit_list_free(&bases);
-	if (process_commit(walk, walk->one, walk->one->uninteresting) < 0)
+		walk->walking = 1;
+		return 0;
+	}
+
+	/*
+	 * first figure out what the merge bases are; with nothing hidden
+	 * there are none, and looking for them would parse the whole
+	 * history before the walk (and the prefetch) gets going
+	 */
+	if (walk->twos.length > 0) {
+		if (git_merge__bases_many(&bases, walk, walk->one, &walk->twos) < 0)
+			return -1;
+
+		git_commit_list_free(&bases);
+	}
+
+	/* hide what all the hidden commits reach in one go */
+	git_vector_foreach(&walk->twos, i, two) {
+		git_commit_list_node **node;
+
+		if (!two->uninteresting)
+			continue;
+
+		if ((error = git_commit_list_parse(walk, two)) < 0)
+			break;
+
+		if ((node = git_array_alloc(hidden)) == NULL) {
+			error = -1;
+			break;
+		}
+
+		*node = two;
+	}
+
+	if (!error)
+		error = mark_uninteresting_many(walk, hidden.ptr, hidden.size);
+
+	git_array_clear(hidden);
+
+	if (error < 0)
+		return error;
+
+	if (process_commit(walk, walk->one, 0) < 0)
 		return -1;
 
 	git_vector_foreach(&walk->twos, i, two) {
-		if (process_commit(walk, two, two->uninteresting) < 0)
+		if (process_commit(walk, two, 0) < 0)
 			return -1;
 	}
 
@@ -397,7 +761,8 @@ static int prepare_walk(git_revwalk *walk)
 
 		while ((error = walk->get_next(&next, walk)) == 0) {
 			for (i = 0; i < next->out_degree; ++i) {
-				git_commit_list_node *parent = next->parents[i];
+				git_commit_list_node *parent =
+				git_revwalk__commit_parent(walk, next, i);
 				parent->in_degree++;
 			}
 
@@ -428,22 +793,217 @@ static int prepare_walk(git_revwalk *walk)
 }
 
 
+typedef struct {
+	char *path;
+	size_t keys_len;
+	git_bloom_key keys[GIT_FLEX_ARRAY];
+} revwalk_path;
+
+int git_revwalk_add_path(git_revwalk *walk, const char *path)
+{
+	revwalk_path *limit;
+	size_t len, keys_len = 0, i;
+
+	assert(walk && path);
+
+	while (*path == '/')
+		path++;
+
+	len = strlen(path);
+	while (len > 0 && path[len - 1] == '/')
+		len--;
+
+	if (!len) {
+		giterr_set(GITERR_INVALID, "Cannot limit a walk to an empty path");
+		return -1;
+	}
+
+	/* one Bloom key for the path and each of its leading directories */
+	if (walk->cgraph && walk->cgraph->bloom_index)
+		for (i = 0, keys_len = 1; i < len; ++i)
+			if (path[i] == '/')
+				keys_len++;
+
+	limit = git__calloc(1, sizeof(revwalk_path) + keys_len * sizeof(git_bloom_key));
+	GITERR_CHECK_ALLOC(limit);
+
+	limit->path = git__strndup(path, len);
+	GITERR_CHECK_ALLOC(limit->path);
+
+	if (keys_len) {
+		for (i = 0; i <= len; ++i) {
+			if (i < len && path[i] != '/')
+				continue;
+
+			git_bloom_key_init(&limit->keys[limit->keys_len++],
+				path, i, &walk->cgraph->bloom_settings);
+		}
+	}
+
+	return git_vector_insert(&walk->paths, limit);
+}
+
+static void revwalk_paths_free(git_revwalk *walk)
+{
+	unsigned int i;
+	revwalk_path *limit;
+
+	git_vector_foreach(&walk->paths, i, limit) {
+		git__free(limit->path);
+		git__free(limit);
+	}
+
+	git_vector_free(&walk->paths);
+}
+
+/*
+ * The changed-path filter of a commit describes its diff against its
+ * first parent; if it rules out every path, the commit is TREESAME to
+ * that parent and cannot be part of the path-limited walk.
+ */
+static int bloom_rules_out(git_revwalk *walk, git_commit_list_node *commit)
+{
+	git_commit_graph_entry entry;
+	git_bloom_filter filter;
+	revwalk_path *limit;
+	unsigned int i;
+	size_t k;
+
+	if (!walk->cgraph || !walk->cgraph->bloom_index ||
+		git_commit_graph_entry_find(&entry, walk->cgraph,
+			git_revwalk__commit_oid(walk, commit)) < 0 ||
+		git_commit_graph_bloom_filter(&filter, walk->cgraph, entry.position) < 0)
+		return 0;
+
+	git_vector_foreach(&walk->paths, i, limit) {
+		for (k = 0; k < limit->keys_len; ++k) {
+			if (git_bloom_filter_contains(&filter,
+					&limit->keys[k], &walk->cgraph->bloom_settings) == 0)
+				break;
+		}
+
+		if (k == limit->keys_len)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int commit_tree(git_tree **out, git_revwalk *walk, const git_oid *oid)
+{
+	git_commit_graph_entry entry;
+	git_commit *commit;
+	int error;
+
+	if (walk->cgraph &&
+		git_commit_graph_entry_find(&entry, walk->cgraph, oid) == 0)
+		return git_tree_lookup(out, walk->repo, &entry.tree_oid);
+
+	if ((error = git_commit_lookup(&commit, walk->repo, oid)) < 0)
+		return error;
+
+	error = git_commit_tree(out, commit);
+	git_commit_free(commit);
+	return error;
+}
+
+static int tree_entry_for_path(
+	git_tree_entry **out, git_tree *tree, const char *path)
+{
+	int error = git_tree_entry_bypath(out, tree, path);
+
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		*out = NULL;
+		error = 0;
+	}
+
+	return error;
+}
+
+/* Does any of the limiting paths differ between the two trees? */
+static int paths_differ(git_revwalk *walk, git_tree *a, git_tree *b)
+{
+	git_tree_entry *entry_a = NULL, *entry_b = NULL;
+	revwalk_path *limit;
+	unsigned int i;
+	int error = 0;
+
+	git_vector_foreach(&walk->paths, i, limit) {
+		if ((error = tree_entry_for_path(&entry_a, a, limit->path)) < 0 ||
+			(b && (error = tree_entry_for_path(&entry_b, b, limit->path)) < 0))
+			break;
+
+		if (entry_a || entry_b)
+			error = (!entry_a || !entry_b ||
+				git_tree_entry_filemode(entry_a) != git_tree_entry_filemode(entry_b) ||
+				git_oid_cmp(git_tree_entry_id(entry_a), git_tree_entry_id(entry_b)) != 0);
+
+		git_tree_entry_free(entry_a);
+		git_tree_entry_free(entry_b);
+		entry_a = entry_b = NULL;
+
+		if (error)
+			break;
+	}
+
+	return error;
+}
+
+static int revwalk_path_changed(git_revwalk *walk, git_commit_list_node *commit)
+{
+	git_tree *tree = NULL, *parent_tree = NULL;
+	unsigned short i, max;
+	int error;
+
+	max = commit->out_degree;
+	if (walk->first_parent && commit->out_degree)
+		max = 1;
+
+	/* the filters only know about the first parent */
+	if (max == 1 && bloom_rules_out(walk, commit))
+		return 0;
+
+	if ((error = commit_tree(&tree, walk, git_revwalk__commit_oid(walk, commit))) < 0)
+		return error;
+
+	if (!max)
+		error = paths_differ(walk, tree, NULL);
+
+	/* a merge is kept unless it is TREESAME to all of its parents */
+	for (i = 0; i < max; ++i) {
+		if ((error = commit_tree(&parent_tree, walk, git_revwalk__commit_oid(
+				walk, git_revwalk__commit_parent(walk, commit, i)))) < 0)
+			break;
+
+		error = paths_differ(walk, tree, parent_tree);
+		git_tree_free(parent_tree);
+
+		if (error != 0)
+			break;
+	}
+
+	git_tree_free(tree);
+	return error;
+}
+
 int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 {
 	git_revwalk *walk;
+	git_buf objects_dir = GIT_BUF_INIT;
+	int error;
 
 	walk = git__malloc(sizeof(git_revwalk));
 	GITERR_CHECK_ALLOC(walk);
 
 	memset(walk, 0x0, sizeof(git_revwalk));
 
-	walk->commits = git_oidmap_alloc();
-	GITERR_CHECK_ALLOC(walk->commits);
-
-	if (git_pqueue_init(&walk->iterator_time, 8, git_commit_list_time_cmp) < 0 ||
+	if (git_commit_table_init(&walk->commits) < 0 ||
+		git_pqueue_init(&walk->iterator_time, 8, git_commit_list_time_cmp) < 0 ||
+		git_pqueue_init(&walk->explore_queue, 8, git_commit_list_generation_cmp) < 0 ||
+		git_pqueue_init(&walk->indegree_queue, 8, git_commit_list_generation_cmp) < 0 ||
 		git_vector_init(&walk->twos, 4, NULL) < 0 ||
-		git_pool_init(&walk->commit_pool, 1,
-			git_pool__suggest_items_per_page(COMMIT_ALLOC) * COMMIT_ALLOC) < 0)
+		git_vector_init(&walk->paths, 0, NULL) < 0)
 		return -1;
 
 	walk->get_next = &revwalk_next_unsorted;
@@ -456,6 +1016,17 @@ int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 		return -1;
 	}
 
+	if ((error = git_buf_joinpath(&objects_dir,
+			git_repository_path(repo), GIT_OBJECTS_DIR)) < 0 ||
+		(error = git_commit_graph_open_for_objects_dir(
+			&walk->cgraph, objects_dir.ptr)) < 0) {
+		git_buf_free(&objects_dir);
+		git_revwalk_free(walk);
+		return error;
+	}
+
+	git_buf_free(&objects_dir);
+
 	*revwalk_out = walk;
 	return 0;
 }
@@ -468,10 +1039,13 @@ void git_revwalk_free(git_revwalk *walk)
 	git_revwalk_reset(walk);
 	git_odb_free(walk->odb);
 
-	git_oidmap_free(walk->commits);
-	git_pool_clear(&walk->commit_pool);
+	git_commit_graph_free(walk->cgraph);
+	git_commit_table_free(&walk->commits);
 	git_pqueue_free(&walk->iterator_time);
+	git_pqueue_free(&walk->explore_queue);
+	git_pqueue_free(&walk->indegree_queue);
 	git_vector_free(&walk->twos);
+	revwalk_paths_free(walk);
 	git__free(walk);
 }
 
@@ -504,6 +1078,20 @@ void git_revwalk_simplify_first_parent(git_revwalk *walk)
 	walk->first_parent = 1;
 }
 
+unsigned int git_revwalk_set_prefetch_threads(git_revwalk *walk, unsigned int n)
+{
+	assert(walk);
+
+#ifdef GIT_THREADS
+	walk->prefetch_threads = n;
+#else
+	GIT_UNUSED(n);
+	assert(0 == walk->prefetch_threads);
+#endif
+
+	return walk->prefetch_threads;
+}
+
 int git_revwalk_next(git_oid *oid, git_revwalk *walk)
 {
 	int error;
@@ -516,7 +1104,16 @@ int git_revwalk_next(git_oid *oid, git_revwalk *walk)
 			return error;
 	}
 
-	error = walk->get_next(&next, walk);
+	while ((error = walk->get_next(&next, walk)) == 0 &&
+		walk->paths.length > 0) {
+		if ((error = revwalk_path_changed(walk, next)) < 0)
+			return error;
+
+		if (error > 0) {
+			error = 0;
+			break;
+		}
+	}
 
 	if (error == GIT_ITEROVER) {
 		git_revwalk_reset(walk);
@@ -525,7 +1122,7 @@ int git_revwalk_next(git_oid *oid, git_revwalk *walk)
 	}
 
 	if (!error)
-		git_oid_cpy(oid, &next->oid);
+		git_oid_cpy(oid, git_revwalk__commit_oid(walk, next));
 
 	return error;
 }
@@ -533,17 +1130,29 @@ int git_revwalk_next(git_oid *oid, git_revwalk *walk)
 void git_revwalk_reset(git_revwalk *walk)
 {
 	git_commit_list_node *commit;
+	uint32_t i;
 
 	assert(walk);
 
-	kh_foreach_value(walk->commits, commit, {
+	git_commit_prefetch_stop(walk);
+
+	for (i = 0; i < walk->commits.length; ++i) {
+		commit = git_commit_table_node(&walk->commits, i);
 		commit->seen = 0;
 		commit->in_degree = 0;
 		commit->topo_delay = 0;
+		commit->topo_explored = 0;
+		commit->topo_indegree = 0;
 		commit->uninteresting = 0;
-		});
+		commit->queued_interesting = 0;
+		commit->flags = 0;
+	}
+
+	walk->queued_interesting = 0;
 
 	git_pqueue_clear(&walk->iterator_time);
+	git_pqueue_clear(&walk->explore_queue);
+	git_pqueue_clear(&walk->indegree_queue);
 	git_commit_list_free(&walk->iterator_topo);
 	git_commit_list_free(&walk->iterator_rand);
 	git_commit_list_free(&walk->iterator_reverse);
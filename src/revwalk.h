@@ -13,6 +13,7 @@
 #include "pqueue.h"
 #include "pool.h"
 #include "vector.h"
+#include "commit_graph.h"
 
 GIT__USE_OIDMAP;
 
@@ -20,14 +21,21 @@ struct git_revwalk {
 	git_repository *repo;
 	git_odb *odb;
 
-	git_oidmap *commits;
-	git_pool commit_pool;
+	git_commit_table commits;
+
+	/* optional; used to parse commits without reading them */
+	git_commit_graph_file *cgraph;
 
 	git_commit_list *iterator_topo;
 	git_commit_list *iterator_rand;
 	git_commit_list *iterator_reverse;
 	git_pqueue iterator_time;
 
+	/* incremental topological sort; see `init_topo_walk` */
+	git_pqueue explore_queue;
+	git_pqueue indegree_queue;
+	uint32_t min_generation;
+
 	int (*get_next)(git_commit_list_node **, git_revwalk *);
 	int (*enqueue)(git_revwalk *, git_commit_list_node *);
 
@@ -35,6 +43,16 @@ struct git_revwalk {
 		first_parent: 1;
 	unsigned int sorting;
 
+	/* how many interesting commits are waiting to be walked */
+	size_t queued_interesting;
+
+	/* see `git_revwalk_set_prefetch_threads` */
+	unsigned int prefetch_threads;
+	git_commit_prefetch *prefetch;
+
+	/* path limiting; see `git_revwalk_add_path` */
+	git_vector paths;
+
 	/* merge base calculation */
 	git_commit_list_node *one;
 	git_vector twos;
@@ -42,4 +60,16 @@ struct git_revwalk {
 
 git_commit_list_node *git_revwalk__commit_lookup(git_revwalk *walk, const git_oid *oid);
 
+GIT_INLINE(const git_oid *) git_revwalk__commit_oid(
+	const git_revwalk *walk, const git_commit_list_node *commit)
+{
+	return git_commit_table_oid(&walk->commits, commit);
+}
+
+GIT_INLINE(git_commit_list_node *) git_revwalk__commit_parent(
+	const git_revwalk *walk, const git_commit_list_node *commit, unsigned short n)
+{
+	return git_commit_table_parent(&walk->commits, commit, n);
+}
+
 #endif
@@ -7,9 +7,57 @@
 
 #include "tree-cache.h"
 
+/*
+ * Children are kept in the order git writes them in: shorter names
+ * first, then byte by byte.  This lets them be found by bisection, and
+ * keeps the extension byte-for-byte the same when it is written back.
+ */
+static int name_cmp(
+	const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	if (a_len != b_len)
+		return a_len < b_len ? -1 : 1;
+
+	return memcmp(a, b, a_len);
+}
+
+static int child_cmp(const void *a, const void *b)
+{
+	const git_tree_cache *ca = a, *cb = b;
+
+	return name_cmp(ca->name, strlen(ca->name), cb->name, strlen(cb->name));
+}
+
+static size_t child_position(
+	const git_tree_cache *tree, const char *name, size_t name_len, bool *found)
+{
+	size_t lo = 0, hi = tree->children_count;
+
+	*found = false;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const char *childname = tree->children[mid]->name;
+		int cmp = name_cmp(name, name_len, childname, strlen(childname));
+
+		if (cmp == 0) {
+			*found = true;
+			return mid;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
 static git_tree_cache *find_child(const git_tree_cache *tree, const char *path)
 {
-	size_t i, dirlen;
+	size_t pos;
+	bool found;
 	const char *end;
 
 	end = strchr(path, '/');
@@ -17,16 +65,8 @@ static git_tree_cache *find_child(const git_tree_cache *tree, const char *path)
 		end = strrchr(path, '\0');
 	}
 
-	dirlen = end - path;
-
-	for (i = 0; i < tree->children_count; ++i) {
-		const char *childname = tree->children[i]->name;
-
-		if (strlen(childname) == dirlen && !memcmp(path, childname, dirlen))
-			return tree->children[i];
-	}
-
-	return NULL;
+	pos = child_position(tree, path, end - path, &found);
+	return found ? tree->children[pos] : NULL;
 }
 
 void git_tree_cache_invalidate_path(git_tree_cache *tree, const char *path)
@@ -69,20 +109,39 @@ const git_tree_cache *git_tree_cache_get(const git_tree_cache *tree, const char
 			return NULL;
 		}
 
-		if (end == NULL || *end + 1 == '\0')
+		if (end == NULL || *(end + 1) == '\0')
 			return tree;
 
 		ptr = end + 1;
 	}
 }
 
+static git_tree_cache *tree_cache_alloc(
+	const char *name, size_t name_len, git_tree_cache *parent)
+{
+	git_tree_cache *tree;
+
+	tree = git__malloc(sizeof(git_tree_cache) + name_len + 1);
+	if (tree == NULL)
+		return NULL;
+
+	memset(tree, 0x0, sizeof(git_tree_cache));
+	tree->parent = parent;
+	tree->entries = -1;
+
+	memcpy(tree->name, name, name_len);
+	tree->name[name_len] = '\0';
+
+	return tree;
+}
+
 static int read_tree_internal(git_tree_cache **out,
 		const char **buffer_in, const char *buffer_end, git_tree_cache *parent)
 {
 	git_tree_cache *tree = NULL;
 	const char *name_start, *buffer;
 	int count;
-	size_t name_len;
+	size_t i;
 
 	buffer = name_start = *buffer_in;
 
@@ -92,16 +151,9 @@ static int read_tree_internal(git_tree_cache **out,
 	if (++buffer >= buffer_end)
 		goto corrupted;
 
-	name_len = strlen(name_start);
-	tree = git__malloc(sizeof(git_tree_cache) + name_len + 1);
-	GITERR_CHECK_ALLOC(tree);
-
-	memset(tree, 0x0, sizeof(git_tree_cache));
-	tree->parent = parent;
-
 	/* NUL-terminated tree name */
-	memcpy(tree->name, name_start, name_len);
-	tree->name[name_len] = '\0';
+	tree = tree_cache_alloc(name_start, strlen(name_start), parent);
+	GITERR_CHECK_ALLOC(tree);
 
 	/* Blank-terminated ASCII decimal number of entries in this tree */
 	if (git__strtol32(&count, buffer, &buffer, 10) < 0)
@@ -116,8 +168,6 @@ static int read_tree_internal(git_tree_cache **out,
 	if (git__strtol32(&count, buffer, &buffer, 10) < 0 || count < 0)
 		goto corrupted;
 
-	tree->children_count = count;
-
 	if (*buffer != '\n' || ++buffer > buffer_end)
 		goto corrupted;
 
@@ -132,16 +182,22 @@ static int read_tree_internal(git_tree_cache **out,
 	}
 
 	/* Parse children: */
-	if (tree->children_count > 0) {
-		unsigned int i;
+	if (count > 0) {
+		tree->children = git__calloc(count, sizeof(git_tree_cache *));
+		if (tree->children == NULL)
+			goto on_error;
 
-		tree->children = git__malloc(tree->children_count * sizeof(git_tree_cache *));
-		GITERR_CHECK_ALLOC(tree->children);
+		tree->children_alloc = count;
 
-		for (i = 0; i < tree->children_count; ++i) {
+		for (i = 0; i < tree->children_alloc; ++i) {
 			if (read_tree_internal(&tree->children[i], &buffer, buffer_end, tree) < 0)
-				return -1;
+				goto on_error;
+
+			tree->children_count++;
 		}
+
+		/* lookups bisect the children; don't trust the writer's order */
+		git__tsort((void **)tree->children, tree->children_count, child_cmp);
 	}
 
 	*buffer_in = buffer;
@@ -149,8 +205,9 @@ static int read_tree_internal(git_tree_cache **out,
 	return 0;
 
  corrupted:
-	git_tree_cache_free(tree);
 	giterr_set(GITERR_INDEX, "Corruped TREE extension in index");
+ on_error:
+	git_tree_cache_free(tree);
 	return -1;
 }
 
@@ -163,15 +220,92 @@ int git_tree_cache_read(git_tree_cache **tree, const char *buffer, size_t buffer
 
 	if (buffer < buffer_end) {
 		giterr_set(GITERR_INDEX, "Corruped TREE extension in index (unexpected trailing data)");
+		git_tree_cache_free(*tree);
+		*tree = NULL;
 		return -1;
 	}
 
 	return 0;
 }
 
+int git_tree_cache_new(git_tree_cache **out)
+{
+	*out = tree_cache_alloc("", 0, NULL);
+	GITERR_CHECK_ALLOC(*out);
+
+	return 0;
+}
+
+int git_tree_cache_child(
+	git_tree_cache **out, git_tree_cache *tree, const char *name, size_t name_len)
+{
+	git_tree_cache *child;
+	size_t pos;
+	bool found;
+
+	pos = child_position(tree, name, name_len, &found);
+	if (found) {
+		*out = tree->children[pos];
+		return 0;
+	}
+
+	if (tree->children_count == tree->children_alloc) {
+		size_t new_alloc = tree->children_alloc ? tree->children_alloc * 2 : 4;
+		git_tree_cache **children = git__realloc(
+			tree->children, new_alloc * sizeof(git_tree_cache *));
+		GITERR_CHECK_ALLOC(children);
+
+		tree->children = children;
+		tree->children_alloc = new_alloc;
+	}
+
+	child = tree_cache_alloc(name, name_len, tree);
+	GITERR_CHECK_ALLOC(child);
+
+	memmove(&tree->children[pos + 1], &tree->children[pos],
+		(tree->children_count - pos) * sizeof(git_tree_cache *));
+	tree->children[pos] = child;
+	tree->children_count++;
+
+	*out = child;
+	return 0;
+}
+
+void git_tree_cache_prune(git_tree_cache *tree)
+{
+	size_t i, kept = 0;
+
+	for (i = 0; i < tree->children_count; ++i) {
+		if (tree->children[i]->entries < 0)
+			git_tree_cache_free(tree->children[i]);
+		else
+			tree->children[kept++] = tree->children[i];
+	}
+
+	tree->children_count = kept;
+}
+
+int git_tree_cache_write(git_buf *out, const git_tree_cache *tree)
+{
+	size_t i;
+
+	git_buf_put(out, tree->name, strlen(tree->name) + 1);
+	git_buf_printf(out, "%d %d\n",
+		(int)tree->entries, (int)tree->children_count);
+
+	if (tree->entries >= 0)
+		git_buf_put(out, (const char *)tree->oid.id, GIT_OID_RAWSZ);
+
+	for (i = 0; i < tree->children_count; ++i)
+		if (git_tree_cache_write(out, tree->children[i]) < 0)
+			return -1;
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
 void git_tree_cache_free(git_tree_cache *tree)
 {
-	unsigned int i;
+	size_t i;
 
 	if (tree == NULL)
 		return;
@@ -10,11 +10,13 @@
 
 #include "common.h"
 #include "git2/oid.h"
+#include "buffer.h"
 
 struct git_tree_cache {
 	struct git_tree_cache *parent;
 	struct git_tree_cache **children;
 	size_t children_count;
+	size_t children_alloc;
 
 	ssize_t entries;
 	git_oid oid;
@@ -24,6 +26,18 @@ struct git_tree_cache {
 typedef struct git_tree_cache git_tree_cache;
 
 int git_tree_cache_read(git_tree_cache **tree, const char *buffer, size_t buffer_size);
+int git_tree_cache_write(git_buf *out, const git_tree_cache *tree);
+
+/* Create an empty (invalid) cache for the root tree */
+int git_tree_cache_new(git_tree_cache **out);
+
+/* Find the cache of the subtree `name`, creating an invalid one if needed */
+int git_tree_cache_child(
+	git_tree_cache **out, git_tree_cache *tree, const char *name, size_t name_len);
+
+/* Drop the invalid children of a tree which has just been written out */
+void git_tree_cache_prune(git_tree_cache *tree);
+
 void git_tree_cache_invalidate_path(git_tree_cache *tree, const char *path);
 const git_tree_cache *git_tree_cache_get(const git_tree_cache *tree, const char *path);
 void git_tree_cache_free(git_tree_cache *tree);
@@ -467,10 +467,45 @@ static int append_entry(
 	return 0;
 }
 
+/*
+ * A valid cache tells how many entries its tree covers; check that they
+ * are exactly the entries from `start` which are inside `dirname`.
+ */
+static bool cache_covers(
+	const git_tree_cache *cache, git_index *index,
+	const char *dirname, size_t dirname_len, size_t start)
+{
+	size_t end = start + cache->entries;
+	const git_index_entry *entry;
+
+	if (cache->entries <= 0 || end > git_index_entrycount(index))
+		return false;
+
+	entry = git_index_get_byindex(index, end - 1);
+	if (dirname_len > 0 && (git__prefixcmp(entry->path, dirname) != 0 ||
+		entry->path[dirname_len] != '/'))
+		return false;
+
+	return find_next_dir(dirname, index, end - 1) == end;
+}
+
+/* The cache may have been filled in while writing to another repository */
+static bool cache_is_in(const git_tree_cache *cache, git_repository *repo, git_index *index)
+{
+	git_odb *odb;
+
+	if (repo == git_index_owner(index))
+		return true;
+
+	return git_repository_odb__weakptr(&odb, repo) == 0 &&
+		git_odb_exists(odb, &cache->oid);
+}
+
 static int write_tree(
 	git_oid *oid,
 	git_repository *repo,
 	git_index *index,
+	git_tree_cache *cache,
 	const char *dirname,
 	size_t start)
 {
@@ -478,14 +513,16 @@ static int write_tree(
 	size_t i, entries = git_index_entrycount(index);
 	int error;
 	size_t dirname_len = strlen(dirname);
-	const git_tree_cache *cache;
 
-	cache = git_tree_cache_get(index->tree, dirname);
-	if (cache != NULL && cache->entries >= 0){
+	if (cache->entries >= 0 &&
+		cache_covers(cache, index, dirname, dirname_len, start) &&
+		cache_is_in(cache, repo, index)) {
 		git_oid_cpy(oid, &cache->oid);
-		return (int)find_next_dir(dirname, index, start);
+		return (int)(start + cache->entries);
 	}
 
+	cache->entries = -1;
+
 	if ((error = git_treebuilder_create(&bld, NULL)) < 0 || bld == NULL)
 		return -1;
 
@@ -518,14 +555,19 @@ static int write_tree(
 		next_slash = strchr(filename, '/');
 		if (next_slash) {
 			git_oid sub_oid;
+			git_tree_cache *sub_cache;
 			int written;
 			char *subdir, *last_comp;
 
+			if (git_tree_cache_child(&sub_cache,
+					cache, filename, next_slash - filename) < 0)
+				goto on_error;
+
 			subdir = git__strndup(entry->path, next_slash - entry->path);
 			GITERR_CHECK_ALLOC(subdir);
 
 			/* Write out the subtree */
-			written = write_tree(&sub_oid, repo, index, subdir, i);
+			written = write_tree(&sub_oid, repo, index, sub_cache, subdir, i);
 			if (written < 0) {
 				git__free(subdir);
 				goto on_error;
@@ -560,6 +602,11 @@ static int write_tree(
 	if (git_treebuilder_write(oid, repo, bld) < 0)
 		goto on_error;
 
+	/* every subtree which is still there has just been made valid */
+	git_oid_cpy(&cache->oid, oid);
+	cache->entries = i - start;
+	git_tree_cache_prune(cache);
+
 	git_treebuilder_free(bld);
 	return (int)i;
 
@@ -582,14 +629,13 @@ int git_tree__write_index(
 		return GIT_EUNMERGED;
 	}
 
-	if (index->tree != NULL && index->tree->entries >= 0) {
-		git_oid_cpy(oid, &index->tree->oid);
-		return 0;
-	}
+	if (index->tree == NULL && git_tree_cache_new(&index->tree) < 0)
+		return -1;
 
-	/* The tree cache didn't help us; we'll have to write
-	 * out a tree. If the index is ignore_case, we must
-	 * make it case-sensitive for the duration of the tree-write
+	/* The subtrees which are still valid in the tree cache are
+	 * reused, and the cache is filled in with the ones that we
+	 * write. If the index is ignore_case, we must make it
+	 * case-sensitive for the duration of the tree-write
 	 * operation. */
 
 	if (index->ignore_case) {
@@ -597,7 +643,7 @@ int git_tree__write_index(
 		git_index__set_ignore_case(index, false);
 	}
 
-	ret = write_tree(oid, repo, index, "", 0);
+	ret = write_tree(oid, repo, index, index->tree, "", 0);
 
 	if (old_ignore_case)
 		git_index__set_ignore_case(index, true);
@@ -0,0 +1,965 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "untracked_cache.h"
+#include "index.h"
+#include "path.h"
+#include "varint.h"
+#include "ewah.h"
+#include "bitvec.h"
+
+#ifndef GIT_WIN32
+#include <sys/utsname.h>
+#endif
+
+/*
+ * git keeps the listings of `git status` in this extension, and tells
+ * them apart by the flags they were made with.  Ours list every entry
+ * which is not in the index, ignored or not, and stop at untracked
+ * directories: that is what git would call "other directories" with
+ * "ignored too".  git never uses those flags for its own listings, so
+ * it builds a new cache rather than trust ours, and we do the same with
+ * a cache that git wrote.
+ */
+#define DIR_SHOW_OTHER_DIRECTORIES (1u << 1)
+#define DIR_SHOW_IGNORED_TOO (1u << 5)
+
+#define UNTRACKED_CACHE_FLAGS (DIR_SHOW_OTHER_DIRECTORIES | DIR_SHOW_IGNORED_TOO)
+
+#define EXCLUDE_PER_DIR ".gitignore"
+
+/* ctime, mtime, dev, ino, uid, gid and size, as 32-bit numbers */
+#define STAT_DATA_SIZE 36
+
+/* the stat data of info/exclude and core.excludesfile, then the flags */
+#define HEADER_SIZE (2 * STAT_DATA_SIZE + 4)
+
+static int name_cmp(const void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static int name_icmp(const void *a, const void *b)
+{
+	return strcasecmp(a, b);
+}
+
+static int dir_cmp(const void *a, const void *b)
+{
+	const git_untracked_dir *da = a, *db = b;
+	return strcmp(da->name, db->name);
+}
+
+static int dir_srch(const void *key, const void *array_member)
+{
+	const git_untracked_dir *dir = array_member;
+	return strcmp(key, dir->name);
+}
+
+static uint32_t get_be32(const unsigned char *buf)
+{
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+		((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+static void put_be32(git_buf *out, uint32_t value)
+{
+	unsigned char buf[4];
+
+	buf[0] = (unsigned char)(value >> 24);
+	buf[1] = (unsigned char)(value >> 16);
+	buf[2] = (unsigned char)(value >> 8);
+	buf[3] = (unsigned char)value;
+
+	git_buf_put(out, (const char *)buf, sizeof(buf));
+}
+
+static void put_varint(git_buf *out, uintmax_t value)
+{
+	unsigned char buf[16];
+	int len = git_encode_varint(buf, sizeof(buf), value);
+
+	git_buf_put(out, (const char *)buf, len);
+}
+
+static void stat_from_disk(git_untracked_stat *out, const unsigned char *buf)
+{
+	out->ctime.seconds = get_be32(buf);
+	out->ctime.nanoseconds = get_be32(buf + 4);
+	out->mtime.seconds = get_be32(buf + 8);
+	out->mtime.nanoseconds = get_be32(buf + 12);
+	out->dev = get_be32(buf + 16);
+	out->ino = get_be32(buf + 20);
+	out->uid = get_be32(buf + 24);
+	out->gid = get_be32(buf + 28);
+	out->size = get_be32(buf + 32);
+}
+
+static void stat_to_disk(git_buf *out, const git_untracked_stat *st)
+{
+	put_be32(out, (uint32_t)st->ctime.seconds);
+	put_be32(out, st->ctime.nanoseconds);
+	put_be32(out, (uint32_t)st->mtime.seconds);
+	put_be32(out, st->mtime.nanoseconds);
+	put_be32(out, st->dev);
+	put_be32(out, st->ino);
+	put_be32(out, st->uid);
+	put_be32(out, st->gid);
+	put_be32(out, st->size);
+}
+
+/* The stat data as it is stored, so that it compares equal once read */
+static void stat_from(git_untracked_stat *out, const struct stat *st)
+{
+	memset(out, 0x0, sizeof(*out));
+
+	out->ctime.seconds = (uint32_t)st->st_ctime;
+	out->mtime.seconds = (uint32_t)st->st_mtime;
+	out->dev = (uint32_t)st->st_dev;
+	out->ino = (uint32_t)st->st_ino;
+	out->uid = (uint32_t)st->st_uid;
+	out->gid = (uint32_t)st->st_gid;
+	out->size = (uint32_t)st->st_size;
+}
+
+static bool stat_equal(const git_untracked_stat *a, const git_untracked_stat *b)
+{
+	return a->ctime.seconds == b->ctime.seconds &&
+		a->ctime.nanoseconds == b->ctime.nanoseconds &&
+		a->mtime.seconds == b->mtime.seconds &&
+		a->mtime.nanoseconds == b->mtime.nanoseconds &&
+		a->dev == b->dev && a->ino == b->ino &&
+		a->uid == b->uid && a->gid == b->gid && a->size == b->size;
+}
+
+/* git names a cache after where it is, and on what system */
+static int ident_for(git_buf *out, const char *workdir)
+{
+	const char *system = "Windows";
+	size_t len = strlen(workdir);
+#ifndef GIT_WIN32
+	struct utsname uts;
+
+	if (uname(&uts) < 0) {
+		giterr_set(GITERR_OS, "Failed to get the system name");
+		return -1;
+	}
+
+	system = uts.sysname;
+#endif
+
+	if (len > 1 && workdir[len - 1] == '/')
+		len--;
+
+	git_buf_clear(out);
+	git_buf_puts(out, "Location ");
+	git_buf_put(out, workdir, len);
+	git_buf_printf(out, ", system %s", system);
+	git_buf_putc(out, '\0');
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+static void untracked_free(git_vector *untracked)
+{
+	size_t i;
+	char *name;
+
+	git_vector_foreach(untracked, i, name)
+		git__free(name);
+	git_vector_free(untracked);
+}
+
+static void dir_free(git_untracked_dir *dir)
+{
+	size_t i;
+	git_untracked_dir *child;
+
+	if (dir == NULL)
+		return;
+
+	git_vector_foreach(&dir->dirs, i, child)
+		dir_free(child);
+	git_vector_free(&dir->dirs);
+
+	untracked_free(&dir->untracked);
+	git__free(dir);
+}
+
+static git_untracked_dir *dir_alloc(const char *name, size_t name_len)
+{
+	git_untracked_dir *dir;
+
+	dir = git__calloc(1, sizeof(git_untracked_dir) + name_len + 1);
+	if (!dir)
+		return NULL;
+
+	memcpy(dir->name, name, name_len);
+
+	if (git_vector_init(&dir->dirs, 0, dir_cmp) < 0 ||
+		git_vector_init(&dir->untracked, 0, name_cmp) < 0) {
+		dir_free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+int git_untracked_cache_new(git_untracked_cache **out, const char *workdir)
+{
+	git_untracked_cache *cache;
+
+	cache = git__calloc(1, sizeof(git_untracked_cache));
+	GITERR_CHECK_ALLOC(cache);
+
+	if (ident_for(&cache->ident, workdir) < 0) {
+		git_untracked_cache_free(cache);
+		return -1;
+	}
+
+	*out = cache;
+	return 0;
+}
+
+bool git_untracked_cache_is_for(
+	const git_untracked_cache *cache, const char *workdir)
+{
+	git_buf ident = GIT_BUF_INIT;
+	bool same;
+
+	same = !ident_for(&ident, workdir) &&
+		ident.size == cache->ident.size &&
+		!memcmp(ident.ptr, cache->ident.ptr, ident.size);
+
+	git_buf_free(&ident);
+	return same;
+}
+
+void git_untracked_cache_free(git_untracked_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	dir_free(cache->root);
+	git_buf_free(&cache->ident);
+	git__free(cache);
+}
+
+/* Find the directory `path` (which ends with a slash, or is empty) */
+static git_untracked_dir *find_dir(git_untracked_cache *cache, const char *path)
+{
+	git_buf name = GIT_BUF_INIT;
+	git_untracked_dir *dir;
+	const char *slash;
+	size_t pos;
+
+	if (!cache->root && (cache->root = dir_alloc("", 0)) == NULL)
+		return NULL;
+
+	for (dir = cache->root; dir && (slash = strchr(path, '/')) != NULL;
+		path = slash + 1) {
+		git_untracked_dir *child;
+
+		if (git_buf_set(&name, path, slash - path) < 0) {
+			dir = NULL;
+			break;
+		}
+
+		if (!git_vector_bsearch2(&pos, &dir->dirs, dir_srch, name.ptr)) {
+			dir = git_vector_get(&dir->dirs, pos);
+			continue;
+		}
+
+		if ((child = dir_alloc(name.ptr, name.size)) == NULL ||
+			git_vector_insert_sorted(&dir->dirs, child, NULL) < 0) {
+			dir_free(child);
+			child = NULL;
+		}
+
+		dir = child;
+	}
+
+	git_buf_free(&name);
+	return dir;
+}
+
+void git_untracked_cache_invalidate_path(
+	git_untracked_cache *cache, const char *path)
+{
+	git_untracked_dir *dir;
+	const char *slash;
+
+	if (cache == NULL)
+		return;
+
+	/* the case of the path may not be the one on disk; forgetting too
+	 * much is harmless */
+	for (dir = cache->root; dir != NULL; path = slash + 1) {
+		git_untracked_dir *child = NULL;
+		size_t i;
+
+		dir->valid = 0;
+
+		if ((slash = strchr(path, '/')) == NULL)
+			break;
+
+		git_vector_foreach(&dir->dirs, i, child) {
+			if (!strncasecmp(child->name, path, slash - path) &&
+				child->name[slash - path] == '\0')
+				break;
+		}
+
+		dir = (i < dir->dirs.length) ? child : NULL;
+	}
+}
+
+/* The names of the entries of the directory `dir` in the index */
+static int index_children(
+	git_vector *out, git_index *index, const char *dir, size_t dir_len)
+{
+	int (*strncomp)(const char *a, const char *b, size_t sz) =
+		index->ignore_case ? git__strncasecmp : git__strncmp;
+	const git_index_entry *entry;
+	const char *last = NULL;
+	size_t pos, last_len = 0;
+
+	pos = dir_len ? git_index__prefix_position(index, dir) : 0;
+	git_vector_sort(&index->entries);
+
+	while ((entry = git_vector_get(&index->entries, pos++)) != NULL) {
+		const char *name = entry->path + dir_len, *slash;
+		size_t name_len;
+		char *copy;
+
+		if (strncomp(entry->path, dir, dir_len) != 0)
+			break;
+
+		slash = strchr(name, '/');
+		name_len = slash ? (size_t)(slash - name) : strlen(name);
+
+		/* the entries of a subdirectory, or the stages of a file */
+		if (last && last_len == name_len && !strncomp(last, name, name_len))
+			continue;
+
+		if ((copy = git__strndup(name, name_len)) == NULL ||
+			git_vector_insert(out, copy) < 0) {
+			git__free(copy);
+			return -1;
+		}
+
+		last = name;
+		last_len = name_len;
+	}
+
+	git_vector_uniq(out, git__free);
+	return 0;
+}
+
+static int add_entry(
+	git_vector *contents, const char *dir, size_t dir_len,
+	const char *name, size_t name_len)
+{
+	git_path_with_stat *ps;
+
+	/* room for the slash that a directory gets */
+	ps = git__calloc(1, sizeof(git_path_with_stat) + dir_len + name_len + 2);
+	GITERR_CHECK_ALLOC(ps);
+
+	memcpy(ps->path, dir, dir_len);
+	memcpy(ps->path + dir_len, name, name_len);
+	ps->path_len = dir_len + name_len;
+
+	return git_vector_insert(contents, ps);
+}
+
+/* The stat data that the index has for an entry known to be unchanged */
+static void stat_from_entry(struct stat *st, const git_index_entry *entry)
+{
+	memset(st, 0x0, sizeof(*st));
+
+	st->st_ctime = (time_t)entry->ctime.seconds;
+	st->st_mtime = (time_t)entry->mtime.seconds;
+	st->st_rdev = entry->dev;
+	st->st_ino = entry->ino;
+	st->st_mode = entry->mode;
+	st->st_uid = entry->uid;
+	st->st_gid = entry->gid;
+	st->st_size = entry->file_size;
+}
+
+/*
+ * The entry of the index for `path`, when the file system monitor says
+ * that it has not changed since it was last looked at
+ */
+static const git_index_entry *unchanged_entry(git_index *index, const char *path)
+{
+	const git_index_entry *entry;
+
+	if (!index->fsmonitor_token ||
+		(entry = git_index_get_bypath(index, path, 0)) == NULL ||
+		!(entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID) ||
+		!(S_ISREG(entry->mode) || S_ISLNK(entry->mode)))
+		return NULL;
+
+	return entry;
+}
+
+static int load_from_cache(
+	git_untracked_dir *ud,
+	git_vector *tracked,
+	git_index *index,
+	const char *path,
+	size_t prefix_len,
+	uint32_t flags,
+	const char *start_stat,
+	const char *end_stat,
+	git_vector *contents)
+{
+	const char *dir = path + prefix_len, *name;
+	size_t dir_len = strlen(dir), i;
+	git_vector unchanged = GIT_VECTOR_INIT;
+	git_path_with_stat *ps;
+	git_buf buf = GIT_BUF_INIT;
+	int error = 0;
+
+	git_vector_foreach(tracked, i, name) {
+		const git_index_entry *entry;
+
+		if ((error = git_buf_sets(&buf, dir)) < 0 ||
+			(error = git_buf_puts(&buf, name)) < 0)
+			goto done;
+
+		/* these are not even looked at */
+		if ((entry = unchanged_entry(index, buf.ptr)) != NULL) {
+			if ((error = add_entry(&unchanged, dir, dir_len, name, strlen(name))) < 0)
+				goto done;
+
+			ps = git_vector_last(&unchanged);
+			stat_from_entry(&ps->st, entry);
+			continue;
+		}
+
+		if ((error = add_entry(contents, dir, dir_len, name, strlen(name))) < 0)
+			goto done;
+	}
+
+	git_vector_foreach(&ud->untracked, i, name) {
+		size_t name_len = strlen(name);
+
+		if (name_len > 0 && name[name_len - 1] == '/')
+			name_len--;
+
+		if ((error = git_buf_set(&buf, name, name_len)) < 0)
+			goto done;
+
+		/* it may have been added to the index since */
+		if (!git_vector_bsearch(NULL, tracked, buf.ptr))
+			continue;
+
+		if ((error = add_entry(contents, dir, dir_len, name, name_len)) < 0)
+			goto done;
+	}
+
+	if ((error = git_path_with_stat_entries(
+			path, prefix_len, flags, start_stat, end_stat, contents)) < 0)
+		goto done;
+
+	git_vector_foreach(&unchanged, i, ps) {
+		if ((error = git_vector_insert(contents, ps)) < 0)
+			goto done;
+		unchanged.contents[i] = NULL;
+	}
+
+	git_vector_sort(contents);
+
+done:
+	git_vector_foreach(&unchanged, i, ps)
+		git__free(ps);
+	git_vector_free(&unchanged);
+	git_buf_free(&buf);
+	return error;
+}
+
+static int update_dir(
+	git_untracked_dir *ud,
+	git_vector *tracked,
+	git_vector *contents,
+	size_t dir_len,
+	const git_untracked_stat *dir_stat,
+	bool valid)
+{
+	git_vector untracked = GIT_VECTOR_INIT, subdirs = GIT_VECTOR_INIT;
+	git_buf name = GIT_BUF_INIT;
+	git_path_with_stat *ps;
+	git_untracked_dir *child;
+	size_t i;
+	int error = 0;
+
+	git_vector_set_cmp(&untracked, name_cmp);
+	git_vector_set_cmp(&subdirs, name_cmp);
+
+	git_vector_foreach(contents, i, ps) {
+		size_t name_len = ps->path_len - dir_len;
+		bool is_dir = S_ISDIR(ps->st.st_mode) ||
+			ps->st.st_mode == GIT_FILEMODE_COMMIT;
+		bool is_tracked;
+		char *entry;
+
+		if (name_len > 0 && ps->path[ps->path_len - 1] == '/')
+			name_len--;
+
+		if ((error = git_buf_set(&name, ps->path + dir_len, name_len)) < 0)
+			break;
+
+		is_tracked = !git_vector_bsearch(NULL, tracked, name.ptr);
+
+		if (is_tracked && !is_dir)
+			continue;
+
+		if (is_dir && (error = git_buf_putc(&name, '/')) < 0)
+			break;
+
+		/* subdirectories are remembered whether tracked or not */
+		if (is_dir && ((entry = git__strdup(name.ptr)) == NULL ||
+			(error = git_vector_insert(&subdirs, entry)) < 0)) {
+			git__free(entry);
+			error = -1;
+			break;
+		}
+
+		if (is_tracked)
+			continue;
+
+		if ((entry = git_buf_detach(&name)) == NULL ||
+			(error = git_vector_insert(&untracked, entry)) < 0) {
+			git__free(entry);
+			error = -1;
+			break;
+		}
+	}
+
+	if (error < 0) {
+		ud->valid = 0;
+		goto done;
+	}
+
+	git_vector_sort(&untracked);
+	git_vector_swap(&untracked, &ud->untracked);
+
+	ud->stat = *dir_stat;
+	ud->valid = valid;
+
+	/* forget the subdirectories that are gone */
+	for (i = 0; i < ud->dirs.length; ) {
+		child = git_vector_get(&ud->dirs, i);
+
+		git_buf_sets(&name, child->name);
+		git_buf_putc(&name, '/');
+
+		if (git_buf_oom(&name)) {
+			error = -1;
+			break;
+		}
+
+		if (!git_vector_bsearch(NULL, &subdirs, name.ptr))
+			i++;
+		else {
+			git_vector_remove(&ud->dirs, i);
+			dir_free(child);
+		}
+	}
+
+done:
+	untracked_free(&untracked);
+	untracked_free(&subdirs);
+	git_buf_free(&name);
+	return error;
+}
+
+int git_untracked_cache_dirload(
+	git_untracked_cache *cache,
+	git_index *index,
+	const char *path,
+	size_t prefix_len,
+	const struct stat *st,
+	uint32_t flags,
+	const char *start_stat,
+	const char *end_stat,
+	git_vector *contents)
+{
+	const char *dir = path + prefix_len;
+	git_vector tracked = GIT_VECTOR_INIT;
+	git_untracked_stat dir_stat;
+	git_untracked_dir *ud;
+	time_t now;
+	int error;
+
+	git_vector_set_cmp(&tracked,
+		(flags & GIT_PATH_DIR_IGNORE_CASE) ? name_icmp : name_cmp);
+
+	if ((ud = find_dir(cache, dir)) == NULL)
+		return -1;
+
+	stat_from(&dir_stat, st);
+
+	if ((error = index_children(&tracked, index, dir, strlen(dir))) < 0)
+		goto done;
+
+	if (ud->valid && stat_equal(&ud->stat, &dir_stat)) {
+		error = load_from_cache(ud, &tracked, index,
+			path, prefix_len, flags, start_stat, end_stat, contents);
+		goto done;
+	}
+
+	now = time(NULL);
+
+	if ((error = git_path_dirload_with_stat(
+			path, prefix_len, flags, start_stat, end_stat, contents)) < 0)
+		goto done;
+
+	/* outside of the range, entries are not looked at closely enough to
+	 * be remembered; and a directory changed since `now` may change again
+	 * without its stat data showing it */
+	if (!start_stat && !end_stat)
+		error = update_dir(ud, &tracked, contents, strlen(dir),
+			&dir_stat, st->st_mtime < now);
+
+done:
+	untracked_free(&tracked);
+	return error;
+}
+
+/*
+ * On disk, the directories are written depth first: the number of their
+ * untracked entries and of their subdirectories, their name, and their
+ * untracked entries.  Bitmaps then tell which of them are valid, and the
+ * stat data of those follows.
+ */
+struct read_data {
+	const unsigned char *data;
+	const unsigned char *end;
+	git_vector dirs;
+};
+
+static const char *read_string(struct read_data *rd)
+{
+	const unsigned char *eos;
+	const char *str = (const char *)rd->data;
+
+	if (rd->data >= rd->end ||
+		(eos = memchr(rd->data, '\0', rd->end - rd->data)) == NULL)
+		return NULL;
+
+	rd->data = eos + 1;
+	return str;
+}
+
+static int read_varint(size_t *out, struct read_data *rd)
+{
+	size_t len;
+	uintmax_t value = git_decode_varint(&len, rd->data, rd->end - rd->data);
+
+	if (!len || value > SIZE_MAX)
+		return -1;
+
+	rd->data += len;
+	*out = (size_t)value;
+	return 0;
+}
+
+static int read_one_dir(git_untracked_dir **out, struct read_data *rd)
+{
+	git_untracked_dir *dir;
+	size_t untracked_count, dirs_count, i;
+	const char *name;
+
+	*out = NULL;
+
+	if (read_varint(&untracked_count, rd) < 0 ||
+		read_varint(&dirs_count, rd) < 0 ||
+		(name = read_string(rd)) == NULL)
+		return -1;
+
+	if ((dir = dir_alloc(name, strlen(name))) == NULL)
+		return -1;
+
+	*out = dir;
+
+	if (git_vector_insert(&rd->dirs, dir) < 0)
+		return -1;
+
+	for (i = 0; i < untracked_count; ++i) {
+		char *entry;
+
+		if ((name = read_string(rd)) == NULL ||
+			(entry = git__strdup(name)) == NULL)
+			return -1;
+
+		if (git_vector_insert(&dir->untracked, entry) < 0) {
+			git__free(entry);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < dirs_count; ++i) {
+		git_untracked_dir *child;
+		int error = read_one_dir(&child, rd);
+
+		if (child && git_vector_insert(&dir->dirs, child) < 0) {
+			dir_free(child);
+			return -1;
+		}
+
+		if (error < 0)
+			return error;
+	}
+
+	git_vector_sort(&dir->untracked);
+	git_vector_sort(&dir->dirs);
+
+	return 0;
+}
+
+static int read_bitmap(git_bitvec *bv, size_t *bit_size, struct read_data *rd)
+{
+	size_t len = git_ewah_read(bv, bit_size,
+		(const char *)rd->data, rd->end - rd->data);
+
+	if (!len)
+		return -1;
+
+	rd->data += len;
+	return 0;
+}
+
+static bool bitmap_get(git_bitvec *bv, size_t bit_size, size_t bit)
+{
+	return bit < bit_size && git_bitvec_get(bv, bit);
+}
+
+static int read_dirs(git_untracked_cache *cache, struct read_data *rd)
+{
+	git_bitvec valid, check_only, sha1_valid;
+	size_t valid_size, check_only_size, sha1_valid_size, count, i;
+	git_untracked_dir *dir;
+	int error = -1;
+
+	memset(&valid, 0x0, sizeof(valid));
+	memset(&check_only, 0x0, sizeof(check_only));
+	memset(&sha1_valid, 0x0, sizeof(sha1_valid));
+
+	if (read_varint(&count, rd) < 0)
+		return -1;
+
+	/* there is no root directory when nothing was read yet */
+	if (count == 0)
+		return 0;
+
+	if (read_one_dir(&cache->root, rd) < 0 || rd->dirs.length != count ||
+		read_bitmap(&valid, &valid_size, rd) < 0 ||
+		read_bitmap(&check_only, &check_only_size, rd) < 0 ||
+		read_bitmap(&sha1_valid, &sha1_valid_size, rd) < 0)
+		goto done;
+
+	git_vector_foreach(&rd->dirs, i, dir) {
+		if (!bitmap_get(&valid, valid_size, i))
+			continue;
+
+		if ((size_t)(rd->end - rd->data) < STAT_DATA_SIZE)
+			goto done;
+
+		stat_from_disk(&dir->stat, rd->data);
+		rd->data += STAT_DATA_SIZE;
+
+		/* these only know whether the directory has untracked entries */
+		dir->valid = !bitmap_get(&check_only, check_only_size, i);
+	}
+
+	/* the ids of the ignore files are of no use to us */
+	git_vector_foreach(&rd->dirs, i, dir) {
+		if (!bitmap_get(&sha1_valid, sha1_valid_size, i))
+			continue;
+
+		if ((size_t)(rd->end - rd->data) < GIT_OID_RAWSZ)
+			goto done;
+
+		rd->data += GIT_OID_RAWSZ;
+	}
+
+	error = 0;
+
+done:
+	git_bitvec_free(&valid);
+	git_bitvec_free(&check_only);
+	git_bitvec_free(&sha1_valid);
+	return error;
+}
+
+int git_untracked_cache_read(
+	git_untracked_cache **out, const char *buffer, size_t buffer_size)
+{
+	git_untracked_cache *cache = NULL;
+	struct read_data rd;
+	size_t ident_len;
+	uint32_t flags;
+	int error = -1;
+
+	*out = NULL;
+
+	memset(&rd, 0x0, sizeof(rd));
+	rd.data = (const unsigned char *)buffer;
+	rd.end = rd.data + buffer_size;
+
+	/* the extension ends with a NUL, to stop any string read too far */
+	if (buffer_size <= 1 || rd.end[-1] != '\0')
+		goto corrupted;
+	rd.end--;
+
+	if (read_varint(&ident_len, &rd) < 0 ||
+		(size_t)(rd.end - rd.data) < ident_len ||
+		(size_t)(rd.end - rd.data - ident_len) < HEADER_SIZE + 2 * GIT_OID_RAWSZ)
+		goto corrupted;
+
+	flags = get_be32(rd.data + ident_len + 2 * STAT_DATA_SIZE);
+
+	if (flags != UNTRACKED_CACHE_FLAGS)
+		return 0;
+
+	cache = git__calloc(1, sizeof(git_untracked_cache));
+	GITERR_CHECK_ALLOC(cache);
+
+	if (git_buf_put(&cache->ident, (const char *)rd.data, ident_len) < 0 ||
+		git_vector_init(&rd.dirs, 0, NULL) < 0)
+		goto done;
+
+	rd.data += ident_len + HEADER_SIZE + 2 * GIT_OID_RAWSZ;
+
+	/* the name of the ignore files, which are always ".gitignore" */
+	if (read_string(&rd) == NULL) {
+		error = 0;
+		goto done;
+	}
+
+	/* nothing past that is fine too */
+	if (rd.data >= rd.end || read_dirs(cache, &rd) == 0)
+		error = 0;
+
+done:
+	git_vector_free(&rd.dirs);
+
+	if (error < 0) {
+		git_untracked_cache_free(cache);
+		goto corrupted;
+	}
+
+	*out = cache;
+	return 0;
+
+corrupted:
+	giterr_set(GITERR_INDEX, "Corrupted untracked cache extension");
+	return -1;
+}
+
+struct write_data {
+	size_t index;
+	git_buf dirs;
+	git_buf stat;
+	git_bitvec valid;
+};
+
+static void count_dirs(size_t *count, const git_untracked_dir *dir)
+{
+	size_t i;
+	git_untracked_dir *child;
+
+	(*count)++;
+
+	git_vector_foreach(&dir->dirs, i, child)
+		count_dirs(count, child);
+}
+
+static void write_one_dir(struct write_data *wd, const git_untracked_dir *dir)
+{
+	size_t i;
+	const char *name;
+	git_untracked_dir *child;
+
+	if (dir->valid) {
+		git_bitvec_set(&wd->valid, wd->index, true);
+		stat_to_disk(&wd->stat, &dir->stat);
+	}
+
+	wd->index++;
+
+	put_varint(&wd->dirs, dir->untracked.length);
+	put_varint(&wd->dirs, dir->dirs.length);
+	git_buf_put(&wd->dirs, dir->name, strlen(dir->name) + 1);
+
+	git_vector_foreach(&dir->untracked, i, name)
+		git_buf_put(&wd->dirs, name, strlen(name) + 1);
+
+	git_vector_foreach(&dir->dirs, i, child)
+		write_one_dir(wd, child);
+}
+
+int git_untracked_cache_write(git_buf *out, const git_untracked_cache *cache)
+{
+	static const char null_data[2 * STAT_DATA_SIZE] = { 0 };
+	struct write_data wd;
+	git_bitvec empty;
+	size_t count = 0;
+	int error;
+
+	put_varint(out, cache->ident.size);
+	git_buf_put(out, cache->ident.ptr, cache->ident.size);
+
+	/* no stat data nor ids for info/exclude and core.excludesfile,
+	 * which our listings do not depend on */
+	git_buf_put(out, null_data, 2 * STAT_DATA_SIZE);
+	put_be32(out, UNTRACKED_CACHE_FLAGS);
+	git_buf_put(out, null_data, 2 * GIT_OID_RAWSZ);
+
+	git_buf_put(out, EXCLUDE_PER_DIR, strlen(EXCLUDE_PER_DIR) + 1);
+
+	if (!cache->root) {
+		put_varint(out, 0);
+		return git_buf_oom(out) ? -1 : 0;
+	}
+
+	count = 0;
+	count_dirs(&count, cache->root);
+
+	memset(&wd, 0x0, sizeof(wd));
+	git_buf_init(&wd.dirs, 0);
+	git_buf_init(&wd.stat, 0);
+	git_bitvec_init(&empty, 0);
+
+	if ((error = git_bitvec_init(&wd.valid, count)) < 0)
+		return error;
+
+	write_one_dir(&wd, cache->root);
+
+	put_varint(out, count);
+	git_buf_put(out, wd.dirs.ptr, wd.dirs.size);
+
+	if ((error = git_ewah_write(out, &wd.valid, count)) < 0 ||
+		(error = git_ewah_write(out, &empty, 0)) < 0 ||
+		(error = git_ewah_write(out, &empty, 0)) < 0)
+		goto done;
+
+	git_buf_put(out, wd.stat.ptr, wd.stat.size);
+	git_buf_putc(out, '\0');
+
+	if (git_buf_oom(out) || git_buf_oom(&wd.dirs) || git_buf_oom(&wd.stat))
+		error = -1;
+
+done:
+	git_bitvec_free(&wd.valid);
+	git_buf_free(&wd.dirs);
+	git_buf_free(&wd.stat);
+	return error;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_untracked_cache_h__
+#define INCLUDE_untracked_cache_h__
+
+#include "common.h"
+#include "vector.h"
+#include "buffer.h"
+#include "git2/index.h"
+
+/*
+ * The untracked cache remembers, for each directory of the working
+ * directory, the entries which are not in the index, along with the stat
+ * data of the directory when it was read.  While the directory does not
+ * change, its entries are the ones in the index plus these, and it does
+ * not have to be read again.
+ *
+ * It is stored in the "UNTR" extension of the index, in git's format.
+ */
+
+typedef struct {
+	git_index_time ctime;
+	git_index_time mtime;
+	uint32_t dev;
+	uint32_t ino;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t size;
+} git_untracked_stat;
+
+typedef struct git_untracked_dir git_untracked_dir;
+struct git_untracked_dir {
+	/* the subdirectories that have been read, by name */
+	git_vector dirs;
+	/* the names of the entries that are not in the index; directories
+	 * end with a slash */
+	git_vector untracked;
+
+	git_untracked_stat stat;
+	unsigned int valid:1;
+
+	char name[GIT_FLEX_ARRAY];
+};
+
+typedef struct {
+	git_buf ident;
+	git_untracked_dir *root;
+} git_untracked_cache;
+
+/* Create an empty cache for the working directory `workdir` */
+extern int git_untracked_cache_new(
+	git_untracked_cache **out, const char *workdir);
+
+/*
+ * Read the "UNTR" extension.  `*out` is set to NULL when the extension
+ * is valid but was not written by us (git keeps a different listing).
+ */
+extern int git_untracked_cache_read(
+	git_untracked_cache **out, const char *buffer, size_t buffer_size);
+
+extern int git_untracked_cache_write(
+	git_buf *out, const git_untracked_cache *cache);
+
+/* Whether the cache was made for the working directory `workdir` */
+extern bool git_untracked_cache_is_for(
+	const git_untracked_cache *cache, const char *workdir);
+
+/*
+ * Load the entries of the directory `path` as `git_path_dirload_with_stat`
+ * does, from the cache if `st` says that the directory is unchanged, and
+ * update the cache otherwise.  The entries of `index` are the ones that
+ * the cache leaves out.
+ */
+extern int git_untracked_cache_dirload(
+	git_untracked_cache *cache,
+	git_index *index,
+	const char *path,
+	size_t prefix_len,
+	const struct stat *st,
+	uint32_t flags,
+	const char *start_stat,
+	const char *end_stat,
+	git_vector *contents);
+
+/* Forget the listings of the directories that lead to `path` */
+extern void git_untracked_cache_invalidate_path(
+	git_untracked_cache *cache, const char *path);
+
+extern void git_untracked_cache_free(git_untracked_cache *cache);
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "varint.h"
+
+#define VARINT_MSB(x, bits) ((x) & (~(uintmax_t)0 << (sizeof(x) * 8 - (bits))))
+
+uintmax_t git_decode_varint(
+	size_t *varint_len, const unsigned char *buf, size_t bufsize)
+{
+	const unsigned char *start = buf, *end = buf + bufsize;
+	unsigned char c;
+	uintmax_t val;
+
+	*varint_len = 0;
+
+	if (buf == end)
+		return 0;
+
+	c = *buf++;
+	val = c & 127;
+
+	while (c & 128) {
+		val += 1;
+		if (!val || VARINT_MSB(val, 7) || buf == end)
+			return 0; /* overflow or truncated */
+
+		c = *buf++;
+		val = (val << 7) + (c & 127);
+	}
+
+	*varint_len = buf - start;
+	return val;
+}
+
+int git_encode_varint(unsigned char *buf, size_t bufsize, uintmax_t value)
+{
+	unsigned char varint[16];
+	unsigned pos = sizeof(varint) - 1;
+
+	varint[pos] = value & 127;
+	while (value >>= 7)
+		varint[--pos] = 128 | (--value & 127);
+
+	if (buf) {
+		if (bufsize < sizeof(varint) - pos)
+			return -1;
+		memcpy(buf, varint + pos, sizeof(varint) - pos);
+	}
+
+	return (int)(sizeof(varint) - pos);
+}
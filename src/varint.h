@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_varint_h__
+#define INCLUDE_varint_h__
+
+#include "common.h"
+
+/*
+ * The variable-length integers of git's index format version 4: seven
+ * bits per byte, most significant group first, with the high bit set on
+ * every byte but the last.  Each continuation also adds one, so that
+ * every number has a single encoding.
+ */
+
+/*
+ * Encode `value` into `buf`; returns the number of bytes written, or
+ * -1 if `bufsize` is too small.  A NULL `buf` only counts the bytes.
+ */
+extern int git_encode_varint(unsigned char *buf, size_t bufsize, uintmax_t value);
+
+/*
+ * Decode a number from at most `bufsize` bytes of `buf`, and store the
+ * number of bytes it took in `varint_len`; that is 0 when the number is
+ * truncated or does not fit.
+ */
+extern uintmax_t git_decode_varint(
+	size_t *varint_len, const unsigned char *buf, size_t bufsize);
+
+#endif
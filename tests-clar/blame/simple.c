@@ -0,0 +1,159 @@
+#include "clar_libgit2.h"
+
+static git_repository *g_repo;
+static git_blame *g_blame;
+
+void test_blame_simple__initialize(void)
+{
+	g_repo = NULL;
+	g_blame = NULL;
+}
+
+void test_blame_simple__cleanup(void)
+{
+	git_blame_free(g_blame);
+	cl_git_sandbox_cleanup();
+}
+
+static void check_hunk(
+	size_t idx, const char *commit, size_t final_start, size_t orig_start,
+	size_t lines, const char *orig_path)
+{
+	const git_blame_hunk *hunk = git_blame_get_hunk_byindex(g_blame, idx);
+	char str[GIT_OID_HEXSZ + 1];
+
+	cl_assert(hunk != NULL);
+
+	git_oid_tostr(str, sizeof(str), &hunk->final_commit_id);
+	cl_assert_equal_s(commit, str);
+	cl_assert_equal_sz(final_start, hunk->final_start_line_number);
+	cl_assert_equal_sz(orig_start, hunk->orig_start_line_number);
+	cl_assert_equal_sz(lines, hunk->lines_in_hunk);
+	cl_assert_equal_s(orig_path, hunk->orig_path);
+}
+
+#define SEVEN "31e47d8c1fa36d7f8d537b96158e3f024de0a9f2"
+#define HEAD "19dd32dfb1520a64e5bbaae8dce6ef423dfa2f13"
+
+/* the same as `git blame songof7cities.txt` */
+void test_blame_simple__follows_renames(void)
+{
+	g_repo = cl_git_sandbox_init("renames");
+
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "songof7cities.txt", NULL));
+	cl_assert_equal_sz(16, git_blame_get_hunk_count(g_blame));
+
+	check_hunk(0, SEVEN, 1, 1, 1, "sevencities.txt");
+	check_hunk(1, HEAD, 2, 2, 1, "songof7cities.txt");
+	check_hunk(2, SEVEN, 3, 3, 3, "sevencities.txt");
+	check_hunk(3, HEAD, 6, 6, 1, "songof7cities.txt");
+	check_hunk(4, SEVEN, 7, 7, 2, "sevencities.txt");
+	check_hunk(6, SEVEN, 10, 10, 16, "sevencities.txt");
+	check_hunk(15, HEAD, 49, 49, 1, "songof7cities.txt");
+
+	cl_assert(git_blame_get_hunk_byindex(g_blame, 0)->boundary);
+	cl_assert(!git_blame_get_hunk_byindex(g_blame, 1)->boundary);
+	cl_assert_equal_s("Russell Belfer",
+		git_blame_get_hunk_byindex(g_blame, 1)->final_signature->name);
+}
+
+void test_blame_simple__lines_moved_within_file(void)
+{
+	g_repo = cl_git_sandbox_init("renames");
+
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "sixserving.txt", NULL));
+	cl_assert_equal_sz(8, git_blame_get_hunk_count(g_blame));
+
+	check_hunk(0, HEAD, 1, 1, 8, "sixserving.txt");
+	check_hunk(1, SEVEN, 9, 9, 1, "serving.txt");
+	check_hunk(5, "1c068dee5790ef1580cfc4cd670915b48d790084",
+		23, 19, 1, "sixserving.txt");
+	check_hunk(7, SEVEN, 25, 23, 1, "serving.txt");
+}
+
+void test_blame_simple__line_range(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+
+	g_repo = cl_git_sandbox_init("renames");
+
+	opts.min_line = 8;
+	opts.max_line = 11;
+
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "songof7cities.txt", &opts));
+	cl_assert_equal_sz(3, git_blame_get_hunk_count(g_blame));
+
+	check_hunk(0, SEVEN, 8, 8, 1, "sevencities.txt");
+	check_hunk(1, HEAD, 9, 9, 1, "songof7cities.txt");
+	check_hunk(2, SEVEN, 10, 10, 2, "sevencities.txt");
+
+	opts.min_line = 48;
+	opts.max_line = 50;
+	git_blame_free(g_blame);
+	cl_git_fail(git_blame_file(&g_blame, g_repo, "songof7cities.txt", &opts));
+	g_blame = NULL;
+}
+
+void test_blame_simple__byline(void)
+{
+	const git_blame_hunk *hunk;
+
+	g_repo = cl_git_sandbox_init("testrepo.git");
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "branch_file.txt", NULL));
+
+	cl_assert_equal_sz(2, git_blame_get_hunk_count(g_blame));
+
+	cl_assert((hunk = git_blame_get_hunk_byline(g_blame, 1)) != NULL);
+	cl_assert_equal_sz(1, hunk->final_start_line_number);
+	cl_assert((hunk = git_blame_get_hunk_byline(g_blame, 2)) != NULL);
+	cl_assert_equal_sz(2, hunk->final_start_line_number);
+
+	cl_assert(git_blame_get_hunk_byline(g_blame, 0) == NULL);
+	cl_assert(git_blame_get_hunk_byline(g_blame, 3) == NULL);
+}
+
+void test_blame_simple__oldest_commit_is_a_boundary(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	const git_blame_hunk *hunk;
+	char str[GIT_OID_HEXSZ + 1];
+
+	g_repo = cl_git_sandbox_init("testrepo.git");
+
+	/* README was last changed by the oldest commit we look at */
+	cl_git_pass(git_oid_fromstr(&opts.oldest_commit,
+		"4a202b346bb0fb0db7eff3cffeb3c70babbd2045"));
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "README", &opts));
+
+	cl_assert_equal_sz(1, git_blame_get_hunk_count(g_blame));
+	hunk = git_blame_get_hunk_byindex(g_blame, 0);
+	git_oid_tostr(str, sizeof(str), &hunk->final_commit_id);
+	cl_assert_equal_s("4a202b346bb0fb0db7eff3cffeb3c70babbd2045", str);
+	cl_assert(hunk->boundary);
+}
+
+static int count_and_stop(const git_blame_hunk *hunk, void *payload)
+{
+	int *count = payload;
+	GIT_UNUSED(hunk);
+	return (++(*count) == 2);
+}
+
+void test_blame_simple__foreach_can_be_aborted(void)
+{
+	int count = 0;
+
+	g_repo = cl_git_sandbox_init("renames");
+
+	cl_assert_equal_i(GIT_EUSER, git_blame_file_foreach(
+		g_repo, "songof7cities.txt", NULL, count_and_stop, &count));
+	cl_assert_equal_i(2, count);
+}
+
+void test_blame_simple__missing_file(void)
+{
+	g_repo = cl_git_sandbox_init("testrepo.git");
+
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_blame_file(&g_blame, g_repo, "no-such-file", NULL));
+}
@@ -256,6 +256,35 @@ void test_checkout_index__options_dir_modes(void)
 	git_commit_free(commit);
 }
 
+static void assert_checkout_file_mode_with_umask(mode_t mask, mode_t expected)
+{
+	git_checkout_opts opts = GIT_CHECKOUT_OPTS_INIT;
+	struct stat st;
+	mode_t old_umask;
+
+	if (git_path_isfile("./testrepo/new.txt"))
+		cl_must_pass(p_unlink("./testrepo/new.txt"));
+
+	old_umask = p_umask(mask);
+
+	opts.checkout_strategy = GIT_CHECKOUT_SAFE_CREATE;
+	cl_git_pass(git_checkout_index(g_repo, NULL, &opts));
+
+	(void)p_umask(old_umask);
+
+	cl_git_pass(p_stat("./testrepo/new.txt", &st));
+	cl_assert_equal_i_fmt(st.st_mode & GIT_MODE_PERMS_MASK, expected, "%07o");
+}
+
+void test_checkout_index__options_file_modes_follow_the_umask(void)
+{
+	if (!cl_is_chmod_supported())
+		return;
+
+	assert_checkout_file_mode_with_umask(022, 0644);
+	assert_checkout_file_mode_with_umask(077, 0600);
+}
+
 void test_checkout_index__options_override_file_modes(void)
 {
 	git_checkout_opts opts = GIT_CHECKOUT_OPTS_INIT;
@@ -919,6 +919,76 @@ void test_core_buffer__similarity_metric_whitespace(void)
 	git_buf_free(&buf);
 }
 
+#define SIMILAR_COUNT 8
+
+static int collect_similar_cb(size_t a_idx, size_t b_idx, void *payload)
+{
+	int *found = payload;
+	found[a_idx * SIMILAR_COUNT + b_idx]++;
+	return 0;
+}
+
+static void make_lines(git_hashsig **out, int start, int count)
+{
+	git_buf buf = GIT_BUF_INIT;
+	int i;
+
+	for (i = start; i < start + count; ++i)
+		cl_git_pass(git_buf_printf(&buf, "line %04d\n", i));
+
+	cl_git_pass(git_hashsig_create(out, buf.ptr, buf.size, GIT_HASHSIG_NORMAL));
+	git_buf_free(&buf);
+}
+
+void test_core_buffer__similarity_metric_finds_similar_pairs(void)
+{
+	git_hashsig *a[SIMILAR_COUNT], *b[SIMILAR_COUNT];
+	int found[SIMILAR_COUNT * SIMILAR_COUNT];
+	int threshold, i, j;
+
+	/* windows of lines sliding further apart, against one far away */
+	for (i = 0; i < SIMILAR_COUNT; ++i) {
+		make_lines(&a[i], i * 1000, 200);
+		make_lines(&b[i], i * 1000 + i * 25, 200);
+	}
+	git_hashsig_free(b[SIMILAR_COUNT - 1]);
+	make_lines(&b[SIMILAR_COUNT - 1], 100000, 200);
+
+	for (threshold = 10; threshold <= 100; threshold += 10) {
+		memset(found, 0, sizeof(found));
+
+		cl_git_pass(git_hashsig_find_similar(
+			(const git_hashsig **)a, SIMILAR_COUNT,
+			(const git_hashsig **)b, SIMILAR_COUNT,
+			threshold, collect_similar_cb, found));
+
+		for (i = 0; i < SIMILAR_COUNT; ++i) {
+			for (j = 0; j < SIMILAR_COUNT; ++j) {
+				int sim = git_hashsig_compare(a[i], b[j]);
+
+				/* each pair at most once, and every one that scores */
+				cl_assert(found[i * SIMILAR_COUNT + j] <= 1);
+				if (sim >= threshold)
+					cl_assert_equal_i(1, found[i * SIMILAR_COUNT + j]);
+
+				/* and none of those with nothing in common */
+				if (i != j || j == SIMILAR_COUNT - 1)
+					cl_assert_equal_i(0, found[i * SIMILAR_COUNT + j]);
+			}
+		}
+	}
+
+	/* no signatures at all leaves nothing to find */
+	cl_git_pass(git_hashsig_find_similar(
+		(const git_hashsig **)a, 0, (const git_hashsig **)b, SIMILAR_COUNT,
+		50, collect_similar_cb, found));
+
+	for (i = 0; i < SIMILAR_COUNT; ++i) {
+		git_hashsig_free(a[i]);
+		git_hashsig_free(b[i]);
+	}
+}
+
 #include "../filter/crlf.h"
 
 #define check_buf(expected,buf) do { \
@@ -0,0 +1,91 @@
+#include "clar_libgit2.h"
+#include "ewah.h"
+
+static void roundtrip(git_bitvec *bv, size_t bit_size, size_t expected_words)
+{
+	git_buf buf = GIT_BUF_INIT;
+	git_bitvec read;
+	size_t i, read_size;
+
+	cl_git_pass(git_ewah_write(&buf, bv, bit_size));
+	cl_assert_equal_sz(12 + 8 * expected_words, buf.size);
+
+	cl_assert_equal_sz(buf.size, git_ewah_read(&read, &read_size, buf.ptr, buf.size));
+	cl_assert_equal_sz(bit_size, read_size);
+
+	for (i = 0; i < bit_size; ++i)
+		cl_assert_equal_b(git_bitvec_get(bv, i), git_bitvec_get(&read, i));
+
+	/* truncated */
+	cl_assert_equal_sz(0, git_ewah_read(&read, &read_size, buf.ptr, buf.size - 1));
+
+	git_bitvec_free(&read);
+	git_buf_free(&buf);
+}
+
+void test_core_ewah__empty(void)
+{
+	git_bitvec bv;
+
+	cl_git_pass(git_bitvec_init(&bv, 0));
+	roundtrip(&bv, 0, 1);
+
+	/* all clear bits are a single run */
+	git_bitvec_free(&bv);
+	cl_git_pass(git_bitvec_init(&bv, 10000));
+	roundtrip(&bv, 10000, 1);
+	git_bitvec_free(&bv);
+}
+
+void test_core_ewah__runs_and_literals(void)
+{
+	git_bitvec bv;
+	size_t i;
+
+	cl_git_pass(git_bitvec_init(&bv, 1000));
+
+	/* a run of set words, a literal word, a run of clear ones, and
+	 * a last word that is only partly used */
+	for (i = 0; i < 256; ++i)
+		git_bitvec_set(&bv, i, true);
+	git_bitvec_set(&bv, 300, true);
+	git_bitvec_set(&bv, 999, true);
+
+	roundtrip(&bv, 1000, 4);
+	git_bitvec_free(&bv);
+}
+
+void test_core_ewah__short(void)
+{
+	git_bitvec bv;
+
+	cl_git_pass(git_bitvec_init(&bv, 6));
+	git_bitvec_set(&bv, 0, true);
+	git_bitvec_set(&bv, 5, true);
+
+	roundtrip(&bv, 6, 2);
+	git_bitvec_free(&bv);
+}
+
+void test_core_ewah__reads_what_git_writes(void)
+{
+	/* the delete bitmap of a split index written by git: bit 3 */
+	static const unsigned char data[] = {
+		0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x02,
+		0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08,
+		0x00, 0x00, 0x00, 0x00
+	};
+	git_bitvec bv;
+	size_t bit_size;
+
+	cl_assert_equal_sz(sizeof(data),
+		git_ewah_read(&bv, &bit_size, (const char *)data, sizeof(data)));
+	cl_assert_equal_sz(4, bit_size);
+
+	cl_assert(!git_bitvec_get(&bv, 0));
+	cl_assert(!git_bitvec_get(&bv, 2));
+	cl_assert(git_bitvec_get(&bv, 3));
+
+	git_bitvec_free(&bv);
+}
@@ -0,0 +1,123 @@
+#include "clar_libgit2.h"
+#include "buffer.h"
+
+static git_repository *g_repo;
+
+void test_describe_describe__initialize(void)
+{
+	git_object *target;
+	git_signature *sig;
+	git_oid id;
+
+	g_repo = cl_git_sandbox_init("testrepo.git");
+
+	cl_git_pass(git_signature_now(&sig, "Describer", "describer@example.com"));
+
+	cl_git_pass(git_revparse_single(&target, g_repo, "5b5b025"));
+	cl_git_pass(git_tag_create(&id, g_repo, "v1", target, sig, "v1\n", 0));
+	git_object_free(target);
+
+	cl_git_pass(git_revparse_single(&target, g_repo, "c47800c"));
+	cl_git_pass(git_tag_create_lightweight(&id, g_repo, "light", target, 0));
+	git_object_free(target);
+
+	git_signature_free(sig);
+}
+
+void test_describe_describe__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void assert_describe(
+	const char *expected,
+	const char *spec,
+	git_describe_options *opts,
+	git_describe_format_options *fmt_opts)
+{
+	git_object *object;
+	git_describe_result *result;
+	git_buf buf = GIT_BUF_INIT;
+
+	cl_git_pass(git_revparse_single(&object, g_repo, spec));
+	cl_git_pass(git_describe_commit(&result, object, opts));
+	cl_git_pass(git_describe_format(&buf, result, fmt_opts));
+
+	cl_assert_equal_s(expected, buf.ptr);
+
+	git_describe_result_free(result);
+	git_object_free(object);
+	git_buf_free(&buf);
+}
+
+/* expected values are the output of git-describe on the same history */
+void test_describe_describe__annotated_tags(void)
+{
+	assert_describe("hard_tag", "a65fedf", NULL, NULL);
+	assert_describe("v1-1-gc47800c", "c47800c", NULL, NULL);
+	assert_describe("v1-2-g9fd738e", "9fd738e", NULL, NULL);
+	assert_describe("v1-2-g763d71a", "763d71a", NULL, NULL);
+	assert_describe("v1-4-gbe3563a", "be3563a", NULL, NULL);
+}
+
+void test_describe_describe__strategies(void)
+{
+	git_describe_options opts = GIT_DESCRIBE_OPTIONS_INIT;
+
+	opts.describe_strategy = GIT_DESCRIBE_TAGS;
+	assert_describe("light", "c47800c", &opts, NULL);
+	assert_describe("light-1-g763d71a", "763d71a", &opts, NULL);
+	assert_describe("light-3-gbe3563a", "be3563a", &opts, NULL);
+
+	opts.describe_strategy = GIT_DESCRIBE_ALL;
+	assert_describe("heads/track-local", "9fd738e", &opts, NULL);
+	assert_describe("tags/hard_tag", "a65fedf", &opts, NULL);
+
+	opts.describe_strategy = GIT_DESCRIBE_DEFAULT;
+	opts.pattern = "hard*";
+	assert_describe("hard_tag", "a65fedf", &opts, NULL);
+}
+
+void test_describe_describe__walk_options(void)
+{
+	git_describe_options opts = GIT_DESCRIBE_OPTIONS_INIT;
+
+	opts.only_follow_first_parent = 1;
+	assert_describe("v1-3-gbe3563a", "be3563a", &opts, NULL);
+
+	opts.only_follow_first_parent = 0;
+	opts.describe_strategy = GIT_DESCRIBE_TAGS;
+	opts.max_candidates_tags = 1;
+	assert_describe("light-1-g763d71a", "763d71a", &opts, NULL);
+	assert_describe("light-3-gbe3563a", "be3563a", &opts, NULL);
+}
+
+void test_describe_describe__format_options(void)
+{
+	git_describe_format_options fmt_opts = GIT_DESCRIBE_FORMAT_OPTIONS_INIT;
+
+	fmt_opts.always_use_long_format = 1;
+	assert_describe("hard_tag-0-ga65fedf", "a65fedf", NULL, &fmt_opts);
+
+	fmt_opts.always_use_long_format = 0;
+	fmt_opts.abbreviated_size = 10;
+	assert_describe("v1-2-g9fd738e8f7", "9fd738e", NULL, &fmt_opts);
+
+	fmt_opts.abbreviated_size = 0;
+	assert_describe("v1", "9fd738e", NULL, &fmt_opts);
+}
+
+void test_describe_describe__nothing_to_describe_with(void)
+{
+	git_describe_options opts = GIT_DESCRIBE_OPTIONS_INIT;
+	git_describe_result *result;
+	git_object *object;
+
+	cl_git_pass(git_revparse_single(&object, g_repo, "6dcf9bf"));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_describe_commit(&result, object, NULL));
+	git_object_free(object);
+
+	opts.show_commit_oid_as_fallback = 1;
+	assert_describe("6dcf9bf", "6dcf9bf", &opts, NULL);
+}
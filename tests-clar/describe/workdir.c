@@ -0,0 +1,59 @@
+#include "clar_libgit2.h"
+#include "buffer.h"
+
+static git_repository *g_repo;
+
+void test_describe_workdir__initialize(void)
+{
+	git_object *head;
+	git_signature *sig;
+	git_oid id;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	cl_git_pass(git_signature_now(&sig, "Describer", "describer@example.com"));
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD"));
+	cl_git_pass(git_reset(g_repo, head, GIT_RESET_HARD));
+	cl_git_pass(git_tag_create(&id, g_repo, "release", head, sig, "rel\n", 0));
+
+	git_object_free(head);
+	git_signature_free(sig);
+}
+
+void test_describe_workdir__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void assert_workdir(const char *expected)
+{
+	git_describe_format_options fmt_opts = GIT_DESCRIBE_FORMAT_OPTIONS_INIT;
+	git_describe_result *result;
+	git_buf buf = GIT_BUF_INIT;
+
+	fmt_opts.dirty_suffix = "-dirty";
+
+	cl_git_pass(git_describe_workdir(&result, g_repo, NULL));
+	cl_git_pass(git_describe_format(&buf, result, &fmt_opts));
+	cl_assert_equal_s(expected, buf.ptr);
+
+	git_describe_result_free(result);
+	git_buf_free(&buf);
+}
+
+void test_describe_workdir__clean(void)
+{
+	assert_workdir("release");
+}
+
+void test_describe_workdir__dirty(void)
+{
+	cl_git_append2file("testrepo/README", "more\n");
+	assert_workdir("release-dirty");
+}
+
+void test_describe_workdir__untracked_files_are_not_dirty(void)
+{
+	cl_git_mkfile("testrepo/untracked.txt", "new\n");
+	assert_workdir("release");
+}
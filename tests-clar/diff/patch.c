@@ -580,3 +580,155 @@ void test_diff_patch__line_counts_with_eofnl(void)
 
 	git_buf_free(&content);
 }
+
+/* a tree of many changed files, and an index that changes them */
+static git_tree *change_many_files(git_index *index, int count)
+{
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_oid tree_id;
+	git_tree *tree;
+	int i, j;
+
+	cl_git_pass(p_mkdir("empty_standard_repo/many", 0777));
+
+	for (i = 0; i < count; ++i) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/many/%03d.txt", i));
+
+		git_buf_clear(&content);
+		for (j = 0; j < 40; ++j)
+			cl_git_pass(git_buf_printf(&content, "file %d, line %d\n", i, j));
+
+		/* some of them are binary */
+		if (i % 11 == 3)
+			cl_git_pass(git_buf_putc(&content, '\0'));
+
+		cl_git_pass(git_futils_writebuffer(&content, path.ptr, 0, 0666));
+		cl_git_pass(git_index_add_bypath(index, path.ptr + strlen("empty_standard_repo/")));
+	}
+
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &tree_id));
+
+	for (i = 0; i < count; ++i) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/many/%03d.txt", i));
+
+		git_buf_clear(&content);
+		for (j = 0; j < 40 - i % 7; ++j) {
+			if (j % 10 == i % 10)
+				cl_git_pass(git_buf_printf(&content, "changed %d\n", j));
+			else
+				cl_git_pass(git_buf_printf(&content, "file %d, line %d\n", i, j));
+		}
+		if (i % 5 == 0)
+			git_buf_rtrim(&content);
+		if (i % 11 == 3)
+			cl_git_pass(git_buf_putc(&content, '\0'));
+
+		if (i % 9 == 0) {
+			cl_must_pass(p_unlink(path.ptr));
+			cl_git_pass(git_index_remove_bypath(index, path.ptr + strlen("empty_standard_repo/")));
+			continue;
+		}
+
+		cl_git_pass(git_futils_writebuffer(&content, path.ptr, 0, 0666));
+		cl_git_pass(git_index_add_bypath(index, path.ptr + strlen("empty_standard_repo/")));
+	}
+
+	git_buf_free(&content);
+	git_buf_free(&path);
+
+	return tree;
+}
+
+static int print_to_buf_cb(
+	const git_diff_delta *delta,
+	const git_diff_range *range,
+	char line_origin,
+	const char *formatted_output,
+	size_t output_len,
+	void *payload)
+{
+	GIT_UNUSED(delta); GIT_UNUSED(range); GIT_UNUSED(line_origin);
+
+	return git_buf_put((git_buf *)payload, formatted_output, output_len);
+}
+
+void test_diff_patch__threads_print_the_same_patch(void)
+{
+	static const unsigned int threads[] = { 1, 0, 2, 5 };
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	git_index *index;
+	git_tree *tree;
+	git_diff_list *diff;
+	size_t t;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	cl_git_pass(git_repository_index(&index, g_repo));
+	tree = change_many_files(index, 200);
+
+	for (t = 0; t < ARRAY_SIZE(threads); ++t) {
+		opts.threads = threads[t];
+		cl_git_pass(git_diff_tree_to_index(&diff, g_repo, tree, index, &opts));
+
+		git_buf_clear(&actual);
+		cl_git_pass(git_diff_print_patch(diff, print_to_buf_cb, &actual));
+		git_diff_list_free(diff);
+
+		if (t == 0)
+			cl_git_pass(git_buf_set(&expected, actual.ptr, actual.size));
+		else
+			cl_assert_equal_s(expected.ptr, actual.ptr);
+	}
+
+	cl_assert(strstr(expected.ptr, "\\ No newline at end of file") != NULL);
+	cl_assert(strstr(expected.ptr, "diff --git a/many/003.txt") != NULL);
+
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+	git_tree_free(tree);
+	git_index_free(index);
+}
+
+static int stop_after_lines_cb(
+	const git_diff_delta *delta,
+	const git_diff_range *range,
+	char line_origin,
+	const char *content,
+	size_t content_len,
+	void *payload)
+{
+	size_t *lines = payload;
+
+	GIT_UNUSED(delta); GIT_UNUSED(range); GIT_UNUSED(line_origin);
+	GIT_UNUSED(content); GIT_UNUSED(content_len);
+
+	return (--*lines == 0);
+}
+
+void test_diff_patch__threads_stop_at_the_failing_callback(void)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_index *index;
+	git_tree *tree;
+	git_diff_list *diff;
+	size_t lines;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	cl_git_pass(git_repository_index(&index, g_repo));
+	tree = change_many_files(index, 200);
+
+	opts.threads = 4;
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, tree, index, &opts));
+
+	lines = 1000;
+	cl_assert_equal_i(GIT_EUSER, git_diff_foreach(
+		diff, NULL, NULL, stop_after_lines_cb, &lines));
+	cl_assert_equal_sz(0, lines);
+
+	git_diff_list_free(diff);
+	git_tree_free(tree);
+	git_index_free(index);
+}
@@ -1,6 +1,7 @@
 #include "clar_libgit2.h"
 #include "diff_helpers.h"
 #include "buf_text.h"
+#include "diff.h"
 
 static git_repository *g_repo = NULL;
 
@@ -1283,3 +1284,213 @@ void test_diff_rename__rewrite_on_single_file(void)
 	git_diff_list_free(diff);
 	git_index_free(index);
 }
+
+/* Rename (and edit) `count` files in "many", which share some lines */
+static void rename_many_files(git_index *index, int count)
+{
+	git_buf path = GIT_BUF_INIT, newpath = GIT_BUF_INIT;
+	git_buf content = GIT_BUF_INIT;
+	int i, j;
+
+	cl_git_pass(p_mkdir("renames/many", 0777));
+
+	for (i = 0; i < count; ++i) {
+		git_buf_clear(&content);
+		for (j = 0; j < 20; ++j)
+			cl_git_pass(git_buf_printf(&content, "file %d, line %d\n", i, j));
+		for (j = 0; j < 10; ++j)
+			cl_git_pass(git_buf_printf(&content, "group %d, line %d\n", i / 3, j));
+
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "renames/many/old%03d.txt", i));
+		cl_git_mkfile(path.ptr, content.ptr);
+		cl_git_pass(git_index_add_bypath(index, path.ptr + strlen("renames/")));
+
+		for (j = 0; j < i % 12; ++j)
+			cl_git_pass(git_buf_puts(&content, "one more line\n"));
+
+		git_buf_clear(&newpath);
+		cl_git_pass(git_buf_printf(&newpath, "renames/many/new%03d.txt", i));
+		cl_git_mkfile(newpath.ptr, content.ptr);
+		cl_git_pass(p_unlink(path.ptr));
+	}
+
+	git_buf_free(&content);
+	git_buf_free(&path);
+	git_buf_free(&newpath);
+}
+
+static git_diff_list *find_many_renames(
+	git_index *index, uint32_t flags, unsigned int threads)
+{
+	git_diff_list *diff = NULL;
+	git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
+	git_diff_find_options findopts = GIT_DIFF_FIND_OPTIONS_INIT;
+	char *pathspec = "many";
+
+	diffopts.flags = GIT_DIFF_INCLUDE_UNTRACKED;
+	diffopts.pathspec.strings = &pathspec;
+	diffopts.pathspec.count = 1;
+
+	findopts.flags = flags | GIT_DIFF_FIND_FOR_UNTRACKED;
+	findopts.threads = threads;
+
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, index, &diffopts));
+	cl_git_pass(git_diff_find_similar(diff, &findopts));
+
+	return diff;
+}
+
+void test_diff_rename__finds_renames_past_the_rename_limit(void)
+{
+	git_index *index;
+	git_diff_list *diff;
+	diff_expects exp;
+
+	/* more renamed and edited files than the default rename limit */
+	cl_git_pass(git_repository_index(&index, g_repo));
+	rename_many_files(index, 300);
+
+	diff = find_many_renames(index, GIT_DIFF_FIND_RENAMES, 0);
+
+	memset(&exp, 0, sizeof(exp));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, &exp));
+	cl_assert_equal_i(300, exp.files);
+	cl_assert_equal_i(300, exp.file_status[GIT_DELTA_RENAMED]);
+
+	git_diff_list_free(diff);
+	git_index_free(index);
+}
+
+static int print_delta_cb(
+	const git_diff_delta *delta, float progress, void *payload)
+{
+	GIT_UNUSED(progress);
+
+	return git_buf_printf((git_buf *)payload, "%d %s %s %u\n",
+		(int)delta->status, delta->old_file.path, delta->new_file.path,
+		delta->similarity);
+}
+
+void test_diff_rename__threads_find_the_same_renames(void)
+{
+	static const uint32_t flags[] = {
+		GIT_DIFF_FIND_RENAMES,
+		GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_COPIES,
+		GIT_DIFF_FIND_COPIES | GIT_DIFF_FIND_COPIES_FROM_UNMODIFIED,
+	};
+	static const unsigned int threads[] = { 0, 2, 7 };
+	git_index *index;
+	git_diff_list *diff;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	size_t f, t;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	rename_many_files(index, 120);
+
+	for (f = 0; f < ARRAY_SIZE(flags); ++f) {
+		git_buf_clear(&expected);
+		diff = find_many_renames(index, flags[f], 1);
+		cl_git_pass(git_diff_foreach(diff, print_delta_cb, NULL, NULL, &expected));
+		git_diff_list_free(diff);
+
+		for (t = 0; t < ARRAY_SIZE(threads); ++t) {
+			git_buf_clear(&actual);
+			diff = find_many_renames(index, flags[f], threads[t]);
+			cl_git_pass(git_diff_foreach(diff, print_delta_cb, NULL, NULL, &actual));
+			git_diff_list_free(diff);
+
+			cl_assert_equal_s(expected.ptr, actual.ptr);
+		}
+	}
+
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+	git_index_free(index);
+}
+
+static int print_to_buf_cb(
+	const git_diff_delta *delta,
+	const git_diff_range *range,
+	char line_origin,
+	const char *formatted_output,
+	size_t output_len,
+	void *payload)
+{
+	GIT_UNUSED(delta); GIT_UNUSED(range); GIT_UNUSED(line_origin);
+
+	return git_buf_put((git_buf *)payload, formatted_output, output_len);
+}
+
+static git_diff_list *find_renames_between(
+	const char *old_sha, const char *new_sha)
+{
+	git_tree *old_tree, *new_tree;
+	git_diff_list *diff;
+	git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+
+	old_tree = resolve_commit_oid_to_tree(g_repo, old_sha);
+	new_tree = resolve_commit_oid_to_tree(g_repo, new_sha);
+
+	cl_git_pass(git_diff_tree_to_tree(
+		&diff, g_repo, old_tree, new_tree, &diffopts));
+
+	opts.flags = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_COPIES;
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+
+	return diff;
+}
+
+void test_diff_rename__patches_reuse_blobs_read_to_find_renames(void)
+{
+	const char *old_sha = "1c068dee5790ef1580cfc4cd670915b48d790084";
+	const char *new_sha = "19dd32dfb1520a64e5bbaae8dce6ef423dfa2f13";
+	git_diff_list *diff;
+	const git_diff_delta *delta;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	git_blob *blob;
+	size_t i;
+
+	/* without the blobs kept from finding renames */
+	diff = find_renames_between(old_sha, new_sha);
+	cl_assert(diff->blobs_size > 0);
+
+	for (i = 0; i < git_diff_num_deltas(diff); ++i) {
+		cl_git_pass(git_diff_get_patch(NULL, &delta, diff, i));
+		git_blob_free(git_diff__take_blob(diff, &delta->old_file.oid));
+		git_blob_free(git_diff__take_blob(diff, &delta->new_file.oid));
+	}
+	cl_assert_equal_sz(0, diff->blobs_size);
+
+	cl_git_pass(git_diff_print_patch(diff, print_to_buf_cb, &expected));
+	git_diff_list_free(diff);
+
+	/* with them, which are used up by the patches */
+	diff = find_renames_between(old_sha, new_sha);
+	cl_assert(diff->blobs_size > 0);
+
+	cl_git_pass(git_diff_print_patch(diff, print_to_buf_cb, &actual));
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+	cl_assert_equal_sz(0, diff->blobs_size);
+	cl_assert_equal_i(0, kh_size(diff->blobs));
+
+	/* a blob is only kept once, and only taken once */
+	cl_git_pass(git_diff_get_patch(NULL, &delta, diff, 0));
+	cl_git_pass(git_blob_lookup(&blob, g_repo, &delta->new_file.oid));
+	git_diff__keep_blob(diff, blob);
+	git_diff__keep_blob(diff, blob);
+	cl_assert_equal_sz((size_t)git_blob_rawsize(blob), diff->blobs_size);
+	git_blob_free(blob);
+
+	cl_assert((blob = git_diff__take_blob(diff, &delta->new_file.oid)) != NULL);
+	cl_assert(git_diff__take_blob(diff, &delta->new_file.oid) == NULL);
+	git_blob_free(blob);
+
+	git_diff_list_free(diff);
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+}
@@ -0,0 +1,138 @@
+#include "clar_libgit2.h"
+#include "diff_helpers.h"
+#include "diff.h"
+
+static git_repository *g_repo = NULL;
+static git_diff_options opts;
+static git_diff_list *diff;
+static git_diff_stats *stats;
+
+void test_diff_stats__initialize(void)
+{
+	GIT_INIT_STRUCTURE(&opts, GIT_DIFF_OPTIONS_VERSION);
+
+	g_repo = cl_git_sandbox_init("attr");
+
+	diff = NULL;
+	stats = NULL;
+}
+
+void test_diff_stats__cleanup(void)
+{
+	git_diff_stats_free(stats);
+	git_diff_list_free(diff);
+
+	cl_git_sandbox_cleanup();
+}
+
+static void diff_trees(const char *a_commit, const char *b_commit)
+{
+	git_tree *a, *b;
+
+	cl_assert((a = resolve_commit_oid_to_tree(g_repo, a_commit)) != NULL);
+	cl_assert((b = resolve_commit_oid_to_tree(g_repo, b_commit)) != NULL);
+
+	git_diff_list_free(diff);
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, a, b, &opts));
+
+	git_tree_free(a);
+	git_tree_free(b);
+}
+
+/* The stats must add up to what the patches of each delta say */
+static void assert_stats_match_patches(void)
+{
+	git_diff_patch *patch;
+	const git_diff_delta *delta;
+	size_t i, adds, dels, stat_adds, stat_dels;
+	size_t files = 0, total_adds = 0, total_dels = 0;
+
+	for (i = 0; i < git_diff_num_deltas(diff); ++i) {
+		cl_git_pass(git_diff_get_patch(&patch, &delta, diff, i));
+		cl_git_pass(git_diff_stats_delta(&stat_adds, &stat_dels, stats, i));
+
+		adds = dels = 0;
+		if (patch != NULL) {
+			cl_git_pass(git_diff_patch_line_stats(NULL, &adds, &dels, patch));
+			git_diff_patch_free(patch);
+		}
+
+		cl_assert_equal_sz(adds, stat_adds);
+		cl_assert_equal_sz(dels, stat_dels);
+
+		if (!git_diff_delta__should_skip(&opts, delta))
+			files++;
+		total_adds += adds;
+		total_dels += dels;
+	}
+
+	cl_assert_equal_sz(files, git_diff_stats_files_changed(stats));
+	cl_assert_equal_sz(total_adds, git_diff_stats_insertions(stats));
+	cl_assert_equal_sz(total_dels, git_diff_stats_deletions(stats));
+}
+
+void test_diff_stats__counts_lines_between_trees(void)
+{
+	diff_trees("6bab5c7", "8d0b9df");
+
+	cl_git_pass(git_diff_get_stats(&stats, diff));
+
+	cl_assert_equal_sz(16, git_diff_stats_files_changed(stats));
+	cl_assert_equal_sz(148, git_diff_stats_insertions(stats));
+	cl_assert_equal_sz(8, git_diff_stats_deletions(stats));
+
+	assert_stats_match_patches();
+}
+
+void test_diff_stats__match_patches_on_any_number_of_threads(void)
+{
+	static const char *commits[] = {
+		"6bab5c7", "605812a", "370fe9e", "f5b0af1", "a97cc01", "8d0b9df"
+	};
+	static const unsigned int threads[] = { 1, 0, 2, 5 };
+	size_t i, j, t;
+
+	opts.flags = GIT_DIFF_IGNORE_WHITESPACE_CHANGE;
+
+	for (t = 0; t < ARRAY_SIZE(threads); ++t) {
+		opts.threads = threads[t];
+
+		for (i = 0; i < ARRAY_SIZE(commits); ++i) {
+			for (j = 0; j < ARRAY_SIZE(commits); ++j) {
+				diff_trees(commits[i], commits[j]);
+
+				git_diff_stats_free(stats);
+				cl_git_pass(git_diff_get_stats(&stats, diff));
+
+				assert_stats_match_patches();
+			}
+		}
+	}
+}
+
+void test_diff_stats__counts_lines_in_the_workdir(void)
+{
+	opts.flags = GIT_DIFF_INCLUDE_UNTRACKED |
+		GIT_DIFF_INCLUDE_UNTRACKED_CONTENT | GIT_DIFF_INCLUDE_UNMODIFIED;
+
+	cl_git_append2file("attr/root_test3", "one more\nand another\n");
+
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, NULL, &opts));
+	cl_git_pass(git_diff_get_stats(&stats, diff));
+
+	cl_assert(git_diff_stats_insertions(stats) > 2);
+	assert_stats_match_patches();
+}
+
+void test_diff_stats__delta_out_of_range(void)
+{
+	size_t adds, dels;
+
+	diff_trees("605812a", "370fe9e");
+	cl_git_pass(git_diff_get_stats(&stats, diff));
+
+	cl_git_pass(git_diff_stats_delta(
+		&adds, &dels, stats, git_diff_num_deltas(diff) - 1));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_diff_stats_delta(
+		&adds, &dels, stats, git_diff_num_deltas(diff)));
+}
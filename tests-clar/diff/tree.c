@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "diff_helpers.h"
+#include "posix.h"
 
 static git_repository *g_repo = NULL;
 static git_diff_options opts;
@@ -528,3 +529,94 @@ void test_diff_tree__diff_configs(void)
 	cl_assert_equal_i(7, expect.line_adds);
 	cl_assert_equal_i(15, expect.line_dels);
 }
+
+static void build_tree(
+	git_oid *out, const char *name_a, const git_oid *oid_a, git_filemode_t mode_a,
+	const char *name_b, const git_oid *oid_b, git_filemode_t mode_b)
+{
+	git_treebuilder *bld;
+
+	cl_git_pass(git_treebuilder_create(&bld, NULL));
+	if (name_a)
+		cl_git_pass(git_treebuilder_insert(NULL, bld, name_a, oid_a, mode_a));
+	if (name_b)
+		cl_git_pass(git_treebuilder_insert(NULL, bld, name_b, oid_b, mode_b));
+	cl_git_pass(git_treebuilder_write(out, g_repo, bld));
+	git_treebuilder_free(bld);
+}
+
+void test_diff_tree__skips_subtrees_which_did_not_change(void)
+{
+	git_oid one, two, subtree, a_oid, b_oid;
+	git_buf path = GIT_BUF_INIT;
+	char hex[GIT_OID_HEXSZ + 1];
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+
+	cl_git_pass(git_blob_create_frombuffer(&one, g_repo, "one\n", 4));
+	cl_git_pass(git_blob_create_frombuffer(&two, g_repo, "two\n", 4));
+
+	build_tree(&subtree, "file", &one, GIT_FILEMODE_BLOB, NULL, NULL, 0);
+	build_tree(&a_oid, "dir", &subtree, GIT_FILEMODE_TREE,
+		"file", &one, GIT_FILEMODE_BLOB);
+	build_tree(&b_oid, "dir", &subtree, GIT_FILEMODE_TREE,
+		"file", &two, GIT_FILEMODE_BLOB);
+
+	cl_git_pass(git_tree_lookup(&a, g_repo, &a_oid));
+	cl_git_pass(git_tree_lookup(&b, g_repo, &b_oid));
+
+	/* the subtree they share is not even read */
+	git_oid_fmt(hex, &subtree);
+	hex[GIT_OID_HEXSZ] = '\0';
+	cl_git_pass(git_buf_printf(&path,
+		"empty_standard_repo/.git/objects/%.2s/%s", hex, hex + 2));
+	cl_must_pass(p_unlink(path.ptr));
+	git_buf_free(&path);
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, a, b, &opts));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, &expect));
+
+	cl_assert_equal_i(1, expect.files);
+	cl_assert_equal_i(1, expect.file_status[GIT_DELTA_MODIFIED]);
+
+	/* unless every file is asked for */
+	git_diff_list_free(diff);
+	diff = NULL;
+
+	opts.flags |= GIT_DIFF_INCLUDE_UNMODIFIED;
+	cl_git_fail(git_diff_tree_to_tree(&diff, g_repo, a, b, &opts));
+}
+
+void test_diff_tree__steps_into_subtrees_which_changed(void)
+{
+	git_oid one, two, empty, sub_a, sub_b, a_oid, b_oid;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+
+	cl_git_pass(git_blob_create_frombuffer(&one, g_repo, "one\n", 4));
+	cl_git_pass(git_blob_create_frombuffer(&two, g_repo, "two\n", 4));
+
+	build_tree(&empty, NULL, NULL, 0, NULL, NULL, 0);
+	build_tree(&sub_a, "file", &one, GIT_FILEMODE_BLOB,
+		"gone", &one, GIT_FILEMODE_BLOB);
+	build_tree(&sub_b, "file", &two, GIT_FILEMODE_BLOB,
+		"empty", &empty, GIT_FILEMODE_TREE);
+
+	/* "dir" changes, "x" goes from a file to an (empty) tree */
+	build_tree(&a_oid, "dir", &sub_a, GIT_FILEMODE_TREE,
+		"x", &one, GIT_FILEMODE_BLOB);
+	build_tree(&b_oid, "dir", &sub_b, GIT_FILEMODE_TREE,
+		"x", &sub_a, GIT_FILEMODE_TREE);
+
+	cl_git_pass(git_tree_lookup(&a, g_repo, &a_oid));
+	cl_git_pass(git_tree_lookup(&b, g_repo, &b_oid));
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, a, b, &opts));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, &expect));
+
+	/* dir/file modified, dir/gone and x deleted, x/file and x/gone added */
+	cl_assert_equal_i(5, expect.files);
+	cl_assert_equal_i(1, expect.file_status[GIT_DELTA_MODIFIED]);
+	cl_assert_equal_i(2, expect.file_status[GIT_DELTA_DELETED]);
+	cl_assert_equal_i(2, expect.file_status[GIT_DELTA_ADDED]);
+}
@@ -328,8 +328,10 @@ void test_filter_custom__order_dependency(void)
 void test_filter_custom__filter_registry_failure_cases(void)
 {
 	git_filter fake = { GIT_FILTER_VERSION, 0 };
+	git_filter future = { GIT_FILTER_VERSION + 1, 0 };
 
 	cl_assert_equal_i(GIT_EEXISTS, git_filter_register("bitflip", &fake, 0));
+	cl_git_fail(git_filter_register("future", &future, 0));
 
 	cl_git_fail(git_filter_unregister(GIT_FILTER_CRLF));
 	cl_git_fail(git_filter_unregister(GIT_FILTER_IDENT));
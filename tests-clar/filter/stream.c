@@ -0,0 +1,417 @@
+#include "clar_libgit2.h"
+#include "posix.h"
+#include "fileops.h"
+#include "git2/sys/filter.h"
+
+#define STREAMFLIP_FILTER_PRIORITY GIT_FILTER_DRIVER_PRIORITY
+
+#define BIG_FILE_SIZE (1024 * 1024 + 123)
+#define CHUNK_LIMIT (64 * 1024)
+
+static git_repository *g_repo = NULL;
+
+/* what the filter has been handed so far */
+static size_t g_writes, g_largest_write;
+
+static void register_streamflip_filter(void);
+static void register_streamfail_filter(void);
+static void register_oldflip_filter(void);
+
+void test_filter_stream__initialize(void)
+{
+	register_streamflip_filter();
+	register_streamfail_filter();
+	register_oldflip_filter();
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+
+	cl_git_mkfile(
+		"empty_standard_repo/.gitattributes",
+		"*.flip streamflip\n"
+		"*.crlf streamflip text eol=crlf\n"
+		"*.fail streamfail\n"
+		"*.old oldflip\n");
+
+	g_writes = g_largest_write = 0;
+}
+
+void test_filter_stream__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+	g_repo = NULL;
+}
+
+typedef struct {
+	git_writestream parent;
+	git_writestream *next;
+} streamflip_stream;
+
+static int streamflip_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	streamflip_stream *stream = (streamflip_stream *)s;
+	char *flipped;
+	size_t i;
+	int error;
+
+	g_writes++;
+	if (len > g_largest_write)
+		g_largest_write = len;
+
+	flipped = git__malloc(len);
+	cl_assert(flipped);
+
+	for (i = 0; i < len; i++)
+		flipped[i] = buffer[i] ^ 0xff;
+
+	error = stream->next->write(stream->next, flipped, len);
+
+	git__free(flipped);
+	return error;
+}
+
+static int streamflip_stream_close(git_writestream *s)
+{
+	streamflip_stream *stream = (streamflip_stream *)s;
+	return stream->next->close(stream->next);
+}
+
+static void streamflip_stream_free(git_writestream *s)
+{
+	git__free(s);
+}
+
+static int streamflip_filter_stream(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next)
+{
+	streamflip_stream *stream;
+
+	GIT_UNUSED(self); GIT_UNUSED(payload); GIT_UNUSED(src);
+
+	stream = git__calloc(1, sizeof(streamflip_stream));
+	cl_assert(stream);
+
+	stream->parent.write = streamflip_stream_write;
+	stream->parent.close = streamflip_stream_close;
+	stream->parent.free = streamflip_stream_free;
+	stream->next = next;
+
+	*out = (git_writestream *)stream;
+	return 0;
+}
+
+static void streamflip_filter_free(git_filter *f)
+{
+	git__free(f);
+}
+
+static void register_streamflip_filter(void)
+{
+	static int filter_registered = 0;
+	git_filter *filter;
+
+	if (filter_registered)
+		return;
+
+	/* no `apply` at all, so nothing can fall back to buffering it */
+	filter = git__calloc(1, sizeof(git_filter));
+	cl_assert(filter);
+
+	filter->version = GIT_FILTER_VERSION;
+	filter->attributes = "+streamflip";
+	filter->shutdown = streamflip_filter_free;
+	filter->stream = streamflip_filter_stream;
+
+	cl_git_pass(git_filter_register(
+		"streamflip", filter, STREAMFLIP_FILTER_PRIORITY));
+
+	filter_registered = 1;
+}
+
+/* passes the first chunk on, then fails */
+static int streamfail_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	streamflip_stream *stream = (streamflip_stream *)s;
+
+	if (g_writes++ > 0) {
+		giterr_set(GITERR_FILTER, "streamfail failed");
+		return -1;
+	}
+
+	return stream->next->write(stream->next, buffer, len);
+}
+
+static int streamfail_filter_stream(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next)
+{
+	cl_git_pass(streamflip_filter_stream(out, self, payload, src, next));
+	(*out)->write = streamfail_stream_write;
+	return 0;
+}
+
+static void register_streamfail_filter(void)
+{
+	static int filter_registered = 0;
+	git_filter *filter;
+
+	if (filter_registered)
+		return;
+
+	filter = git__calloc(1, sizeof(git_filter));
+	cl_assert(filter);
+
+	filter->version = GIT_FILTER_VERSION;
+	filter->attributes = "+streamfail";
+	filter->shutdown = streamflip_filter_free;
+	filter->stream = streamfail_filter_stream;
+
+	cl_git_pass(git_filter_register(
+		"streamfail", filter, STREAMFLIP_FILTER_PRIORITY));
+
+	filter_registered = 1;
+}
+
+static int oldflip_filter_apply(
+	git_filter *self,
+	void **payload,
+	git_buf *to,
+	const git_buf *from,
+	const git_filter_source *src)
+{
+	size_t i;
+
+	GIT_UNUSED(self); GIT_UNUSED(payload); GIT_UNUSED(src);
+
+	cl_git_pass(git_buf_set(to, from->ptr, from->size));
+	for (i = 0; i < to->size; i++)
+		to->ptr[i] ^= 0xff;
+
+	return 0;
+}
+
+static int oldflip_filter_stream(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next)
+{
+	GIT_UNUSED(out); GIT_UNUSED(self); GIT_UNUSED(payload);
+	GIT_UNUSED(src); GIT_UNUSED(next);
+
+	cl_fail("a version 1 filter has no stream callback");
+	return -1;
+}
+
+static void register_oldflip_filter(void)
+{
+	static int filter_registered = 0;
+	git_filter *filter;
+
+	if (filter_registered)
+		return;
+
+	/* what a filter written before `stream` came along would leave
+	 * there is not to be called */
+	filter = git__calloc(1, sizeof(git_filter));
+	cl_assert(filter);
+
+	filter->version = 1;
+	filter->attributes = "+oldflip";
+	filter->shutdown = streamflip_filter_free;
+	filter->apply = oldflip_filter_apply;
+	filter->stream = oldflip_filter_stream;
+
+	cl_git_pass(git_filter_register(
+		"oldflip", filter, STREAMFLIP_FILTER_PRIORITY));
+
+	filter_registered = 1;
+}
+
+static void big_content(git_buf *out, bool flipped)
+{
+	size_t i;
+
+	git_buf_clear(out);
+	cl_git_pass(git_buf_grow(out, BIG_FILE_SIZE));
+
+	for (i = 0; i < BIG_FILE_SIZE; i++)
+		out->ptr[i] = (char)((i % 251) ^ (flipped ? 0xff : 0));
+
+	out->size = BIG_FILE_SIZE;
+	out->ptr[out->size] = '\0';
+}
+
+static void assert_streamed_in_chunks(void)
+{
+	cl_assert(g_writes >= BIG_FILE_SIZE / CHUNK_LIMIT);
+	cl_assert(g_largest_write <= CHUNK_LIMIT);
+}
+
+void test_filter_stream__blobs_are_created_a_chunk_at_a_time(void)
+{
+	git_buf content = GIT_BUF_INIT;
+	git_oid blob_id, hashed_id;
+	git_blob *blob;
+
+	big_content(&content, false);
+	cl_git_pass(git_futils_writebuffer(
+		&content, "empty_standard_repo/big.flip", 0, 0));
+
+	cl_git_pass(git_blob_create_fromworkdir(&blob_id, g_repo, "big.flip"));
+	assert_streamed_in_chunks();
+
+	big_content(&content, true);
+	cl_git_pass(git_blob_lookup(&blob, g_repo, &blob_id));
+	cl_assert_equal_sz(content.size, (size_t)git_blob_rawsize(blob));
+	cl_assert(!memcmp(content.ptr, git_blob_rawcontent(blob), content.size));
+	git_blob_free(blob);
+
+	g_writes = g_largest_write = 0;
+
+	cl_git_pass(git_repository_hashfile(
+		&hashed_id, g_repo, "big.flip", GIT_OBJ_BLOB, NULL));
+	cl_assert(git_oid_equal(&blob_id, &hashed_id));
+	assert_streamed_in_chunks();
+
+	git_buf_free(&content);
+}
+
+void test_filter_stream__checkout_writes_a_chunk_at_a_time(void)
+{
+	git_checkout_opts opts = GIT_CHECKOUT_OPTS_INIT;
+	git_buf content = GIT_BUF_INIT, written = GIT_BUF_INIT;
+	git_index *index;
+
+	big_content(&content, false);
+	cl_git_pass(git_futils_writebuffer(
+		&content, "empty_standard_repo/big.flip", 0, 0));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_bypath(index, "big.flip"));
+	cl_git_pass(git_index_write(index));
+
+	cl_must_pass(p_unlink("empty_standard_repo/big.flip"));
+	g_writes = g_largest_write = 0;
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_index(g_repo, index, &opts));
+	assert_streamed_in_chunks();
+
+	cl_git_pass(git_futils_readbuffer(&written, "empty_standard_repo/big.flip"));
+	cl_assert_equal_sz(content.size, written.size);
+	cl_assert(!memcmp(content.ptr, written.ptr, content.size));
+
+	git_index_free(index);
+	git_buf_free(&written);
+	git_buf_free(&content);
+}
+
+void test_filter_stream__streams_follow_filters_which_only_apply(void)
+{
+	git_filter_list *fl;
+	git_buf in = GIT_BUF_INIT_CONST("one\ntwo\n", 8);
+	git_buf out = GIT_BUF_INIT, back = GIT_BUF_INIT;
+	size_t i;
+
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "file.crlf", GIT_FILTER_TO_WORKTREE));
+	cl_assert_equal_sz(2, git_filter_list_length(fl));
+
+	/* crlf is applied first going to the workdir */
+	cl_git_pass(git_filter_list_apply_to_data(&out, fl, &in));
+	cl_assert_equal_sz(10, out.size);
+	for (i = 0; i < out.size; i++)
+		out.ptr[i] ^= 0xff;
+	cl_assert_equal_s("one\r\ntwo\r\n", out.ptr);
+
+	git_filter_list_free(fl);
+
+	/* and last going to the odb */
+	for (i = 0; i < out.size; i++)
+		out.ptr[i] ^= 0xff;
+
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "file.crlf", GIT_FILTER_TO_ODB));
+	cl_git_pass(git_filter_list_apply_to_data(&back, fl, &out));
+	cl_assert_equal_s("one\ntwo\n", back.ptr);
+
+	git_filter_list_free(fl);
+	git_buf_free(&out);
+	git_buf_free(&back);
+}
+
+static int count_files_cb(void *payload, git_buf *path)
+{
+	GIT_UNUSED(path);
+	(*(size_t *)payload)++;
+	return 0;
+}
+
+void test_filter_stream__checkout_leaves_the_file_alone_when_a_filter_fails(void)
+{
+	git_checkout_opts opts = GIT_CHECKOUT_OPTS_INIT;
+	git_buf content = GIT_BUF_INIT, written = GIT_BUF_INIT;
+	git_index_entry entry;
+	git_buf dir = GIT_BUF_INIT;
+	git_index *index;
+	size_t files = 0;
+
+	/* put the blob in without going through the filter */
+	big_content(&content, false);
+	memset(&entry, 0x0, sizeof(entry));
+	entry.path = "big.fail";
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_blob_create_frombuffer(
+		&entry.oid, g_repo, content.ptr, content.size));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add(index, &entry));
+	cl_git_pass(git_index_write(index));
+
+	cl_git_mkfile("empty_standard_repo/big.fail", "precious\n");
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_fail(git_checkout_index(g_repo, index, &opts));
+	cl_assert(g_writes > 1);
+
+	cl_git_pass(git_futils_readbuffer(&written, "empty_standard_repo/big.fail"));
+	cl_assert_equal_s("precious\n", written.ptr);
+
+	/* and no temporary file is left behind */
+	cl_git_pass(git_buf_sets(&dir, "empty_standard_repo"));
+	cl_git_pass(git_path_direach(&dir, 0, count_files_cb, &files));
+	cl_assert_equal_sz(3, files); /* .git, .gitattributes and big.fail */
+
+	git_buf_free(&dir);
+	git_index_free(index);
+	git_buf_free(&written);
+	git_buf_free(&content);
+}
+
+void test_filter_stream__version_1_filters_are_applied_in_full(void)
+{
+	git_filter_list *fl;
+	git_buf in = GIT_BUF_INIT_CONST("one\ntwo\n", 8);
+	git_buf out = GIT_BUF_INIT;
+
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "file.old", GIT_FILTER_TO_WORKTREE));
+	cl_assert_equal_sz(1, git_filter_list_length(fl));
+
+	cl_git_pass(git_filter_list_apply_to_data(&out, fl, &in));
+	cl_assert_equal_sz(8, out.size);
+	cl_assert_equal_i('o' ^ 0xff, (unsigned char)out.ptr[0]);
+
+	git_filter_list_free(fl);
+	git_buf_free(&out);
+}
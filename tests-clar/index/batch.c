@@ -0,0 +1,190 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "posix.h"
+#include "git2/sys/index.h"
+
+static git_repository *repo;
+static git_index *repo_index;
+
+#define TEST_INDEX_PATH "mergedrepo/.git/index"
+
+#define TEST_OID "f00ff00ff00ff00ff00ff00ff00ff00ff00ff00f"
+#define OTHER_TEST_OID "b44bb44bb44bb44bb44bb44bb44bb44bb44bb44b"
+
+void test_index_batch__initialize(void)
+{
+	repo = cl_git_sandbox_init("mergedrepo");
+	cl_git_pass(git_repository_index(&repo_index, repo));
+}
+
+void test_index_batch__cleanup(void)
+{
+	git_index_free(repo_index);
+	repo_index = NULL;
+
+	cl_git_sandbox_cleanup();
+}
+
+static void make_entry(git_index_entry *entry, const char *path, const char *oid)
+{
+	memset(entry, 0x0, sizeof(git_index_entry));
+	entry->path = (char *)path;
+	entry->mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(&entry->oid, oid));
+}
+
+static void assert_same_entries(git_index *a, git_index *b)
+{
+	size_t i;
+
+	cl_assert_equal_sz(git_index_entrycount(a), git_index_entrycount(b));
+
+	for (i = 0; i < git_index_entrycount(a); ++i) {
+		const git_index_entry *entry_a = git_index_get_byindex(a, i);
+		const git_index_entry *entry_b = git_index_get_byindex(b, i);
+
+		cl_assert_equal_s(entry_a->path, entry_b->path);
+		cl_assert(git_oid_equal(&entry_a->oid, &entry_b->oid));
+		cl_assert_equal_i(entry_a->flags, entry_b->flags);
+		cl_assert_equal_i(entry_a->mode, entry_b->mode);
+	}
+}
+
+void test_index_batch__applies_changes_like_one_at_a_time(void)
+{
+	git_index *other;
+	git_index_batch *batch;
+	git_index_entry entry;
+	char path[32];
+	int i;
+
+	cl_git_pass(git_index_open(&other, TEST_INDEX_PATH));
+	cl_git_pass(git_index_batch_new(&batch, repo_index));
+
+	/* in no particular order */
+	for (i = 499; i >= 0; --i) {
+		p_snprintf(path, sizeof(path), "dir%03d/file", (i * 7) % 500);
+		make_entry(&entry, path, TEST_OID);
+
+		cl_git_pass(git_index_batch_add(batch, &entry));
+		cl_git_pass(git_index_add(other, &entry));
+	}
+
+	make_entry(&entry, "two.txt", OTHER_TEST_OID);
+	cl_git_pass(git_index_batch_add(batch, &entry));
+	cl_git_pass(git_index_add(other, &entry));
+
+	cl_git_pass(git_index_batch_remove(batch, "one.txt", 0));
+	cl_git_pass(git_index_remove(other, "one.txt", 0));
+
+	cl_git_pass(git_index_batch_remove(batch, "conflicts-two.txt", 2));
+	cl_git_pass(git_index_remove(other, "conflicts-two.txt", 2));
+
+	/* nothing happens until the batch is applied */
+	cl_assert_equal_sz(8, git_index_entrycount(repo_index));
+	cl_git_pass(git_index_batch_apply(batch));
+
+	cl_assert(repo_index->entries.sorted);
+	cl_assert_equal_sz(506, git_index_entrycount(repo_index));
+	assert_same_entries(other, repo_index);
+
+	git_index_batch_free(batch);
+	git_index_free(other);
+}
+
+void test_index_batch__last_change_wins(void)
+{
+	git_index_batch *batch;
+	git_index_entry entry;
+	const git_index_entry *found;
+
+	cl_git_pass(git_index_batch_new(&batch, repo_index));
+
+	make_entry(&entry, "new.txt", TEST_OID);
+	cl_git_pass(git_index_batch_add(batch, &entry));
+	cl_git_pass(git_index_batch_remove(batch, "new.txt", 0));
+
+	cl_git_pass(git_index_batch_remove(batch, "one.txt", 0));
+	make_entry(&entry, "one.txt", TEST_OID);
+	cl_git_pass(git_index_batch_add(batch, &entry));
+	make_entry(&entry, "one.txt", OTHER_TEST_OID);
+	cl_git_pass(git_index_batch_add(batch, &entry));
+
+	/* removing what is not there is no error */
+	cl_git_pass(git_index_batch_remove(batch, "missing.txt", 0));
+
+	cl_git_pass(git_index_batch_apply(batch));
+
+	cl_assert_equal_sz(8, git_index_entrycount(repo_index));
+	cl_assert(git_index_get_bypath(repo_index, "new.txt", 0) == NULL);
+
+	cl_assert((found = git_index_get_bypath(repo_index, "one.txt", 0)) != NULL);
+	cl_assert(git_oid_streq(&found->oid, OTHER_TEST_OID) == 0);
+
+	/* the batch is empty once applied */
+	cl_git_pass(git_index_batch_apply(batch));
+	cl_assert_equal_sz(8, git_index_entrycount(repo_index));
+
+	git_index_batch_free(batch);
+}
+
+void test_index_batch__moves_conflicts_to_reuc(void)
+{
+	git_index_batch *batch;
+	size_t reuc_count = git_index_reuc_entrycount(repo_index);
+
+	cl_git_pass(git_index_batch_new(&batch, repo_index));
+
+	cl_git_mkfile("./mergedrepo/conflicts-one.txt", "new-file\n");
+	cl_git_pass(git_index_batch_add_bypath(batch, "conflicts-one.txt"));
+
+	cl_git_pass(p_unlink("./mergedrepo/conflicts-two.txt"));
+	cl_git_pass(git_index_batch_remove_bypath(batch, "conflicts-two.txt"));
+
+	cl_git_pass(git_index_batch_apply(batch));
+
+	cl_assert_equal_sz(3, git_index_entrycount(repo_index));
+	cl_assert_equal_i(0, git_index_has_conflicts(repo_index));
+	cl_assert(git_index_get_bypath(repo_index, "conflicts-one.txt", 0) != NULL);
+	cl_assert(git_index_get_bypath(repo_index, "conflicts-two.txt", 0) == NULL);
+
+	cl_assert_equal_sz(reuc_count + 2, git_index_reuc_entrycount(repo_index));
+	cl_assert(git_index_reuc_get_bypath(repo_index, "conflicts-one.txt") != NULL);
+	cl_assert(git_index_reuc_get_bypath(repo_index, "conflicts-two.txt") != NULL);
+
+	git_index_batch_free(batch);
+}
+
+void test_index_batch__invalidates_the_tree_cache(void)
+{
+	git_index_batch *batch;
+	git_index_entry entry;
+	git_object *head;
+	git_tree *tree;
+	git_tree_entry *found;
+	git_oid blob_id, tree_id;
+
+	cl_git_pass(git_revparse_single(&head, repo, "HEAD^{tree}"));
+	cl_git_pass(git_index_read_tree(repo_index, (git_tree *)head));
+	cl_assert(repo_index->tree->entries >= 0);
+
+	cl_git_pass(git_blob_create_frombuffer(&blob_id, repo, "new\n", 4));
+
+	cl_git_pass(git_index_batch_new(&batch, repo_index));
+	make_entry(&entry, "dir/new.txt", TEST_OID);
+	entry.oid = blob_id;
+	cl_git_pass(git_index_batch_add(batch, &entry));
+	cl_git_pass(git_index_batch_apply(batch));
+
+	cl_assert_equal_i(-1, repo_index->tree->entries);
+
+	cl_git_pass(git_index_write_tree(&tree_id, repo_index));
+	cl_git_pass(git_tree_lookup(&tree, repo, &tree_id));
+	cl_git_pass(git_tree_entry_bypath(&found, tree, "dir/new.txt"));
+	cl_assert(git_oid_equal(&blob_id, git_tree_entry_id(found)));
+
+	git_tree_entry_free(found);
+	git_tree_free(tree);
+	git_object_free(head);
+	git_index_batch_free(batch);
+}
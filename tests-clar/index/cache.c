@@ -0,0 +1,284 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "tree-cache.h"
+
+static git_repository *g_repo;
+static git_index *g_index;
+
+#define README_ID "a8233120f6ad708f843d861ce2b7228ec4e3dec6"
+#define BRANCH_FILE_ID "3697d64be941a53d4ae8f6a271e4e3fa56b022cc"
+
+void test_index_cache__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("testrepo.git");
+
+	cl_git_pass(git_index_new(&g_index));
+}
+
+void test_index_cache__cleanup(void)
+{
+	git_index_free(g_index);
+	g_index = NULL;
+
+	cl_git_sandbox_cleanup();
+	p_unlink("index_tree");
+}
+
+static void add_entry(git_index *index, const char *path, const char *id)
+{
+	git_index_entry entry;
+
+	memset(&entry, 0x0, sizeof(entry));
+	entry.path = (char *)path;
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(&entry.oid, id));
+
+	cl_git_pass(git_index_add(index, &entry));
+}
+
+static void add_entries(git_index *index)
+{
+	add_entry(index, "README", README_ID);
+	add_entry(index, "a.txt", README_ID);
+	add_entry(index, "a/file", README_ID);
+	add_entry(index, "a/b/file", README_ID);
+	add_entry(index, "a/c/file", README_ID);
+	add_entry(index, "d/file", README_ID);
+}
+
+static bool cache_is_valid(git_index *index, const char *path)
+{
+	const git_tree_cache *cache = *path ?
+		git_tree_cache_get(index->tree, path) : index->tree;
+
+	cl_assert(cache != NULL);
+	return cache->entries >= 0;
+}
+
+/* the tree that an index without a cache gives for the same entries */
+static void assert_fresh_tree(git_index *index, const git_oid *expected)
+{
+	git_index *fresh;
+	git_oid id;
+	size_t i;
+
+	cl_git_pass(git_index_new(&fresh));
+
+	for (i = 0; i < git_index_entrycount(index); ++i)
+		cl_git_pass(git_index_add(fresh, git_index_get_byindex(index, i)));
+
+	cl_git_pass(git_index_write_tree_to(&id, fresh, g_repo));
+	cl_assert(git_oid_equal(expected, &id));
+
+	git_index_free(fresh);
+}
+
+static void assert_cache_matches_tree(git_index *index, const char *path)
+{
+	git_tree *tree;
+	git_tree_entry *entry;
+	const git_tree_cache *cache;
+
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &index->tree->oid));
+	cl_git_pass(git_tree_entry_bypath(&entry, tree, path));
+	cl_assert((cache = git_tree_cache_get(index->tree, path)) != NULL);
+
+	cl_assert(cache->entries >= 0);
+	cl_assert(git_oid_equal(&cache->oid, git_tree_entry_id(entry)));
+
+	git_tree_entry_free(entry);
+	git_tree_free(tree);
+}
+
+void test_index_cache__write_tree_fills_in_the_cache(void)
+{
+	git_oid id;
+
+	add_entries(g_index);
+	cl_assert(g_index->tree == NULL);
+
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+
+	cl_assert(git_oid_equal(&id, &g_index->tree->oid));
+	cl_assert_equal_i(6, (int)g_index->tree->entries);
+
+	assert_cache_matches_tree(g_index, "a");
+	assert_cache_matches_tree(g_index, "a/b");
+	assert_cache_matches_tree(g_index, "a/c");
+	assert_cache_matches_tree(g_index, "d");
+	cl_assert_equal_i(3, (int)git_tree_cache_get(g_index->tree, "a")->entries);
+}
+
+void test_index_cache__only_changed_trees_are_written_again(void)
+{
+	git_oid id, before;
+
+	add_entries(g_index);
+	cl_git_pass(git_index_write_tree_to(&before, g_index, g_repo));
+
+	add_entry(g_index, "a/b/file", BRANCH_FILE_ID);
+
+	cl_assert(!cache_is_valid(g_index, ""));
+	cl_assert(!cache_is_valid(g_index, "a"));
+	cl_assert(!cache_is_valid(g_index, "a/b"));
+	cl_assert(cache_is_valid(g_index, "a/c"));
+	cl_assert(cache_is_valid(g_index, "d"));
+
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+	cl_assert(!git_oid_equal(&id, &before));
+	assert_fresh_tree(g_index, &id);
+
+	cl_assert(cache_is_valid(g_index, ""));
+	assert_cache_matches_tree(g_index, "a/b");
+}
+
+void test_index_cache__new_and_removed_trees(void)
+{
+	git_oid id;
+
+	add_entries(g_index);
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+
+	cl_git_pass(git_index_remove(g_index, "d/file", 0));
+	add_entry(g_index, "a/b/e/file", README_ID);
+
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+	assert_fresh_tree(g_index, &id);
+
+	cl_assert(git_tree_cache_get(g_index->tree, "d") == NULL);
+	assert_cache_matches_tree(g_index, "a/b/e");
+	cl_assert_equal_i(2, (int)git_tree_cache_get(g_index->tree, "a/b")->entries);
+}
+
+void test_index_cache__a_wrong_entry_count_is_not_trusted(void)
+{
+	git_tree_cache *cache;
+	git_oid id;
+
+	add_entries(g_index);
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+
+	/* "a/c" would swallow "a/file" */
+	cache = (git_tree_cache *)git_tree_cache_get(g_index->tree, "a/c");
+	cache->entries = 2;
+	cache->parent->entries = -1;
+	g_index->tree->entries = -1;
+
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+	assert_fresh_tree(g_index, &id);
+	cl_assert_equal_i(1, (int)git_tree_cache_get(g_index->tree, "a/c")->entries);
+}
+
+void test_index_cache__conflicts_invalidate_their_trees(void)
+{
+	git_index_entry ancestor, ours;
+	git_oid id;
+
+	add_entries(g_index);
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+
+	memset(&ancestor, 0x0, sizeof(ancestor));
+	ancestor.path = "a/c/conflicted";
+	ancestor.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(&ancestor.oid, README_ID));
+	memcpy(&ours, &ancestor, sizeof(ours));
+
+	cl_git_pass(git_index_conflict_add(g_index, &ancestor, &ours, NULL));
+	cl_assert(!cache_is_valid(g_index, "a/c"));
+	cl_assert(cache_is_valid(g_index, "a/b"));
+
+	git_index_conflict_cleanup(g_index);
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+	assert_fresh_tree(g_index, &id);
+}
+
+void test_index_cache__trees_are_written_to_another_repository(void)
+{
+	git_repository *other;
+	git_tree *tree;
+	git_tree_entry *entry;
+	git_oid id;
+
+	add_entries(g_index);
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+
+	cl_git_pass(git_repository_init(&other, "other.git", 1));
+	cl_git_pass(git_index_write_tree_to(&id, g_index, other));
+
+	cl_git_pass(git_tree_lookup(&tree, other, &id));
+	cl_git_pass(git_tree_entry_bypath(&entry, tree, "a/b"));
+	git_tree_free(tree);
+
+	cl_git_pass(git_tree_lookup(&tree, other, git_tree_entry_id(entry)));
+	git_tree_free(tree);
+	git_tree_entry_free(entry);
+
+	git_repository_free(other);
+	cl_fixture_cleanup("other.git");
+}
+
+void test_index_cache__read_tree_fills_in_the_cache(void)
+{
+	git_oid id, again;
+	git_tree *tree;
+	git_index *index;
+
+	add_entries(g_index);
+	cl_git_pass(git_index_write_tree_to(&id, g_index, g_repo));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &id));
+
+	cl_git_pass(git_index_new(&index));
+	cl_git_pass(git_index_read_tree(index, tree));
+
+	cl_assert(git_oid_equal(&id, &index->tree->oid));
+	cl_assert_equal_i(6, (int)index->tree->entries);
+	assert_cache_matches_tree(index, "a/b");
+	assert_cache_matches_tree(index, "d");
+	cl_assert_equal_i(3, (int)git_tree_cache_get(index->tree, "a")->entries);
+
+	cl_git_pass(git_index_write_tree_to(&again, index, g_repo));
+	cl_assert(git_oid_equal(&id, &again));
+
+	git_index_free(index);
+	git_tree_free(tree);
+}
+
+void test_index_cache__is_written_with_the_index(void)
+{
+	git_oid id;
+	git_index *index;
+
+	cl_git_pass(git_index_open(&index, "index_tree"));
+	add_entries(index);
+	cl_git_pass(git_index_write_tree_to(&id, index, g_repo));
+
+	add_entry(index, "d/file", BRANCH_FILE_ID);
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_git_pass(git_index_open(&index, "index_tree"));
+	cl_assert(index->tree != NULL);
+	cl_assert(!cache_is_valid(index, ""));
+	cl_assert(!cache_is_valid(index, "d"));
+	cl_assert(cache_is_valid(index, "a/b"));
+
+	cl_git_pass(git_index_write_tree_to(&id, index, g_repo));
+	assert_fresh_tree(index, &id);
+	git_index_free(index);
+}
+
+void test_index_cache__extension_from_git_is_written_back_as_is(void)
+{
+	git_buf buf = GIT_BUF_INIT;
+	git_index *index;
+
+	cl_git_pass(git_futils_readbuffer(&buf, cl_fixture("gitgit.index")));
+	cl_git_pass(git_futils_writebuffer(&buf, "index_tree", 0, 0666));
+
+	cl_git_pass(git_index_open(&index, "index_tree"));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_assert_equal_file(buf.ptr, buf.size, "index_tree");
+	git_buf_free(&buf);
+}
@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "posix.h"
+#include "buffer.h"
 
 /* Test that reading and writing a tree is a no-op */
 void test_index_read_tree__read_write_involution(void)
@@ -44,3 +45,82 @@ void test_index_read_tree__read_write_involution(void)
 
 	cl_fixture_cleanup("read_tree");
 }
+
+static void assert_read_tree_keeps_stat_data(unsigned int caps)
+{
+	git_repository *repo;
+	git_index *index;
+	git_index_entry entry;
+	const git_index_entry *found;
+	git_oid tree_oid;
+	git_tree *tree;
+	size_t i;
+	const char *paths[] = { "abc-d", "abc/d", "abc/e", "abc_d" };
+
+	p_mkdir("read_tree", 0700);
+
+	cl_git_pass(git_repository_init(&repo, "./read_tree", 0));
+	cl_git_pass(git_repository_index(&index, repo));
+	cl_git_pass(git_index_set_caps(index, caps));
+
+	p_mkdir("./read_tree/abc", 0700);
+
+	for (i = 0; i < ARRAY_SIZE(paths); ++i) {
+		git_buf path = GIT_BUF_INIT;
+
+		cl_git_pass(git_buf_joinpath(&path, "read_tree", paths[i]));
+		cl_git_mkfile(path.ptr, paths[i]);
+		cl_git_pass(git_index_add_bypath(index, paths[i]));
+		git_buf_free(&path);
+
+		/* mark each entry, to tell whether read_tree kept it */
+		memcpy(&entry, git_index_get_bypath(index, paths[i], 0), sizeof(entry));
+		entry.ino = (unsigned int)(i + 1);
+		cl_git_pass(git_index_add(index, &entry));
+	}
+
+	cl_git_pass(git_index_write_tree(&tree_oid, index));
+
+	/* change one of them, and put another in conflict */
+	cl_git_rewritefile("read_tree/abc/d", "changed");
+	cl_git_pass(git_index_add_bypath(index, "abc/d"));
+
+	memcpy(&entry, git_index_get_bypath(index, "abc_d", 0), sizeof(entry));
+	entry.flags |= (2 << GIT_IDXENTRY_STAGESHIFT);
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert(git_index_has_conflicts(index));
+
+	cl_git_pass(git_tree_lookup(&tree, repo, &tree_oid));
+	cl_git_pass(git_index_read_tree(index, tree));
+	git_tree_free(tree);
+
+	cl_assert_equal_i(ARRAY_SIZE(paths), git_index_entrycount(index));
+	cl_assert(!git_index_has_conflicts(index));
+
+	for (i = 0; i < ARRAY_SIZE(paths); ++i) {
+		cl_assert(found = git_index_get_byindex(index, i));
+		cl_assert_equal_s(paths[i], found->path);
+		cl_assert(found == git_index_get_bypath(index, paths[i], 0));
+		cl_assert_equal_i(strcmp(paths[i], "abc/d") ? i + 1 : 0, found->ino);
+	}
+
+	/* and they can be changed like any other */
+	cl_git_pass(git_index_remove_bypath(index, "abc/e"));
+	cl_git_pass(git_index_add_bypath(index, "abc/d"));
+	cl_assert_equal_i(ARRAY_SIZE(paths) - 1, git_index_entrycount(index));
+
+	git_index_free(index);
+	git_repository_free(repo);
+
+	cl_fixture_cleanup("read_tree");
+}
+
+void test_index_read_tree__keeps_the_stat_data_of_unchanged_entries(void)
+{
+	assert_read_tree_keeps_stat_data(0);
+}
+
+void test_index_read_tree__keeps_the_stat_data_when_ignoring_case(void)
+{
+	assert_read_tree_keeps_stat_data(GIT_INDEXCAP_IGNORE_CASE);
+}
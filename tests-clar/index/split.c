@@ -0,0 +1,438 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "posix.h"
+#include "ewah.h"
+
+#ifdef GIT_WIN32
+# include <sys/utime.h>
+#else
+# include <utime.h>
+#endif
+
+/* written by `git update-index --split-index`, then with "a" to "e" and
+ * "sub/s" changed, "d" removed and "f" added */
+#define SPLIT_SHARED_ID "9538d14391c8d11ccb05c8e14223f022dde19674"
+
+/* written by git for "f00" to "f19", then with "f03" and "f11" changed,
+ * which replace those of the shared index */
+#define REPLACED_SHARED_ID "fd92d82b4db33544aaa9e41ab393b84f487c95a6"
+#define REPLACED_ID "5ea2ed416fbd4a4cbe227b75fe255dd7fa6bd4d6"
+
+static git_index *g_index;
+
+void test_index_split__initialize(void)
+{
+	cl_fixture_sandbox("split-index");
+}
+
+void test_index_split__cleanup(void)
+{
+	git_index_free(g_index);
+	g_index = NULL;
+
+	cl_fixture_cleanup("split-index");
+	cl_fixture_cleanup("split-index-replaced");
+}
+
+static void assert_same_entries(git_index *a, git_index *b)
+{
+	size_t i;
+
+	cl_assert_equal_sz(git_index_entrycount(a), git_index_entrycount(b));
+
+	for (i = 0; i < git_index_entrycount(a); ++i) {
+		const git_index_entry *ea = git_index_get_byindex(a, i);
+		const git_index_entry *eb = git_index_get_byindex(b, i);
+
+		cl_assert_equal_s(ea->path, eb->path);
+		cl_assert(git_oid_equal(&ea->oid, &eb->oid));
+		cl_assert_equal_i(ea->mode, eb->mode);
+		cl_assert(ea->file_size == eb->file_size);
+	}
+}
+
+/* the number of entries stored in the index file itself */
+static unsigned int entries_on_disk(const char *path)
+{
+	git_buf buf = GIT_BUF_INIT;
+	unsigned int count;
+
+	cl_git_pass(git_futils_readbuffer(&buf, path));
+	cl_assert(buf.size > 12);
+	count = ntohl(*(uint32_t *)(buf.ptr + 8));
+	git_buf_free(&buf);
+
+	return count;
+}
+
+static bool shared_index_exists(const char *dir, const git_oid *id)
+{
+	char hex[GIT_OID_HEXSZ + 1];
+	git_buf path = GIT_BUF_INIT;
+	bool exists;
+
+	git_oid_tostr(hex, sizeof(hex), id);
+	cl_git_pass(git_buf_printf(&path, "%s/sharedindex.%s", dir, hex));
+	exists = git_path_exists(path.ptr);
+	git_buf_free(&path);
+
+	return exists;
+}
+
+/* the bitmaps of the "link" extension of the index file at `path` */
+static void read_link_bitmaps(
+	const char *path,
+	git_bitvec *deleted, size_t *deleted_size,
+	git_bitvec *replaced, size_t *replaced_size)
+{
+	git_buf buf = GIT_BUF_INIT;
+	const char *link = NULL, *data;
+	size_t i, size, len;
+
+	cl_git_pass(git_futils_readbuffer(&buf, path));
+
+	/* it is the first extension, and no entry of ours holds its name */
+	for (i = 12; !link && i + 8 < buf.size; ++i)
+		if (!memcmp(buf.ptr + i, "link", 4))
+			link = buf.ptr + i;
+	cl_assert(link);
+
+	size = ntohl(*(uint32_t *)(link + 4));
+	cl_assert(size > GIT_OID_RAWSZ);
+
+	data = link + 8 + GIT_OID_RAWSZ;
+	size -= GIT_OID_RAWSZ;
+
+	cl_assert((len = git_ewah_read(deleted, deleted_size, data, size)) > 0);
+	cl_assert(git_ewah_read(
+		replaced, replaced_size, data + len, size - len) == size - len);
+
+	git_buf_free(&buf);
+}
+
+static void backdate_shared_index(const char *dir, const git_oid *id)
+{
+	char hex[GIT_OID_HEXSZ + 1];
+	git_buf path = GIT_BUF_INIT;
+	struct utimbuf times;
+
+	git_oid_tostr(hex, sizeof(hex), id);
+	cl_git_pass(git_buf_printf(&path, "%s/sharedindex.%s", dir, hex));
+
+	times.actime = times.modtime = time(NULL) - 15 * 24 * 60 * 60;
+	cl_must_pass(utime(path.ptr, &times));
+
+	git_buf_free(&path);
+}
+
+static void add_entry(git_index *index, const char *path, const char *id)
+{
+	git_index_entry entry;
+
+	memset(&entry, 0x0, sizeof(entry));
+	entry.path = (char *)path;
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(&entry.oid, id));
+
+	cl_git_pass(git_index_add(index, &entry));
+}
+
+static void copy_big_index(void)
+{
+	git_buf buf = GIT_BUF_INIT;
+
+	cl_git_pass(git_futils_readbuffer(&buf, cl_fixture("gitgit.index")));
+	cl_git_pass(git_futils_writebuffer(&buf, "split-index/big", 0, 0666));
+	git_buf_free(&buf);
+}
+
+void test_index_split__reads_a_split_index_from_git(void)
+{
+	static const char *expected[][2] = {
+		{ "a", "78981922613b2afb6025042ff6bd878ac1994e85" },
+		{ "b", "61780798228d17af2d34fce4cfbdf35556832472" },
+		{ "c", "3cc58df83752123644fef39faab2393af643b1d2" },
+		{ "e", "d905d9da82c97264ab6f4920e20242e088850ce9" },
+		{ "f", "6a69f92020f5df77af6e8813ff1232493383b708" },
+		{ "sub/s", "b4785957bc986dc39c629de9fac9df46972c00fc" },
+	};
+	git_oid id;
+	size_t i;
+
+	cl_git_pass(git_index_open(&g_index, "split-index/index"));
+
+	cl_assert(g_index->split);
+	cl_git_pass(git_oid_fromstr(&id, SPLIT_SHARED_ID));
+	cl_assert(git_oid_equal(&id, &g_index->shared_id));
+
+	cl_assert_equal_sz(ARRAY_SIZE(expected), git_index_entrycount(g_index));
+
+	for (i = 0; i < ARRAY_SIZE(expected); ++i) {
+		const git_index_entry *entry = git_index_get_byindex(g_index, i);
+
+		cl_assert_equal_s(expected[i][0], entry->path);
+		cl_git_pass(git_oid_fromstr(&id, expected[i][1]));
+		cl_assert(git_oid_equal(&id, &entry->oid));
+	}
+
+	cl_assert(git_index_get_bypath(g_index, "d", 0) == NULL);
+}
+
+void test_index_split__cannot_split_an_in_memory_index(void)
+{
+	cl_git_pass(git_index_new(&g_index));
+	cl_git_fail(git_index_set_split(g_index, 1));
+}
+
+void test_index_split__small_changes_only_write_what_changed(void)
+{
+	git_index *original, *index;
+	git_oid shared_id;
+
+	copy_big_index();
+	cl_git_pass(git_index_open(&original, cl_fixture("gitgit.index")));
+	cl_git_pass(git_index_open(&g_index, "split-index/big"));
+
+	/* everything goes to the shared index the first time */
+	cl_git_pass(git_index_set_split(g_index, 1));
+	cl_git_pass(git_index_write(g_index));
+
+	git_oid_cpy(&shared_id, &g_index->shared_id);
+	cl_assert(shared_index_exists("split-index", &shared_id));
+	cl_assert_equal_i(0, entries_on_disk("split-index/big"));
+
+	cl_git_pass(git_index_open(&index, "split-index/big"));
+	cl_assert(index->split);
+	assert_same_entries(original, index);
+	git_index_free(index);
+
+	/* a few changed entries are written next to the same shared index */
+	add_entry(g_index, "git.c", "78981922613b2afb6025042ff6bd878ac1994e85");
+	add_entry(g_index, "new-file", "78981922613b2afb6025042ff6bd878ac1994e85");
+	cl_git_pass(git_index_remove(g_index, "Makefile", 0));
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(git_oid_equal(&shared_id, &g_index->shared_id));
+	cl_assert_equal_i(2, entries_on_disk("split-index/big"));
+
+	cl_git_pass(git_index_open(&index, "split-index/big"));
+	assert_same_entries(g_index, index);
+	cl_assert(git_index_get_bypath(index, "Makefile", 0) == NULL);
+	git_index_free(index);
+
+	git_index_free(original);
+}
+
+void test_index_split__keeps_the_entries_that_git_replaced(void)
+{
+	git_index *index;
+	git_oid id;
+
+	cl_fixture_sandbox("split-index-replaced");
+	cl_git_pass(git_index_open(&g_index, "split-index-replaced/index"));
+
+	cl_git_pass(git_oid_fromstr(&id, REPLACED_SHARED_ID));
+	cl_assert(git_oid_equal(&id, &g_index->shared_id));
+	cl_assert_equal_sz(20, git_index_entrycount(g_index));
+
+	cl_git_pass(git_oid_fromstr(&id, REPLACED_ID));
+	cl_assert(git_oid_equal(&id,
+		&git_index_get_bypath(g_index, "f03", 0)->oid));
+	cl_assert(git_oid_equal(&id,
+		&git_index_get_bypath(g_index, "f11", 0)->oid));
+
+	/* the replacements still count as kept, so the shared index stays */
+	add_entry(g_index, "f07", REPLACED_ID);
+	cl_git_pass(git_index_write(g_index));
+
+	cl_git_pass(git_oid_fromstr(&id, REPLACED_SHARED_ID));
+	cl_assert(git_oid_equal(&id, &g_index->shared_id));
+	cl_assert_equal_i(3, entries_on_disk("split-index-replaced/index"));
+
+	cl_git_pass(git_index_open(&index, "split-index-replaced/index"));
+	cl_assert(git_oid_equal(&id, &index->shared_id));
+	assert_same_entries(g_index, index);
+	git_index_free(index);
+}
+
+void test_index_split__batches_replace_shared_entries(void)
+{
+	git_index_batch *batch;
+	git_index_entry entry;
+	git_bitvec deleted, replaced;
+	size_t deleted_size, replaced_size;
+	git_oid id;
+
+	cl_fixture_sandbox("split-index-replaced");
+	cl_git_pass(git_index_open(&g_index, "split-index-replaced/index"));
+
+	memset(&entry, 0x0, sizeof(entry));
+	entry.path = "f07";
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(&entry.oid, REPLACED_ID));
+
+	cl_git_pass(git_index_batch_new(&batch, g_index));
+	cl_git_pass(git_index_batch_add(batch, &entry));
+	cl_git_pass(git_index_batch_apply(batch));
+	git_index_batch_free(batch);
+
+	cl_git_pass(git_index_write(g_index));
+
+	cl_git_pass(git_oid_fromstr(&id, REPLACED_SHARED_ID));
+	cl_assert(git_oid_equal(&id, &g_index->shared_id));
+	cl_assert_equal_i(3, entries_on_disk("split-index-replaced/index"));
+
+	/* "f03", "f07" and "f11" replace theirs, and nothing is deleted */
+	read_link_bitmaps("split-index-replaced/index",
+		&deleted, &deleted_size, &replaced, &replaced_size);
+
+	cl_assert(git_bitvec_get(&replaced, 3));
+	cl_assert(git_bitvec_get(&replaced, 7));
+	cl_assert(git_bitvec_get(&replaced, 11));
+	cl_assert(!git_bitvec_get(&replaced, 6));
+	cl_assert(!git_bitvec_get(&deleted, 7));
+
+	git_bitvec_free(&deleted);
+	git_bitvec_free(&replaced);
+}
+
+void test_index_split__the_shared_index_in_use_never_expires(void)
+{
+	git_oid shared_id;
+	size_t count;
+
+	copy_big_index();
+	cl_git_pass(git_index_open(&g_index, "split-index/big"));
+	cl_git_pass(git_index__set_shared_expire(g_index, "now"));
+	cl_git_pass(git_index_set_split(g_index, 1));
+	cl_git_pass(git_index_write(g_index));
+	git_oid_cpy(&shared_id, &g_index->shared_id);
+
+	count = git_index_entrycount(g_index);
+	while (git_index_entrycount(g_index) > count / 2)
+		cl_git_pass(git_index_remove(g_index,
+			git_index_get_byindex(g_index, 0)->path, 0));
+
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(!git_oid_equal(&shared_id, &g_index->shared_id));
+	cl_assert(!shared_index_exists("split-index", &shared_id));
+	cl_assert(shared_index_exists("split-index", &g_index->shared_id));
+}
+
+void test_index_split__many_changes_write_a_new_shared_index(void)
+{
+	git_index *index;
+	git_oid shared_id;
+	size_t count;
+
+	copy_big_index();
+	cl_git_pass(git_index_open(&g_index, "split-index/big"));
+	cl_git_pass(git_index_set_split(g_index, 1));
+	cl_git_pass(git_index_write(g_index));
+	git_oid_cpy(&shared_id, &g_index->shared_id);
+
+	count = git_index_entrycount(g_index);
+	while (git_index_entrycount(g_index) > count * 3 / 4)
+		cl_git_pass(git_index_remove(g_index,
+			git_index_get_byindex(g_index, 0)->path, 0));
+
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(!git_oid_equal(&shared_id, &g_index->shared_id));
+	cl_assert(shared_index_exists("split-index", &g_index->shared_id));
+	cl_assert_equal_i(0, entries_on_disk("split-index/big"));
+
+	/* another index file may still link to the previous one for now */
+	cl_assert(shared_index_exists("split-index", &shared_id));
+
+	cl_git_pass(git_index_open(&index, "split-index/big"));
+	assert_same_entries(g_index, index);
+	git_index_free(index);
+}
+
+void test_index_split__old_shared_indexes_expire(void)
+{
+	git_oid shared_id, old_id;
+
+	cl_git_pass(git_oid_fromstr(&old_id, SPLIT_SHARED_ID));
+	backdate_shared_index("split-index", &old_id);
+
+	copy_big_index();
+	cl_git_pass(git_index_open(&g_index, "split-index/big"));
+	cl_git_pass(git_index_set_split(g_index, 1));
+	cl_git_pass(git_index_write(g_index));
+	git_oid_cpy(&shared_id, &g_index->shared_id);
+
+	/* the one written just now is not old enough */
+	cl_git_pass(git_index_remove(g_index,
+		git_index_get_byindex(g_index, 0)->path, 0));
+	cl_git_pass(git_index_set_split(g_index, 0));
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(shared_index_exists("split-index", &shared_id));
+	cl_assert(!shared_index_exists("split-index", &old_id));
+
+	/* unless they are set to expire right away */
+	cl_git_pass(git_index__set_shared_expire(g_index, "now"));
+	cl_git_pass(git_index_set_split(g_index, 1));
+	cl_git_pass(git_index_write(g_index));
+	cl_git_pass(git_index_set_split(g_index, 0));
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(!shared_index_exists("split-index", &shared_id));
+	cl_assert(!shared_index_exists("split-index", &g_index->shared_id));
+}
+
+void test_index_split__shared_indexes_can_be_kept_for_good(void)
+{
+	git_oid old_id;
+
+	cl_git_pass(git_index_open(&g_index, "split-index/index"));
+	git_oid_cpy(&old_id, &g_index->shared_id);
+	backdate_shared_index("split-index", &old_id);
+
+	cl_git_pass(git_index__set_shared_expire(g_index, "never"));
+	cl_git_pass(git_index_set_split(g_index, 0));
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(shared_index_exists("split-index", &old_id));
+}
+
+void test_index_split__can_be_turned_off(void)
+{
+	git_index *index;
+	git_oid shared_id;
+
+	cl_git_pass(git_index_open(&g_index, "split-index/index"));
+	git_oid_cpy(&shared_id, &g_index->shared_id);
+
+	cl_git_pass(git_index_set_split(g_index, 0));
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(shared_index_exists("split-index", &shared_id));
+	cl_assert_equal_i(6, entries_on_disk("split-index/index"));
+
+	cl_git_pass(git_index_open(&index, "split-index/index"));
+	cl_assert(!index->split);
+	assert_same_entries(g_index, index);
+	git_index_free(index);
+}
+
+void test_index_split__follows_the_repository_configuration(void)
+{
+	git_repository *repo = cl_git_sandbox_init("testrepo");
+	git_index *index;
+
+	cl_repo_set_bool(repo, "core.splitIndex", true);
+
+	cl_git_pass(git_repository_index(&index, repo));
+	cl_assert(index->split);
+
+	cl_git_pass(git_index_write(index));
+	cl_assert(!git_oid_iszero(&index->shared_id));
+	cl_assert(shared_index_exists("testrepo/.git", &index->shared_id));
+
+	git_index_free(index);
+	cl_git_sandbox_cleanup();
+}
@@ -534,3 +534,131 @@ void test_index_tests__reload_from_disk(void)
 	git_index_free(write_index);
 	git_repository_free(repo);
 }
+
+static void build_wide_tree(git_oid *out, git_repository *repo, size_t width, size_t depth)
+{
+	git_treebuilder *builder;
+	git_oid id;
+	char name[16];
+	size_t i;
+
+	if (depth == 0) {
+		cl_git_pass(git_blob_create_frombuffer(out, repo, "hello\n", 6));
+		return;
+	}
+
+	build_wide_tree(&id, repo, width, depth - 1);
+
+	cl_git_pass(git_treebuilder_create(&builder, NULL));
+
+	for (i = 0; i < width; ++i) {
+		p_snprintf(name, sizeof(name), "%04d", (int)i);
+		cl_git_pass(git_treebuilder_insert(NULL, builder, name, &id,
+			depth > 1 ? GIT_FILEMODE_TREE : GIT_FILEMODE_BLOB));
+	}
+
+	cl_git_pass(git_treebuilder_write(out, repo, builder));
+	git_treebuilder_free(builder);
+}
+
+void test_index_tests__reads_many_entries(void)
+{
+	git_repository *repo;
+	git_index *index, *read_index;
+	git_tree *tree;
+	git_oid tree_id;
+	size_t i;
+
+	cl_set_cleanup(&cleanup_myrepo, NULL);
+
+	cl_git_pass(git_repository_init(&repo, "./myrepo", 0));
+
+	/* more than enough entries for several threads to read them */
+	build_wide_tree(&tree_id, repo, 200, 2);
+	cl_git_pass(git_tree_lookup(&tree, repo, &tree_id));
+
+	cl_git_pass(git_index_open(&index, "./myrepo/big_index"));
+	cl_git_pass(git_index_read_tree(index, tree));
+	cl_git_pass(git_index_write(index));
+
+	cl_git_pass(git_index_open(&read_index, "./myrepo/big_index"));
+	cl_assert_equal_sz(40000, git_index_entrycount(read_index));
+	cl_assert(read_index->entries.sorted);
+
+	for (i = 0; i < git_index_entrycount(index); ++i) {
+		const git_index_entry *a = git_index_get_byindex(index, i);
+		const git_index_entry *b = git_index_get_byindex(read_index, i);
+
+		cl_assert_equal_s(a->path, b->path);
+		cl_assert(git_oid_equal(&a->oid, &b->oid));
+		cl_assert_equal_i(a->mode, b->mode);
+	}
+
+	/* and they can be replaced and removed like any other */
+	cl_git_pass(git_index_add(read_index, git_index_get_bypath(index, "0100/0100", 0)));
+	cl_git_pass(git_index_remove(read_index, "0199/0199", 0));
+	cl_assert_equal_sz(39999, git_index_entrycount(read_index));
+
+	git_index_free(read_index);
+	git_index_free(index);
+	git_tree_free(tree);
+	git_repository_free(repo);
+}
+
+void test_index_tests__lookups_by_path_follow_changes(void)
+{
+	git_index *index;
+	git_index_entry entry;
+	const git_index_entry *found, *ancestor, *ours, *theirs;
+
+	cl_git_pass(git_index_open(&index, TEST_INDEX_PATH));
+
+	cl_assert((found = git_index_get_bypath(index, "Makefile", 0)) != NULL);
+	cl_assert(index->entries_map != NULL);
+	cl_assert(git_index_get_bypath(index, "Makefile", 1) == NULL);
+	cl_assert(git_index_get_bypath(index, "makefile", 0) == NULL);
+
+	memset(&entry, 0x0, sizeof(git_index_entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(&entry.oid, "f00ff00ff00ff00ff00ff00ff00ff00ff00ff00f"));
+
+	/* an entry which is replaced stays where it was */
+	entry.path = "Makefile";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert(git_index_get_bypath(index, "Makefile", 0) == found);
+	cl_assert(git_oid_equal(&found->oid, &entry.oid));
+
+	entry.path = "src/new.c";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert(git_index_get_bypath(index, "src/new.c", 0) != NULL);
+
+	cl_git_pass(git_index_remove(index, "src/new.c", 0));
+	cl_assert(git_index_get_bypath(index, "src/new.c", 0) == NULL);
+
+	cl_assert(git_index_get_bypath(index, "tests/Makefile", 0) != NULL);
+	cl_git_pass(git_index_remove_directory(index, "tests", 0));
+	cl_assert(git_index_get_bypath(index, "tests/Makefile", 0) == NULL);
+
+	entry.path = "conflicted.c";
+	cl_git_pass(git_index_conflict_add(index, &entry, &entry, NULL));
+	cl_git_pass(git_index_conflict_get(&ancestor, &ours, &theirs, index, "conflicted.c"));
+	cl_assert(ancestor != NULL && ours != NULL && theirs == NULL);
+	cl_assert(git_index_get_bypath(index, "conflicted.c", 2) == ours);
+
+	cl_git_pass(git_index_conflict_remove(index, "conflicted.c"));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_index_conflict_get(&ancestor, &ours, &theirs, index, "conflicted.c"));
+	cl_assert(git_index_get_bypath(index, "conflicted.c", 1) == NULL);
+
+	/* paths which differ in case are the same to an index which ignores it */
+	cl_git_pass(git_index_set_caps(index, GIT_INDEXCAP_IGNORE_CASE));
+	cl_assert(git_index_get_bypath(index, "makefile", 0) == found);
+	cl_assert(index->entries_map_icase != NULL);
+
+	entry.path = "MAKEFILE";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert(git_index_get_bypath(index, "MakeFile", 0) == found);
+	cl_assert_equal_s("Makefile", found->path);
+
+	git_index_free(index);
+}
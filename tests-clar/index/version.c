@@ -0,0 +1,143 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "hash.h"
+
+/* gitgit.index, rewritten by `git update-index --index-version 4` */
+#define TEST_INDEX2_PATH cl_fixture("gitgit.index")
+#define TEST_INDEX2_V4_PATH cl_fixture("gitgit-v4.index")
+
+static git_index *g_index;
+
+void test_index_version__cleanup(void)
+{
+	git_index_free(g_index);
+	g_index = NULL;
+
+	p_unlink("index_v4");
+}
+
+static void assert_same_entries(git_index *a, git_index *b)
+{
+	size_t i;
+
+	cl_assert_equal_sz(git_index_entrycount(a), git_index_entrycount(b));
+
+	for (i = 0; i < git_index_entrycount(a); ++i) {
+		const git_index_entry *ea = git_index_get_byindex(a, i);
+		const git_index_entry *eb = git_index_get_byindex(b, i);
+
+		cl_assert_equal_s(ea->path, eb->path);
+		cl_assert(git_oid_equal(&ea->oid, &eb->oid));
+		cl_assert_equal_i(ea->flags, eb->flags);
+		cl_assert_equal_i(ea->mode, eb->mode);
+		cl_assert(ea->mtime.seconds == eb->mtime.seconds);
+		cl_assert(ea->file_size == eb->file_size);
+	}
+}
+
+static size_t file_size(const char *path)
+{
+	struct stat st;
+
+	cl_must_pass(p_stat(path, &st));
+	return (size_t)st.st_size;
+}
+
+void test_index_version__defaults_to_v2(void)
+{
+	cl_git_pass(git_index_new(&g_index));
+	cl_assert_equal_i(2, git_index_version(g_index));
+
+	git_index_free(g_index);
+	cl_git_pass(git_index_open(&g_index, TEST_INDEX2_PATH));
+	cl_assert_equal_i(2, git_index_version(g_index));
+}
+
+void test_index_version__can_only_set_known_versions(void)
+{
+	cl_git_pass(git_index_new(&g_index));
+
+	cl_git_fail(git_index_set_version(g_index, 1));
+	cl_git_fail(git_index_set_version(g_index, 5));
+	cl_assert_equal_i(2, git_index_version(g_index));
+
+	cl_git_pass(git_index_set_version(g_index, 4));
+	cl_assert_equal_i(4, git_index_version(g_index));
+}
+
+void test_index_version__reads_v4(void)
+{
+	git_index *v2;
+
+	cl_git_pass(git_index_open(&v2, TEST_INDEX2_PATH));
+	cl_git_pass(git_index_open(&g_index, TEST_INDEX2_V4_PATH));
+
+	cl_assert_equal_i(4, git_index_version(g_index));
+	assert_same_entries(v2, g_index);
+
+	git_index_free(v2);
+}
+
+void test_index_version__writes_v4(void)
+{
+	git_index *v2, *v4;
+	git_buf buf = GIT_BUF_INIT;
+
+	cl_git_pass(git_futils_readbuffer(&buf, TEST_INDEX2_PATH));
+	cl_git_pass(git_futils_writebuffer(&buf, "index_v4", 0, 0666));
+	git_buf_free(&buf);
+
+	cl_git_pass(git_index_open(&v2, TEST_INDEX2_PATH));
+	cl_git_pass(git_index_open(&g_index, "index_v4"));
+
+	cl_git_pass(git_index_set_version(g_index, 4));
+	cl_git_pass(git_index_write(g_index));
+
+	cl_git_pass(git_index_open(&v4, "index_v4"));
+	cl_assert_equal_i(4, git_index_version(v4));
+	assert_same_entries(v2, v4);
+
+	/* the paths are what makes up most of this index */
+	cl_assert(file_size("index_v4") < file_size(TEST_INDEX2_V4_PATH) + 1024);
+	cl_assert(file_size("index_v4") < file_size(TEST_INDEX2_PATH) * 9 / 10);
+
+	/* an index read as version 4 is written back as version 4 */
+	cl_git_pass(git_index_write(v4));
+	git_index_free(v4);
+
+	cl_git_pass(git_index_open(&v4, "index_v4"));
+	cl_assert_equal_i(4, git_index_version(v4));
+	assert_same_entries(v2, v4);
+
+	/* and can be turned back */
+	cl_git_pass(git_index_set_version(v4, 2));
+	cl_git_pass(git_index_write(v4));
+	git_index_free(v4);
+
+	cl_git_pass(git_index_open(&v4, "index_v4"));
+	cl_assert_equal_i(2, git_index_version(v4));
+	assert_same_entries(v2, v4);
+
+	git_index_free(v4);
+	git_index_free(v2);
+}
+
+void test_index_version__rejects_a_path_prefix_longer_than_the_previous_path(void)
+{
+	git_buf buf = GIT_BUF_INIT;
+	git_oid checksum;
+
+	cl_git_pass(git_futils_readbuffer(&buf, TEST_INDEX2_V4_PATH));
+
+	/* the first entry cannot strip anything from the empty path */
+	cl_assert_equal_i(0, buf.ptr[12 + 62]);
+	buf.ptr[12 + 62] = 1;
+
+	cl_git_pass(git_hash_buf(&checksum, buf.ptr, buf.size - GIT_OID_RAWSZ));
+	memcpy(buf.ptr + buf.size - GIT_OID_RAWSZ, checksum.id, GIT_OID_RAWSZ);
+
+	cl_git_pass(git_futils_writebuffer(&buf, "index_v4", 0, 0666));
+	git_buf_free(&buf);
+
+	cl_git_fail(git_index_open(&g_index, "index_v4"));
+}
@@ -1,4 +1,7 @@
 #include "clar_libgit2.h"
+#include "vector.h"
+#include "posix.h"
+#include "graph_helpers.h"
 
 /*
 	*   a4a7dce [0] Merge branch 'master' into br2
@@ -233,6 +236,54 @@ void test_revwalk_basic__push_head_hide_ref_nobase(void)
 	cl_assert(i == 7);
 }
 
+void test_revwalk_basic__push_head_hide_many(void)
+{
+	int i = 0;
+	git_oid oid, hidden[3];
+
+	revwalk_basic_setup_walk(NULL);
+
+	/* refs/heads/packed-test twice, and one of its ancestors */
+	cl_git_pass(git_oid_fromstr(&hidden[0], commit_ids[2]));
+	cl_git_pass(git_oid_fromstr(&hidden[1], commit_ids[2]));
+	cl_git_pass(git_oid_fromstr(&hidden[2], commit_ids[5]));
+
+	cl_git_pass(git_revwalk_push_head(_walk));
+	cl_git_pass(git_revwalk_hide_many(_walk, hidden, 3));
+
+	while (git_revwalk_next(&oid, _walk) == 0) {
+		i++;
+	}
+
+	/* git log HEAD --oneline --not refs/heads/packed-test | wc -l => 4 */
+	cl_assert_equal_i(4, i);
+
+	cl_git_pass(git_oid_fromstr(&hidden[1], "521d87c1ec3aef9824daf6d96cc0ae3710766d91"));
+	cl_git_fail(git_revwalk_hide_many(_walk, hidden, 3));
+}
+
+void test_revwalk_basic__push_head_hide_glob(void)
+{
+	int i = 0;
+	git_oid oid;
+
+	revwalk_basic_setup_walk(NULL);
+
+	cl_git_pass(git_revwalk_push_head(_walk));
+	cl_git_pass(git_revwalk_hide_glob(_walk, "heads/packed*"));
+
+	while (git_revwalk_next(&oid, _walk) == 0) {
+		i++;
+	}
+
+	/* git log HEAD --oneline --not --glob=heads/packed* | wc -l => 4 */
+	cl_assert_equal_i(4, i);
+
+	cl_git_pass(git_revwalk_push_head(_walk));
+	cl_git_pass(git_revwalk_hide_glob(_walk, "heads"));
+	cl_assert_equal_i(GIT_ITEROVER, git_revwalk_next(&oid, _walk));
+}
+
 void test_revwalk_basic__disallow_non_commit(void)
 {
 	git_oid oid;
@@ -252,3 +303,136 @@ void test_revwalk_basic__push_range(void)
 	cl_git_pass(git_revwalk_push_range(_walk, "9fd738e~2..9fd738e"));
 	cl_git_pass(test_walk_only(_walk, commit_sorting_segment, 1));
 }
+
+static int topo_walk_count(git_repository *repo, const char *hide)
+{
+	git_revwalk *walk;
+	git_commit *commit;
+	git_oid oid;
+	git_vector seen = GIT_VECTOR_INIT;
+	git_oid *entry;
+	unsigned int i, j, n;
+
+	cl_git_pass(git_revwalk_new(&walk, repo));
+	git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL);
+	cl_git_pass(git_revwalk_push_glob(walk, "heads"));
+	if (hide)
+		cl_git_pass(git_revwalk_hide_ref(walk, hide));
+
+	while (git_revwalk_next(&oid, walk) == 0) {
+		/* no commit may be returned after one of its parents */
+		cl_git_pass(git_commit_lookup(&commit, repo, &oid));
+		for (n = 0; n < git_commit_parentcount(commit); ++n)
+			git_vector_foreach(&seen, j, entry)
+				cl_assert(git_oid_cmp(entry, git_commit_parent_id(commit, n)));
+		git_commit_free(commit);
+
+		entry = git__malloc(sizeof(git_oid));
+		git_oid_cpy(entry, &oid);
+		cl_git_pass(git_vector_insert(&seen, entry));
+	}
+
+	i = (unsigned int)seen.length;
+
+	git_vector_foreach(&seen, j, entry)
+		git__free(entry);
+	git_vector_free(&seen);
+	git_revwalk_free(walk);
+
+	return i;
+}
+
+void test_revwalk_basic__topo_with_and_without_commit_graph(void)
+{
+	git_repository *without;
+
+	revwalk_basic_setup_walk("testrepo.git");
+	revwalk_add_commit_graph("testrepo.git");
+	cl_git_pass(git_repository_open(&without, cl_fixture("testrepo.git")));
+
+	/* git log --branches --oneline | wc -l => 14 */
+	cl_assert_equal_i(14, topo_walk_count(_repo, NULL));
+	cl_assert_equal_i(14, topo_walk_count(without, NULL));
+
+	cl_assert_equal_i(
+		topo_walk_count(without, "refs/heads/packed-test"),
+		topo_walk_count(_repo, "refs/heads/packed-test"));
+	cl_assert_equal_i(
+		topo_walk_count(without, "refs/heads/br2"),
+		topo_walk_count(_repo, "refs/heads/br2"));
+
+	git_repository_free(without);
+}
+
+static void time_walk_ids(git_vector *out, git_revwalk *walk, const char *hide)
+{
+	git_oid oid, *entry;
+
+	git_revwalk_sorting(walk, GIT_SORT_TIME);
+	cl_git_pass(git_revwalk_push_glob(walk, "heads"));
+	if (hide)
+		cl_git_pass(git_revwalk_hide_ref(walk, hide));
+
+	while (git_revwalk_next(&oid, walk) == 0) {
+		entry = git__malloc(sizeof(git_oid));
+		git_oid_cpy(entry, &oid);
+		cl_git_pass(git_vector_insert(out, entry));
+	}
+}
+
+static void assert_prefetch_walk_matches(const char *hide)
+{
+	git_revwalk *walk;
+	git_vector expected = GIT_VECTOR_INIT, actual = GIT_VECTOR_INIT;
+	git_oid *entry;
+	unsigned int i;
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	time_walk_ids(&expected, walk, hide);
+	git_revwalk_free(walk);
+
+	time_walk_ids(&actual, _walk, hide);
+
+	cl_assert_equal_i(expected.length, actual.length);
+	for (i = 0; i < expected.length; ++i)
+		cl_assert(git_oid_equal(expected.contents[i], actual.contents[i]));
+
+	git_vector_foreach(&expected, i, entry)
+		git__free(entry);
+	git_vector_foreach(&actual, i, entry)
+		git__free(entry);
+	git_vector_free(&expected);
+	git_vector_free(&actual);
+}
+
+void test_revwalk_basic__prefetch_threads(void)
+{
+	git_oid id;
+	unsigned int n;
+
+	/* commits are only prefetched when they are not in a commit-graph */
+	revwalk_basic_setup_walk(NULL);
+
+	n = git_revwalk_set_prefetch_threads(_walk, 4);
+#ifdef GIT_THREADS
+	cl_assert_equal_i(4, n);
+#else
+	cl_assert_equal_i(0, n);
+#endif
+
+	git_oid_fromstr(&id, commit_head);
+	cl_git_pass(test_walk(_walk, &id, GIT_SORT_TIME, commit_sorting_time, 1));
+	cl_git_pass(test_walk(_walk, &id, GIT_SORT_TOPOLOGICAL, commit_sorting_topo, 2));
+
+	assert_prefetch_walk_matches(NULL);
+	assert_prefetch_walk_matches("refs/heads/packed-test");
+	assert_prefetch_walk_matches("refs/heads/br2");
+
+	/* stopping a walk halfway through stops the prefetching */
+	cl_git_pass(git_revwalk_push_glob(_walk, "heads"));
+	cl_git_pass(git_revwalk_next(&id, _walk));
+	git_revwalk_reset(_walk);
+
+	cl_assert_equal_i(0, git_revwalk_set_prefetch_threads(_walk, 0));
+	assert_prefetch_walk_matches(NULL);
+}
@@ -0,0 +1,158 @@
+#include "clar_libgit2.h"
+#include "commit_graph.h"
+#include "fileops.h"
+#include "graph_helpers.h"
+
+static git_commit_graph_file *_file;
+
+void test_revwalk_commitgraph__initialize(void)
+{
+	cl_git_pass(git_commit_graph_open(&_file,
+		cl_fixture("testrepo.commit-graph")));
+}
+
+void test_revwalk_commitgraph__cleanup(void)
+{
+	git_commit_graph_free(_file);
+	_file = NULL;
+
+	cl_git_sandbox_cleanup();
+}
+
+void test_revwalk_commitgraph__parse(void)
+{
+	git_commit_graph_entry e, parent;
+	git_oid id;
+	uint32_t pos;
+
+	cl_assert_equal_i(15, _file->num_commits);
+
+	cl_git_pass(git_oid_fromstr(&id, "5001298e0c09ad9c34e4249bc5801c75e9754fa5"));
+	cl_git_pass(git_commit_graph_entry_find(&e, _file, &id));
+	cl_assert(git_oid_cmp(&e.sha1, &id) == 0);
+	cl_assert_equal_i(0, e.parent_count);
+	cl_assert_equal_i(1, e.generation);
+	cl_assert(e.commit_time == 1273610423);
+
+	cl_git_pass(git_oid_fromstr(&id, "a4a7dce85cf63874e984719f4fdd239f5145052f"));
+	cl_git_pass(git_commit_graph_entry_find(&e, _file, &id));
+	cl_assert_equal_i(2, e.parent_count);
+	cl_assert_equal_i(5, e.generation);
+	cl_assert(e.commit_time == 1274814023);
+
+	cl_git_pass(git_commit_graph_entry_parent_position(&pos, _file, &e, 1));
+	cl_git_pass(git_commit_graph_entry_at(&parent, _file, pos));
+	cl_git_pass(git_oid_fromstr(&id, "9fd738e8f7967c078dceed8190330fc8648ee56a"));
+	cl_assert(git_oid_cmp(&parent.sha1, &id) == 0);
+	cl_assert_equal_i(4, parent.generation);
+
+	cl_git_fail(git_commit_graph_entry_parent_position(&pos, _file, &e, 2));
+}
+
+void test_revwalk_commitgraph__not_found(void)
+{
+	git_commit_graph_entry e;
+	git_oid id;
+
+	/* a tree, which never appears in the graph */
+	cl_git_pass(git_oid_fromstr(&id, "181037049a54a1eb5fab404658a3a250b44335d7"));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_commit_graph_entry_find(&e, _file, &id));
+}
+
+void test_revwalk_commitgraph__rejects_garbage(void)
+{
+	git_commit_graph_file *file;
+
+	cl_git_mkfile("garbage-graph", "CGPH this is not a commit-graph at all");
+	cl_git_fail(git_commit_graph_open(&file, "garbage-graph"));
+	cl_git_pass(p_unlink("garbage-graph"));
+}
+
+static void assert_same_with_and_without_graph(
+	git_repository *with, git_repository *without,
+	const char *one_str, const char *two_str)
+{
+	git_oid one, two, base1, base2;
+	size_t ahead1, behind1, ahead2, behind2;
+
+	cl_git_pass(git_oid_fromstr(&one, one_str));
+	cl_git_pass(git_oid_fromstr(&two, two_str));
+
+	cl_git_pass(git_merge_base(&base1, with, &one, &two));
+	cl_git_pass(git_merge_base(&base2, without, &one, &two));
+	cl_assert(git_oid_cmp(&base1, &base2) == 0);
+
+	cl_git_pass(git_graph_ahead_behind(&ahead1, &behind1, with, &one, &two));
+	cl_git_pass(git_graph_ahead_behind(&ahead2, &behind2, without, &one, &two));
+	cl_assert_equal_sz(ahead1, ahead2);
+	cl_assert_equal_sz(behind1, behind2);
+}
+
+void test_revwalk_commitgraph__merge_base_matches_walk_without_graph(void)
+{
+	git_repository *with, *without;
+
+	with = cl_git_sandbox_init("testrepo.git");
+	revwalk_add_commit_graph("testrepo.git");
+	cl_git_pass(git_repository_open(&without, cl_fixture("testrepo.git")));
+
+	assert_same_with_and_without_graph(with, without,
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+		"9fd738e8f7967c078dceed8190330fc8648ee56a");
+	assert_same_with_and_without_graph(with, without,
+		"763d71aadf09a7951596c9746c024e7eece7c7af",
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	assert_same_with_and_without_graph(with, without,
+		"258f0e2a959a364e40ed6603d5d44fbb24765b10",
+		"a4a7dce85cf63874e984719f4fdd239f5145052f");
+	assert_same_with_and_without_graph(with, without,
+		"e90810b8df3e80c413d903f631643c716887138d",
+		"6dcf9bf7541ee10456529833502442f385010c3d");
+
+	git_repository_free(without);
+}
+
+void test_revwalk_commitgraph__murmur3(void)
+{
+	cl_assert_equal_i(0x00000000, git_bloom_murmur3_seeded(0, "", 0, 2));
+	cl_assert_equal_i(0x627b0c2c,
+		git_bloom_murmur3_seeded(0, "Hello world!", 12, 2));
+	cl_assert_equal_i(0x2e4ff723, git_bloom_murmur3_seeded(0,
+		"The quick brown fox jumps over the lazy dog", 43, 2));
+
+	/* version 1 only differs from version 2 for bytes >= 0x80 */
+	cl_assert_equal_i(
+		git_bloom_murmur3_seeded(0, "Hello world!", 12, 1),
+		git_bloom_murmur3_seeded(0, "Hello world!", 12, 2));
+	cl_assert(git_bloom_murmur3_seeded(0, "\xc3\xa9", 2, 1) !=
+		git_bloom_murmur3_seeded(0, "\xc3\xa9", 2, 2));
+}
+
+static int bloom_contains(const git_bloom_filter *filter, const char *path)
+{
+	git_bloom_key key;
+
+	git_bloom_key_init(&key, path, strlen(path), &_file->bloom_settings);
+	return git_bloom_filter_contains(filter, &key, &_file->bloom_settings);
+}
+
+void test_revwalk_commitgraph__bloom_filters(void)
+{
+	git_commit_graph_entry e;
+	git_bloom_filter filter;
+	git_oid id;
+
+	cl_assert(_file->bloom_index != NULL);
+	cl_assert_equal_i(7, _file->bloom_settings.num_hashes);
+
+	/* "Add some files into subdirectories" */
+	cl_git_pass(git_oid_fromstr(&id, "763d71aadf09a7951596c9746c024e7eece7c7af"));
+	cl_git_pass(git_commit_graph_entry_find(&e, _file, &id));
+	cl_git_pass(git_commit_graph_bloom_filter(&filter, _file, e.position));
+
+	cl_assert_equal_i(1, bloom_contains(&filter, "ab/de/fgh/1.txt"));
+	cl_assert_equal_i(1, bloom_contains(&filter, "ab/de/fgh"));
+	cl_assert_equal_i(1, bloom_contains(&filter, "ab"));
+	cl_assert_equal_i(0, bloom_contains(&filter, "README"));
+	cl_assert_equal_i(0, bloom_contains(&filter, "new.txt"));
+}
@@ -0,0 +1,15 @@
+#include "graph_helpers.h"
+#include "fileops.h"
+
+void revwalk_add_commit_graph(const char *repo_path)
+{
+	git_buf path = GIT_BUF_INIT;
+
+	cl_git_pass(git_buf_joinpath(
+		&path, repo_path, "objects/info/commit-graph"));
+	cl_git_pass(git_futils_mkpath2file(path.ptr, 0777));
+	cl_git_pass(git_futils_cp(
+		cl_fixture("testrepo.commit-graph"), path.ptr, 0644));
+
+	git_buf_free(&path);
+}
@@ -0,0 +1,6 @@
+#include "clar_libgit2.h"
+
+/* gives a sandboxed copy of testrepo.git the commit-graph git wrote for it;
+ * the testrepo.git fixture itself has none
+ */
+extern void revwalk_add_commit_graph(const char *repo_path);
@@ -18,6 +18,8 @@ void test_revwalk_mergebase__cleanup(void)
 
 	git_repository_free(_repo2);
 	_repo2 = NULL;
+
+	cl_git_sandbox_cleanup();
 }
 
 void test_revwalk_mergebase__single1(void)
@@ -390,3 +392,158 @@ void test_revwalk_mergebase__many_merge_branch(void)
  *
  *       a
  */
+
+static void assert_ahead_behind_many(
+	git_repository *repo, const git_oid *locals, size_t count,
+	const git_oid *upstream)
+{
+	size_t i, ahead, behind, *aheads, *behinds;
+
+	aheads = git__calloc(count, sizeof(size_t));
+	behinds = git__calloc(count, sizeof(size_t));
+	cl_assert(aheads && behinds);
+
+	cl_git_pass(git_graph_ahead_behind_many(
+		aheads, behinds, repo, locals, count, upstream));
+
+	for (i = 0; i < count; i++) {
+		cl_git_pass(git_graph_ahead_behind(
+			&ahead, &behind, repo, &locals[i], upstream));
+		cl_assert_equal_sz(ahead, aheads[i]);
+		cl_assert_equal_sz(behind, behinds[i]);
+	}
+
+	git__free(aheads);
+	git__free(behinds);
+}
+
+static int collect_tip(const char *name, void *payload)
+{
+	git_vector *tips = payload;
+	git_oid *id = git__malloc(sizeof(git_oid));
+
+	cl_assert(id);
+	cl_git_pass(git_reference_name_to_id(id, _repo, name));
+	cl_git_pass(git_vector_insert(tips, id));
+
+	return 0;
+}
+
+void test_revwalk_mergebase__ahead_behind_many_matches_single(void)
+{
+	git_vector tips = GIT_VECTOR_INIT;
+	git_oid *locals, upstream, *id;
+	size_t i, count;
+
+	cl_git_pass(git_reference_foreach_glob(
+		_repo, "refs/heads/*", collect_tip, &tips));
+
+	/* enough tips to spill over a second bitset word */
+	count = tips.length * 5;
+	locals = git__calloc(count, sizeof(git_oid));
+	cl_assert(locals);
+
+	for (i = 0; i < count; i++)
+		git_oid_cpy(&locals[i], git_vector_get(&tips, i % tips.length));
+
+	cl_assert(count > 32);
+
+	cl_git_pass(git_oid_fromstr(&upstream, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"));
+	assert_ahead_behind_many(_repo, locals, count, &upstream);
+
+	cl_git_pass(git_oid_fromstr(&upstream, "e90810b8df3e80c413d903f631643c716887138d"));
+	assert_ahead_behind_many(_repo, locals, count, &upstream);
+
+	git__free(locals);
+	git_vector_foreach(&tips, i, id)
+		git__free(id);
+	git_vector_free(&tips);
+}
+
+void test_revwalk_mergebase__ahead_behind_many_two_way_merge(void)
+{
+	git_oid locals[2], upstream;
+	size_t ahead[2], behind[2];
+
+	cl_git_pass(git_oid_fromstr(&locals[0], "9b219343610c88a1187c996d0dc58330b55cee28"));
+	cl_git_pass(git_oid_fromstr(&locals[1], "a953a018c5b10b20c86e69fef55ebc8ad4c5a417"));
+	cl_git_pass(git_oid_fromstr(&upstream, "a953a018c5b10b20c86e69fef55ebc8ad4c5a417"));
+
+	cl_git_pass(git_graph_ahead_behind_many(
+		ahead, behind, _repo2, locals, 2, &upstream));
+
+	cl_assert_equal_sz(ahead[0], 2);
+	cl_assert_equal_sz(behind[0], 8);
+	cl_assert_equal_sz(ahead[1], 0);
+	cl_assert_equal_sz(behind[1], 0);
+}
+
+static void commit_at(
+	git_oid *out, git_repository *repo, git_time_t time,
+	int parent_count, const git_oid *parent_ids)
+{
+	const git_commit *parents[2];
+	git_treebuilder *builder;
+	git_signature *sig;
+	git_tree *tree;
+	git_oid tree_id;
+	int i;
+
+	cl_git_pass(git_treebuilder_create(&builder, NULL));
+	cl_git_pass(git_treebuilder_write(&tree_id, repo, builder));
+	git_treebuilder_free(builder);
+	cl_git_pass(git_tree_lookup(&tree, repo, &tree_id));
+
+	for (i = 0; i < parent_count; i++)
+		cl_git_pass(git_commit_lookup(
+			(git_commit **)&parents[i], repo, &parent_ids[i]));
+
+	cl_git_pass(git_signature_new(&sig, "Skew", "skew@example.com", time, 0));
+	cl_git_pass(git_commit_create(out, repo, NULL, sig, sig, NULL,
+		"skewed\n", tree, parent_count, parents));
+
+	for (i = 0; i < parent_count; i++)
+		git_commit_free((git_commit *)parents[i]);
+	git_signature_free(sig);
+	git_tree_free(tree);
+}
+
+/*
+ *   U (2000)      L (1900)
+ *   |             |  \
+ *   |             S (5)
+ *   |            /    |
+ *   P (1500) ---'     |
+ *   |                 |
+ *   A (1400)          |
+ *   |                 |
+ *   B (1000) ---------'
+ *   |
+ *   R (1)
+ *
+ * S has a skewed date, so without a commit-graph P and A are walked
+ * from U alone before S shows that L reaches them too.
+ */
+void test_revwalk_mergebase__ahead_behind_many_with_skewed_dates(void)
+{
+	git_repository *repo;
+	git_oid r, b, a, p, s, l, u, parents[2];
+	size_t ahead, behind;
+
+	repo = cl_git_sandbox_init("empty_bare.git");
+
+	commit_at(&r, repo, 1, 0, NULL);
+	commit_at(&b, repo, 1000, 1, &r);
+	commit_at(&a, repo, 1400, 1, &b);
+	commit_at(&p, repo, 1500, 1, &a);
+	commit_at(&s, repo, 5, 1, &p);
+	commit_at(&u, repo, 2000, 1, &p);
+
+	git_oid_cpy(&parents[0], &s);
+	git_oid_cpy(&parents[1], &b);
+	commit_at(&l, repo, 1900, 2, parents);
+
+	cl_git_pass(git_graph_ahead_behind_many(&ahead, &behind, repo, &l, 1, &u));
+	cl_assert_equal_sz(1, ahead);
+	cl_assert_equal_sz(2, behind);
+}
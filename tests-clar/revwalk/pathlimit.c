@@ -0,0 +1,99 @@
+#include "clar_libgit2.h"
+#include "posix.h"
+#include "graph_helpers.h"
+
+static git_repository *_repo;
+static git_repository *_nograph;
+
+void test_revwalk_pathlimit__initialize(void)
+{
+	_repo = cl_git_sandbox_init("testrepo.git");
+	revwalk_add_commit_graph("testrepo.git");
+
+	cl_git_pass(git_repository_open(&_nograph, cl_fixture("testrepo.git")));
+}
+
+void test_revwalk_pathlimit__cleanup(void)
+{
+	git_repository_free(_nograph);
+	_nograph = NULL;
+
+	cl_git_sandbox_cleanup();
+}
+
+static int count_path_history(
+	git_repository *repo, unsigned int sorting, const char *path, const char *path2)
+{
+	git_revwalk *walk;
+	git_oid oid;
+	int i = 0;
+
+	cl_git_pass(git_revwalk_new(&walk, repo));
+	git_revwalk_sorting(walk, sorting);
+	cl_git_pass(git_revwalk_push_glob(walk, "heads"));
+	cl_git_pass(git_revwalk_add_path(walk, path));
+	if (path2)
+		cl_git_pass(git_revwalk_add_path(walk, path2));
+
+	while (git_revwalk_next(&oid, walk) == 0)
+		i++;
+
+	git_revwalk_free(walk);
+	return i;
+}
+
+static void assert_path_history(int expected, const char *path, const char *path2)
+{
+	/* git rev-list --full-history --branches -- <path> | wc -l */
+	cl_assert_equal_i(expected, count_path_history(_repo, GIT_SORT_TIME, path, path2));
+	cl_assert_equal_i(expected, count_path_history(_repo, GIT_SORT_TOPOLOGICAL, path, path2));
+	cl_assert_equal_i(expected, count_path_history(_nograph, GIT_SORT_TIME, path, path2));
+	cl_assert_equal_i(expected, count_path_history(_nograph, GIT_SORT_NONE, path, path2));
+}
+
+void test_revwalk_pathlimit__files(void)
+{
+	assert_path_history(4, "README", NULL);
+	assert_path_history(5, "new.txt", NULL);
+	assert_path_history(5, "branch_file.txt", NULL);
+	assert_path_history(0, "does-not-exist", NULL);
+}
+
+void test_revwalk_pathlimit__directories(void)
+{
+	assert_path_history(1, "ab", NULL);
+	assert_path_history(1, "ab/de/", NULL);
+	assert_path_history(0, "ab/xy", NULL);
+}
+
+void test_revwalk_pathlimit__several_paths(void)
+{
+	assert_path_history(7, "README", "new.txt");
+}
+
+void test_revwalk_pathlimit__first_commit_of_a_file(void)
+{
+	git_revwalk *walk;
+	git_oid oid, expected;
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	git_revwalk_sorting(walk, GIT_SORT_TIME | GIT_SORT_REVERSE);
+	cl_git_pass(git_revwalk_push_glob(walk, "heads"));
+	cl_git_pass(git_revwalk_add_path(walk, "README"));
+
+	cl_git_pass(git_revwalk_next(&oid, walk));
+	cl_git_pass(git_oid_fromstr(&expected, "8496071c1b46c854b31185ea97743be6a8774479"));
+	cl_assert(git_oid_cmp(&oid, &expected) == 0);
+
+	git_revwalk_free(walk);
+}
+
+void test_revwalk_pathlimit__empty_path_is_rejected(void)
+{
+	git_revwalk *walk;
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	cl_git_fail(git_revwalk_add_path(walk, ""));
+	cl_git_fail(git_revwalk_add_path(walk, "/"));
+	git_revwalk_free(walk);
+}
@@ -0,0 +1,254 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "index.h"
+#include "posix.h"
+#include "repository.h"
+
+#ifdef GIT_WIN32
+# include <sys/utime.h>
+#else
+# include <utime.h>
+#endif
+
+static git_repository *g_repo;
+static git_index *g_index;
+
+void test_status_fsmonitor__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("status");
+	cl_repo_set_bool(g_repo, "core.untrackedCache", true);
+	cl_repo_set_bool(g_repo, "core.fsmonitor", true);
+
+	cl_git_pass(git_repository_index__weakptr(&g_index, g_repo));
+}
+
+void test_status_fsmonitor__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+/* the monitor is only there where inotify is */
+static bool has_monitor(void)
+{
+	git_fsmonitor *mon;
+
+	if (git_repository__fsmonitor(&mon, g_repo) < 0)
+		giterr_clear();
+
+	return (mon != NULL);
+}
+
+static int backdate_cb(void *payload, git_buf *path)
+{
+	struct utimbuf times;
+	time_t *when = payload;
+
+	if (!git_path_isdir(path->ptr) ||
+		!git__suffixcmp(path->ptr, "/.git"))
+		return 0;
+
+	cl_git_pass(git_path_direach(path, 0, backdate_cb, when));
+
+	times.actime = times.modtime = *when;
+	cl_must_pass(utime(path->ptr, &times));
+
+	return 0;
+}
+
+/* the untracked cache does not trust a directory changed within the second */
+static void backdate_directories(void)
+{
+	static int calls;
+	git_buf path = GIT_BUF_INIT;
+	time_t when = time(NULL) - 60 * ++calls;
+
+	cl_git_pass(git_buf_sets(&path, "status"));
+	cl_git_pass(backdate_cb(&when, &path));
+	git_buf_free(&path);
+}
+
+static int collect_status_cb(const char *path, unsigned int status, void *payload)
+{
+	return git_buf_printf((git_buf *)payload, "%s:%u\n", path, status);
+}
+
+static void status_with_monitor(git_buf *out)
+{
+	git_buf_clear(out);
+	cl_git_pass(git_status_foreach(g_repo, collect_status_cb, out));
+}
+
+static void assert_status_without_monitor_matches(void)
+{
+	git_buf monitored = GIT_BUF_INIT, unmonitored = GIT_BUF_INIT;
+	git_repository *repo;
+
+	status_with_monitor(&monitored);
+	cl_git_pass(git_index_write(g_index));
+
+	/* off, without touching the configuration that `g_repo` reads */
+	cl_git_pass(git_repository_open(&repo, "status"));
+	repo->cvar_cache[GIT_CVAR_FSMONITOR] = GIT_FSMONITOR_DEFAULT;
+	cl_git_pass(git_status_foreach(repo, collect_status_cb, &unmonitored));
+	git_repository_free(repo);
+
+	cl_assert_equal_s(unmonitored.ptr, monitored.ptr);
+
+	git_buf_free(&monitored);
+	git_buf_free(&unmonitored);
+}
+
+static bool is_valid(const char *path)
+{
+	const git_index_entry *entry = git_index_get_bypath(g_index, path, 0);
+
+	cl_assert(entry != NULL);
+	return (entry->flags_extended & GIT_IDXENTRY_FSMONITOR_VALID) != 0;
+}
+
+void test_status_fsmonitor__marks_unchanged_entries(void)
+{
+	git_buf status = GIT_BUF_INIT;
+
+	if (!has_monitor())
+		return;
+
+	status_with_monitor(&status);
+	cl_assert(g_index->fsmonitor_token != NULL);
+
+	cl_assert(is_valid("current_file"));
+	cl_assert(is_valid("subdir/current_file"));
+	cl_assert(!is_valid("modified_file"));
+	cl_assert(!is_valid("file_deleted"));
+	cl_assert(!is_valid("staged_new_file_modified_file"));
+
+	git_buf_free(&status);
+}
+
+void test_status_fsmonitor__trusts_unchanged_entries(void)
+{
+	git_buf status = GIT_BUF_INIT;
+	git_index_entry *entry;
+
+	if (!has_monitor())
+		return;
+
+	backdate_directories();
+	status_with_monitor(&status);
+	cl_assert(strstr(status.ptr, "\nmodified_file:") != NULL);
+
+	/* an entry that the monitor vouches for is not looked at */
+	entry = (git_index_entry *)git_index_get_bypath(g_index, "modified_file", 0);
+	entry->flags_extended |= GIT_IDXENTRY_FSMONITOR_VALID;
+
+	status_with_monitor(&status);
+	cl_assert(strstr(status.ptr, "\nmodified_file:") == NULL);
+
+	/* until it changes */
+	cl_git_append2file("status/modified_file", "more\n");
+
+	status_with_monitor(&status);
+	cl_assert(strstr(status.ptr, "\nmodified_file:") != NULL);
+
+	git_buf_free(&status);
+}
+
+void test_status_fsmonitor__follows_changes(void)
+{
+	git_buf status = GIT_BUF_INIT;
+
+	if (!has_monitor())
+		return;
+
+	backdate_directories();
+	assert_status_without_monitor_matches();
+
+	cl_git_rewritefile("status/current_file", "changed\n");
+	cl_git_rewritefile("status/subdir/current_file", "changed\n");
+	assert_status_without_monitor_matches();
+	cl_assert(!is_valid("current_file"));
+
+	cl_git_rewritefile("status/current_file", "current_file\n");
+	cl_must_pass(p_unlink("status/subdir/current_file"));
+	assert_status_without_monitor_matches();
+
+	/* directories made, renamed and removed under the monitor */
+	cl_git_pass(p_mkdir("status/newdir", 0777));
+	cl_git_mkfile("status/newdir/file", "hello\n");
+	assert_status_without_monitor_matches();
+
+	cl_git_pass(git_index_add_bypath(g_index, "newdir/file"));
+	backdate_directories();
+	assert_status_without_monitor_matches();
+	cl_assert(is_valid("newdir/file"));
+
+	cl_must_pass(p_rename("status/newdir", "status/renamed"));
+	cl_git_pass(p_mkdir("status/newdir", 0777));
+	cl_git_mkfile("status/newdir/file", "other\n");
+	assert_status_without_monitor_matches();
+	cl_assert(!is_valid("newdir/file"));
+
+	cl_git_mkfile("status/renamed/file", "again\n");
+	cl_git_pass(git_futils_rmdir_r("status/subdir", NULL, GIT_RMDIR_REMOVE_FILES));
+	assert_status_without_monitor_matches();
+
+	git_buf_free(&status);
+}
+
+void test_status_fsmonitor__token_is_saved_with_the_index(void)
+{
+	git_buf status = GIT_BUF_INIT;
+	git_repository *repo;
+	git_index *index;
+	char *token;
+
+	if (!has_monitor())
+		return;
+
+	status_with_monitor(&status);
+	cl_git_pass(git_index_write(g_index));
+
+	token = git__strdup(g_index->fsmonitor_token);
+
+	/* the same monitor picks up where it left off */
+	cl_git_pass(git_index_read(g_index));
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert_equal_s(token, index->fsmonitor_token);
+	cl_assert(git_index_get_bypath(index, "current_file", 0)->flags_extended &
+		GIT_IDXENTRY_FSMONITOR_VALID);
+	cl_assert(!(git_index_get_bypath(index, "modified_file", 0)->flags_extended &
+		GIT_IDXENTRY_FSMONITOR_VALID));
+	git_index_free(index);
+
+	/* another one knows nothing about it */
+	cl_git_pass(git_repository_open(&repo, "status"));
+	cl_git_pass(git_repository_index__weakptr(&index, repo));
+	cl_assert_equal_s(token, index->fsmonitor_token);
+
+	cl_git_pass(git_status_foreach(repo, collect_status_cb, &status));
+	cl_assert(strcmp(token, index->fsmonitor_token) != 0);
+
+	git_repository_free(repo);
+	git__free(token);
+	git_buf_free(&status);
+}
+
+void test_status_fsmonitor__can_be_turned_off(void)
+{
+	git_buf status = GIT_BUF_INIT;
+
+	if (!has_monitor())
+		return;
+
+	status_with_monitor(&status);
+	cl_assert(g_index->fsmonitor_token != NULL);
+	cl_assert(is_valid("current_file"));
+
+	cl_repo_set_bool(g_repo, "core.fsmonitor", false);
+
+	status_with_monitor(&status);
+	cl_assert(g_index->fsmonitor_token == NULL);
+	cl_assert(!is_valid("current_file"));
+
+	git_buf_free(&status);
+}
@@ -0,0 +1,235 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "index.h"
+#include "posix.h"
+#include "repository.h"
+#include "status_helpers.h"
+
+#ifdef GIT_WIN32
+# include <sys/utime.h>
+#else
+# include <utime.h>
+#endif
+
+static git_repository *g_repo;
+static git_index *g_index;
+
+void test_status_untracked_cache__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("status");
+	cl_repo_set_bool(g_repo, "core.untrackedCache", true);
+
+	cl_git_pass(git_repository_index__weakptr(&g_index, g_repo));
+	cl_assert(g_index->keep_untracked);
+}
+
+void test_status_untracked_cache__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static int backdate_cb(void *payload, git_buf *path)
+{
+	struct utimbuf times;
+	time_t *when = payload;
+
+	if (!git_path_isdir(path->ptr) ||
+		!git__suffixcmp(path->ptr, "/.git"))
+		return 0;
+
+	cl_git_pass(git_path_direach(path, 0, backdate_cb, when));
+
+	times.actime = times.modtime = *when;
+	cl_must_pass(utime(path->ptr, &times));
+
+	return 0;
+}
+
+/*
+ * The cache does not trust a directory changed within the second; and
+ * each call goes further back, so that the directories changed since
+ * the last one do not end up with the same stat data.
+ */
+static void backdate_directories(void)
+{
+	static int calls;
+	git_buf path = GIT_BUF_INIT;
+	time_t when = time(NULL) - 60 * ++calls;
+
+	cl_git_pass(git_buf_sets(&path, "status"));
+	cl_git_pass(backdate_cb(&when, &path));
+	git_buf_free(&path);
+}
+
+static int collect_status_cb(const char *path, unsigned int status, void *payload)
+{
+	return git_buf_printf((git_buf *)payload, "%s:%u\n", path, status);
+}
+
+static void assert_status_without_cache_matches(void)
+{
+	git_buf cached = GIT_BUF_INIT, uncached = GIT_BUF_INIT;
+
+	cl_git_pass(git_status_foreach(g_repo, collect_status_cb, &cached));
+
+	g_index->keep_untracked = 0;
+	cl_git_pass(git_status_foreach(g_repo, collect_status_cb, &uncached));
+	g_index->keep_untracked = 1;
+
+	cl_assert_equal_s(uncached.ptr, cached.ptr);
+
+	git_buf_free(&cached);
+	git_buf_free(&uncached);
+}
+
+static git_untracked_dir *find_dir(const char *name)
+{
+	git_untracked_dir *dir;
+	size_t i;
+
+	cl_assert(g_index->untracked && g_index->untracked->root);
+
+	if (!*name)
+		return g_index->untracked->root;
+
+	git_vector_foreach(&g_index->untracked->root->dirs, i, dir) {
+		if (!strcmp(dir->name, name))
+			return dir;
+	}
+
+	return NULL;
+}
+
+static bool has_untracked(git_untracked_dir *dir, const char *name)
+{
+	return git_vector_bsearch(NULL, &dir->untracked, name) == 0;
+}
+
+void test_status_untracked_cache__is_filled_in_by_status(void)
+{
+	git_untracked_dir *root, *subdir;
+
+	backdate_directories();
+	assert_status_without_cache_matches();
+
+	cl_assert((root = find_dir("")) != NULL);
+	cl_assert(root->valid);
+	cl_assert(has_untracked(root, "new_file"));
+	cl_assert(has_untracked(root, "ignored_file"));
+	cl_assert(!has_untracked(root, "current_file"));
+	cl_assert(!has_untracked(root, "subdir/"));
+
+	cl_assert((subdir = find_dir("subdir")) != NULL);
+	cl_assert(subdir->valid);
+	cl_assert(has_untracked(subdir, "new_file"));
+	cl_assert(!has_untracked(subdir, "current_file"));
+}
+
+void test_status_untracked_cache__reuses_unchanged_directories(void)
+{
+	git_buf status = GIT_BUF_INIT;
+	git_untracked_dir *subdir;
+	size_t pos;
+
+	backdate_directories();
+	assert_status_without_cache_matches();
+
+	/* the next status only knows of what the cache says */
+	cl_assert((subdir = find_dir("subdir")) != NULL);
+	cl_git_pass(git_vector_bsearch(&pos, &subdir->untracked, "new_file"));
+	git__free(git_vector_get(&subdir->untracked, pos));
+	cl_git_pass(git_vector_remove(&subdir->untracked, pos));
+
+	cl_git_pass(git_status_foreach(g_repo, collect_status_cb, &status));
+	cl_assert(strstr(status.ptr, "\nnew_file:") != NULL);
+	cl_assert(strstr(status.ptr, "subdir/modified_file:") != NULL);
+	cl_assert(strstr(status.ptr, "subdir/new_file:") == NULL);
+	git_buf_free(&status);
+
+	/* until the directory changes */
+	cl_git_mkfile("status/subdir/another_new_file", "hello\n");
+	backdate_directories();
+	assert_status_without_cache_matches();
+
+	cl_assert(has_untracked(subdir, "new_file"));
+	cl_assert(has_untracked(subdir, "another_new_file"));
+}
+
+void test_status_untracked_cache__follows_changes(void)
+{
+	backdate_directories();
+	assert_status_without_cache_matches();
+
+	/* new directories, new and removed files */
+	cl_git_pass(p_mkdir("status/newdir", 0777));
+	cl_git_mkfile("status/newdir/file", "hello\n");
+	cl_git_mkfile("status/subdir/ignored_too", "ignored\n");
+	cl_must_pass(p_unlink("status/subdir/new_file"));
+	cl_must_pass(p_unlink("status/new_file"));
+	assert_status_without_cache_matches();
+
+	backdate_directories();
+	assert_status_without_cache_matches();
+
+	/* files which leave the index are seen again, although their
+	 * directory did not change */
+	cl_git_pass(git_index_remove_bypath(g_index, "subdir/current_file"));
+	cl_git_pass(git_index_remove_bypath(g_index, "current_file"));
+	assert_status_without_cache_matches();
+
+	cl_git_pass(git_index_add_bypath(g_index, "subdir/current_file"));
+	cl_git_pass(git_index_add_bypath(g_index, "newdir/file"));
+	assert_status_without_cache_matches();
+
+	cl_git_pass(git_index_remove_directory(g_index, "subdir", 0));
+	assert_status_without_cache_matches();
+}
+
+void test_status_untracked_cache__is_saved_with_the_index(void)
+{
+	git_repository *repo;
+	git_index *index;
+	git_untracked_dir *subdir;
+
+	backdate_directories();
+	assert_status_without_cache_matches();
+	cl_git_pass(git_index_write(g_index));
+
+	cl_git_pass(git_repository_open(&repo, "status"));
+	cl_git_pass(git_repository_index__weakptr(&index, repo));
+	cl_assert(index->untracked != NULL);
+
+	/* look at what was read, and use it */
+	g_repo = repo;
+	g_index = index;
+
+	cl_assert((subdir = find_dir("subdir")) != NULL);
+	cl_assert(subdir->valid);
+	cl_assert(has_untracked(subdir, "new_file"));
+
+	assert_status_without_cache_matches();
+
+	git_repository_free(repo);
+}
+
+void test_status_untracked_cache__can_be_turned_off(void)
+{
+	git_index *index;
+
+	backdate_directories();
+	assert_status_without_cache_matches();
+	cl_git_pass(git_index_write(g_index));
+
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert(index->untracked != NULL);
+	cl_assert(index->keep_untracked);
+
+	cl_git_pass(git_index_set_untracked_cache(index, 0));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert(index->untracked == NULL);
+	cl_assert(!index->keep_untracked);
+	git_index_free(index);
+}
@@ -0,0 +1,247 @@
+#include "clar_libgit2.h"
+#include "buffer.h"
+#include "revwalk.h"
+
+static git_repository *g_repo = NULL;
+
+void test_stress_revwalk__initialize(void)
+{
+}
+
+void test_stress_revwalk__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+	cl_fixture_cleanup("deep.git");
+}
+
+static void synthetic_oid(git_oid *oid, uint32_t n)
+{
+	uint32_t h = n * 2654435761u;
+
+	memset(oid, 0, sizeof(*oid));
+	memcpy(oid->id, &h, sizeof(h));
+	memcpy(oid->id + sizeof(h), &n, sizeof(n));
+}
+
+#define TABLE_COMMITS (1 << 22)
+
+/*
+ * A deep history with a merge every eight commits, built straight in a
+ * commit table: measure how much memory a node costs, and how fast
+ * nodes are found by id and their parents followed.
+ */
+void test_stress_revwalk__commit_table(void)
+{
+	git_commit_table table;
+	git_commit_list_node *commit, *parent;
+	git_oid oid;
+	uint32_t i, found = 0;
+	double start, build_time, walk_time;
+
+	cl_git_pass(git_commit_table_init(&table));
+
+	start = git__timer();
+
+	for (i = 0; i < TABLE_COMMITS; ++i) {
+		synthetic_oid(&oid, i);
+		cl_assert((commit = git_commit_table_lookup(&table, &oid)) != NULL);
+
+		if (i + 1 < TABLE_COMMITS) {
+			synthetic_oid(&oid, i + 1);
+			cl_assert((parent = git_commit_table_lookup(&table, &oid)) != NULL);
+			cl_git_pass(git_commit_table_add_parent(&table, commit, parent));
+		}
+
+		if (i % 8 == 0 && i + 8 < TABLE_COMMITS) {
+			synthetic_oid(&oid, i + 8);
+			cl_assert((parent = git_commit_table_lookup(&table, &oid)) != NULL);
+			cl_git_pass(git_commit_table_add_parent(&table, commit, parent));
+		}
+	}
+
+	build_time = git__timer() - start;
+	start = git__timer();
+
+	synthetic_oid(&oid, 0);
+	commit = git_commit_table_lookup(&table, &oid);
+
+	while (commit->out_degree > 0) {
+		commit = git_commit_table_parent(&table, commit, 0);
+		found++;
+	}
+
+	walk_time = git__timer() - start;
+
+	cl_assert_equal_i(TABLE_COMMITS, table.length);
+	cl_assert_equal_i(TABLE_COMMITS - 1, found);
+
+	synthetic_oid(&oid, TABLE_COMMITS - 1);
+	cl_assert(git_oid_equal(&oid, git_commit_table_oid(&table, commit)));
+
+	printf("\n%u commits: %.1f bytes per commit, "
+		"%.0f lookups/s, %.0f parents followed/s\n",
+		TABLE_COMMITS,
+		(double)git_commit_table_memsize(&table) / TABLE_COMMITS,
+		(3.0 * TABLE_COMMITS) / build_time,
+		TABLE_COMMITS / walk_time);
+
+	git_commit_table_free(&table);
+}
+
+#define HISTORY_COMMITS 20000
+
+static void write_commit(
+	git_oid *out, git_odb *odb, const git_oid *tree,
+	const git_oid *parents, size_t parent_count, int n)
+{
+	git_buf buf = GIT_BUF_INIT;
+	char hex[GIT_OID_HEXSZ + 1];
+	size_t i;
+
+	git_buf_printf(&buf, "tree %s\n", git_oid_tostr(hex, sizeof(hex), tree));
+	for (i = 0; i < parent_count; ++i)
+		git_buf_printf(&buf, "parent %s\n",
+			git_oid_tostr(hex, sizeof(hex), &parents[i]));
+	git_buf_printf(&buf,
+		"author A U Thor <author@example.com> %d +0000\n"
+		"committer A U Thor <author@example.com> %d +0000\n"
+		"\ncommit %d\n", 1000000000 + n, 1000000000 + n, n);
+	cl_assert(!git_buf_oom(&buf));
+
+	cl_git_pass(git_odb_write(out, odb, buf.ptr, buf.size, GIT_OBJ_COMMIT));
+	git_buf_free(&buf);
+}
+
+static size_t walk_history(
+	const git_oid *head, unsigned int sorting, unsigned int threads)
+{
+	git_repository *repo;
+	git_revwalk *walk;
+	git_oid oid;
+	size_t count = 0;
+	double start;
+
+	/* a repository of its own, so that no commit is in its cache yet */
+	cl_git_pass(git_repository_open(&repo, "deep.git"));
+
+	start = git__timer();
+	cl_git_pass(git_revwalk_new(&walk, repo));
+	git_revwalk_sorting(walk, sorting);
+	threads = git_revwalk_set_prefetch_threads(walk, threads);
+	cl_git_pass(git_revwalk_push(walk, head));
+
+	while (git_revwalk_next(&oid, walk) == 0)
+		count++;
+
+	printf("sorting %u, %u prefetch threads: %.0f commits/s, "
+		"table of %.1f bytes per commit\n",
+		sorting, threads, count / (git__timer() - start),
+		(double)git_commit_table_memsize(&walk->commits) / count);
+
+	git_revwalk_free(walk);
+	git_repository_free(repo);
+	return count;
+}
+
+#define HISTORY_LINES 8
+
+/*
+ * A deep and wide history in a real repository: lines of history that
+ * grow from one root in turns, and are merged at the top.  It is walked
+ * in every order, and with prefetching.
+ */
+void test_stress_revwalk__deep_history(void)
+{
+	git_odb *odb;
+	git_oid tree, root, head, tips[HISTORY_LINES];
+	int i;
+
+	cl_git_pass(git_repository_init(&g_repo, "deep.git", 1));
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	cl_git_pass(git_odb_write(&tree, odb, "", 0, GIT_OBJ_TREE));
+
+	write_commit(&root, odb, &tree, NULL, 0, 0);
+	for (i = 0; i < HISTORY_LINES; ++i)
+		git_oid_cpy(&tips[i], &root);
+
+	for (i = 1; i < HISTORY_COMMITS - 1; ++i)
+		write_commit(&tips[i % HISTORY_LINES], odb, &tree,
+			&tips[i % HISTORY_LINES], 1, i);
+
+	write_commit(&head, odb, &tree, tips, HISTORY_LINES, i);
+
+	git_odb_free(odb);
+
+	cl_assert_equal_sz(HISTORY_COMMITS, walk_history(&head, GIT_SORT_NONE, 0));
+	cl_assert_equal_sz(HISTORY_COMMITS, walk_history(&head, GIT_SORT_TIME, 0));
+	cl_assert_equal_sz(HISTORY_COMMITS,
+		walk_history(&head, GIT_SORT_TOPOLOGICAL, 0));
+	cl_assert_equal_sz(HISTORY_COMMITS, walk_history(&head, GIT_SORT_TIME, 4));
+}
+
+#define HIDDEN_TIPS 10000
+
+static size_t walk_hiding(
+	const git_oid *head, const git_oid *tips, size_t count, int at_once)
+{
+	git_repository *repo;
+	git_revwalk *walk;
+	git_oid oid;
+	size_t i, walked = 0;
+	double start;
+
+	cl_git_pass(git_repository_open(&repo, "deep.git"));
+
+	start = git__timer();
+	cl_git_pass(git_revwalk_new(&walk, repo));
+	git_revwalk_sorting(walk, GIT_SORT_TIME);
+	cl_git_pass(git_revwalk_push(walk, head));
+
+	if (at_once)
+		cl_git_pass(git_revwalk_hide_many(walk, tips, count));
+	else
+		for (i = 0; i < count; ++i)
+			cl_git_pass(git_revwalk_hide(walk, &tips[i]));
+
+	while (git_revwalk_next(&oid, walk) == 0)
+		walked++;
+
+	printf("%u tips hidden %s: %.3fs\n", (unsigned int)count,
+		at_once ? "at once" : "one by one", git__timer() - start);
+
+	git_revwalk_free(walk);
+	git_repository_free(repo);
+	return walked;
+}
+
+/*
+ * A history where every commit but the newest one is hidden, the way
+ * every tag of a repository is when negotiating a fetch.
+ */
+void test_stress_revwalk__hide_many(void)
+{
+	git_odb *odb;
+	git_oid tree, head, *tips;
+	int i;
+
+	tips = git__calloc(HIDDEN_TIPS, sizeof(git_oid));
+	cl_assert(tips != NULL);
+
+	cl_git_pass(git_repository_init(&g_repo, "deep.git", 1));
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	cl_git_pass(git_odb_write(&tree, odb, "", 0, GIT_OBJ_TREE));
+
+	write_commit(&tips[0], odb, &tree, NULL, 0, 0);
+	for (i = 1; i < HIDDEN_TIPS; ++i)
+		write_commit(&tips[i], odb, &tree, &tips[i - 1], 1, i);
+
+	write_commit(&head, odb, &tree, &tips[HIDDEN_TIPS - 1], 1, i);
+
+	git_odb_free(odb);
+
+	cl_assert_equal_sz(1, walk_hiding(&head, tips, HIDDEN_TIPS, 0));
+	cl_assert_equal_sz(1, walk_hiding(&head, tips, HIDDEN_TIPS, 1));
+
+	git__free(tips);
+}